@@ -0,0 +1,315 @@
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp32s3/rom/miniz.h"
+#include "logger.hpp"
+#include "asset_pack.hpp"
+
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_TYPE_FONT 1
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+#define ASSET_PACK_MMAP_DATA ESP_PARTITION_MMAP_DATA
+typedef esp_partition_mmap_handle_t asset_pack_mmap_t;
+#else
+#define ASSET_PACK_MMAP_DATA SPI_FLASH_MMAP_DATA
+typedef spi_flash_mmap_handle_t asset_pack_mmap_t;
+#endif
+
+// Layouts written by tools/build_assets.py, little endian
+typedef struct __attribute__((packed)) {
+  char magic[4];
+  uint16_t version;
+  uint16_t count;
+  uint32_t size;                // Whole pack
+  uint32_t crc;                 // Of everything after the header
+} pack_header_t;
+
+typedef struct __attribute__((packed)) {
+  char name[20];
+  uint8_t type;
+  uint8_t pad[3];
+  uint32_t offset;
+  uint32_t size;
+} pack_entry_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t line_height;
+  int16_t base_line;
+  int8_t underline_position;
+  int8_t underline_thickness;
+  uint8_t bpp;
+  uint8_t pad;
+  uint16_t glyph_count;
+  uint16_t max_bitmap;          // Largest inflated bitmap
+} pack_font_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t unicode;
+  uint16_t adv_w;               // 1/16 px
+  uint8_t box_w;
+  uint8_t box_h;
+  int8_t ofs_x;
+  int8_t ofs_y;
+  uint16_t zsize;               // Stored as is when equal to the bitmap size
+  uint32_t offset;              // From the start of the font
+} pack_glyph_t;
+
+typedef struct {
+  lv_font_t font;
+  const uint8_t* data;
+  const pack_font_t* head;
+  const pack_glyph_t* glyphs;   // Sorted by unicode
+} asset_font_t;
+
+typedef struct {
+  const pack_glyph_t* glyph;
+  uint32_t used;
+  uint8_t* bitmap;
+} cache_slot_t;
+
+static const uint8_t* pack = NULL;
+static const pack_entry_t* entries = NULL;
+static uint16_t entry_count = 0;
+static asset_font_t fonts[ASSET_PACK_FONTS];
+static int font_count = 0;
+
+static cache_slot_t cache[ASSET_PACK_CACHE_SLOTS];
+static uint32_t cache_tick = 0;
+static tinfl_decompressor* inflator = NULL;
+static asset_pack_stats_t stats;
+
+static uint32_t glyph_bytes(const pack_font_t* head, const pack_glyph_t* g) {
+  return ((uint32_t)g->box_w * g->box_h * head->bpp + 7) / 8;
+}
+
+static const pack_glyph_t* find_glyph(const asset_font_t* f, uint32_t letter) {
+  int lo = 0;
+  int hi = f->head->glyph_count - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    uint32_t u = f->glyphs[mid].unicode;
+    if (u == letter) {
+      return &f->glyphs[mid];
+    }
+    if (u < letter) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return NULL;
+}
+
+static bool inflate_glyph(const asset_font_t* f, const pack_glyph_t* g, uint8_t* out) {
+  size_t raw = glyph_bytes(f->head, g);
+  const uint8_t* src = f->data + g->offset;
+  if (g->zsize == raw) {
+    memcpy(out, src, raw);
+    return true;
+  }
+  size_t in = g->zsize;
+  size_t len = raw;
+  tinfl_init(inflator);
+  tinfl_status st = tinfl_decompress(inflator, src, &in, out, out, &len, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+  return st == TINFL_STATUS_DONE && len == raw;
+}
+
+static bool font_glyph_dsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next) {
+  (void)letter_next;
+  const asset_font_t* f = (const asset_font_t*)font->dsc;
+  const pack_glyph_t* g = find_glyph(f, letter);
+  if (!g) {
+    return false;
+  }
+  dsc->adv_w = (g->adv_w + 8) >> 4;
+  dsc->box_w = g->box_w;
+  dsc->box_h = g->box_h;
+  dsc->ofs_x = g->ofs_x;
+  dsc->ofs_y = g->ofs_y;
+  dsc->bpp = f->head->bpp;
+#if LV_VERSION_CHECK(8, 3, 0)
+  dsc->is_placeholder = 0;
+#endif
+  return true;
+}
+
+// Valid until ASSET_PACK_CACHE_SLOTS other glyphs have been drawn, LVGL uses it right away
+static const uint8_t* font_glyph_bitmap(const lv_font_t* font, uint32_t letter) {
+  const asset_font_t* f = (const asset_font_t*)font->dsc;
+  const pack_glyph_t* g = find_glyph(f, letter);
+  if (!g) {
+    return NULL;
+  }
+  cache_slot_t* lru = &cache[0];
+  for (auto& s : cache) {
+    if (s.glyph == g) {
+      s.used = ++cache_tick;
+      stats.hits++;
+      return s.bitmap;
+    }
+    if (s.used < lru->used) {
+      lru = &s;
+    }
+  }
+
+  uint32_t start = (uint32_t)esp_timer_get_time();
+  lru->glyph = NULL;
+  if (!inflate_glyph(f, g, lru->bitmap)) {
+    return NULL;
+  }
+  uint32_t us = (uint32_t)esp_timer_get_time() - start;
+  lru->glyph = g;
+  lru->used = ++cache_tick;
+  stats.misses++;
+  stats.inflate_us_total += us;
+  if (us > stats.inflate_us_max) {
+    stats.inflate_us_max = us;
+  }
+  return lru->bitmap;
+}
+
+// Every table and glyph inside the pack, so lookups need no checks later
+static bool check_font(const pack_entry_t* e, uint16_t* max_bitmap) {
+  if (e->size < sizeof(pack_font_t)) {
+    return false;
+  }
+  const pack_font_t* head = (const pack_font_t*)(pack + e->offset);
+  if (e->size < sizeof(pack_font_t) + head->glyph_count * sizeof(pack_glyph_t)) {
+    return false;
+  }
+  const pack_glyph_t* glyphs = (const pack_glyph_t*)(head + 1);
+  for (int i = 0; i < head->glyph_count; i++) {
+    const pack_glyph_t* g = &glyphs[i];
+    if (g->offset + g->zsize > e->size || glyph_bytes(head, g) > head->max_bitmap ||
+        (i && g->unicode <= glyphs[i - 1].unicode)) {
+      return false;
+    }
+  }
+  if (head->max_bitmap > *max_bitmap) {
+    *max_bitmap = head->max_bitmap;
+  }
+  return true;
+}
+
+static const char* map_pack(void) {
+  const esp_partition_t* part =
+    esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ASSET_PACK_PARTITION);
+  if (!part) {
+    return "no partition";
+  }
+  pack_header_t head;
+  if (esp_partition_read(part, 0, &head, sizeof(head)) != ESP_OK || memcmp(head.magic, "TAPK", 4) ||
+      head.version != ASSET_PACK_VERSION || head.size < sizeof(head) || head.size > part->size) {
+    return "not flashed";
+  }
+
+  const void* ptr;
+  asset_pack_mmap_t handle;
+  if (esp_partition_mmap(part, 0, head.size, ASSET_PACK_MMAP_DATA, &ptr, &handle) != ESP_OK) {
+    return "mmap failed";
+  }
+  const uint8_t* p = (const uint8_t*)ptr;
+  bool ok = esp_rom_crc32_le(0, p + sizeof(head), head.size - sizeof(head)) == head.crc &&
+            sizeof(head) + head.count * sizeof(pack_entry_t) <= head.size;
+  if (ok) {
+    pack = p;
+    entries = (const pack_entry_t*)(p + sizeof(head));
+    entry_count = head.count;
+  }
+
+  uint16_t max_bitmap = 0;
+  for (int i = 0; ok && i < entry_count; i++) {
+    const pack_entry_t* e = &entries[i];
+    ok = e->offset + e->size <= head.size && (e->type != ASSET_PACK_TYPE_FONT || check_font(e, &max_bitmap));
+  }
+  if (ok) {
+    inflator = (tinfl_decompressor*)heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t* bitmaps =
+      (uint8_t*)heap_caps_malloc(ASSET_PACK_CACHE_SLOTS * max_bitmap, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ok = inflator && bitmaps;
+    for (int i = 0; ok && i < ASSET_PACK_CACHE_SLOTS; i++) {
+      cache[i].bitmap = bitmaps + i * max_bitmap;
+    }
+    if (!ok) {
+      heap_caps_free(inflator);
+      heap_caps_free(bitmaps);
+      inflator = NULL;
+    }
+  }
+  if (!ok) {
+    pack = NULL;
+    entry_count = 0;
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap(handle);
+#else
+    spi_flash_munmap(handle);
+#endif
+    return "corrupt";
+  }
+  return NULL;
+}
+
+bool asset_pack_begin(void) {
+  uint32_t start = (uint32_t)esp_timer_get_time();
+  const char* err = map_pack();
+  if (err) {
+    LOG_W(ASSET_PACK_MISSING, err);
+    return false;
+  }
+  int n = 0;
+  for (int i = 0; i < entry_count; i++) {
+    n += entries[i].type == ASSET_PACK_TYPE_FONT;
+  }
+  LOG_I(ASSET_PACK, n, asset_pack_size(), (uint32_t)esp_timer_get_time() - start);
+  return true;
+}
+
+const lv_font_t* asset_pack_font(const char* name, const lv_font_t* fallback) {
+  const pack_entry_t* e = NULL;
+  for (int i = 0; i < entry_count; i++) {
+    if (entries[i].type == ASSET_PACK_TYPE_FONT && !strncmp(entries[i].name, name, sizeof(entries[i].name))) {
+      e = &entries[i];
+    }
+  }
+  if (!e || font_count == ASSET_PACK_FONTS) {
+    return fallback;
+  }
+  for (int i = 0; i < font_count; i++) {
+    if (fonts[i].data == pack + e->offset) {
+      return &fonts[i].font;
+    }
+  }
+
+  asset_font_t* f = &fonts[font_count++];
+  f->data = pack + e->offset;
+  f->head = (const pack_font_t*)f->data;
+  f->glyphs = (const pack_glyph_t*)(f->head + 1);
+  memset(&f->font, 0, sizeof(f->font));
+  f->font.get_glyph_dsc = font_glyph_dsc;
+  f->font.get_glyph_bitmap = font_glyph_bitmap;
+  f->font.line_height = f->head->line_height;
+  f->font.base_line = f->head->base_line;
+  f->font.subpx = LV_FONT_SUBPX_NONE;
+  f->font.underline_position = f->head->underline_position;
+  f->font.underline_thickness = f->head->underline_thickness;
+  f->font.dsc = f;
+#if LV_VERSION_CHECK(8, 2, 0)
+  f->font.fallback = fallback;
+#endif
+  return &f->font;
+}
+
+uint32_t asset_pack_size(void) {
+  return pack ? ((const pack_header_t*)pack)->size : 0;
+}
+
+void asset_pack_get_stats(asset_pack_stats_t* out, bool reset) {
+  *out = stats;
+  if (reset) {
+    memset(&stats, 0, sizeof(stats));
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "stdint.h"
+#include <lvgl.h>
+
+// Fonts from the asset pack in the "assets" flash partition.
+//
+// tools/build_assets.py cuts every UI font down to the glyphs the UI draws
+// with it, deflates each glyph bitmap and writes the pack at build time. The
+// pack is memory mapped, never copied: an lv_font_t built here looks glyphs up
+// in the mapped table and inflates a bitmap only when LVGL draws it, into a
+// small LRU cache of ASSET_PACK_CACHE_SLOTS glyphs. Kerning is not kept.
+//
+// A glyph missing from the pack is drawn from the fallback font, so a pack
+// left behind by an OTA update of the app alone still shows every character.
+
+#define ASSET_PACK_PARTITION "assets"
+#define ASSET_PACK_FONTS 4          // Fonts handed out at most
+#define ASSET_PACK_CACHE_SLOTS 8    // Inflated glyph bitmaps kept
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;          // Inflated
+  uint32_t inflate_us_total;
+  uint32_t inflate_us_max;
+} asset_pack_stats_t;
+
+// Maps and checks the pack. False without a valid one, asset_pack_font() then returns the fallback.
+bool asset_pack_begin(void);
+
+// The named font from the pack, or fallback
+const lv_font_t* asset_pack_font(const char* name, const lv_font_t* fallback);
+
+// Bytes of the mapped pack, 0 if none
+uint32_t asset_pack_size(void);
+
+void asset_pack_get_stats(asset_pack_stats_t* stats, bool reset);
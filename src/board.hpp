@@ -0,0 +1,131 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// Board description: pins, panel timing, resolution and draw buffer strategy.
+//
+// main.cpp builds the panel bus, the RGB panel, the display, the LVGL draw
+// buffers and driver structs from board_t as static objects, so none of them
+// comes from the heap at boot and the drivers are called through their own
+// types. Another board variant is another struct with the same members,
+// picked with -D BOARD=<struct> in platformio.ini. The static_asserts at the
+// end check the selected board where it is compiled: a pin used twice, the
+// SWSPI pins the ST7701 shares with the RGB bus, and the internal RAM taken by
+// the draw and bounce buffers against the board's budget.
+//
+// Written for C++11 (Arduino core 2), members are scalars so none of them
+// needs a definition outside the struct. Include after Arduino_GFX_Library.h,
+// it has the panel init tables.
+
+typedef enum {
+  DRAW_BUF_INTERNAL,  // Static, in internal RAM
+  DRAW_BUF_PSRAM      // From the PSRAM heap at boot, static .bss in PSRAM needs an sdkconfig option the core does not set
+} draw_buf_place_t;
+
+// ZX2D10GE01R-V4848: ESP32-S3, 480x480 round ST7701 panel on a 16 bit RGB bus, knob encoder
+struct board_zx2d10ge01r_v4848 {
+  static constexpr int16_t width = 480;
+  static constexpr int16_t height = 480;
+
+  static constexpr int8_t backlight = 38;
+  static constexpr int8_t button = 3;
+  static constexpr int8_t motor = 7;
+  static constexpr int8_t led = 4;
+  static constexpr int8_t encoder_sig = 5;
+  static constexpr int8_t encoder_dir = 6;
+
+  // ST7701 3 wire SPI, clock and data double as RGB data lines (0 is B0)
+  static constexpr int8_t spi_cs = 21;
+  static constexpr int8_t spi_sck = 47;
+  static constexpr int8_t spi_mosi = 41;
+  static constexpr int8_t spi_sck_data_bit = 0;
+  static constexpr int8_t spi_mosi_data_bit = 1;
+  static constexpr const uint8_t* panel_init = st7701_type7_init_operations;
+  static constexpr size_t panel_init_size = sizeof(st7701_type7_init_operations);
+
+  // RGB565 bus
+  static constexpr int8_t de = 39, vsync = 48, hsync = 40, pclk = 45;
+  static constexpr int8_t r0 = 10, r1 = 16, r2 = 9, r3 = 15, r4 = 46;
+  static constexpr int8_t g0 = 8, g1 = 13, g2 = 18, g3 = 12, g4 = 11, g5 = 17;
+  static constexpr int8_t b0 = 47, b1 = 41, b2 = 0, b3 = 42, b4 = 14;
+  static constexpr uint16_t hsync_polarity = 1, hsync_front_porch = 10, hsync_pulse_width = 10, hsync_back_porch = 10;
+  static constexpr uint16_t vsync_polarity = 1, vsync_front_porch = 14, vsync_pulse_width = 2, vsync_back_porch = 12;
+
+  // Scan out through two internal RAM buffers of this many lines, 0 streams straight from the
+  // PSRAM framebuffer. Needs Arduino core 3, must divide the height.
+  static constexpr int16_t bounce_buffer_lines = 0;
+
+  // LVGL render stripes, a second one lets LVGL render while the previous stripe flushes
+  static constexpr int16_t draw_buf_lines = 32;
+  static constexpr int8_t draw_buf_count = 2;
+  static constexpr draw_buf_place_t draw_buf_place = DRAW_BUF_INTERNAL;
+
+  static constexpr size_t internal_ram_budget = 96 * 1024;  // For draw and bounce buffers
+};
+
+#ifndef BOARD
+#define BOARD board_zx2d10ge01r_v4848
+#endif
+typedef BOARD board_t;
+
+// Pixels per draw buffer and internal RAM taken by the display buffers
+static constexpr size_t board_draw_buf_px = (size_t)board_t::width * board_t::draw_buf_lines;
+static constexpr size_t board_internal_ram =
+  (board_t::draw_buf_place == DRAW_BUF_INTERNAL ? board_t::draw_buf_count * board_draw_buf_px * 2 : 0) +
+  2 * (size_t)board_t::width * board_t::bounce_buffer_lines * 2;
+
+constexpr bool board_pin_in(int8_t) {
+  return false;
+}
+
+template <typename... T>
+constexpr bool board_pin_in(int8_t pin, int8_t first, T... rest) {
+  return pin == first || board_pin_in(pin, rest...);
+}
+
+constexpr bool board_pins_unique() {
+  return true;
+}
+
+template <typename... T>
+constexpr bool board_pins_unique(int8_t first, T... rest) {
+  return (first < 0 || !board_pin_in(first, rest...)) && board_pins_unique(rest...);
+}
+
+// GPIO of an RGB565 data line: B0-B4, G0-G5, R0-R4
+template <typename B>
+constexpr int8_t board_data_pin(int bit) {
+  return bit == 0 ? B::b0 : bit == 1 ? B::b1 : bit == 2 ? B::b2 : bit == 3 ? B::b3 : bit == 4 ? B::b4
+       : bit == 5 ? B::g0 : bit == 6 ? B::g1 : bit == 7 ? B::g2 : bit == 8 ? B::g3 : bit == 9 ? B::g4
+       : bit == 10 ? B::g5 : bit == 11 ? B::r0 : bit == 12 ? B::r1 : bit == 13 ? B::r2 : bit == 14 ? B::r3
+       : bit == 15 ? B::r4 : -1;
+}
+
+// The SWSPI pins are the only ones allowed twice, and only as the data lines named for them
+static_assert(board_pins_unique(board_t::backlight, board_t::button, board_t::motor, board_t::led,
+                                board_t::encoder_sig, board_t::encoder_dir, board_t::spi_cs, board_t::de,
+                                board_t::vsync, board_t::hsync, board_t::pclk, board_t::r0, board_t::r1,
+                                board_t::r2, board_t::r3, board_t::r4, board_t::g0, board_t::g1, board_t::g2,
+                                board_t::g3, board_t::g4, board_t::g5, board_t::b0, board_t::b1, board_t::b2,
+                                board_t::b3, board_t::b4),
+              "board: a pin is used twice");
+static_assert(board_t::spi_sck_data_bit < 0
+                ? !board_pin_in(board_t::spi_sck, board_t::b0, board_t::b1, board_t::b2, board_t::b3, board_t::b4,
+                                board_t::g0, board_t::g1, board_t::g2, board_t::g3, board_t::g4, board_t::g5,
+                                board_t::r0, board_t::r1, board_t::r2, board_t::r3, board_t::r4)
+                : board_data_pin<board_t>(board_t::spi_sck_data_bit) == board_t::spi_sck,
+              "board: SWSPI clock is not the RGB data line named for it");
+static_assert(board_t::spi_mosi_data_bit < 0
+                ? !board_pin_in(board_t::spi_mosi, board_t::b0, board_t::b1, board_t::b2, board_t::b3, board_t::b4,
+                                board_t::g0, board_t::g1, board_t::g2, board_t::g3, board_t::g4, board_t::g5,
+                                board_t::r0, board_t::r1, board_t::r2, board_t::r3, board_t::r4)
+                : board_data_pin<board_t>(board_t::spi_mosi_data_bit) == board_t::spi_mosi,
+              "board: SWSPI data is not the RGB data line named for it");
+static_assert(board_t::draw_buf_count == 1 || board_t::draw_buf_count == 2, "board: one or two draw buffers");
+static_assert(board_t::draw_buf_lines > 0 && board_t::draw_buf_lines <= board_t::height,
+              "board: draw buffer lines out of range");
+static_assert(board_t::bounce_buffer_lines == 0 || board_t::height % board_t::bounce_buffer_lines == 0,
+              "board: bounce buffer lines must divide the height");
+static_assert(board_internal_ram <= board_t::internal_ram_budget,
+              "board: draw and bounce buffers exceed the internal RAM budget");
@@ -0,0 +1,61 @@
+#include "hal.hpp"
+#include "logger.hpp"
+#include "boot_prof.hpp"
+
+static volatile uint32_t stamps[BOOT_STAGE_COUNT];
+static bool reported = false;
+
+static const char* const stage_names[BOOT_STAGE_COUNT] = {
+  "setup", "net task", "NVS", "WiFi start", "panel", "UI", "first frame", "join", "WiFi up", "live data"
+};
+
+void boot_prof_mark(boot_stage_t stage) {
+  if (!stamps[stage]) {
+    uint32_t now = hal_micros();
+    stamps[stage] = now ? now : 1;
+  }
+}
+
+uint32_t boot_prof_at(boot_stage_t stage) {
+  return stamps[stage];
+}
+
+static int at_ms(boot_stage_t stage) {
+  return stamps[stage] ? (int)(stamps[stage] / 1000) : -1;
+}
+
+bool boot_prof_report(const char* version) {
+  if (reported) {
+    return true;
+  }
+  if (!stamps[BOOT_STAGE_LIVE_DATA] && hal_millis() < BOOT_PROF_TIMEOUT) {
+    return false;
+  }
+  reported = true;
+
+  // Reached stages by time, the two cores interleave
+  uint8_t order[BOOT_STAGE_COUNT];
+  int n = 0;
+  for (int s = 0; s < BOOT_STAGE_COUNT; s++) {
+    if (!stamps[s]) {
+      continue;
+    }
+    int i = n++;
+    for (; i > 0 && stamps[order[i - 1]] > stamps[s]; i--) {
+      order[i] = order[i - 1];
+    }
+    order[i] = (uint8_t)s;
+  }
+  uint32_t prev = 0;
+  for (int i = 0; i < n; i++) {
+    uint32_t at = stamps[order[i]];
+    LOG_I(BOOT_STAGE, stage_names[order[i]], (unsigned)(at / 1000), (unsigned)((at - prev) / 1000));
+    prev = at;
+  }
+  LOG_I(BOOT_PROFILE, version, at_ms(BOOT_STAGE_FIRST_FRAME), at_ms(BOOT_STAGE_LIVE_DATA));
+  return true;
+}
+
+const char* boot_prof_stage_str(boot_stage_t stage) {
+  return stage < BOOT_STAGE_COUNT ? stage_names[stage] : "?";
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stdint.h"
+
+// Boot profiler.
+//
+// Every boot stage is stamped once, by whichever task gets there first, in us
+// of hal_micros() (on the ESP32 counted from the start of the app, the
+// bootloader before it is not included). A stamp is a single 32 bit store, so
+// the network task on the other core and the loop task mark without a lock.
+// boot_prof_report() logs the stages in the order they were reached, then the
+// two numbers to compare across releases: time to first frame and time to live
+// data. It does so once live data arrived, or after BOOT_PROF_TIMEOUT with
+// whatever was reached.
+
+#define BOOT_PROF_TIMEOUT 60000   // ms
+
+typedef enum {
+  BOOT_STAGE_SETUP,         // setup() entered
+  BOOT_STAGE_NET_START,     // Network task running
+  BOOT_STAGE_NVS,           // Settings loaded from NVS
+  BOOT_STAGE_WIFI_START,    // Association started
+  BOOT_STAGE_PANEL,         // Panel initialised, LVGL driver registered
+  BOOT_STAGE_UI,            // Screens built
+  BOOT_STAGE_FIRST_FRAME,   // First frame on the panel, not on a timer wake
+  BOOT_STAGE_JOIN,          // Loop task past the network task
+  BOOT_STAGE_WIFI_UP,
+  BOOT_STAGE_LIVE_DATA,     // First reading from the server or the leader
+  BOOT_STAGE_COUNT
+} boot_stage_t;
+
+// Later marks of a stage are ignored
+void boot_prof_mark(boot_stage_t stage);
+// us, 0 if not reached
+uint32_t boot_prof_at(boot_stage_t stage);
+
+// Call from loop(), true once the profile was logged. version tells releases apart in the log.
+bool boot_prof_report(const char* version);
+
+const char* boot_prof_stage_str(boot_stage_t stage);
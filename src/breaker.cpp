@@ -0,0 +1,92 @@
+#if defined __has_include
+#if __has_include("esp_random.h")
+#include "esp_random.h"
+#else
+#include "esp_system.h"
+#endif
+#else
+#include "esp_system.h"
+#endif
+#include "breaker.hpp"
+
+static void breaker_transition(breaker_t* breaker, breaker_state_t to) {
+  breaker_state_t from = breaker->state;
+  if (from == to) {
+    return;
+  }
+  breaker->state = to;
+  breaker->transitions++;
+  if (breaker->listener) {
+    breaker->listener(breaker, from, to);
+  }
+}
+
+// Equal jitter: wait between half and all of the current backoff
+static void breaker_open(breaker_t* breaker, uint32_t now) {
+  uint32_t half = breaker->backoff / 2;
+  breaker->open_time = now;
+  breaker->retry_after = half + (half ? esp_random() % (half + 1) : 0);
+  breaker_transition(breaker, BREAKER_OPEN);
+}
+
+void breaker_init(breaker_t* breaker, const char* name, uint8_t threshold, uint32_t base_backoff,
+                  uint32_t max_backoff, breaker_listener_t listener) {
+  breaker->name = name;
+  breaker->state = BREAKER_CLOSED;
+  breaker->failures = 0;
+  breaker->threshold = threshold;
+  breaker->base_backoff = base_backoff;
+  breaker->max_backoff = max_backoff;
+  breaker->backoff = base_backoff;
+  breaker->open_time = 0;
+  breaker->retry_after = 0;
+  breaker->transitions = 0;
+  breaker->rejected = 0;
+  breaker->listener = listener;
+}
+
+bool breaker_allow(breaker_t* breaker, uint32_t now) {
+  switch (breaker->state) {
+    case BREAKER_CLOSED:
+      return true;
+    case BREAKER_OPEN:
+      if (now - breaker->open_time >= breaker->retry_after) {
+        breaker_transition(breaker, BREAKER_HALF_OPEN);
+        return true;
+      }
+      break;
+    case BREAKER_HALF_OPEN:
+      // The probe is still in flight
+      break;
+  }
+  breaker->rejected++;
+  return false;
+}
+
+void breaker_success(breaker_t* breaker, uint32_t now) {
+  (void)now;
+  breaker->failures = 0;
+  breaker->backoff = breaker->base_backoff;
+  breaker_transition(breaker, BREAKER_CLOSED);
+}
+
+void breaker_failure(breaker_t* breaker, uint32_t now) {
+  if (breaker->state == BREAKER_HALF_OPEN) {
+    uint32_t next = breaker->backoff * 2;
+    breaker->backoff = next > breaker->max_backoff ? breaker->max_backoff : next;
+    breaker_open(breaker, now);
+    return;
+  }
+  if (breaker->state == BREAKER_CLOSED && ++breaker->failures >= breaker->threshold) {
+    breaker_open(breaker, now);
+  }
+}
+
+const char* breaker_state_str(breaker_state_t state) {
+  switch (state) {
+    case BREAKER_CLOSED: return "closed";
+    case BREAKER_OPEN: return "open";
+    case BREAKER_HALF_OPEN: return "half-open";
+  }
+  return "unknown";
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "stdint.h"
+
+// Per-endpoint circuit breaker.
+//
+// CLOSED lets every call through and counts consecutive failures. Reaching the
+// threshold opens the breaker: calls are rejected until a jittered backoff
+// expires, then a single probe is let through in HALF_OPEN. A successful probe
+// closes the breaker, a failed one reopens it with twice the backoff.
+
+typedef enum {
+  BREAKER_CLOSED,
+  BREAKER_OPEN,
+  BREAKER_HALF_OPEN
+} breaker_state_t;
+
+typedef struct breaker breaker_t;
+
+typedef void (*breaker_listener_t)(const breaker_t* breaker, breaker_state_t from, breaker_state_t to);
+
+struct breaker {
+  const char* name;
+  breaker_state_t state;
+  uint8_t failures;
+  uint8_t threshold;
+  uint32_t base_backoff;
+  uint32_t max_backoff;
+  uint32_t backoff;
+  uint32_t open_time;
+  uint32_t retry_after;
+  uint32_t transitions;
+  uint32_t rejected;
+  breaker_listener_t listener;
+};
+
+void breaker_init(breaker_t* breaker, const char* name, uint8_t threshold, uint32_t base_backoff,
+                  uint32_t max_backoff, breaker_listener_t listener);
+
+// Returns true if a call may be made now. In HALF_OPEN only the probe is allowed.
+bool breaker_allow(breaker_t* breaker, uint32_t now);
+
+void breaker_success(breaker_t* breaker, uint32_t now);
+void breaker_failure(breaker_t* breaker, uint32_t now);
+
+const char* breaker_state_str(breaker_state_t state);
@@ -0,0 +1,54 @@
+#include "esp_freertos_hooks.h"
+#include "esp_timer.h"
+#include "cpu_load.hpp"
+
+typedef struct {
+  int64_t last_hook;
+  volatile uint32_t idle_us;   // Running total, only written by the core's own hook
+  uint32_t sampled_idle_us;
+  int64_t window_start;
+} cpu_load_core_t;
+
+static cpu_load_core_t cores[2];
+
+static bool cpu_load_hook(cpu_load_core_t* core) {
+  int64_t now = esp_timer_get_time();
+  int64_t gap = now - core->last_hook;
+  if (gap < CPU_LOAD_IDLE_GAP) {
+    core->idle_us += (uint32_t)gap;
+  }
+  core->last_hook = now;
+  return false;  // Call again right away instead of waiting for an interrupt
+}
+
+static bool cpu_load_hook0(void) {
+  return cpu_load_hook(&cores[0]);
+}
+
+static bool cpu_load_hook1(void) {
+  return cpu_load_hook(&cores[1]);
+}
+
+void cpu_load_begin(void) {
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < 2; i++) {
+    cores[i].last_hook = now;
+    cores[i].window_start = now;
+  }
+  esp_register_freertos_idle_hook_for_cpu(cpu_load_hook0, 0);
+  esp_register_freertos_idle_hook_for_cpu(cpu_load_hook1, 1);
+}
+
+uint16_t cpu_load_sample(int core) {
+  cpu_load_core_t* c = &cores[core];
+  int64_t now = esp_timer_get_time();
+  int64_t window = now - c->window_start;
+  uint32_t idle_total = c->idle_us;
+  int64_t idle = (uint32_t)(idle_total - c->sampled_idle_us);
+  c->sampled_idle_us = idle_total;
+  c->window_start = now;
+  if (window <= 0 || idle >= window) {
+    return 0;
+  }
+  return (uint16_t)(1000 - idle * 1000 / window);
+}
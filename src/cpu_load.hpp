@@ -0,0 +1,19 @@
+#pragma once
+
+#include "stdint.h"
+
+// Per-core CPU load from the FreeRTOS idle hooks.
+//
+// While enabled, the idle task of each core calls the hook back to back and
+// every short gap between two calls is counted as idle time. A longer gap means
+// a task or an interrupt ran in between, so interrupt work such as refilling
+// the RGB bounce buffers shows up as load, which the run time stats of the
+// tasks would miss. The hooks keep the cores out of WAITI, enable them only to
+// measure.
+
+#define CPU_LOAD_IDLE_GAP 20  // us, a longer gap between idle hook calls is busy time
+
+void cpu_load_begin(void);
+
+// Load of a core in permille since the previous call for that core
+uint16_t cpu_load_sample(int core);
@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "local_ctrl.hpp"
+
+// The local fallback controller (local_ctrl.hpp) against first-order room
+// models, on the host:
+//
+//   pio run -e ctrlsim && .pio/build/ctrlsim/program [-v]
+//
+// A room warms by heat degrees an hour with the boiler on and loses loss of its
+// difference to the outside per hour, stepped once per 1 s control tick. The
+// controller sees a reading refreshed every CTRLSIM_POLL, truncated to
+// centi-degrees like the thermostat does, with a little deterministic noise.
+// Each model runs a day in both modes: warming up from CTRLSIM_START_TEMP to
+// 21, a step down to 18 and back up to 21. Checked per run:
+//   - the warm-up takes at most CTRLSIM_RISE_SLACK times the full power time
+//   - the overshoot past the setpoint and the band held once settled
+//   - the settled average for PID, which has no offset to excuse
+//   - boiler switches per settled hour
+//   - the boiler follows a setpoint step within CTRLSIM_STEP_RESPONSE, so the
+//     integral did not wind up
+// Takeover and handback around server outages are checked in src/sim.
+// Exits with 1 if any check fails.
+
+#define CTRLSIM_TICK 1                  // s, LOCAL_CTRL_TICK
+#define CTRLSIM_POLL 30                 // s between readings
+#define CTRLSIM_NOISE 2                 // +- centi-degrees on a reading
+#define CTRLSIM_START_TEMP 15.0
+#define CTRLSIM_SETTLE 1800             // s after reaching a setpoint before the band counts
+#define CTRLSIM_RISE_SLACK 1.5
+#define CTRLSIM_OVERSHOOT 0.5           // Degrees
+#define CTRLSIM_BAND 0.5                // Degrees either side once settled
+#define CTRLSIM_PID_OFFSET 0.15         // Degrees, settled average
+#define CTRLSIM_MAX_SWITCHES 12         // Per hour, on and off each count
+#define CTRLSIM_STEP_RESPONSE 600       // s
+
+typedef struct {
+  const char* name;
+  double heat;      // Degrees per hour with the boiler on
+  double loss;      // Fraction of the difference to the outside lost per hour
+  double outside;
+} ctrlsim_room_t;
+
+typedef struct {
+  uint32_t at;      // s
+  int setpoint;
+} ctrlsim_step_t;
+
+static const ctrlsim_room_t rooms[] = {
+  { "sim room", 10.0, 1.0 / 3.0, 5.0 },   // src/sim's server room
+  { "cold night", 10.0, 1.0 / 3.0, -5.0 },
+  { "large room", 3.0, 0.1, 5.0 },
+};
+
+static const ctrlsim_step_t steps[] = {
+  { 0, 21 },
+  { 8 * 3600, 18 },
+  { 14 * 3600, 21 },
+};
+#define CTRLSIM_STEPS (sizeof(steps) / sizeof(steps[0]))
+#define CTRLSIM_END (24 * 3600)
+
+static unsigned failures = 0;
+static bool verbose = false;
+static uint32_t rng;
+
+#define CTRLSIM_CHECK(cond, ...)                  \
+  do {                                            \
+    if (!(cond)) {                                \
+      failures++;                                 \
+      printf("  FAIL %s: ", #cond);               \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+// xorshift32
+static uint32_t ctrlsim_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// Hours at full power from temp to setpoint, infinite if the boiler can not get there
+static double full_power_hours(const ctrlsim_room_t* room, double temp, double setpoint) {
+  double top = room->outside + room->heat / room->loss;
+  if (setpoint >= top) {
+    return INFINITY;
+  }
+  return setpoint <= temp ? 0 : log((top - temp) / (top - setpoint)) / room->loss;
+}
+
+static void run(const ctrlsim_room_t* room, local_ctrl_mode_t mode) {
+  local_ctrl_cfg_t cfg;
+  local_ctrl_defaults(&cfg, mode);
+  local_ctrl_t ctrl;
+  local_ctrl_init(&ctrl, &cfg);
+  rng = 0x2545f491;
+
+  const char* mode_name = mode == LOCAL_CTRL_PID ? "PID" : "hysteresis";
+  printf("%s, %s\n", mode_name, room->name);
+  double temp = CTRLSIM_START_TEMP;
+  int32_t reading = 0;
+  bool boiler = false;
+  size_t step = 0;
+  int setpoint = steps[0].setpoint;
+  uint32_t step_at = 0;
+  double step_from = temp;
+
+  // Per step: when the reading first reached the setpoint, the first boiler response
+  uint32_t reached = 0;
+  bool responded = false;
+  double overshoot = 0;
+  double band_lo = 1e9, band_hi = -1e9;
+  double settled_sum = 0;
+  uint32_t settled_ticks = 0;
+  uint32_t switches = 0;
+  double worst_rise = 0;
+
+  for (uint32_t t = 0; t < CTRLSIM_END; t += CTRLSIM_TICK) {
+    if (step + 1 < CTRLSIM_STEPS && t >= steps[step + 1].at) {
+      step++;
+      CTRLSIM_CHECK(reached, "%d never reached by %u s", setpoint, t);
+      setpoint = steps[step].setpoint;
+      step_at = t;
+      step_from = temp;
+      reached = 0;
+      responded = false;
+    }
+    if (t % CTRLSIM_POLL == 0) {
+      int noise = (int)(ctrlsim_rand() % (2 * CTRLSIM_NOISE + 1)) - CTRLSIM_NOISE;
+      reading = (int32_t)(temp * 100) + noise;
+    }
+    bool heat = local_ctrl_tick(&ctrl, reading, setpoint * 100);
+
+    // The boiler has to head the right way soon after a step, a wound up integral would hold it
+    bool rising = setpoint > step_from;
+    if (!responded && heat == rising) {
+      responded = true;
+      CTRLSIM_CHECK(t - step_at <= CTRLSIM_STEP_RESPONSE, "boiler %s %u s after the step to %d",
+                    rising ? "on" : "off", t - step_at, setpoint);
+    }
+    if (!reached && (rising ? temp >= setpoint : temp <= setpoint)) {
+      reached = t ? t : 1;
+      if (rising) {
+        double rise = (t - step_at) / 3600.0;
+        double ideal = full_power_hours(room, step_from, setpoint);
+        worst_rise = rise / ideal > worst_rise ? rise / ideal : worst_rise;
+        CTRLSIM_CHECK(rise <= ideal * CTRLSIM_RISE_SLACK, "%.2f h to reach %d, %.2f h at full power", rise,
+                      setpoint, ideal);
+      }
+    }
+    if (reached && temp - setpoint > overshoot) {
+      overshoot = temp - setpoint;
+    }
+    bool settled = reached && t - reached >= CTRLSIM_SETTLE;
+    if (settled) {
+      band_lo = temp - setpoint < band_lo ? temp - setpoint : band_lo;
+      band_hi = temp - setpoint > band_hi ? temp - setpoint : band_hi;
+      settled_sum += temp - setpoint;
+      settled_ticks++;
+      switches += heat != boiler;
+    }
+    if (verbose && t % 600 == 0) {
+      printf("  %5.2f h  setpoint %d  room %6.3f  reading %5d  duty %4d  boiler %d\n", t / 3600.0, setpoint, temp,
+             reading, (int)ctrl.duty, heat);
+    }
+    boiler = heat;
+
+    double hours = CTRLSIM_TICK / 3600.0;
+    temp += ((boiler ? room->heat : 0) - room->loss * (temp - room->outside)) * hours;
+  }
+  double settled_hours = settled_ticks * CTRLSIM_TICK / 3600.0;
+  double average = settled_ticks ? settled_sum / settled_ticks : 0;
+  double per_hour = settled_hours > 0 ? switches / settled_hours : 0;
+  printf("  rise %.2fx, overshoot %.2f, settled %+.2f..%+.2f avg %+.3f, %.1f switches/h\n", worst_rise, overshoot,
+         band_lo, band_hi, average, per_hour);
+  CTRLSIM_CHECK(overshoot <= CTRLSIM_OVERSHOOT, "overshoot %.2f", overshoot);
+  CTRLSIM_CHECK(settled_ticks && band_lo >= -CTRLSIM_BAND && band_hi <= CTRLSIM_BAND, "settled %+.2f..%+.2f",
+                band_lo, band_hi);
+  CTRLSIM_CHECK(mode != LOCAL_CTRL_PID || fabs(average) <= CTRLSIM_PID_OFFSET, "settled average %+.3f", average);
+  // Give or take a partial cycle at either end
+  CTRLSIM_CHECK(switches <= CTRLSIM_MAX_SWITCHES * settled_hours + 2, "%.1f switches per hour", per_hour);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else {
+      printf("usage: %s [-v]\n", argv[0]);
+      return 2;
+    }
+  }
+  for (const ctrlsim_room_t& room : rooms) {
+    run(&room, LOCAL_CTRL_HYSTERESIS);
+    run(&room, LOCAL_CTRL_PID);
+  }
+  printf("%u failed checks\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "logger.hpp"
+#include "deep_sleep.hpp"
+
+#define DEEP_SLEEP_MAGIC 0x534e4150   // "SNAP"
+
+typedef struct {
+  uint32_t magic;
+  thermostat_snapshot_t snapshot;
+  int64_t slept_at;                 // gettimeofday() in us, kept running through deep sleep
+  uint32_t check;
+} deep_sleep_rtc_t;
+
+// RTC_DATA_ATTR is loaded from the image on a cold boot and kept across deep sleep
+static RTC_DATA_ATTR deep_sleep_rtc_t rtc;
+static RTC_DATA_ATTR deep_sleep_stats_t stats;
+
+static uint32_t rtc_checksum(void) {
+  const uint8_t* b = (const uint8_t*)&rtc;
+  uint32_t sum = 0x811c9dc5;
+  for (size_t i = 0; i < offsetof(deep_sleep_rtc_t, check); i++) {
+    sum = (sum ^ b[i]) * 16777619;
+  }
+  return sum;
+}
+
+static int64_t wall_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+deep_sleep_wake_t deep_sleep_begin(thermostat_snapshot_t* snapshot, const deep_sleep_pins_t* pins) {
+  // Driven low before the latch opens, so the pins never float on the way out
+  const gpio_num_t held[] = { (gpio_num_t)pins->backlight, (gpio_num_t)pins->led };
+  for (gpio_num_t pin : held) {
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT);
+    gpio_set_level(pin, 0);
+    gpio_hold_dis(pin);
+  }
+  gpio_deep_sleep_hold_dis();
+
+  deep_sleep_wake_t wake = DEEP_SLEEP_COLD;
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_EXT0:
+    case ESP_SLEEP_WAKEUP_EXT1:
+      wake = DEEP_SLEEP_WAKE_INPUT;
+      break;
+    case ESP_SLEEP_WAKEUP_TIMER:
+      wake = DEEP_SLEEP_WAKE_TIMER;
+      break;
+    default:
+      break;
+  }
+  bool valid = rtc.magic == DEEP_SLEEP_MAGIC && rtc.check == rtc_checksum();
+  if (wake == DEEP_SLEEP_COLD || !valid) {
+    memset(&stats, 0, sizeof(stats));
+    rtc.magic = 0;
+    return DEEP_SLEEP_COLD;
+  }
+
+  *snapshot = rtc.snapshot;
+  rtc.magic = 0;
+  stats.last_slept_s = (uint32_t)((wall_us() - rtc.slept_at) / 1000000);
+  if (wake == DEEP_SLEEP_WAKE_INPUT) {
+    stats.input_wakes++;
+  } else {
+    stats.timer_wakes++;
+  }
+  return wake;
+}
+
+void deep_sleep_first_frame(deep_sleep_wake_t wake) {
+  uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+  if (wake == DEEP_SLEEP_COLD) {
+    stats.cold_first_frame_ms = ms;
+  } else if (wake == DEEP_SLEEP_WAKE_INPUT) {
+    stats.last_first_frame_ms = ms;
+    if (ms > stats.max_first_frame_ms) {
+      stats.max_first_frame_ms = ms;
+    }
+  }
+  LOG_I(WAKE_FIRST_FRAME, deep_sleep_wake_str(wake), ms, stats.cold_first_frame_ms, stats.last_slept_s);
+}
+
+void deep_sleep_enter(const thermostat_snapshot_t* snapshot, const deep_sleep_pins_t* pins, uint32_t timer_ms) {
+  rtc.snapshot = *snapshot;
+  rtc.slept_at = wall_us();
+  rtc.magic = DEEP_SLEEP_MAGIC;
+  rtc.check = rtc_checksum();
+  stats.sleeps++;
+  LOG_I(DEEP_SLEEP, snapshot->setpoint, snapshot->temp, timer_ms / 1000, stats.sleeps);
+  vTaskDelay(pdMS_TO_TICKS(DEEP_SLEEP_LOG_DRAIN));
+
+  // The knob wakes on the first edge of its signal, the button when pressed
+  gpio_num_t sig = (gpio_num_t)pins->encoder_sig;
+  gpio_num_t button = (gpio_num_t)pins->button;
+  esp_sleep_enable_ext0_wakeup(sig, !gpio_get_level(sig));
+  esp_sleep_enable_ext1_wakeup(1ULL << button, ESP_EXT1_WAKEUP_ALL_LOW);
+  rtc_gpio_pullup_en(button);
+  rtc_gpio_pulldown_dis(button);
+  // Latched low until deep_sleep_begin() after the wake
+  const gpio_num_t held[] = { (gpio_num_t)pins->backlight, (gpio_num_t)pins->led };
+  for (gpio_num_t pin : held) {
+    gpio_set_level(pin, 0);
+    gpio_hold_en(pin);
+  }
+  gpio_deep_sleep_hold_en();
+  if (timer_ms) {
+    esp_sleep_enable_timer_wakeup((uint64_t)timer_ms * 1000);
+  }
+  esp_deep_sleep_start();
+}
+
+void deep_sleep_get_stats(deep_sleep_stats_t* out) {
+  *out = stats;
+}
+
+const char* deep_sleep_wake_str(deep_sleep_wake_t wake) {
+  switch (wake) {
+    case DEEP_SLEEP_COLD: return "cold";
+    case DEEP_SLEEP_WAKE_INPUT: return "input";
+    case DEEP_SLEEP_WAKE_TIMER: return "timer";
+    default: return "?";
+  }
+}
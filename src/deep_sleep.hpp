@@ -0,0 +1,58 @@
+#pragma once
+
+#include "stdint.h"
+#include "thermostat.hpp"
+
+// Deep sleep between uses.
+//
+// deep_sleep_enter() keeps a thermostat snapshot in RTC memory and powers down
+// everything but the RTC. The knob (any edge on the encoder signal), the
+// button and an optional timer wake the chip, which boots from the top. With
+// the snapshot main.cpp draws the last known state in the first frame and
+// lets WiFi and the first polls catch up behind it. The backlight and LED
+// pins are latched low for the sleep, a floating backlight pin glows. A timer wake refreshes
+// the readings with the screen off. The snapshot carries a checksum and is
+// only used after a deep sleep wake, any other reset is a cold boot.
+//
+// deep_sleep_first_frame() measures boot to first frame for wakes and for the
+// cold boot, so the two can be compared. The time the ROM and bootloader take
+// before the app starts is not included.
+
+#define DEEP_SLEEP_LOG_DRAIN 50   // ms for the logger task to write out the last records
+
+typedef enum {
+  DEEP_SLEEP_COLD,
+  DEEP_SLEEP_WAKE_INPUT,
+  DEEP_SLEEP_WAKE_TIMER
+} deep_sleep_wake_t;
+
+typedef struct {
+  int8_t button;         // Active low
+  int8_t encoder_sig;
+  int8_t backlight;      // Held low through the sleep
+  int8_t led;
+} deep_sleep_pins_t;
+
+// Kept in RTC memory across sleeps, cleared by a cold boot
+typedef struct {
+  uint32_t sleeps;
+  uint32_t input_wakes;
+  uint32_t timer_wakes;
+  uint32_t cold_first_frame_ms;
+  uint32_t last_first_frame_ms;  // Last input wake
+  uint32_t max_first_frame_ms;
+  uint32_t last_slept_s;
+} deep_sleep_stats_t;
+
+// Call early in setup(). Releases the held pins driven low, fills snapshot and returns the wake
+// cause, DEEP_SLEEP_COLD without one.
+deep_sleep_wake_t deep_sleep_begin(thermostat_snapshot_t* snapshot, const deep_sleep_pins_t* pins);
+
+// Call once the first frame has been rendered and flushed
+void deep_sleep_first_frame(deep_sleep_wake_t wake);
+
+// Does not return. timer_ms 0 sleeps until the knob or the button.
+void deep_sleep_enter(const thermostat_snapshot_t* snapshot, const deep_sleep_pins_t* pins, uint32_t timer_ms);
+
+void deep_sleep_get_stats(deep_sleep_stats_t* stats);
+const char* deep_sleep_wake_str(deep_sleep_wake_t wake);
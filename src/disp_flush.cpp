@@ -0,0 +1,102 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "input_trace.hpp"
+#include "stall_mon.hpp"
+#include "disp_flush.hpp"
+
+typedef struct {
+  lv_disp_drv_t* drv;
+  lv_area_t area;
+  lv_color_t* color_p;
+} flush_job_t;
+
+static disp_flush_draw_t flush_draw = NULL;
+static QueueHandle_t flush_queue = NULL;
+static volatile disp_flush_stats_t flush_stats;
+
+static void flush_run(const flush_job_t* job) {
+  int64_t start = esp_timer_get_time();
+  flush_draw(&job->area, job->color_p);
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+  flush_stats.flushes++;
+  flush_stats.flush_us_total += elapsed;
+  if (elapsed > flush_stats.flush_us_max) {
+    flush_stats.flush_us_max = elapsed;
+  }
+  input_trace_flush_done();
+  lv_disp_flush_ready(job->drv);
+}
+
+static void flush_task(void* arg) {
+  flush_job_t job;
+  for (;;) {
+    xQueueReceive(flush_queue, &job, portMAX_DELAY);
+    flush_run(&job);
+  }
+}
+
+static void flush_cb(lv_disp_drv_t* drv, const lv_area_t* area, lv_color_t* color_p) {
+  flush_job_t job = {drv, *area, color_p};
+  stall_mon_step(STALL_STEP_FLUSH);
+  input_trace_flush_begin();
+  if (flush_queue) {
+    // LVGL has at most one flush outstanding, this never blocks
+    xQueueSend(flush_queue, &job, portMAX_DELAY);
+  } else {
+    flush_run(&job);
+  }
+  stall_mon_step(STALL_STEP_RENDER);
+}
+
+// LVGL spins here until the previous stripe is out, right before the next flush_cb()
+static void wait_cb(lv_disp_drv_t* drv) {
+  stall_mon_step(STALL_STEP_FLUSH);
+}
+
+static void monitor_cb(lv_disp_drv_t* drv, uint32_t time, uint32_t px) {
+  flush_stats.frames++;
+  flush_stats.render_ms_total += time;
+  flush_stats.rendered_px += px;
+  input_trace_frame();
+}
+
+bool disp_flush_init(lv_disp_drv_t* drv, disp_flush_draw_t draw, bool async, int core) {
+  flush_draw = draw;
+  drv->flush_cb = flush_cb;
+  drv->monitor_cb = monitor_cb;
+  drv->wait_cb = wait_cb;
+  if (!async || flush_queue) {
+    return true;
+  }
+
+  flush_queue = xQueueCreate(1, sizeof(flush_job_t));
+  if (flush_queue == NULL) {
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(flush_task, "flush", 4 * 1024, NULL, 5, NULL, core) != pdPASS) {
+    vQueueDelete(flush_queue);
+    flush_queue = NULL;
+    return false;
+  }
+  return true;
+}
+
+void disp_flush_get_stats(disp_flush_stats_t* stats, bool reset) {
+  stats->flushes = flush_stats.flushes;
+  stats->flush_us_total = flush_stats.flush_us_total;
+  stats->flush_us_max = flush_stats.flush_us_max;
+  stats->frames = flush_stats.frames;
+  stats->render_ms_total = flush_stats.render_ms_total;
+  stats->rendered_px = flush_stats.rendered_px;
+  if (reset) {
+    flush_stats.flushes = 0;
+    flush_stats.flush_us_total = 0;
+    flush_stats.flush_us_max = 0;
+    flush_stats.frames = 0;
+    flush_stats.render_ms_total = 0;
+    flush_stats.rendered_px = 0;
+  }
+}
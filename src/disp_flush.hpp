@@ -0,0 +1,27 @@
+#pragma once
+
+#include "stdint.h"
+#include <lvgl.h>
+
+// LVGL flush path.
+//
+// In async mode the copy to the panel runs on a dedicated task pinned to the
+// other core and lv_disp_flush_ready() is called when it completes. With two
+// draw buffers LVGL renders the next stripe while the previous one is being
+// copied. In sync mode the copy runs inside the flush callback as before.
+
+typedef void (*disp_flush_draw_t)(const lv_area_t* area, lv_color_t* color_p);
+
+typedef struct {
+  uint32_t flushes;
+  uint32_t flush_us_total;
+  uint32_t flush_us_max;
+  uint32_t frames;
+  uint32_t render_ms_total;
+  uint32_t rendered_px;
+} disp_flush_stats_t;
+
+// Installs the flush and monitor callbacks on drv, call before lv_disp_drv_register()
+bool disp_flush_init(lv_disp_drv_t* drv, disp_flush_draw_t draw, bool async, int core);
+
+void disp_flush_get_stats(disp_flush_stats_t* stats, bool reset);
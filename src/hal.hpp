@@ -0,0 +1,62 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// Hardware abstraction for the thermostat logic.
+//
+// thermostat.cpp reaches the board only through these calls and through the
+// http_client.hpp request API, which is the network interface. hal_esp32.cpp
+// implements them on the board, src/sim/ implements them on a simulated clock
+// so days of operation run on the host in seconds (pio run -e sim).
+
+typedef struct {
+  int8_t backlight;
+  int8_t button;
+  int8_t encoder_sig;
+  int8_t encoder_dir;
+} hal_pins_t;
+
+void hal_begin(const hal_pins_t* pins);
+
+// Clock
+uint32_t hal_millis(void);
+uint32_t hal_micros(void);
+
+// GPIO
+void hal_gpio_output(int pin, bool level);
+void hal_gpio_write(int pin, bool level);
+
+// Encoder count and button edge
+int16_t hal_encoder_count(void);
+void hal_encoder_restore(int16_t count);  // Continue counting from count, after deep sleep
+bool hal_button_was_pressed(void);
+uint32_t hal_button_held(void);  // ms the button has been down, 0 if released
+
+// WiFi station
+void hal_wifi_begin(const char* ssid, const char* password);
+bool hal_wifi_connected(void);
+void hal_wifi_disconnect(void);
+void hal_wifi_ip(uint8_t ip[4]);
+
+// UDP multicast for peer_sync.hpp, joined once WiFi is up. hal_udp_recv() does
+// not block and returns -1 when nothing is queued
+bool hal_udp_begin(const char* group, uint16_t port);
+bool hal_udp_send(const uint8_t* data, size_t len);
+int hal_udp_recv(uint8_t* buf, size_t size);
+uint32_t hal_node_id(void);  // Unique per unit, from the MAC
+
+// Small blobs kept across resets and power cycles, hal_nvs_read() returns the length or -1
+int hal_nvs_read(const char* key, void* buf, size_t size);
+bool hal_nvs_write(const char* key, const void* buf, size_t len);
+
+// Wall clock. hal_time_zone() sets the POSIX TZ rules localtime_r() follows,
+// hal_sntp_begin() starts SNTP once WiFi is up. hal_time_fix() hands over each
+// new SNTP fix once, as UTC ms and the hal_millis() it was taken at.
+void hal_time_zone(const char* tz);
+void hal_sntp_begin(const char* server);
+bool hal_time_fix(int64_t* utc_ms, uint32_t* at);
+bool hal_rtc_time(int64_t* utc_ms);  // RTC kept through resets and deep sleep, false if never set
+
+// Display, on the board waking the panel takes a few frames (panel.hpp)
+void hal_display_power(bool on);
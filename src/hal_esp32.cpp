@@ -0,0 +1,209 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_mac.h>
+#include <lwip/sockets.h>
+#include <sys/time.h>
+#include "esp_idf_version.h"
+#include "esp_sntp.h"
+#include "nvs.h"
+#include "button.hpp"
+#include "mt8901.hpp"
+#include "panel.hpp"
+#include "hal.hpp"
+
+static button_t* hal_button;
+static int16_t encoder_offset = 0;
+
+void hal_begin(const hal_pins_t* pins) {
+  panel_begin(pins->backlight);
+  hal_button = button_attch(pins->button, 0, 10);
+  mt8901_init(pins->encoder_sig, pins->encoder_dir);
+}
+
+uint32_t hal_millis(void) {
+  return millis();
+}
+
+uint32_t hal_micros(void) {
+  return micros();
+}
+
+void hal_gpio_output(int pin, bool level) {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, level ? HIGH : LOW);
+}
+
+void hal_gpio_write(int pin, bool level) {
+  digitalWrite(pin, level ? HIGH : LOW);
+}
+
+int16_t hal_encoder_count(void) {
+  return mt8901_get_count() + encoder_offset;
+}
+
+void hal_encoder_restore(int16_t count) {
+  encoder_offset = count - mt8901_get_count();
+}
+
+bool hal_button_was_pressed(void) {
+  return hal_button && button_wasPressed(hal_button);
+}
+
+uint32_t hal_button_held(void) {
+  if (!hal_button || !button_isPressed(hal_button)) {
+    return 0;
+  }
+  return (xTaskGetTickCount() - hal_button->last_press_time) * portTICK_PERIOD_MS;
+}
+
+void hal_wifi_begin(const char* ssid, const char* password) {
+  WiFi.begin(ssid, password);
+}
+
+bool hal_wifi_connected(void) {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+void hal_wifi_disconnect(void) {
+  WiFi.disconnect();
+}
+
+void hal_wifi_ip(uint8_t ip[4]) {
+  IPAddress addr = WiFi.localIP();
+  for (int i = 0; i < 4; i++) {
+    ip[i] = addr[i];
+  }
+}
+
+static int udp_sock = -1;
+static struct sockaddr_in udp_group;
+
+bool hal_udp_begin(const char* group, uint16_t port) {
+  if (udp_sock >= 0) {
+    close(udp_sock);
+  }
+  udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (udp_sock < 0) {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(udp_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  struct ip_mreq mreq = {};
+  inet_aton(group, &mreq.imr_multiaddr);
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  uint8_t ttl = 1;
+  if (bind(udp_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      setsockopt(udp_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ||
+      setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+    close(udp_sock);
+    udp_sock = -1;
+    return false;
+  }
+  fcntl(udp_sock, F_SETFL, fcntl(udp_sock, F_GETFL, 0) | O_NONBLOCK);
+  udp_group = addr;
+  udp_group.sin_addr = mreq.imr_multiaddr;
+  return true;
+}
+
+bool hal_udp_send(const uint8_t* data, size_t len) {
+  if (udp_sock < 0) {
+    return false;
+  }
+  return sendto(udp_sock, data, len, 0, (struct sockaddr*)&udp_group, sizeof(udp_group)) == (ssize_t)len;
+}
+
+int hal_udp_recv(uint8_t* buf, size_t size) {
+  if (udp_sock < 0) {
+    return -1;
+  }
+  ssize_t n = recv(udp_sock, buf, size, 0);
+  return n < 0 ? -1 : (int)n;
+}
+
+uint32_t hal_node_id(void) {
+  uint8_t mac[6];
+  esp_read_mac(mac, ESP_MAC_WIFI_STA);
+  return (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+}
+
+static nvs_handle_t nvs = 0;
+
+static bool nvs_ready(void) {
+  return nvs || nvs_open("thermostat", NVS_READWRITE, &nvs) == ESP_OK;
+}
+
+int hal_nvs_read(const char* key, void* buf, size_t size) {
+  size_t len = 0;
+  if (!nvs_ready() || nvs_get_blob(nvs, key, NULL, &len) != ESP_OK || len > size ||
+      nvs_get_blob(nvs, key, buf, &len) != ESP_OK) {
+    return -1;
+  }
+  return (int)len;
+}
+
+bool hal_nvs_write(const char* key, const void* buf, size_t len) {
+  return nvs_ready() && nvs_set_blob(nvs, key, buf, len) == ESP_OK && nvs_commit(nvs) == ESP_OK;
+}
+
+static portMUX_TYPE time_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool time_fixed = false;
+static int64_t time_fix_ms;
+static uint32_t time_fix_at;
+
+// From the lwIP task, after SNTP has set the system time
+static void on_time_sync(struct timeval* tv) {
+  uint32_t at = millis();
+  portENTER_CRITICAL(&time_mux);
+  time_fix_ms = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+  time_fix_at = at;
+  time_fixed = true;
+  portEXIT_CRITICAL(&time_mux);
+}
+
+void hal_time_zone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+void hal_sntp_begin(const char* server) {
+  static bool started = false;
+  if (started) {
+    return;
+  }
+  started = true;
+  sntp_set_time_sync_notification_cb(on_time_sync);
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+  esp_sntp_setservername(0, server);
+  esp_sntp_init();
+#else
+  sntp_setoperatingmode(SNTP_OPMODE_POLL);
+  sntp_setservername(0, server);
+  sntp_init();
+#endif
+}
+
+bool hal_time_fix(int64_t* utc_ms, uint32_t* at) {
+  portENTER_CRITICAL(&time_mux);
+  bool fixed = time_fixed;
+  *utc_ms = time_fix_ms;
+  *at = time_fix_at;
+  time_fixed = false;
+  portEXIT_CRITICAL(&time_mux);
+  return fixed;
+}
+
+bool hal_rtc_time(int64_t* utc_ms) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  *utc_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  return tv.tv_sec > 1700000000;  // Not before 2023, the RTC counts from 1970 until first set
+}
+
+void hal_display_power(bool on) {
+  panel_set_on(on);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Host build of http_client: lwIP mirrors the POSIX socket API
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
@@ -0,0 +1,259 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include "esp_timer.h"
+#include "http_client.hpp"
+
+static uint32_t http_now() {
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void http_close(http_req_t* req) {
+  if (req->sock >= 0) {
+    close(req->sock);
+    req->sock = -1;
+  }
+}
+
+static http_state_t http_fail(http_req_t* req, http_err_t err) {
+  http_close(req);
+  req->error = err;
+  req->elapsed = http_now() - req->start_time;
+  req->state = HTTP_FAILED;
+  return req->state;
+}
+
+static http_state_t http_finish(http_req_t* req) {
+  http_close(req);
+  req->elapsed = http_now() - req->start_time;
+  req->state = HTTP_DONE;
+  return req->state;
+}
+
+// Parses the status line and Content-Length once the header block is complete
+static bool http_parse_headers(http_req_t* req, const char* end) {
+  if (sscanf(req->rx, "HTTP/%*d.%*d %d", &req->status) != 1) {
+    return false;
+  }
+  req->content_length = -1;
+  const char* line = strstr(req->rx, "\r\n");
+  while (line && line < end) {
+    line += 2;
+    if (strncasecmp(line, "Content-Length:", 15) == 0) {
+      req->content_length = atoi(line + 15);
+    }
+    line = strstr(line, "\r\n");
+  }
+  req->body_off = (uint16_t)(end + 4 - req->rx);
+  return true;
+}
+
+static void http_reset(http_req_t* req, uint32_t timeout_ms) {
+  if (http_busy(req)) {
+    http_cancel(req);
+  }
+  memset(req, 0, offsetof(http_req_t, tx));
+  req->sock = -1;
+  req->start_time = http_now();
+  req->timeout = timeout_ms;
+  req->content_length = -1;
+  req->rx[0] = '\0';
+}
+
+// Connects once the request is in tx
+static bool http_open(http_req_t* req, const char* host, uint16_t port, int len) {
+  if (len < 0 || len >= (int)sizeof(req->tx)) {
+    http_fail(req, HTTP_ERR_OVERFLOW);
+    return false;
+  }
+  req->tx_len = (uint16_t)len;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+    http_fail(req, HTTP_ERR_ADDR);
+    return false;
+  }
+
+  req->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (req->sock < 0) {
+    http_fail(req, HTTP_ERR_SOCKET);
+    return false;
+  }
+  fcntl(req->sock, F_SETFL, fcntl(req->sock, F_GETFL, 0) | O_NONBLOCK);
+
+  if (connect(req->sock, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+    req->state = HTTP_SENDING;
+  } else if (errno == EINPROGRESS) {
+    req->state = HTTP_CONNECTING;
+  } else {
+    http_fail(req, HTTP_ERR_CONNECT);
+    return false;
+  }
+  return true;
+}
+
+bool http_begin(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                const char* content_type, const char* body, uint32_t timeout_ms) {
+  http_reset(req, timeout_ms);
+  int len;
+  if (body) {
+    len = snprintf(req->tx, sizeof(req->tx),
+                   "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                   "Content-Type: %s\r\nContent-Length: %u\r\n\r\n%s",
+                   method, path, host, content_type, (unsigned)strlen(body), body);
+  } else {
+    len = snprintf(req->tx, sizeof(req->tx), "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                   method, path, host);
+  }
+  return http_open(req, host, port, len);
+}
+
+bool http_begin_data(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                     const char* content_type, const uint8_t* body, size_t len, uint32_t timeout_ms) {
+  http_reset(req, timeout_ms);
+  if (len > 0xffff) {
+    http_fail(req, HTTP_ERR_OVERFLOW);
+    return false;
+  }
+  req->data = body;
+  req->data_len = (uint16_t)len;
+  int head = snprintf(req->tx, sizeof(req->tx),
+                      "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                      "Content-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                      method, path, host, content_type, (unsigned)len);
+  return http_open(req, host, port, head);
+}
+
+http_state_t http_step(http_req_t* req) {
+  if (!http_busy(req)) {
+    return req->state;
+  }
+  if (http_now() - req->start_time >= req->timeout) {
+    return http_fail(req, HTTP_ERR_TIMEOUT);
+  }
+
+  if (req->state == HTTP_CONNECTING) {
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(req->sock, &wfds);
+    struct timeval tv = {0, 0};
+    int ready = select(req->sock + 1, NULL, &wfds, NULL, &tv);
+    if (ready < 0) {
+      return http_fail(req, HTTP_ERR_CONNECT);
+    }
+    if (ready == 0) {
+      return req->state;
+    }
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    getsockopt(req->sock, SOL_SOCKET, SO_ERROR, &err, &err_len);
+    if (err != 0) {
+      return http_fail(req, HTTP_ERR_CONNECT);
+    }
+    req->state = HTTP_SENDING;
+  }
+
+  if (req->state == HTTP_SENDING) {
+    // The request in tx, then a binary body
+    bool head = req->tx_sent < req->tx_len;
+    const void* from = head ? (const void*)(req->tx + req->tx_sent) : (const void*)(req->data + req->data_sent);
+    int left = head ? req->tx_len - req->tx_sent : req->data_len - req->data_sent;
+    int sent = send(req->sock, from, left, MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return req->state;
+      }
+      return http_fail(req, HTTP_ERR_SEND);
+    }
+    if (head) {
+      req->tx_sent += sent;
+    } else {
+      req->data_sent += sent;
+    }
+    if (req->tx_sent < req->tx_len || req->data_sent < req->data_len) {
+      return req->state;
+    }
+    req->state = HTTP_HEADERS;
+  }
+
+  // HTTP_HEADERS or HTTP_BODY: drain whatever the socket has
+  bool eof = false;
+  for (;;) {
+    int space = (int)sizeof(req->rx) - 1 - req->rx_len;
+    if (space <= 0) {
+      return http_fail(req, HTTP_ERR_OVERFLOW);
+    }
+    int got = recv(req->sock, req->rx + req->rx_len, space, MSG_DONTWAIT);
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return http_fail(req, HTTP_ERR_RECV);
+    }
+    if (got == 0) {
+      eof = true;
+      break;
+    }
+    req->rx_len += got;
+    req->rx[req->rx_len] = '\0';
+  }
+
+  if (req->state == HTTP_HEADERS) {
+    const char* end = strstr(req->rx, "\r\n\r\n");
+    if (!end) {
+      return eof ? http_fail(req, HTTP_ERR_PROTOCOL) : req->state;
+    }
+    if (!http_parse_headers(req, end)) {
+      return http_fail(req, HTTP_ERR_PROTOCOL);
+    }
+    req->state = HTTP_BODY;
+  }
+
+  int32_t body_len = req->rx_len - req->body_off;
+  if (req->content_length >= 0 && body_len >= req->content_length) {
+    req->rx[req->body_off + req->content_length] = '\0';
+    return http_finish(req);
+  }
+  if (eof) {
+    // Without Content-Length the body ends with the connection
+    return req->content_length < 0 ? http_finish(req) : http_fail(req, HTTP_ERR_PROTOCOL);
+  }
+  return req->state;
+}
+
+void http_cancel(http_req_t* req) {
+  if (http_busy(req)) {
+    http_fail(req, HTTP_ERR_CANCELLED);
+  }
+}
+
+bool http_busy(const http_req_t* req) {
+  return req->state != HTTP_IDLE && req->state != HTTP_DONE && req->state != HTTP_FAILED;
+}
+
+const char* http_body(const http_req_t* req) {
+  return req->state == HTTP_DONE ? req->rx + req->body_off : "";
+}
+
+const char* http_err_str(http_err_t err) {
+  switch (err) {
+    case HTTP_ERR_NONE: return "none";
+    case HTTP_ERR_ADDR: return "bad address";
+    case HTTP_ERR_SOCKET: return "socket";
+    case HTTP_ERR_CONNECT: return "connect";
+    case HTTP_ERR_SEND: return "send";
+    case HTTP_ERR_RECV: return "recv";
+    case HTTP_ERR_PROTOCOL: return "protocol";
+    case HTTP_ERR_OVERFLOW: return "overflow";
+    case HTTP_ERR_TIMEOUT: return "timeout";
+    case HTTP_ERR_CANCELLED: return "cancelled";
+  }
+  return "unknown";
+}
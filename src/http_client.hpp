@@ -0,0 +1,84 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// Non-blocking HTTP/1.1 client on top of lwIP sockets.
+//
+// A request is a resumable state machine: http_begin() opens the socket and
+// returns immediately, every http_step() call advances it as far as it can
+// without blocking. Each request carries its own deadline, measured from
+// http_begin(), and can be cancelled at any time. Requests share no global
+// state, so they can be stepped from loop() or from a network task, as long as
+// a single request is only touched by one task.
+//
+// Only numeric IPv4 hosts are accepted, a DNS lookup would block.
+
+#define HTTP_TX_BUF_SIZE 256
+#define HTTP_RX_BUF_SIZE 512
+
+typedef enum {
+  HTTP_IDLE,
+  HTTP_CONNECTING,
+  HTTP_SENDING,
+  HTTP_HEADERS,
+  HTTP_BODY,
+  HTTP_DONE,
+  HTTP_FAILED
+} http_state_t;
+
+typedef enum {
+  HTTP_ERR_NONE,
+  HTTP_ERR_ADDR,
+  HTTP_ERR_SOCKET,
+  HTTP_ERR_CONNECT,
+  HTTP_ERR_SEND,
+  HTTP_ERR_RECV,
+  HTTP_ERR_PROTOCOL,
+  HTTP_ERR_OVERFLOW,
+  HTTP_ERR_TIMEOUT,
+  HTTP_ERR_CANCELLED
+} http_err_t;
+
+typedef struct {
+  http_state_t state;
+  http_err_t error;
+  int sock;
+  int status;
+  uint32_t start_time;
+  uint32_t timeout;
+  uint32_t elapsed;
+  int32_t content_length;
+  uint16_t tx_len;
+  uint16_t tx_sent;
+  uint16_t rx_len;
+  uint16_t body_off;
+  const uint8_t* data;          // Binary body sent after tx, see http_begin_data()
+  uint16_t data_len;
+  uint16_t data_sent;
+  char tx[HTTP_TX_BUF_SIZE];
+  char rx[HTTP_RX_BUF_SIZE];
+} http_req_t;
+
+// Starts a request. body may be NULL for a GET. Returns false if the request
+// failed immediately, req->error tells why.
+bool http_begin(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                const char* content_type, const char* body, uint32_t timeout_ms);
+
+// Starts a request with a binary body of len bytes. The body is sent from where it is, not copied,
+// so it must stay untouched until the request is no longer busy.
+bool http_begin_data(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                     const char* content_type, const uint8_t* body, size_t len, uint32_t timeout_ms);
+
+// Advances the request without blocking and returns the new state.
+http_state_t http_step(http_req_t* req);
+
+void http_cancel(http_req_t* req);
+
+// True while the request is in flight.
+bool http_busy(const http_req_t* req);
+
+// Null terminated response body, valid once the request is HTTP_DONE.
+const char* http_body(const http_req_t* req);
+
+const char* http_err_str(http_err_t err);
@@ -0,0 +1,157 @@
+#include <atomic>
+#include "hal.hpp"
+#include "input_trace.hpp"
+
+// Histogram buckets: exact below 16 us, then 8 per power of two (12.5 %) up to 2^26 us
+#define TRACE_SUB_BITS 3
+#define TRACE_LINEAR 16
+#define TRACE_BUCKETS (TRACE_LINEAR + 22 * (1 << TRACE_SUB_BITS))
+
+typedef enum {
+  TRACE_IDLE,
+  TRACE_CAPTURED,
+  TRACE_WIDGET,
+  TRACE_FRAME
+} trace_state_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t max;
+  uint32_t buckets[TRACE_BUCKETS];
+} trace_hist_t;
+
+// The flush completes on the flush task, everything else runs in loop()
+static std::atomic<uint8_t> state(TRACE_IDLE);
+static std::atomic<uint32_t> flushes_submitted(0);
+static std::atomic<uint32_t> flushes_done(0);
+static std::atomic<uint32_t> last_flush_done(0);
+static uint32_t capture_time;
+static bool render_seen;
+
+static trace_hist_t hists[INPUT_TRACE_STAGE_COUNT];
+static input_trace_counts_t counts;
+
+static int trace_bucket(uint32_t us) {
+  if (us < TRACE_LINEAR) {
+    return us;
+  }
+  int msb = 31 - __builtin_clz(us);
+  int sub = (us >> (msb - TRACE_SUB_BITS)) & ((1 << TRACE_SUB_BITS) - 1);
+  int idx = TRACE_LINEAR + ((msb - 4) << TRACE_SUB_BITS) + sub;
+  return idx < TRACE_BUCKETS ? idx : TRACE_BUCKETS - 1;
+}
+
+static uint32_t trace_bucket_upper(int idx) {
+  if (idx < TRACE_LINEAR) {
+    return idx;
+  }
+  int msb = ((idx - TRACE_LINEAR) >> TRACE_SUB_BITS) + 4;
+  int sub = (idx - TRACE_LINEAR) & ((1 << TRACE_SUB_BITS) - 1);
+  uint32_t lower = (uint32_t)((1 << TRACE_SUB_BITS) + sub) << (msb - TRACE_SUB_BITS);
+  return lower + (1u << (msb - TRACE_SUB_BITS)) - 1;
+}
+
+static void trace_record(input_trace_stage_t stage, uint32_t us) {
+  trace_hist_t* h = &hists[stage];
+  h->count++;
+  h->buckets[trace_bucket(us)]++;
+  if (us > h->max) {
+    h->max = us;
+  }
+}
+
+// Ends the trace once the frame is over and every stripe of it has been flushed
+static void trace_finish_if_flushed(void) {
+  if (flushes_done.load() != flushes_submitted.load()) {
+    return;
+  }
+  uint8_t expected = TRACE_FRAME;
+  if (state.compare_exchange_strong(expected, TRACE_IDLE)) {
+    trace_record(INPUT_TRACE_FLUSH, last_flush_done.load() - capture_time);
+  }
+}
+
+void input_trace_capture(input_trace_source_t source, uint32_t poll_gap_us) {
+  uint32_t now = hal_micros();
+  if (state.load() != TRACE_IDLE) {
+    if (now - capture_time < INPUT_TRACE_TIMEOUT) {
+      counts.coalesced++;
+      return;
+    }
+    counts.abandoned++;
+  }
+  capture_time = now;
+  render_seen = false;
+  counts.events[source]++;
+  if (source == INPUT_TRACE_ENCODER) {
+    trace_record(INPUT_TRACE_POLL, poll_gap_us);
+  }
+  state.store(TRACE_CAPTURED);
+}
+
+void input_trace_widget(bool redraw) {
+  if (state.load() != TRACE_CAPTURED) {
+    return;
+  }
+  trace_record(INPUT_TRACE_WIDGET, hal_micros() - capture_time);
+  state.store(redraw ? TRACE_WIDGET : TRACE_IDLE);
+}
+
+void input_trace_flush_begin(void) {
+  flushes_submitted++;
+  if (state.load() == TRACE_WIDGET && !render_seen) {
+    render_seen = true;
+    trace_record(INPUT_TRACE_RENDER, hal_micros() - capture_time);
+  }
+}
+
+void input_trace_flush_done(void) {
+  last_flush_done.store(hal_micros());
+  flushes_done++;
+  trace_finish_if_flushed();
+}
+
+void input_trace_frame(void) {
+  if (state.load() != TRACE_WIDGET || !render_seen) {
+    return;
+  }
+  trace_record(INPUT_TRACE_FRAME, hal_micros() - capture_time);
+  state.store(TRACE_FRAME);
+  trace_finish_if_flushed();
+}
+
+void input_trace_get(input_trace_stage_t stage, input_trace_pct_t* pct) {
+  const trace_hist_t* h = &hists[stage];
+  static const uint8_t percents[] = { 50, 90, 99 };
+  uint32_t* out[] = { &pct->p50, &pct->p90, &pct->p99 };
+  pct->count = h->count;
+  pct->max = h->max;
+  for (int p = 0; p < 3; p++) {
+    uint32_t rank = (uint32_t)(((uint64_t)h->count * percents[p] + 99) / 100);
+    uint32_t seen = 0;
+    *out[p] = 0;
+    for (int i = 0; i < TRACE_BUCKETS && h->count; i++) {
+      seen += h->buckets[i];
+      if (seen >= rank) {
+        uint32_t upper = trace_bucket_upper(i);
+        *out[p] = upper < h->max ? upper : h->max;
+        break;
+      }
+    }
+  }
+}
+
+void input_trace_get_counts(input_trace_counts_t* out) {
+  *out = counts;
+}
+
+const char* input_trace_stage_str(input_trace_stage_t stage) {
+  switch (stage) {
+    case INPUT_TRACE_POLL: return "poll";
+    case INPUT_TRACE_WIDGET: return "widget";
+    case INPUT_TRACE_RENDER: return "render";
+    case INPUT_TRACE_FRAME: return "frame";
+    case INPUT_TRACE_FLUSH: return "flush";
+    default: return "?";
+  }
+}
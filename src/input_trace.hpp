@@ -0,0 +1,57 @@
+#pragma once
+
+#include "stdint.h"
+
+// Input-to-photon latency tracing.
+//
+// An input event is timestamped when it is captured and followed through the
+// widget update, the first rendered stripe, the end of the LVGL refresh and
+// the completion of the last flush into the panel framebuffer, which the RGB
+// panel scans out within one frame. One event is traced at a time, inputs that
+// land in the same frame are counted as coalesced. Each stage feeds a fixed
+// log-scale histogram (latency from capture), recording is a handful of
+// instructions so tracing stays on in production builds.
+
+typedef enum {
+  INPUT_TRACE_ENCODER,
+  INPUT_TRACE_BUTTON
+} input_trace_source_t;
+
+typedef enum {
+  INPUT_TRACE_POLL,     // Encoder: gap since the previous indev read, an upper bound on the time
+                        // the count waited in PCNT. Not included in the stages below.
+  INPUT_TRACE_WIDGET,   // Setpoint handled and widgets invalidated
+  INPUT_TRACE_RENDER,   // First stripe rendered and handed to the flush
+  INPUT_TRACE_FRAME,    // LVGL refresh finished
+  INPUT_TRACE_FLUSH,    // Last stripe copied into the framebuffer
+  INPUT_TRACE_STAGE_COUNT
+} input_trace_stage_t;
+
+#define INPUT_TRACE_TIMEOUT 1000000  // us, a trace that never reaches the panel is abandoned
+
+typedef struct {
+  uint32_t count;
+  uint32_t p50;
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t max;          // us
+} input_trace_pct_t;
+
+typedef struct {
+  uint32_t events[2];    // Per source
+  uint32_t coalesced;
+  uint32_t abandoned;
+} input_trace_counts_t;
+
+// Input side, poll_gap_us is the time since the previous read of the source
+void input_trace_capture(input_trace_source_t source, uint32_t poll_gap_us);
+void input_trace_widget(bool redraw);
+
+// Display side, called by disp_flush
+void input_trace_flush_begin(void);
+void input_trace_flush_done(void);
+void input_trace_frame(void);
+
+void input_trace_get(input_trace_stage_t stage, input_trace_pct_t* pct);
+void input_trace_get_counts(input_trace_counts_t* counts);
+const char* input_trace_stage_str(input_trace_stage_t stage);
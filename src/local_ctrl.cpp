@@ -0,0 +1,78 @@
+#include "local_ctrl.hpp"
+
+static int32_t clamp32(int64_t value, int32_t lo, int32_t hi) {
+  return value < lo ? lo : value > hi ? hi : (int32_t)value;
+}
+
+void local_ctrl_defaults(local_ctrl_cfg_t* cfg, local_ctrl_mode_t mode) {
+  cfg->mode = mode;
+  cfg->hysteresis = 30;                // +-0.3 degrees
+  cfg->kp = LOCAL_CTRL_Q16(10.0);      // Full duty 1 degree below the setpoint
+  cfg->ki = LOCAL_CTRL_Q16(0.003);     // Integral time kp / ki of about an hour, rooms are that slow
+  cfg->kd = LOCAL_CTRL_Q16(0.0);
+  cfg->window = 600;                   // 10 minute windows, at most 6 boiler cycles an hour
+}
+
+void local_ctrl_init(local_ctrl_t* ctrl, const local_ctrl_cfg_t* cfg) {
+  ctrl->cfg = *cfg;
+  if (ctrl->cfg.window == 0) {
+    ctrl->cfg.window = 1;
+  }
+  local_ctrl_reset(ctrl, false);
+}
+
+void local_ctrl_reset(local_ctrl_t* ctrl, bool output) {
+  ctrl->output = output;
+  ctrl->primed = false;
+  ctrl->last_error = 0;
+  ctrl->integral = 0;
+  ctrl->duty = output ? LOCAL_CTRL_DUTY_MAX : 0;
+  ctrl->phase = 0;
+}
+
+static bool hysteresis_tick(local_ctrl_t* ctrl, int32_t temp, int32_t setpoint) {
+  if (temp <= setpoint - ctrl->cfg.hysteresis) {
+    ctrl->output = true;
+  } else if (temp >= setpoint + ctrl->cfg.hysteresis) {
+    ctrl->output = false;
+  }
+  return ctrl->output;
+}
+
+static bool pid_tick(local_ctrl_t* ctrl, int32_t temp, int32_t setpoint) {
+  const int64_t duty_max_q16 = (int64_t)LOCAL_CTRL_DUTY_MAX << 16;
+  int32_t error = setpoint - temp;
+  int32_t derivative = ctrl->primed ? error - ctrl->last_error : 0;
+  ctrl->last_error = error;
+  ctrl->primed = true;
+
+  // Anti-windup: the integral stops while the output is saturated in the direction of the error,
+  // and stays within the output range
+  int64_t pd = (int64_t)ctrl->cfg.kp * error + (int64_t)ctrl->cfg.kd * derivative;
+  int64_t out = pd + ctrl->integral;
+  if (!(out >= duty_max_q16 && error > 0) && !(out <= 0 && error < 0)) {
+    ctrl->integral += (int64_t)ctrl->cfg.ki * error;
+    if (ctrl->integral < 0) {
+      ctrl->integral = 0;
+    } else if (ctrl->integral > duty_max_q16) {
+      ctrl->integral = duty_max_q16;
+    }
+    out = pd + ctrl->integral;
+  }
+  // Only pick up a new duty at the start of a window so each window is one clean on/off cycle
+  if (ctrl->phase == 0) {
+    ctrl->duty = clamp32(out >> 16, 0, LOCAL_CTRL_DUTY_MAX);
+  }
+  ctrl->output = (int32_t)ctrl->phase * LOCAL_CTRL_DUTY_MAX < ctrl->duty * ctrl->cfg.window;
+  if (++ctrl->phase >= ctrl->cfg.window) {
+    ctrl->phase = 0;
+  }
+  return ctrl->output;
+}
+
+bool local_ctrl_tick(local_ctrl_t* ctrl, int32_t temp, int32_t setpoint) {
+  if (ctrl->cfg.mode == LOCAL_CTRL_PID) {
+    return pid_tick(ctrl, temp, setpoint);
+  }
+  return hysteresis_tick(ctrl, temp, setpoint);
+}
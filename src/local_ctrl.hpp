@@ -0,0 +1,49 @@
+#pragma once
+
+#include "stdint.h"
+
+// Fallback boiler controller used while the server is unreachable.
+//
+// Temperatures are fixed point centi-degrees, PID gains are Q16.16 and the PID
+// output is a duty cycle in per-mille that is turned into on/off by time
+// proportioning over cfg.window ticks. The controller has no notion of time
+// besides the tick, so call local_ctrl_tick() at a fixed rate.
+
+#define LOCAL_CTRL_DUTY_MAX 1000
+#define LOCAL_CTRL_Q16(x) ((int32_t)((x) * 65536.0))
+
+typedef enum {
+  LOCAL_CTRL_HYSTERESIS,
+  LOCAL_CTRL_PID
+} local_ctrl_mode_t;
+
+typedef struct {
+  local_ctrl_mode_t mode;
+  int32_t hysteresis;  // Half band around the setpoint, centi-degrees
+  int32_t kp;          // Per-mille duty per centi-degree of error, Q16.16
+  int32_t ki;          // Per tick
+  int32_t kd;          // Per centi-degree change per tick
+  uint16_t window;     // Ticks per time proportioning window
+} local_ctrl_cfg_t;
+
+typedef struct {
+  local_ctrl_cfg_t cfg;
+  bool output;
+  bool primed;
+  int32_t last_error;
+  int64_t integral;    // Q16.16 per-mille
+  int32_t duty;
+  uint16_t phase;
+} local_ctrl_t;
+
+// Tuning for a room that warms by a few degrees an hour with the boiler on, at a 1 s tick.
+// src/ctrlsim checks both modes against simulated rooms.
+void local_ctrl_defaults(local_ctrl_cfg_t* cfg, local_ctrl_mode_t mode);
+
+void local_ctrl_init(local_ctrl_t* ctrl, const local_ctrl_cfg_t* cfg);
+
+// Forgets the integral and derivative history, e.g. when taking over from the server
+void local_ctrl_reset(local_ctrl_t* ctrl, bool output);
+
+// Runs one control tick and returns whether the boiler should heat
+bool local_ctrl_tick(local_ctrl_t* ctrl, int32_t temp, int32_t setpoint);
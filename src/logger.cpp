@@ -0,0 +1,206 @@
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "logger.hpp"
+
+#define LOGGER_SYNC0 0xA5
+#define LOGGER_SYNC1 0x5A
+#define LOGGER_DRAIN_PERIOD 20  // ms
+
+#define LOG_FMT(id, fmt) fmt,
+static const char* const logger_formats[] = {
+#include "log_formats.def"
+};
+#undef LOG_FMT
+
+// Bounded multi-producer queue with a sequence number per slot (Vyukov). The
+// drain task is the only consumer.
+typedef struct {
+  std::atomic<uint32_t> seq;
+  logger_record_t rec;
+} logger_slot_t;
+
+static logger_slot_t ring[LOGGER_RING_SIZE];
+static std::atomic<uint32_t> enqueue_pos(0);
+static uint32_t dequeue_pos = 0;
+static std::atomic<uint32_t> dropped(0);
+
+static_assert((LOGGER_RING_SIZE & (LOGGER_RING_SIZE - 1)) == 0, "LOGGER_RING_SIZE must be a power of two");
+
+bool logger_write(uint8_t level, uint16_t fmt, uint8_t nargs, const logger_word_t* args) {
+  uint32_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  logger_slot_t* slot;
+  for (;;) {
+    slot = &ring[pos & (LOGGER_RING_SIZE - 1)];
+    int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->rec.time = millis();
+  slot->rec.fmt = fmt;
+  slot->rec.level = level;
+  slot->rec.nargs = nargs;
+  memcpy(slot->rec.args, args, nargs * sizeof(logger_word_t));
+  slot->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+static bool logger_read(logger_record_t* rec) {
+  logger_slot_t* slot = &ring[dequeue_pos & (LOGGER_RING_SIZE - 1)];
+  if (slot->seq.load(std::memory_order_acquire) != dequeue_pos + 1) {
+    return false;
+  }
+  *rec = slot->rec;
+  slot->seq.store(dequeue_pos + LOGGER_RING_SIZE, std::memory_order_release);
+  dequeue_pos++;
+  return true;
+}
+
+uint32_t logger_dropped(void) {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+// Finds the next conversion in fmt, returns its character or 0 at the end
+static char logger_next_conv(const char** fmt, char* spec, size_t spec_size) {
+  const char* p = *fmt;
+  while (*p) {
+    if (p[0] == '%' && p[1] != '%') {
+      size_t n = 0;
+      do {
+        if (n < spec_size - 1) {
+          spec[n++] = *p;
+        }
+      } while (*p && !strchr("diuxXcsfeEgGp", *p++));
+      spec[n] = '\0';
+      *fmt = p;
+      return spec[n - 1];
+    }
+    p += (p[0] == '%') ? 2 : 1;
+  }
+  *fmt = p;
+  return 0;
+}
+
+#if LOGGER_TEXT_OUTPUT
+static float logger_float(uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static void logger_emit(const logger_record_t* rec) {
+  static const char levels[] = "-EWID";
+  char line[160];
+  int len = snprintf(line, sizeof(line), "[%lu][%c] ", (unsigned long)rec->time,
+                     levels[rec->level <= LOG_LEVEL_DEBUG ? rec->level : 0]);
+  const char* fmt = rec->fmt < LOGF_COUNT ? logger_formats[rec->fmt] : "?";
+  char spec[16];
+  for (uint8_t i = 0; len < (int)sizeof(line);) {
+    const char* start = fmt;
+    char conv = logger_next_conv(&fmt, spec, sizeof(spec));
+    // Literal text up to the conversion
+    const char* lit_end = conv ? fmt - strlen(spec) : fmt;
+    for (const char* c = start; c < lit_end && len < (int)sizeof(line) - 1; c++) {
+      line[len++] = *c;
+      if (c[0] == '%' && c[1] == '%') {
+        c++;
+      }
+    }
+    if (!conv) {
+      break;
+    }
+    uint32_t arg = i < rec->nargs ? (uint32_t)rec->args[i++] : 0;
+    int room = (int)sizeof(line) - len;
+    if (conv == 's') {
+      len += snprintf(line + len, room, spec, (const char*)rec->args[i - 1]);
+    } else if (strchr("feEgG", conv)) {
+      len += snprintf(line + len, room, spec, (double)logger_float(arg));
+    } else {
+      len += snprintf(line + len, room, spec, (unsigned)arg);
+    }
+  }
+  if (len > (int)sizeof(line) - 2) {
+    len = sizeof(line) - 2;
+  }
+  line[len++] = '\n';
+  Serial.write((const uint8_t*)line, len);
+}
+#else
+// Frame: sync, payload length, payload, checksum. The payload is the
+// timestamp, format ID, level and the arguments, with %s arguments expanded
+// to a length prefixed string.
+static void logger_emit(const logger_record_t* rec) {
+  uint8_t frame[3 + 255 + 1];
+  uint8_t* p = frame + 3;
+  memcpy(p, &rec->time, 4);
+  p += 4;
+  memcpy(p, &rec->fmt, 2);
+  p += 2;
+  *p++ = rec->level;
+
+  const char* fmt = rec->fmt < LOGF_COUNT ? logger_formats[rec->fmt] : "";
+  char spec[16];
+  for (uint8_t i = 0; i < rec->nargs; i++) {
+    char conv = logger_next_conv(&fmt, spec, sizeof(spec));
+    if (conv == 's') {
+      const char* s = (const char*)(uintptr_t)rec->args[i];
+      size_t n = s ? strnlen(s, 32) : 0;
+      *p++ = (uint8_t)n;
+      memcpy(p, s, n);
+      p += n;
+    } else {
+      uint32_t word = (uint32_t)rec->args[i];
+      memcpy(p, &word, 4);
+      p += 4;
+    }
+  }
+
+  uint8_t len = (uint8_t)(p - (frame + 3));
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < len; i++) {
+    sum += frame[3 + i];
+  }
+  frame[0] = LOGGER_SYNC0;
+  frame[1] = LOGGER_SYNC1;
+  frame[2] = len;
+  *p++ = sum;
+  Serial.write(frame, p - frame);
+}
+#endif
+
+static void logger_task(void* arg) {
+  uint32_t reported_drops = 0;
+  logger_record_t rec;
+  for (;;) {
+    while (logger_read(&rec)) {
+      logger_emit(&rec);
+    }
+    uint32_t drops = logger_dropped();
+    if (drops != reported_drops) {
+      rec.time = millis();
+      rec.fmt = LOGF_DROPPED;
+      rec.level = LOG_LEVEL_WARN;
+      rec.nargs = 1;
+      rec.args[0] = drops - reported_drops;
+      logger_emit(&rec);
+      reported_drops = drops;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOGGER_DRAIN_PERIOD));
+  }
+}
+
+void logger_begin(int core) {
+  for (uint32_t i = 0; i < LOGGER_RING_SIZE; i++) {
+    ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  xTaskCreatePinnedToCore(logger_task, "log", 3 * 1024, NULL, 1, NULL, core);
+}
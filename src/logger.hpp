@@ -0,0 +1,95 @@
+#pragma once
+
+#include "stdint.h"
+#include "string.h"
+
+// Deferred binary logging.
+//
+// LOG_E/W/I/D(ID, args...) store a fixed size record (timestamp, format ID from
+// log_formats.def and up to LOGGER_MAX_ARGS 32-bit arguments) in a lock-free
+// ring and return. A low priority task drains the ring to the serial port,
+// either as binary frames for tools/logdecode.py (LOGGER_TEXT_OUTPUT 0) or
+// formatted on the device. Records that do not fit are counted and reported.
+//
+// Levels above LOG_LEVEL compile to nothing.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOGGER_TEXT_OUTPUT
+#define LOGGER_TEXT_OUTPUT 0
+#endif
+
+#define LOGGER_MAX_ARGS 6
+#define LOGGER_RING_SIZE 128      // Records, power of two
+
+#define LOG_FMT(id, fmt) LOGF_##id,
+typedef enum {
+#include "log_formats.def"
+  LOGF_COUNT
+} logger_fmt_t;
+#undef LOG_FMT
+
+// One argument, 32 bits on the ESP32. Pointer sized so %s works in the host simulator.
+typedef uintptr_t logger_word_t;
+
+typedef struct {
+  uint32_t time;
+  uint16_t fmt;
+  uint8_t level;
+  uint8_t nargs;
+  logger_word_t args[LOGGER_MAX_ARGS];
+} logger_record_t;
+
+void logger_begin(int core);
+bool logger_write(uint8_t level, uint16_t fmt, uint8_t nargs, const logger_word_t* args);
+uint32_t logger_dropped(void);
+
+static inline logger_word_t logger_arg(int v) { return (uint32_t)v; }
+static inline logger_word_t logger_arg(unsigned v) { return v; }
+static inline logger_word_t logger_arg(long v) { return (uint32_t)v; }
+static inline logger_word_t logger_arg(unsigned long v) { return (uint32_t)v; }
+static inline logger_word_t logger_arg(bool v) { return v; }
+static inline logger_word_t logger_arg(const char* s) { return (uintptr_t)s; }
+static inline logger_word_t logger_arg(double v) {
+  float f = (float)v;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+// Only fundamental types, int32_t is int or long depending on the toolchain
+template <typename... Args>
+static inline void logger_log(uint8_t level, logger_fmt_t fmt, Args... args) {
+  static_assert(sizeof...(args) <= LOGGER_MAX_ARGS, "too many log arguments");
+  const logger_word_t argv[] = {0, logger_arg(args)...};
+  logger_write(level, fmt, sizeof...(args), argv + 1);
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(id, ...) logger_log(LOG_LEVEL_ERROR, LOGF_##id, ##__VA_ARGS__)
+#else
+#define LOG_E(id, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(id, ...) logger_log(LOG_LEVEL_WARN, LOGF_##id, ##__VA_ARGS__)
+#else
+#define LOG_W(id, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(id, ...) logger_log(LOG_LEVEL_INFO, LOGF_##id, ##__VA_ARGS__)
+#else
+#define LOG_I(id, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(id, ...) logger_log(LOG_LEVEL_DEBUG, LOGF_##id, ##__VA_ARGS__)
+#else
+#define LOG_D(id, ...) do {} while (0)
+#endif
@@ -1,501 +1,849 @@
 #include <Arduino.h>
 #include <lvgl.h>
 #include <Arduino_GFX_Library.h>
-#include "button.hpp"
-#include "mt8901.hpp"
+#include <ESPAsyncWebServer.h>
+#include "hal.hpp"
+#include "thermostat.hpp"
 #include "ui.h"
-#include <WiFi.h>
-#include <HTTPClient.h>
-
-#define GFX_BL 38
-#define BUTTON_PIN 3
-#define MOTOR_PIN 7
-#define LED_PIN 4
-#define SCREEN_TIMEOUT 60000
-#define TEMP_FETCH_INTERVAL 5000       // 5 seconds
-#define BOILER_STATUS_FETCH_INTERVAL 2000  // 2 seconds
-
-void connectWiFi(void);
-void checkWiFi(void);
+#include "ui_screens.h"
+#include "disp_flush.hpp"
+#include "pixel_kernels.hpp"
+#include "px_draw.hpp"
+#include "ota.hpp"
+#include "logger.hpp"
+#include "input_trace.hpp"
+#include "mem_pool.h"
+#include "panel.hpp"
+#include "cpu_load.hpp"
+#include "stall_mon.hpp"
+#include "deep_sleep.hpp"
+#include "asset_pack.hpp"
+#include "boot_prof.hpp"
+#include "esp_ota_ops.h"
+#include "esp32s3/rom/cache.h"
+#include "board.hpp"
+
+#define DISP_FLUSH_ASYNC 1             // Copy stripes to the panel from a task on the other core
+#define DISP_FLUSH_CORE 0
+#define PX_KERNELS_SELFTEST 0          // Check and time the pixel kernels against the reference at boot
+#define DISP_STATS_REPORT_INTERVAL 0   // Render/flush timing report period in ms, 0 disables it
+#define NUMLABEL_BENCHMARK 0           // Compare numeric display and label render times at boot
+#define LOOP_LATENCY_REPORT_INTERVAL 0 // Worst loop() time report period in ms, 0 disables it
+#define LOGGER_CORE 0                  // Core of the task that drains the log ring to the serial port
+#define INPUT_TRACE_DUMP_HOLD 3000     // Holding the button this long, or 't' on the serial port, dumps input latencies
+#define MEM_POOL_REPORT_INTERVAL 0     // LVGL heap pool and arena report period in ms, 0 disables it
+#define CPU_LOAD_REPORT_INTERVAL 0     // Per core CPU load report period in ms, 0 disables it
+#define SCREEN_REPORT_INTERVAL 0       // Screen footprint and switch time report period in ms, 0 disables it
+#define STALL_MON 1                    // Time loop() and LVGL passes, keep backtraces of stalls across reboots
+#define STALL_REPORT_INTERVAL 0        // Loop and LVGL pass time histogram report period in ms, 0 disables it
+#define DEEP_SLEEP_AFTER 0             // Deep sleep once the screen has been off this long (ms), 0 never sleeps
+#define DEEP_SLEEP_TIMER 600000        // Wake from deep sleep this often to refresh the readings
+#define DEEP_SLEEP_REFRESH 20000       // Longest a timer wake stays up waiting for both readings
+#define ASSET_PACK 1                   // Draw the large font from the asset pack (tools/build_assets.py)
+#define SCHEDULE_PAGE 1                // GET/POST the weekly schedule as text at http://<device>/schedule
+#define SCHEDULE_TEXT_SIZE 2048
+#define BOOT_NET_CORE 0                // NVS loads and WiFi association run here while setup() brings up the display
+#define BOOT_PROF_REPORT 1             // Log boot stage times once live data arrives (boot_prof.hpp)
+
+static_assert(board_t::bounce_buffer_lines == 0 || ESP_ARDUINO_VERSION_MAJOR >= 3,
+              "bounce buffers need Arduino core 3 (ESP-IDF 5)");
+
 void initScreen(void);
-void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p);
+void my_disp_draw(const lv_area_t *area, lv_color_t *color_p);
+lv_color_t *allocDrawBuf(size_t px);
 void encoder_read(lv_indev_drv_t *drv, lv_indev_data_t *data);
 void init_lv_group(void);
-void postSetTemp(float temp);
-void fetchCurrentTemp(void);
-void fetchBoilerStatus(void);
-void updateActivityTime(void);
-void checkScreenTimeout(void);
-void setScreenState(bool state);
-void buttonLoop(button_t * btn);
-
-Arduino_DataBus *bus = new Arduino_SWSPI(
-  GFX_NOT_DEFINED, /* DC */
-  21,              /* CS */
-  47,              /* SCK */
-  41,              /* MOSI */
-  GFX_NOT_DEFINED  /* MISO */
+void updateTempUI(int temp);
+void updateSetTempUI(int temp);
+void reportLoopLatency(uint32_t loopTime);
+void benchmarkNumLabel(void);
+void reportDispStats(void);
+void selftestPixelKernels(void);
+void updateStatusLabel(void);
+void reportOta(void);
+void checkInputTraceDump(void);
+void reportMemPools(void);
+void reportCpuLoad(void);
+void reportScreens(void);
+void reportStalls(void);
+void checkDeepSleep(void);
+void reportAssetPack(void);
+void beginSchedulePage(void);
+void applySchedule(void);
+void startBootNet(void);
+void joinBootNet(void);
+void reportBoot(void);
+
+// Display drivers, built from the board description at static init
+static Arduino_SWSPI bus(
+  GFX_NOT_DEFINED,   /* DC */
+  board_t::spi_cs,
+  board_t::spi_sck,
+  board_t::spi_mosi,
+  GFX_NOT_DEFINED    /* MISO */
 );
-Arduino_ESP32RGBPanel *rgbpanel = new Arduino_ESP32RGBPanel(
-  39, /* DE */
-  48, /* VSYNC */ 
-  40, /* HSYNC */ 
-  45, /* PCLK */
-  10, /* R0 */
-  16, /* R1 */ 
-  9,  /* R2 */ 
-  15, /* R3 */ 
-  46, /* R4 */
-  8,  /* G0 */ 
-  13, /* G1 */ 
-  18, /* G2 */ 
-  12, /* G3 */ 
-  11, /* G4 */ 
-  17, /* G5 */
-  47, /* B0 */ 
-  41, /* B1 */ 
-  0,  /* B2 */
-  42, /* B3 */ 
-  14, /* B4 */
-  1,  /* hsync_polarity */
-  10, /* hsync_front_porch */
-  10, /* hsync_pulse_width */
-  10, /* hsync_back_porch */
-  1,  /* vsync_polarity */
-  14, /* vsync_front_porch */
-  2,  /* vsync_pulse_width */
-  12  /* vsync_back_porch */
+static Arduino_ESP32RGBPanel rgbpanel(
+  board_t::de, board_t::vsync, board_t::hsync, board_t::pclk,
+  board_t::r0, board_t::r1, board_t::r2, board_t::r3, board_t::r4,
+  board_t::g0, board_t::g1, board_t::g2, board_t::g3, board_t::g4, board_t::g5,
+  board_t::b0, board_t::b1, board_t::b2, board_t::b3, board_t::b4,
+  board_t::hsync_polarity, board_t::hsync_front_porch, board_t::hsync_pulse_width, board_t::hsync_back_porch,
+  board_t::vsync_polarity, board_t::vsync_front_porch, board_t::vsync_pulse_width, board_t::vsync_back_porch
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ,
+  0,               /* pclk_active_neg */
+  GFX_NOT_DEFINED, /* prefer_speed */
+  false,           /* useBigEndian */
+  0,               /* de_idle_high */
+  0,               /* pclk_idle_high */
+  (size_t)board_t::width * board_t::bounce_buffer_lines /* bounce_buffer_size_px */
+#endif
 );
-
-Arduino_RGB_Display *gfx = new Arduino_RGB_Display(
-  480, /* width */
-  480, /* height */
-  rgbpanel, 
-  0, /* rotation */
+static Arduino_RGB_Display gfx(
+  board_t::width,
+  board_t::height,
+  &rgbpanel,
+  0,    /* rotation */
   true, /* auto_flush */
-  bus, 
+  &bus,
   GFX_NOT_DEFINED, /* RST */
-  st7701_type7_init_operations, 
-  sizeof(st7701_type7_init_operations)
+  board_t::panel_init,
+  board_t::panel_init_size
 );
 
-enum WiFiState {
-  WIFI_DISCONNECTED,
-  WIFI_CONNECTING,
-  WIFI_CONNECTED
-};
-
-WiFiState wifiState = WIFI_DISCONNECTED;
-unsigned long lastWiFiAttempt = 0;
-const unsigned long WIFI_RETRY_INTERVAL = 10000; 
-
 const char* ssid = "CHANGE";
 const char* password = "CHANGE";
+const char* webUser = "admin";         // /update and /schedule
+const char* webPassword = "CHANGE";
 const char* serverIP = "192.168.4.1";
+const uint16_t serverPort = 80;
+static const thermostat_cfg_t thermostatCfg = { ssid, password, serverIP, serverPort, board_t::led };
 
-
-static button_t *g_btn;
+// Draw buffers in .bss, only the PSRAM strategy takes them from the heap
+static constexpr bool drawBufStatic = board_t::draw_buf_place == DRAW_BUF_INTERNAL;
+static lv_color_t drawBufMem[drawBufStatic ? board_t::draw_buf_count : 1][drawBufStatic ? board_draw_buf_px : 1]
+  __attribute__((aligned(16)));
 static lv_color_t *disp_draw_buf;
+static lv_color_t *disp_draw_buf2;
 static lv_disp_draw_buf_t draw_buf;
 static lv_disp_drv_t disp_drv;
 static lv_group_t *lv_group;
-
-// Screen timeout in milliseconds (1 minute)
-unsigned long lastActivityTime = 0;
-bool screenOn = true;
-bool boilerStatus = false;
+static deep_sleep_wake_t bootWake;
+static const deep_sleep_pins_t deepSleepPins = { board_t::button, board_t::encoder_sig, board_t::backlight, board_t::led };
 
 void setup(void)
 {
+  boot_prof_mark(BOOT_STAGE_SETUP);
   Serial.begin(115200);
-  Serial.println("Starting system");
-  connectWiFi();
+  logger_begin(LOGGER_CORE);
+  LOG_I(BOOT);
+#if STALL_MON
+  stall_mon_begin();
+#endif
+
+  static const hal_pins_t pins = { board_t::backlight, board_t::button, board_t::encoder_sig, board_t::encoder_dir };
+  hal_begin(&pins);
+
+  // After a deep sleep the first frame shows the saved state, the network catches up behind it
+  thermostat_snapshot_t snapshot;
+  bootWake = deep_sleep_begin(&snapshot, &deepSleepPins);
+  if (bootWake != DEEP_SLEEP_COLD)
+  {
+    thermostat_restore(&snapshot, bootWake == DEEP_SLEEP_WAKE_INPUT);
+  }
+  startBootNet();
+#if ASSET_PACK
+  if (asset_pack_begin())
+  {
+    ui_font_large = asset_pack_font("montserrat_48", ui_font_large);
+  }
+#endif
   initScreen();
+  // Builds the screen without rendering it, so the first frame already has the snapshot values
   ui_init();
+  boot_prof_mark(BOOT_STAGE_UI);
+  if (bootWake != DEEP_SLEEP_COLD)
+  {
+    updateTempUI(snapshot.temp / 100);
+    updateSetTempUI(snapshot.setpoint);
+  }
+  if (bootWake != DEEP_SLEEP_WAKE_TIMER)
+  {
+    lv_refr_now(NULL);
+    boot_prof_mark(BOOT_STAGE_FIRST_FRAME);
+    deep_sleep_first_frame(bootWake);
+    // The backlight has been off since hal_begin(), it comes on a frame from now
+    panel_first_frame();
+    reportAssetPack();
+  }
 
-  // Initial data fetch
-  fetchCurrentTemp();
-  fetchBoilerStatus();
-  
-  // Initialize activity timer
-  updateActivityTime();
+  joinBootNet();
+  static const thermostat_ui_t ui = { updateTempUI, updateSetTempUI };
+  thermostat_begin(&thermostatCfg, &ui);
+
+  beginSchedulePage();
+  ota_begin(webUser, webPassword);
+#if CPU_LOAD_REPORT_INTERVAL > 0
+  cpu_load_begin();
+#endif
+
+#if NUMLABEL_BENCHMARK
+  benchmarkNumLabel();
+#endif
+#if PX_KERNELS_SELFTEST
+  selftestPixelKernels();
+#endif
 }
 
 void loop(void)
 {
-  static unsigned long lastTempFetchTime = 0, lastBoilerStatusFetchTime = 0;
+  uint32_t loopStart = micros();
+#if STALL_MON
+  stall_mon_enter(STALL_PASS_LOOP);
+  stall_mon_enter(STALL_PASS_LVGL);
+#endif
+  stall_mon_step(STALL_STEP_RENDER);
   
-  // Handle LVGL tasks
+  // Handle LVGL tasks, the encoder is read from here
   lv_timer_handler();
+#if STALL_MON
+  stall_mon_exit(STALL_PASS_LVGL);
+#endif
   
-  // Check WiFi connection
-  checkWiFi();
-  
-  // Check for screen timeout
-  checkScreenTimeout();
-  
-  buttonLoop(g_btn);
-  // Periodically fetch temperature
-  unsigned long currentMillis = millis();
-  if (currentMillis - lastTempFetchTime >= TEMP_FETCH_INTERVAL) {
-    lastTempFetchTime = currentMillis;
-    fetchCurrentTemp();
-  }
-  
-  // Periodically fetch boiler status
-  if (currentMillis - lastBoilerStatusFetchTime >= BOILER_STATUS_FETCH_INTERVAL) {
-    lastBoilerStatusFetchTime = currentMillis;
-    fetchBoilerStatus();
-  }
+  // WiFi, screen timeout, polling and local control
+  thermostat_loop();
+  applySchedule();
+  stall_mon_step(STALL_STEP_PANEL);
+  panel_loop();
+
+  stall_mon_step(STALL_STEP_REPORT);
+  reportDispStats();
+  reportMemPools();
+  reportCpuLoad();
+  reportScreens();
+  reportStalls();
+  reportBoot();
+  stall_mon_step(STALL_STEP_RENDER);
+  ui_screens_idle();
+  checkInputTraceDump();
+  // A freshly updated image is confirmed once loop() runs and both endpoints answered it
+  stall_mon_step(STALL_STEP_OTA);
+  thermostat_status_t status;
+  thermostat_get_status(&status);
+  ota_health_check(status.temp_time != 0 && status.boiler_time != 0, status.wifi == WIFI_CONNECTED);
+  reportOta();
+  updateStatusLabel();
+
+  uint32_t loopTime = micros() - loopStart;
+  ota_loop(loopTime);
+  reportLoopLatency(loopTime);
+  checkDeepSleep();
+#if STALL_MON
+  stall_mon_step(STALL_STEP_IDLE);
+  stall_mon_exit(STALL_PASS_LOOP);
+#endif
 }
 
-void checkWiFi(void)
+// Report a finished update with its duration and the worst UI stall during the download
+void reportOta(void)
 {
-  unsigned long currentMillis = millis();
-  
-  switch (wifiState) {
-    case WIFI_DISCONNECTED:
-      // Try to connect if enough time has passed since last attempt
-      if (currentMillis - lastWiFiAttempt >= WIFI_RETRY_INTERVAL) {
-        connectWiFi();
-      }
-      break;
-      
-    case WIFI_CONNECTING:
-      // Check if connected
-      if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("Connected to WiFi");
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
-        wifiState = WIFI_CONNECTED;
-      } 
-      // Check for timeout (5 seconds)
-      else if (currentMillis - lastWiFiAttempt >= 5000) {
-        Serial.println("WiFi connection attempt timed out");
-        wifiState = WIFI_DISCONNECTED;
-        WiFi.disconnect();
-      }
-      break;
-      
-    case WIFI_CONNECTED:
-      // Check if we've lost connection
-      if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("WiFi connection lost");
-        wifiState = WIFI_DISCONNECTED;
-        WiFi.disconnect();
-      }
-      break;
+  static bool reported = false;
+  ota_status_t status;
+  ota_get_status(&status);
+  if (!status.done)
+  {
+    reported = false;
+    return;
+  }
+  if (!reported)
+  {
+    LOG_I(OTA_DONE, status.success ? "done" : "failed", status.progress, status.duration, status.worst_loop_us);
+    reported = true;
   }
 }
 
-void connectWiFi(void)
+// Input-to-photon latency percentiles per stage, on a long button press or 't' from the serial port
+void checkInputTraceDump(void)
 {
-  if (wifiState == WIFI_CONNECTING) {
-    // Already trying to connect
+  static bool held = false;
+  bool request = false;
+  if (hal_button_held() >= INPUT_TRACE_DUMP_HOLD)
+  {
+    request = !held;
+    held = true;
+  }
+  else if (hal_button_held() == 0)
+  {
+    held = false;
+  }
+  while (Serial.available())
+  {
+    request |= Serial.read() == 't';
+  }
+  if (!request)
+  {
     return;
   }
 
-  Serial.println("Starting WiFi connection...");
-  WiFi.begin(ssid, password);
-  wifiState = WIFI_CONNECTING;
-  lastWiFiAttempt = millis();
+  for (int i = 0; i < INPUT_TRACE_STAGE_COUNT; i++)
+  {
+    input_trace_pct_t pct;
+    input_trace_get((input_trace_stage_t)i, &pct);
+    LOG_I(TRACE_STAGE, input_trace_stage_str((input_trace_stage_t)i), pct.count, pct.p50, pct.p90, pct.p99, pct.max);
+  }
+  input_trace_counts_t counts;
+  input_trace_get_counts(&counts);
+  LOG_I(TRACE_COUNTS, counts.events[INPUT_TRACE_ENCODER], counts.events[INPUT_TRACE_BUTTON], counts.coalesced,
+        counts.abandoned);
 }
 
-void initScreen(void)
+// Status line under the readouts: update progress first, then the server state
+void updateStatusLabel(void)
 {
-  gfx->begin();
-  gfx->fillScreen(BLACK);
-
-  pinMode(GFX_BL, OUTPUT);// turns on the screen
-  digitalWrite(GFX_BL, HIGH);
-  pinMode(MOTOR_PIN, OUTPUT);// setup motor's pin
-  pinMode(LED_PIN, OUTPUT);// turns on the screen
-  digitalWrite(LED_PIN, LOW);
-  // Hardware Button
-  g_btn = button_attch(BUTTON_PIN, 0, 10);
-  // Magnetic Encoder
-  mt8901_init(5, 6);
+  static char lastText[32] = "";
+  char text[32] = "";
+  ota_status_t status;
+  ota_get_status(&status);
+  thermostat_status_t thermostat;
+  thermostat_get_status(&thermostat);
+  if (status.active)
+  {
+    snprintf(text, sizeof(text), LV_SYMBOL_DOWNLOAD " Updating %lu%%",
+             (unsigned long)(status.total ? (uint64_t)status.progress * 100 / status.total : 0));
+  }
+  else if (thermostat.server_degraded)
+  {
+    snprintf(text, sizeof(text), LV_SYMBOL_WARNING " Server offline");
+  }
 
-  lv_init();
-  // Must to use PSRAM
-  disp_draw_buf = (lv_color_t *)heap_caps_malloc(sizeof(lv_color_t) * gfx->width() * 32, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-  if(!disp_draw_buf) 
+  if (ui_LabelStatus == NULL || strcmp(text, lastText) == 0)
   {
-        Serial.println("LVGL disp_draw_buf allocation failed!");
-  } 
-  else 
+    return;
+  }
+  strcpy(lastText, text);
+  if (text[0])
   {
-    lv_disp_draw_buf_init(&draw_buf, disp_draw_buf, NULL, gfx->width() * 32);
-    /* Initialize the display */
-    lv_disp_drv_init(&disp_drv);
-    
-    disp_drv.hor_res = gfx->width();
-    disp_drv.ver_res = gfx->height();
-    disp_drv.flush_cb = my_disp_flush;
-    disp_drv.draw_buf = &draw_buf;
-    lv_disp_drv_register(&disp_drv);
-   
-    /* Initialize the input device driver */
-    static lv_indev_drv_t indev_drv;
-    lv_indev_drv_init(&indev_drv);
-    indev_drv.read_cb = encoder_read;
-    indev_drv.type = LV_INDEV_TYPE_ENCODER;
-    lv_indev_drv_register(&indev_drv);
-    init_lv_group();
+    lv_label_set_text(ui_LabelStatus, text);
+    lv_obj_clear_flag(ui_LabelStatus, LV_OBJ_FLAG_HIDDEN);
+  }
+  else
+  {
+    lv_obj_add_flag(ui_LabelStatus, LV_OBJ_FLAG_HIDDEN);
   }
-  gfx->fillScreen(BLACK);
-  Serial.println("Screen started");
 }
 
-/* Display flushing */
-void my_disp_flush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *color_p) 
+// Render and flush timing, to tune stripe height and buffer placement
+void reportDispStats(void)
 {
-  uint32_t w = (area->x2 - area->x1 + 1);
-  uint32_t h = (area->y2 - area->y1 + 1);
-
-#if (LV_COLOR_16_SWAP != 0)
-  gfx->draw16bitBeRGBBitmap(area->x1, area->y1, (uint16_t *)&color_p->full, w, h);
-#else
-  gfx->draw16bitRGBBitmap(area->x1, area->y1, (uint16_t *)&color_p->full, w, h);
+#if DISP_STATS_REPORT_INTERVAL > 0
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport < DISP_STATS_REPORT_INTERVAL)
+  {
+    return;
+  }
+  lastReport = millis();
+
+  disp_flush_stats_t stats;
+  disp_flush_get_stats(&stats, true);
+  LOG_I(DISP_STATS, (unsigned)stats.frames, (unsigned)stats.render_ms_total, (unsigned)stats.rendered_px,
+        (unsigned)stats.flushes, (unsigned)(stats.flushes ? stats.flush_us_total / stats.flushes : 0),
+        (unsigned)stats.flush_us_max);
+  LOG_I(DISP_CONFIG, (int)board_t::draw_buf_lines, disp_draw_buf2 ? "double" : "single",
+        drawBufStatic ? "internal RAM" : "PSRAM");
 #endif
-
-  lv_disp_flush_ready(disp);
 }
 
-// read encoder
-void encoder_read(lv_indev_drv_t *drv, lv_indev_data_t *data)
+// LVGL heap usage per size class and for the PSRAM arena, to size the pools
+void reportMemPools(void)
 {
-  int16_t count_temp;
-  static int16_t count_temp_last = 0;
-  static int16_t temp_lvgl = DEFAULT_TEMP;
+#if MEM_POOL_REPORT_INTERVAL > 0
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport < MEM_POOL_REPORT_INTERVAL)
+  {
+    return;
+  }
+  lastReport = millis();
 
-  count_temp = mt8901_get_count();
-  
-  if (count_temp != count_temp_last)
+  for (int i = 0; i < mem_pool_count(); i++)
   {
-    // Update activity time when encoder is rotated
-    updateActivityTime();
-    
-    // Turn on screen if it was off
-    if (!screenOn)
+    mem_pool_stats_t stats;
+    mem_pool_get_stats(i, &stats);
+    if (stats.block_size)
     {
-      setScreenState(true);
-    }
-    
-    int16_t dif_temp = count_temp_last - count_temp;
-    //Serial.printf( "\nTemp lvgl : %02d\n" , temp_lvgl);
-    //Serial.printf("dif temp : %02d. count temp : %02d\n", dif_temp, count_temp);
-    temp_lvgl = min<int>(max<int>(temp_lvgl + dif_temp, MIN_TEMP), MAX_TEMP);//
-    //Serial.printf( "Temp lvgl : %02d\n" , temp_lvgl);
-    lv_arc_set_value(ui_ArcSetTemp , temp_lvgl);
-    lv_label_set_text_fmt (ui_LabelSetTemp, "Set: %02d", temp_lvgl);
-
-    //Set shorter arc to the front
-    if (lv_arc_get_value(ui_ArcSetTemp) >= lv_arc_get_value(ui_ArcTemp))
-    {
-      lv_obj_move_foreground(ui_ArcTemp);
+      LOG_I(MEM_POOL, stats.block_size, stats.used, stats.capacity, stats.peak, stats.failed, stats.frag_pct);
     }
     else
     {
-      lv_obj_move_foreground(ui_ArcSetTemp);
+      LOG_I(MEM_ARENA, stats.used, stats.capacity, stats.peak, stats.largest_free, stats.frag_pct, stats.failed);
     }
-    count_temp_last = count_temp;
-    // Send new temperature to server
-    postSetTemp((float)temp_lvgl);
   }
+#endif
 }
 
-// Button callback function
-void buttonLoop(button_t * btn)
+// CPU load per core, interrupt time included, to compare the direct and bounce buffer scan-out
+void reportCpuLoad(void)
 {
-  if(button_wasPressed(btn))
+#if CPU_LOAD_REPORT_INTERVAL > 0
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport < CPU_LOAD_REPORT_INTERVAL)
   {
-    // Update activity time when button is pressed
-    updateActivityTime();
-    
-    // Turn on screen if it was off
-    if (!screenOn)
-    {
-      setScreenState(true);
-    }
+    return;
   }
+  lastReport = millis();
+  LOG_I(CPU_LOAD, cpu_load_sample(0), cpu_load_sample(1), board_t::bounce_buffer_lines);
+#endif
 }
 
-// Starts LVGL group
-void init_lv_group(void)
+// LVGL heap footprint, build and switch time of each screen built so far
+void reportScreens(void)
 {
-  lv_group = lv_group_create();
-  lv_group_set_default(lv_group);
-  lv_indev_t *cur_drv = NULL;
-  while ((cur_drv = lv_indev_get_next(cur_drv)))
+#if SCREEN_REPORT_INTERVAL > 0
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport < SCREEN_REPORT_INTERVAL)
   {
-    if (cur_drv->driver->type == LV_INDEV_TYPE_ENCODER)
+    return;
+  }
+  lastReport = millis();
+
+  for (int i = 0; i < UI_SCREEN_COUNT; i++)
+  {
+    ui_screen_stats_t stats;
+    ui_screens_get_stats((ui_screen_id_t)i, &stats);
+    if (stats.builds)
     {
-      lv_indev_set_group(cur_drv, lv_group);
+      LOG_I(SCREEN_STATS, ui_screens_name((ui_screen_id_t)i), stats.footprint, stats.builds, stats.build_us,
+            stats.last_switch_us, stats.max_switch_us);
     }
   }
+#endif
+}
+
+// Boot stage times, once the first reading arrived (or it timed out). The version tells releases apart.
+void reportBoot(void)
+{
+#if BOOT_PROF_REPORT
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  const esp_app_desc_t *app = esp_app_get_description();
+#else
+  const esp_app_desc_t *app = esp_ota_get_app_description();
+#endif
+  boot_prof_report(app->version);
+#endif
+}
+
+static SemaphoreHandle_t bootNetDone = NULL;
+
+void bootNetTask(void *arg)
+{
+  boot_prof_mark(BOOT_STAGE_NET_START);
+  thermostat_begin_net(&thermostatCfg);
+  xSemaphoreGive(bootNetDone);
+  vTaskDelete(NULL);
 }
 
-// Send temperature setting to server
-void postSetTemp(float temp) 
+// Settings from NVS and the first WiFi.begin(), which brings up the WiFi driver, on the other core while this
+// one initialises the panel and renders the first frame. The first fetch goes out from loop() once WiFi is up.
+void startBootNet(void)
 {
-  if (wifiState != WIFI_CONNECTED)
+  bootNetDone = xSemaphoreCreateBinary();
+  if (bootNetDone &&
+      xTaskCreatePinnedToCore(bootNetTask, "boot_net", 8 * 1024, NULL, 1, NULL, BOOT_NET_CORE) == pdPASS)
   {
-    Serial.println("WiFi not connected. Cannot post temperature.");
     return;
   }
+  // thermostat_begin() starts the network itself
+  LOG_W(BOOT_NET_TASK_FAILED);
+  if (bootNetDone)
+  {
+    vSemaphoreDelete(bootNetDone);
+    bootNetDone = NULL;
+  }
+}
 
-  WiFiClient client;
-  HTTPClient http;
-  char serverName[50];
-  snprintf(serverName, sizeof(serverName), "http://%s/setTemp", serverIP);
-  http.begin(client, serverName);
-  http.addHeader("Content-Type", "application/x-www-form-urlencoded");
-
-  String postData = "value=" + String(temp);
-  int httpResponseCode = http.POST(postData);
+void joinBootNet(void)
+{
+  if (bootNetDone)
+  {
+    xSemaphoreTake(bootNetDone, portMAX_DELAY);
+    vSemaphoreDelete(bootNetDone);
+    bootNetDone = NULL;
+  }
+  boot_prof_mark(BOOT_STAGE_JOIN);
+}
 
-  if (httpResponseCode > 0) 
+// Loop and LVGL pass time distribution, the stalls themselves are logged as they happen
+void reportStalls(void)
+{
+#if STALL_MON && STALL_REPORT_INTERVAL > 0
+  static unsigned long lastReport = 0;
+  if (millis() - lastReport < STALL_REPORT_INTERVAL)
   {
-    Serial.print("POST response: ");
-    Serial.println(http.getString());
+    return;
   }
-  else
+  lastReport = millis();
+
+  for (int i = 0; i < STALL_PASS_COUNT; i++)
   {
-    Serial.print("POST error code: ");
-    Serial.println(httpResponseCode);
+    stall_hist_t hist;
+    stall_mon_get_hist((stall_pass_t)i, &hist, true);
+    LOG_I(STALL_HIST, stall_mon_pass_str(i), hist.passes, hist.stalls, hist.max_us, stall_mon_hist_pct(&hist, 50),
+          stall_mon_hist_pct(&hist, 99));
   }
-  
-  http.end();
+#endif
+}
+
+// Glyphs inflated for the first frame and what they cost
+void reportAssetPack(void)
+{
+#if ASSET_PACK
+  asset_pack_stats_t stats;
+  asset_pack_get_stats(&stats, false);
+  LOG_I(ASSET_CACHE, stats.hits, stats.misses, stats.misses ? stats.inflate_us_total / stats.misses : 0,
+        stats.inflate_us_max);
+#endif
 }
 
-// Fetch current temperature from server
-void fetchCurrentTemp(void)
+#if SCHEDULE_PAGE
+static char scheduleText[SCHEDULE_TEXT_SIZE];  // Table as GET returns it, refreshed from loop()
+static SemaphoreHandle_t scheduleTextLock = NULL;
+static QueueHandle_t scheduleQueue = NULL;     // One checked table at a time, loop() frees it once applied
+#endif
+
+// The web server runs on its own task. A POST body goes into a buffer of its own request, is parsed
+// there and only a valid table is handed to loop() to apply.
+void beginSchedulePage(void)
 {
-  static float lastFetchTemp = DEFAULT_TEMP;
-  float temp = lastFetchTemp;
-  if (wifiState  != WIFI_CONNECTED)
+#if SCHEDULE_PAGE
+  scheduleTextLock = xSemaphoreCreateMutex();
+  scheduleQueue = xQueueCreate(1, sizeof(char *));
+  thermostat_get_schedule(scheduleText, sizeof(scheduleText));
+  AsyncWebServer *server = ota_web_server();
+  server->on("/schedule", HTTP_GET, [](AsyncWebServerRequest *request)
   {
-    Serial.println("WiFi not connected. Cannot fetch temperature.");
-  }
-  else
+    if (!ota_authenticated(request))
+    {
+      return request->requestAuthentication();
+    }
+    xSemaphoreTake(scheduleTextLock, portMAX_DELAY);
+    request->send(200, "text/plain", scheduleText);
+    xSemaphoreGive(scheduleTextLock);
+  });
+  server->on("/schedule", HTTP_POST, [](AsyncWebServerRequest *request)
   {
-    WiFiClient client;
-    HTTPClient http;
-    char serverName[50];
-    // Add "?plain" to the URL to get plain text response
-    snprintf(serverName, sizeof(serverName), "http://%s/Temp?plain", serverIP);
-    http.begin(client, serverName);
-  
-    int httpResponseCode = http.GET();
-    
-    if (httpResponseCode > 0) 
+    if (!ota_authenticated(request))
     {
-      String response = http.getString();
-      Serial.print("Temperature from server: ");
-      Serial.println(response);
-      
-      // Parse the temperature value
-      temp = response.toFloat();
-      
+      return request->requestAuthentication();
     }
-    else
+    if (request->contentLength() >= SCHEDULE_TEXT_SIZE)
     {
-      Serial.print("GET temperature error code: ");
-      Serial.println(httpResponseCode);
+      return request->send(413, "text/plain", "too long\n");
     }
-    
-    http.end();
+    char *text = (char *)request->_tempObject;
+    if (!text || !thermostat_check_schedule(text))
+    {
+      return request->send(400, "text/plain", "invalid schedule\n");
+    }
+    if (xQueueSend(scheduleQueue, &text, 0) != pdTRUE)
+    {
+      return request->send(503, "text/plain", "busy, retry\n");
+    }
+    // loop() owns the buffer now, the request must not free it
+    request->_tempObject = NULL;
+    request->send(202, "text/plain", "accepted\n");
+  }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+  {
+    if (total >= SCHEDULE_TEXT_SIZE || !ota_authenticated(request))
+    {
+      return;
+    }
+    // Freed with the request unless handed to loop()
+    if (index == 0)
+    {
+      request->_tempObject = malloc(total + 1);
+    }
+    char *text = (char *)request->_tempObject;
+    if (!text)
+    {
+      return;
+    }
+    memcpy(text + index, data, len);
+    if (index + len == total)
+    {
+      text[total] = '\0';
+    }
+  });
+#endif
+}
+
+void applySchedule(void)
+{
+#if SCHEDULE_PAGE
+  char *text;
+  if (xQueueReceive(scheduleQueue, &text, 0) != pdTRUE)
+  {
+    return;
   }
-  // Update UI with current temperature
-  lv_label_set_text_fmt(ui_LabelTemp, "Temp: %02d", (int)temp);
-  lv_arc_set_value(ui_ArcTemp, (int)temp);
-  
-  // Set shorter arc to the front
-  if (lv_arc_get_value(ui_ArcSetTemp) >= lv_arc_get_value(ui_ArcTemp))
+  thermostat_set_schedule(text);
+  free(text);
+  xSemaphoreTake(scheduleTextLock, portMAX_DELAY);
+  thermostat_get_schedule(scheduleText, sizeof(scheduleText));
+  xSemaphoreGive(scheduleTextLock);
+#endif
+}
+
+// Deep sleep once the screen has been off for a while and nothing is in progress. A timer wake
+// goes back to sleep as soon as both readings are in, unless the boiler turned the screen on.
+void checkDeepSleep(void)
+{
+#if DEEP_SLEEP_AFTER > 0
+  static unsigned long offSince = 0;
+  static bool timerWake = bootWake == DEEP_SLEEP_WAKE_TIMER;
+  thermostat_status_t status;
+  thermostat_get_status(&status);
+  ota_status_t ota;
+  ota_get_status(&ota);
+  if (status.screen_on || status.boiler_on || status.setpoint_pending || status.local_control || ota.active ||
+      ota.pending)
   {
-    lv_obj_move_foreground(ui_ArcTemp);
+    offSince = 0;
+    timerWake = false;
+    return;
   }
-  else
+  if (!offSince)
   {
-    lv_obj_move_foreground(ui_ArcSetTemp);
+    offSince = millis();
   }
-  lastFetchTemp = temp;
+  bool refreshed = status.temp_time && status.boiler_time;
+  if (timerWake ? !refreshed && millis() - offSince < DEEP_SLEEP_REFRESH : millis() - offSince < DEEP_SLEEP_AFTER)
+  {
+    return;
+  }
+
+  thermostat_snapshot_t snapshot;
+  thermostat_save(&snapshot);
+  deep_sleep_enter(&snapshot, &deepSleepPins, DEEP_SLEEP_TIMER);
+#endif
 }
 
-// Fetch boiler status from server
-void fetchBoilerStatus(void)
+// Track the worst loop() iteration, used to benchmark stalls with the server down
+void reportLoopLatency(uint32_t loopTime)
 {
-  if (wifiState != WIFI_CONNECTED)
+#if LOOP_LATENCY_REPORT_INTERVAL > 0
+  static uint32_t worstLoopTime = 0, loopCount = 0;
+  static unsigned long lastReport = 0;
+
+  loopCount++;
+  if (loopTime > worstLoopTime)
   {
-    Serial.println("WiFi not connected. Cannot fetch boiler status.");
-    return;
+    worstLoopTime = loopTime;
+  }
+  if (millis() - lastReport >= LOOP_LATENCY_REPORT_INTERVAL)
+  {
+    LOG_I(LOOP_LATENCY, worstLoopTime, loopCount);
+    lastReport = millis();
+    worstLoopTime = 0;
+    loopCount = 0;
   }
+#else
+  (void)loopTime;
+#endif
+}
 
-  WiFiClient client;
-  HTTPClient http;
-  char serverName[50];
-  snprintf(serverName, sizeof(serverName), "http://%s/boilerStatus?plain", serverIP);
-  http.begin(client, serverName);
-  
-  int httpResponseCode = http.GET();
-  
-  if (httpResponseCode > 0) 
+// Time value updates rendered and flushed through a montserrat 48 label and through the glyph atlas display
+void benchmarkNumLabel(void)
+{
+  const int rounds = 50;
+  lv_obj_t *label = lv_label_create(ui_ScreenPlay);
+  lv_obj_set_style_text_font(label, ui_font_large, LV_PART_MAIN | LV_STATE_DEFAULT);
+  lv_obj_set_style_text_color(label, lv_color_hex(0x007BFF), LV_PART_MAIN | LV_STATE_DEFAULT);
+  lv_obj_align_to(label, ui_NumTemp, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 10);
+  lv_refr_now(NULL);
+
+  uint32_t start = micros();
+  for (int i = 0; i < rounds; i++)
   {
-    String response = http.getString();
-    Serial.print("Boiler status from server: ");
-    Serial.println(response);
-    
-    // Parse the boiler status (true/false)
-    response.toLowerCase();
-    bool newBoilerStatus = (response == "true" || response == "1");
+    lv_label_set_text_fmt(label, "%02d°C", 10 + i);
+    lv_refr_now(NULL);
+  }
+  uint32_t labelTime = micros() - start;
+  lv_obj_del(label);
+  lv_refr_now(NULL);
+
+  start = micros();
+  for (int i = 0; i < rounds; i++)
+  {
+    ui_numlabel_set_value(ui_NumTemp, 10 + i);
+    lv_refr_now(NULL);
+  }
+  uint32_t numTime = micros() - start;
+  ui_numlabel_set_value(ui_NumTemp, DEFAULT_TEMP);
+
+  LOG_I(NUMLABEL_BENCH, (unsigned)(labelTime / rounds), (unsigned)(numTime / rounds), rounds);
+}
+
+void initScreen(void)
+{
+  gfx.begin();
+  gfx.fillScreen(BLACK);
+  static const panel_spi_pins_t panelPins = { board_t::spi_sck, board_t::spi_mosi, board_t::spi_sck_data_bit,
+                                              board_t::spi_mosi_data_bit };
+  panel_attach(&bus, &panelPins);
+
+  // Backlight, button and encoder are set up by hal_begin()
+  pinMode(board_t::motor, OUTPUT);// setup motor's pin
+
+  lv_init();
+  if (drawBufStatic)
+  {
+    disp_draw_buf = drawBufMem[0];
+    disp_draw_buf2 = board_t::draw_buf_count > 1 ? drawBufMem[board_t::draw_buf_count - 1] : NULL;
+  }
+  else
+  {
+    disp_draw_buf = allocDrawBuf(board_draw_buf_px);
+    disp_draw_buf2 = board_t::draw_buf_count > 1 ? allocDrawBuf(board_draw_buf_px) : NULL;
+    if (board_t::draw_buf_count > 1 && !disp_draw_buf2)
+    {
+      LOG_W(DRAW_BUF2_FAILED);
+    }
+  }
+  if(!disp_draw_buf) 
+  {
+        LOG_E(DRAW_BUF_FAILED);
+  } 
+  else 
+  {
+    lv_disp_draw_buf_init(&draw_buf, disp_draw_buf, disp_draw_buf2, board_draw_buf_px);
+    /* Initialize the display */
+    lv_disp_drv_init(&disp_drv);
     
-    // Only process changes in status
-    if (boilerStatus != newBoilerStatus)
+    disp_drv.hor_res = board_t::width;
+    disp_drv.ver_res = board_t::height;
+    if (!disp_flush_init(&disp_drv, my_disp_draw, DISP_FLUSH_ASYNC, DISP_FLUSH_CORE))
     {
-      boilerStatus = newBoilerStatus;
-      
-      // Turn on screen if boiler is active
-      if (boilerStatus && !screenOn)
-      {
-        setScreenState(true);
-        updateActivityTime(); // Reset the screen timeout
-      }
+      LOG_W(FLUSH_TASK_FAILED);
     }
+    px_draw_install(&disp_drv);
+    disp_drv.draw_buf = &draw_buf;
+    lv_disp_drv_register(&disp_drv);
+   
+    /* Initialize the input device driver */
+    static lv_indev_drv_t indev_drv;
+    lv_indev_drv_init(&indev_drv);
+    indev_drv.read_cb = encoder_read;
+    indev_drv.type = LV_INDEV_TYPE_ENCODER;
+    lv_indev_drv_register(&indev_drv);
+    init_lv_group();
   }
-  else
+  gfx.fillScreen(BLACK);
+  boot_prof_mark(BOOT_STAGE_PANEL);
+  LOG_I(SCREEN_STARTED);
+}
+
+// Draw buffers of the PSRAM strategy
+lv_color_t *allocDrawBuf(size_t px)
+{
+  return (lv_color_t *)heap_caps_malloc(sizeof(lv_color_t) * px, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+/* Copy a rendered stripe to the panel, completion is signalled by disp_flush */
+void my_disp_draw(const lv_area_t *area, lv_color_t *color_p) 
+{
+  uint32_t w = (area->x2 - area->x1 + 1);
+  uint32_t h = (area->y2 - area->y1 + 1);
+
+  // Rotation is 0, rows go straight into the panel framebuffer
+  uint16_t *fb = gfx.getFramebuffer() + area->y1 * board_t::width + area->x1;
+  uint16_t *src = (uint16_t *)&color_p->full;
+  for (uint32_t y = 0; y < h; y++)
   {
-    Serial.print("GET boiler status error code: ");
-    Serial.println(httpResponseCode);
+#if (LV_COLOR_16_SWAP != 0)
+    px_swap_copy(fb + y * board_t::width, src + y * w, w);
+#else
+    memcpy(fb + y * board_t::width, src + y * w, w * sizeof(uint16_t));
+#endif
+  }
+  // The panel DMA reads PSRAM, push the written lines out of the cache. The bounce buffers are filled
+  // by the CPU through the cache, they need no write back
+  if (board_t::bounce_buffer_lines == 0)
+  {
+    Cache_WriteBack_Addr((uint32_t)fb, ((h - 1) * board_t::width + w) * sizeof(uint16_t));
   }
-  
-  http.end();
 }
 
-// Update the last activity timestamp
-void updateActivityTime(void)
+// Compare the selected pixel kernels with the scalar reference on a stripe sized buffer
+void selftestPixelKernels(void)
 {
-  lastActivityTime = millis();
+  size_t n = board_draw_buf_px;
+  uint16_t *a = (uint16_t *)heap_caps_malloc(n * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  uint16_t *b = (uint16_t *)heap_caps_malloc(n * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  uint16_t *src = (uint16_t *)heap_caps_malloc(n * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (a && b && src)
+  {
+    px_selftest_t result;
+    px_kernels_selftest(&result, a, b, src, n);
+    LOG_I(PX_SELFTEST, PX_KERNELS_VARIANT, result.exact ? "bit exact" : "MISMATCH", (unsigned)result.pixels);
+    LOG_I(PX_TIMINGS, (unsigned)result.swap_copy_us[0], (unsigned)result.swap_copy_us[1], (unsigned)result.fill_us[0],
+          (unsigned)result.fill_us[1], (unsigned)result.blend_us[0]);
+    LOG_I(PX_BLEND_TIMINGS, (unsigned)result.blend_us[0], (unsigned)result.blend_us[1],
+          (unsigned)result.blend_mask_us[0], (unsigned)result.blend_mask_us[1]);
+  }
+  free(a);
+  free(b);
+  free(src);
 }
 
-// Check if screen should time out
-void checkScreenTimeout(void)
+// read encoder, the thermostat turns count changes into setpoint steps
+void encoder_read(lv_indev_drv_t *drv, lv_indev_data_t *data)
 {
-  if (screenOn && !boilerStatus)
+  thermostat_encoder(hal_encoder_count());
+}
+
+// Starts LVGL group
+void init_lv_group(void)
+{
+  lv_group = lv_group_create();
+  lv_group_set_default(lv_group);
+  lv_indev_t *cur_drv = NULL;
+  while ((cur_drv = lv_indev_get_next(cur_drv)))
   {
-    // Only check timeout if screen is on and boiler is not active
-    if ((millis() - lastActivityTime) > SCREEN_TIMEOUT)
+    if (cur_drv->driver->type == LV_INDEV_TYPE_ENCODER)
     {
-      setScreenState(false);
+      lv_indev_set_group(cur_drv, lv_group);
     }
   }
 }
 
-// Control screen power state
-void setScreenState(bool state)
+// Update UI with current temperature
+void updateTempUI(int temp)
 {
-  screenOn = state;
-  digitalWrite(GFX_BL, state ? HIGH : LOW);
-  Serial.print("Screen turned ");
-  Serial.println(state ? "ON" : "OFF");
+  ui_numlabel_set_value(ui_NumTemp, temp);
+  lv_arc_set_value(ui_ArcTemp, temp);
+  
+  // Set shorter arc to the front
+  if (lv_arc_get_value(ui_ArcSetTemp) >= lv_arc_get_value(ui_ArcTemp))
+  {
+    lv_obj_move_foreground(ui_ArcTemp);
+  }
+  else
+  {
+    lv_obj_move_foreground(ui_ArcSetTemp);
+  }
+}
+
+// Update UI with a new setpoint from the knob
+void updateSetTempUI(int temp)
+{
+  lv_arc_set_value(ui_ArcSetTemp, temp);
+  ui_numlabel_set_value(ui_NumSetTemp, temp);
+
+  // Set shorter arc to the front
+  if (lv_arc_get_value(ui_ArcSetTemp) >= lv_arc_get_value(ui_ArcTemp))
+  {
+    lv_obj_move_foreground(ui_ArcTemp);
+  }
+  else
+  {
+    lv_obj_move_foreground(ui_ArcSetTemp);
+  }
 }
@@ -0,0 +1,391 @@
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "logger.hpp"
+#include "mem_pool.h"
+
+#define POOL_ALIGN 8
+
+// TLSF: the first level splits sizes by power of two, the second level splits
+// each power of two into 16 lists. Below 128 bytes the lists step by 8 bytes.
+#define TLSF_SL_BITS 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_BITS)
+#define TLSF_FL_SHIFT (TLSF_SL_BITS + 3)
+#define TLSF_SMALL (1u << TLSF_FL_SHIFT)
+#define TLSF_FL_MAX 25  // Blocks below 32 MB
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+typedef struct pool_free {
+  struct pool_free* next;
+} pool_free_t;
+
+typedef struct {
+  uint8_t* start;
+  uint8_t* end;
+  pool_free_t* free_list;
+  uint64_t requested;     // Sum of the request sizes, for the fill ratio
+  mem_pool_stats_t stats;
+} pool_class_t;
+
+// Every arena block knows its physical neighbours, free blocks are also on a
+// segregated list. The last block is a zero sized used sentinel.
+typedef struct tlsf_block {
+  struct tlsf_block* prev_phys;
+  uint32_t size;                  // Payload bytes, bit 0 set while free
+  struct tlsf_block* next_free;   // Free blocks only, overlaps the payload
+  struct tlsf_block* prev_free;
+} tlsf_block_t;
+
+#define TLSF_HDR ((uint32_t)((offsetof(tlsf_block_t, next_free) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1)))
+#define TLSF_MIN_PAYLOAD ((uint32_t)((sizeof(tlsf_block_t) - TLSF_HDR + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1)))
+
+static const uint16_t class_size[] = MEM_POOL_CLASSES;
+static const uint16_t class_blocks[] = MEM_POOL_CLASS_BLOCKS;
+#define POOL_CLASS_COUNT ((int)(sizeof(class_size) / sizeof(class_size[0])))
+
+static bool pool_ready = false;
+static pool_class_t classes[POOL_CLASS_COUNT];
+
+static struct {
+  tlsf_block_t* first;
+  uint32_t fl_map;
+  uint32_t sl_map[TLSF_FL_COUNT];
+  tlsf_block_t* heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+  mem_pool_stats_t stats;
+} arena;
+
+static inline uint32_t pool_align(uint32_t size) {
+  return (size + POOL_ALIGN - 1) & ~(uint32_t)(POOL_ALIGN - 1);
+}
+
+static inline uint32_t tlsf_size(const tlsf_block_t* b) {
+  return b->size & ~1u;
+}
+
+static inline bool tlsf_is_free(const tlsf_block_t* b) {
+  return b->size & 1;
+}
+
+static inline tlsf_block_t* tlsf_next(const tlsf_block_t* b) {
+  return (tlsf_block_t*)((uint8_t*)b + TLSF_HDR + tlsf_size(b));
+}
+
+static void tlsf_mapping(uint32_t size, int* fl, int* sl) {
+  if (size < TLSF_SMALL) {
+    *fl = 0;
+    *sl = size / (TLSF_SMALL / TLSF_SL_COUNT);
+  } else {
+    int msb = 31 - __builtin_clz(size);
+    *sl = (size >> (msb - TLSF_SL_BITS)) ^ TLSF_SL_COUNT;
+    *fl = msb - TLSF_FL_SHIFT + 1;
+  }
+}
+
+static void tlsf_insert(tlsf_block_t* b) {
+  int fl, sl;
+  tlsf_mapping(tlsf_size(b), &fl, &sl);
+  b->prev_free = NULL;
+  b->next_free = arena.heads[fl][sl];
+  if (b->next_free) {
+    b->next_free->prev_free = b;
+  }
+  arena.heads[fl][sl] = b;
+  arena.fl_map |= 1u << fl;
+  arena.sl_map[fl] |= 1u << sl;
+}
+
+static void tlsf_remove(tlsf_block_t* b) {
+  int fl, sl;
+  tlsf_mapping(tlsf_size(b), &fl, &sl);
+  if (b->prev_free) {
+    b->prev_free->next_free = b->next_free;
+  } else {
+    arena.heads[fl][sl] = b->next_free;
+  }
+  if (b->next_free) {
+    b->next_free->prev_free = b->prev_free;
+  }
+  if (!arena.heads[fl][sl]) {
+    arena.sl_map[fl] &= ~(1u << sl);
+    if (!arena.sl_map[fl]) {
+      arena.fl_map &= ~(1u << fl);
+    }
+  }
+}
+
+// First non-empty list whose blocks are all at least size bytes
+static tlsf_block_t* tlsf_find(uint32_t size) {
+  if (size >= TLSF_SMALL) {
+    size += (1u << (31 - __builtin_clz(size) - TLSF_SL_BITS)) - 1;
+  }
+  int fl, sl;
+  tlsf_mapping(size, &fl, &sl);
+  if (fl >= TLSF_FL_COUNT) {
+    return NULL;
+  }
+  uint32_t sl_map = arena.sl_map[fl] & (~0u << sl);
+  if (!sl_map) {
+    uint32_t fl_map = fl + 1 < 32 ? arena.fl_map & (~0u << (fl + 1)) : 0;
+    if (!fl_map) {
+      return NULL;
+    }
+    fl = __builtin_ctz(fl_map);
+    sl_map = arena.sl_map[fl];
+  }
+  return arena.heads[fl][__builtin_ctz(sl_map)];
+}
+
+// Gives the tail of a used block back to the arena if it can hold a block
+static void tlsf_trim(tlsf_block_t* b, uint32_t size) {
+  uint32_t have = tlsf_size(b);
+  if (have < size + TLSF_HDR + TLSF_MIN_PAYLOAD) {
+    return;
+  }
+  tlsf_block_t* rest = (tlsf_block_t*)((uint8_t*)b + TLSF_HDR + size);
+  rest->prev_phys = b;
+  rest->size = (have - size - TLSF_HDR) | 1;
+  tlsf_next(rest)->prev_phys = rest;
+  b->size = size;
+  tlsf_insert(rest);
+}
+
+static void arena_init(uint8_t* mem, uint32_t size) {
+  memset(&arena, 0, sizeof(arena));
+  if (!mem) {
+    return;
+  }
+  uint8_t* start = (uint8_t*)(((uintptr_t)mem + POOL_ALIGN - 1) & ~(uintptr_t)(POOL_ALIGN - 1));
+  size = (size - (uint32_t)(start - mem)) & ~(uint32_t)(POOL_ALIGN - 1);
+  tlsf_block_t* b = (tlsf_block_t*)start;
+  b->prev_phys = NULL;
+  b->size = (size - 2 * TLSF_HDR) | 1;
+  tlsf_block_t* sentinel = tlsf_next(b);
+  sentinel->prev_phys = b;
+  sentinel->size = 0;
+  tlsf_insert(b);
+  arena.first = b;
+  arena.stats.capacity = tlsf_size(b);
+}
+
+static void* arena_alloc(uint32_t size) {
+  uint32_t need = pool_align(size < TLSF_MIN_PAYLOAD ? TLSF_MIN_PAYLOAD : size);
+  tlsf_block_t* b = arena.first ? tlsf_find(need) : NULL;
+  if (!b) {
+    arena.stats.failed++;
+    return NULL;
+  }
+  tlsf_remove(b);
+  b->size = tlsf_size(b);
+  tlsf_trim(b, need);
+
+  arena.stats.allocs++;
+  arena.stats.used += tlsf_size(b);
+  if (arena.stats.used > arena.stats.peak) {
+    arena.stats.peak = arena.stats.used;
+  }
+  return (uint8_t*)b + TLSF_HDR;
+}
+
+static void arena_free(void* p) {
+  tlsf_block_t* b = (tlsf_block_t*)((uint8_t*)p - TLSF_HDR);
+  arena.stats.used -= tlsf_size(b);
+  tlsf_block_t* prev = b->prev_phys;
+  if (prev && tlsf_is_free(prev)) {
+    tlsf_remove(prev);
+    prev->size = tlsf_size(prev) + TLSF_HDR + tlsf_size(b);
+    b = prev;
+  }
+  tlsf_block_t* next = tlsf_next(b);
+  if (tlsf_is_free(next)) {
+    tlsf_remove(next);
+    b->size = tlsf_size(b) + TLSF_HDR + tlsf_size(next);
+  }
+  b->size |= 1;
+  tlsf_next(b)->prev_phys = b;
+  tlsf_insert(b);
+}
+
+// Grows in place into a free neighbour when it can
+static bool arena_resize(void* p, uint32_t size) {
+  tlsf_block_t* b = (tlsf_block_t*)((uint8_t*)p - TLSF_HDR);
+  uint32_t need = pool_align(size < TLSF_MIN_PAYLOAD ? TLSF_MIN_PAYLOAD : size);
+  uint32_t old = tlsf_size(b);
+  if (need > old) {
+    tlsf_block_t* next = tlsf_next(b);
+    if (!tlsf_is_free(next) || old + TLSF_HDR + tlsf_size(next) < need) {
+      return false;
+    }
+    tlsf_remove(next);
+    b->size = old + TLSF_HDR + tlsf_size(next);
+    tlsf_next(b)->prev_phys = b;
+    tlsf_trim(b, need);
+  }
+  arena.stats.used += tlsf_size(b) - old;
+  if (arena.stats.used > arena.stats.peak) {
+    arena.stats.peak = arena.stats.used;
+  }
+  return true;
+}
+
+static bool arena_owns(const void* p) {
+  return arena.first && (const uint8_t*)p >= (const uint8_t*)arena.first &&
+         (const uint8_t*)p < (const uint8_t*)arena.first + arena.stats.capacity + TLSF_HDR;
+}
+
+static void mem_pool_init(void) {
+  uint32_t total = 0;
+  for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+    total += class_size[i] * class_blocks[i];
+  }
+  uint8_t* mem = (uint8_t*)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  for (int i = 0; i < POOL_CLASS_COUNT && mem; i++) {
+    pool_class_t* c = &classes[i];
+    c->start = mem;
+    c->end = mem + class_size[i] * class_blocks[i];
+    for (uint8_t* block = c->end - class_size[i]; block >= c->start; block -= class_size[i]) {
+      pool_free_t* f = (pool_free_t*)block;
+      f->next = c->free_list;
+      c->free_list = f;
+    }
+    c->stats.block_size = class_size[i];
+    c->stats.capacity = class_blocks[i];
+    mem = c->end;
+  }
+
+  uint32_t size = MEM_POOL_ARENA_SIZE;
+  uint8_t* arena_mem = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!arena_mem) {
+    size = MEM_POOL_ARENA_INTERNAL_SIZE;
+    arena_mem = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    LOG_W(MEM_ARENA_INTERNAL, (unsigned)(arena_mem ? size / 1024 : 0));
+  }
+  arena_init(arena_mem, size);
+  pool_ready = true;
+}
+
+void* mem_pool_alloc(size_t size) {
+  if (!pool_ready) {
+    mem_pool_init();
+  }
+  if (size == 0) {
+    return NULL;
+  }
+  bool spilled = false;
+  for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+    pool_class_t* c = &classes[i];
+    if (size > class_size[i]) {
+      continue;
+    }
+    if (!c->free_list) {
+      // Counted once, against the class the request belongs to
+      if (!spilled) {
+        c->stats.failed++;
+        spilled = true;
+      }
+      continue;
+    }
+    pool_free_t* f = c->free_list;
+    c->free_list = f->next;
+    c->requested += size;
+    c->stats.allocs++;
+    if (++c->stats.used > c->stats.peak) {
+      c->stats.peak = c->stats.used;
+    }
+    return f;
+  }
+  return size < (1u << TLSF_FL_MAX) ? arena_alloc((uint32_t)size) : NULL;
+}
+
+void mem_pool_free(void* p) {
+  if (!p) {
+    return;
+  }
+  for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+    pool_class_t* c = &classes[i];
+    if ((uint8_t*)p >= c->start && (uint8_t*)p < c->end) {
+      pool_free_t* f = (pool_free_t*)p;
+      f->next = c->free_list;
+      c->free_list = f;
+      c->stats.used--;
+      return;
+    }
+  }
+  if (arena_owns(p)) {
+    arena_free(p);
+  }
+}
+
+void* mem_pool_realloc(void* p, size_t size) {
+  if (!p) {
+    return mem_pool_alloc(size);
+  }
+  if (size == 0) {
+    mem_pool_free(p);
+    return NULL;
+  }
+  uint32_t old = 0;
+  for (int i = 0; i < POOL_CLASS_COUNT && !old; i++) {
+    if ((uint8_t*)p >= classes[i].start && (uint8_t*)p < classes[i].end) {
+      old = class_size[i];
+    }
+  }
+  if (old) {
+    if (size <= old) {
+      return p;
+    }
+  } else if (arena_owns(p)) {
+    if (size < (1u << TLSF_FL_MAX) && arena_resize(p, (uint32_t)size)) {
+      return p;
+    }
+    old = tlsf_size((tlsf_block_t*)((uint8_t*)p - TLSF_HDR));
+  } else {
+    return NULL;
+  }
+  void* moved = mem_pool_alloc(size);
+  if (moved) {
+    memcpy(moved, p, old < size ? old : size);
+    mem_pool_free(p);
+  }
+  return moved;
+}
+
+uint32_t mem_pool_used(void) {
+  uint32_t used = arena.stats.used;
+  for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+    used += classes[i].stats.used * class_size[i];
+  }
+  return used;
+}
+
+int mem_pool_count(void) {
+  return POOL_CLASS_COUNT + 1;
+}
+
+bool mem_pool_get_stats(int idx, mem_pool_stats_t* stats) {
+  if (idx < 0 || idx > POOL_CLASS_COUNT) {
+    return false;
+  }
+  if (idx < POOL_CLASS_COUNT) {
+    const pool_class_t* c = &classes[idx];
+    *stats = c->stats;
+    stats->block_size = class_size[idx];
+    stats->capacity = class_blocks[idx];
+    uint64_t handed = (uint64_t)c->stats.allocs * class_size[idx];
+    stats->frag_pct = handed ? (uint8_t)(100 - c->requested * 100 / handed) : 0;
+    return true;
+  }
+
+  // Walking the blocks is linear, this is for periodic reports only
+  *stats = arena.stats;
+  uint32_t free_total = 0;
+  stats->largest_free = 0;
+  for (tlsf_block_t* b = arena.first; b && tlsf_size(b); b = tlsf_next(b)) {
+    if (tlsf_is_free(b)) {
+      free_total += tlsf_size(b);
+      if (tlsf_size(b) > stats->largest_free) {
+        stats->largest_free = tlsf_size(b);
+      }
+    }
+  }
+  stats->frag_pct = free_total ? (uint8_t)(100 - (uint64_t)stats->largest_free * 100 / free_total) : 0;
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef _MEM_POOL_H
+#define _MEM_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* LVGL heap, installed through LV_MEM_CUSTOM (see platformio.ini).
+ * Small requests come from fixed size classes in internal RAM: a free list pop
+ * or push, no headers, no fragmentation. A full class spills to the next one
+ * up. Larger requests go to a TLSF arena in PSRAM (two level segregated fit,
+ * constant time allocation and coalescing free). Only LVGL calls these, from
+ * the loop task, so there is no locking. */
+
+#define MEM_POOL_CLASSES { 16, 32, 64, 128, 256 }        /* Block sizes */
+#define MEM_POOL_CLASS_BLOCKS { 256, 256, 192, 64, 32 }  /* 40 KB of internal RAM */
+#define MEM_POOL_ARENA_SIZE (512 * 1024)                /* PSRAM */
+#define MEM_POOL_ARENA_INTERNAL_SIZE (32 * 1024)        /* Fallback without PSRAM */
+
+typedef struct {
+    uint32_t block_size;    /* 0 for the arena */
+    uint32_t capacity;      /* Blocks, bytes for the arena */
+    uint32_t used;
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t failed;        /* Class full and spilled, or arena out of memory */
+    uint32_t largest_free;  /* Arena only, bytes */
+    uint8_t frag_pct;       /* Arena: free space outside the largest free block.
+                               Class: block space the requests left unused */
+} mem_pool_stats_t;
+
+void * mem_pool_alloc(size_t size);
+void mem_pool_free(void * p);
+void * mem_pool_realloc(void * p, size_t size);
+
+/* Bytes handed out: class blocks plus arena payload */
+uint32_t mem_pool_used(void);
+
+/* The size classes, then the arena */
+int mem_pool_count(void);
+bool mem_pool_get_stats(int idx, mem_pool_stats_t * stats);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ElegantOTA.h>
+#include "esp_ota_ops.h"
+#include "ota.hpp"
+
+static AsyncWebServer server(80);
+static volatile ota_status_t ota_state;
+static uint32_t ota_start_time = 0;
+static bool pending_verify = false;
+static uint32_t network_time = 0;   // ms on the network since boot while pending
+static uint32_t last_check = 0;
+static const char* auth_user = "";
+static const char* auth_password = "";
+
+// Keep the new image pending, ota_health_check() decides instead of the core
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+static void on_ota_start() {
+  ota_start_time = millis();
+  ota_state.active = true;
+  ota_state.done = false;
+  ota_state.success = false;
+  ota_state.progress = 0;
+  ota_state.total = 0;
+  ota_state.worst_loop_us = 0;
+}
+
+static void on_ota_progress(size_t current, size_t final) {
+  ota_state.progress = current;
+  ota_state.total = final;
+}
+
+static void on_ota_end(bool success) {
+  ota_state.duration = millis() - ota_start_time;
+  ota_state.success = success;
+  ota_state.active = false;
+  ota_state.done = true;
+}
+
+AsyncWebServer* ota_web_server(void) {
+  return &server;
+}
+
+bool ota_authenticated(AsyncWebServerRequest* request) {
+  return request->authenticate(auth_user, auth_password);
+}
+
+void ota_begin(const char* user, const char* password) {
+  auth_user = user;
+  auth_password = password;
+  esp_ota_img_states_t img_state;
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  pending_verify = esp_ota_get_state_partition(running, &img_state) == ESP_OK &&
+                   img_state == ESP_OTA_IMG_PENDING_VERIFY;
+  last_check = millis();
+  if (pending_verify) {
+    // A loop() that stops resets the board, and the bootloader rolls the pending image back
+    enableLoopWDT();
+  }
+
+  ElegantOTA.begin(&server);
+  ElegantOTA.setAuth(user, password);
+  ElegantOTA.onStart(on_ota_start);
+  ElegantOTA.onProgress(on_ota_progress);
+  ElegantOTA.onEnd(on_ota_end);
+  server.begin();
+}
+
+void ota_loop(uint32_t loop_us) {
+  ElegantOTA.loop();
+  if (ota_state.active && loop_us > ota_state.worst_loop_us) {
+    ota_state.worst_loop_us = loop_us;
+  }
+}
+
+void ota_health_check(bool healthy, bool network) {
+  if (!pending_verify) {
+    return;
+  }
+  uint32_t now = millis();
+  if (network) {
+    network_time += now - last_check;
+  }
+  last_check = now;
+  if (healthy) {
+    esp_ota_mark_app_valid_cancel_rollback();
+    disableLoopWDT();
+    pending_verify = false;
+  } else if (network_time > OTA_HEALTH_TIMEOUT) {
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
+void ota_get_status(ota_status_t* status) {
+  status->active = ota_state.active;
+  status->done = ota_state.done;
+  status->success = ota_state.success;
+  status->pending = pending_verify;
+  status->progress = ota_state.progress;
+  status->total = ota_state.total;
+  status->duration = ota_state.duration;
+  status->worst_loop_us = ota_state.worst_loop_us;
+}
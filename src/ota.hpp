@@ -0,0 +1,52 @@
+#pragma once
+
+#include "stdint.h"
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+
+// Over the air updates through ElegantOTA at http://<device>/update.
+//
+// The image streams into the inactive app slot while the UI and polling keep
+// running, the Update library hashes it on the fly and refuses it if the MD5
+// sent by the uploader does not match. A freshly booted image stays pending
+// until ota_health_check() sees the system healthy, otherwise the bootloader
+// rolls back to the previous slot. Only time on the network counts towards
+// the rollback, an image that can not reach a network has not shown anything
+// either way. While an image is pending the loop task is on the task watchdog,
+// a loop() that hangs resets the board and the bootloader rolls back a pending
+// image that resets.
+//
+// /update and every page registered on the web server ask for HTTP basic auth.
+
+#define OTA_HEALTH_TIMEOUT 90000  // ms on the network a new image has to prove healthy
+
+typedef struct {
+  bool active;
+  bool done;
+  bool success;
+  bool pending;             // Running a new image not confirmed yet, a reset rolls it back
+  uint32_t progress;        // Bytes written
+  uint32_t total;
+  uint32_t duration;        // ms, download and flash
+  uint32_t worst_loop_us;   // Longest loop() iteration while updating
+} ota_status_t;
+
+// user and password are kept, not copied
+void ota_begin(const char* user, const char* password);
+
+// Call once per loop() with the iteration time, tracks the UI stall during a download
+void ota_loop(uint32_t loop_us);
+
+// Confirms a pending image once healthy, rolls back if it is not healthy within OTA_HEALTH_TIMEOUT
+// of network time. Call once per loop().
+void ota_health_check(bool healthy, bool network);
+
+void ota_get_status(ota_status_t* status);
+
+// The web server behind /update, for other pages to register on before ota_begin()
+AsyncWebServer* ota_web_server(void);
+
+// True if the request carries the credentials given to ota_begin(). Pages answer
+// request->requestAuthentication() otherwise, and ignore the body of a POST.
+bool ota_authenticated(AsyncWebServerRequest* request);
@@ -0,0 +1,189 @@
+#include <Arduino.h>
+#include <Arduino_GFX_Library.h>
+#include "esp_rom_gpio.h"
+#include "soc/gpio_sig_map.h"
+#include "soc/lcd_cam_struct.h"
+#include "hal/lcd_ll.h"
+#include "logger.hpp"
+#include "panel.hpp"
+
+#define ST7701_SLPIN 0x10
+#define ST7701_SLPOUT 0x11
+#define ST7701_DISPOFF 0x28
+#define ST7701_DISPON 0x29
+
+typedef enum {
+  PANEL_BOOT,          // Backlight off until the first frame is in the framebuffer
+  PANEL_ON,
+  PANEL_SLEEPING,      // SLPIN sent, scan-out still running
+  PANEL_OFF,           // Clock gated
+  PANEL_WAKE_SLPOUT,   // Clock running, waiting out PANEL_SLEEP_MIN
+  PANEL_WAKE_DISPON,   // SLPOUT sent
+  PANEL_WAKE_FRAME     // DISPON sent, backlight after a full frame
+} panel_state_t;
+
+static int8_t backlight_pin = -1;
+static Arduino_DataBus* panel_bus = NULL;
+static panel_spi_pins_t spi_pins;
+static panel_state_t state = PANEL_BOOT;
+static bool want_on = true;
+static uint32_t step_time;
+static uint32_t slpin_time;
+static uint32_t slpout_time;
+static uint32_t wake_request;
+static panel_stats_t stats;
+
+static void panel_backlight(bool on) {
+  if (backlight_pin >= 0) {
+    digitalWrite(backlight_pin, on ? HIGH : LOW);
+  }
+}
+
+// Borrows the shared pins from LCD_CAM for one command
+static void panel_command(uint8_t cmd) {
+  if (spi_pins.sck_data_bit >= 0) {
+    pinMode(spi_pins.sck, OUTPUT);
+  }
+  if (spi_pins.mosi_data_bit >= 0) {
+    pinMode(spi_pins.mosi, OUTPUT);
+  }
+  panel_bus->sendCommand(cmd);
+  if (spi_pins.sck_data_bit >= 0) {
+    esp_rom_gpio_connect_out_signal(spi_pins.sck, LCD_DATA_OUT0_IDX + spi_pins.sck_data_bit, false, false);
+  }
+  if (spi_pins.mosi_data_bit >= 0) {
+    esp_rom_gpio_connect_out_signal(spi_pins.mosi, LCD_DATA_OUT0_IDX + spi_pins.mosi_data_bit, false, false);
+  }
+}
+
+// Backlight off first, the ST7701 takes SLPIN no sooner than PANEL_SLEEP_MIN after SLPOUT
+static void panel_sleep(uint32_t now) {
+  panel_backlight(false);
+  if (now - slpout_time < PANEL_SLEEP_MIN) {
+    if (state == PANEL_ON) {
+      // Waits as a wake, turning on again in the meantime brings the backlight back
+      step_time = now;
+      state = PANEL_WAKE_FRAME;
+    }
+    return;
+  }
+  panel_command(ST7701_DISPOFF);
+  panel_command(ST7701_SLPIN);
+  slpin_time = step_time = now;
+  stats.sleeps++;
+  state = PANEL_SLEEPING;
+}
+
+void panel_begin(int8_t backlight) {
+  backlight_pin = backlight;
+  pinMode(backlight, OUTPUT);
+  panel_backlight(false);
+}
+
+void panel_attach(Arduino_DataBus* bus, const panel_spi_pins_t* pins) {
+#if PANEL_SLEEP
+  panel_bus = bus;
+  spi_pins = *pins;
+#endif
+}
+
+void panel_first_frame(void) {
+  if (state == PANEL_BOOT) {
+    wake_request = step_time = millis();
+    state = PANEL_WAKE_FRAME;
+  }
+  panel_loop();
+}
+
+void panel_set_on(bool on) {
+  if (on && !want_on) {
+    wake_request = millis();
+  }
+  want_on = on;
+  panel_loop();
+}
+
+void panel_loop(void) {
+  uint32_t now = millis();
+  if (!panel_bus) {
+    // Backlight only, a timer wake that left the screen off has no first frame to wait for
+    if (state == PANEL_BOOT && !want_on) {
+      state = PANEL_ON;
+    }
+    if (state == PANEL_WAKE_FRAME && now - step_time >= PANEL_FRAME_MS) {
+      state = PANEL_ON;
+    }
+    if (state == PANEL_ON) {
+      panel_backlight(want_on);
+    }
+    return;
+  }
+  switch (state) {
+    case PANEL_BOOT:
+    case PANEL_ON:
+      if (!want_on) {
+        panel_sleep(now);
+      }
+      break;
+
+    case PANEL_SLEEPING:
+      if (want_on) {
+        state = PANEL_WAKE_SLPOUT;
+      } else if (now - step_time >= max(PANEL_CMD_WAIT, PANEL_FRAME_MS)) {
+        // Stops the PSRAM reads, DMA and timing freeze at the same pixel
+        lcd_ll_enable_clock(&LCD_CAM, false);
+        step_time = now;
+        state = PANEL_OFF;
+      }
+      break;
+
+    case PANEL_OFF:
+      if (want_on) {
+        lcd_ll_enable_clock(&LCD_CAM, true);
+        stats.off_ms += now - step_time;
+        state = PANEL_WAKE_SLPOUT;
+      }
+      break;
+
+    // Turned off again mid-wake: back to sleep, the backlight stays off
+    case PANEL_WAKE_SLPOUT:
+      if (!want_on) {
+        step_time = now;
+        state = PANEL_SLEEPING;
+      } else if (now - slpin_time >= PANEL_SLEEP_MIN) {
+        panel_command(ST7701_SLPOUT);
+        slpout_time = step_time = now;
+        state = PANEL_WAKE_DISPON;
+      }
+      break;
+
+    case PANEL_WAKE_DISPON:
+      if (!want_on) {
+        panel_sleep(now);
+      } else if (now - step_time >= PANEL_CMD_WAIT) {
+        panel_command(ST7701_DISPON);
+        step_time = now;
+        state = PANEL_WAKE_FRAME;
+      }
+      break;
+
+    case PANEL_WAKE_FRAME:
+      if (!want_on) {
+        panel_sleep(now);
+      } else if (now - step_time >= PANEL_FRAME_MS) {
+        panel_backlight(true);
+        stats.wakes++;
+        stats.last_wake_ms = now - wake_request;
+        if (stats.last_wake_ms > stats.max_wake_ms) {
+          stats.max_wake_ms = stats.last_wake_ms;
+        }
+        LOG_I(PANEL_WAKE, stats.last_wake_ms, stats.max_wake_ms, stats.sleeps);
+        state = PANEL_ON;
+      }
+      break;
+  }
+}
+
+void panel_get_stats(panel_stats_t* out) {
+  *out = stats;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "stdint.h"
+
+class Arduino_DataBus;
+
+// Panel power: backlight, ST7701 sleep and the RGB scan-out.
+//
+// Turning off switches the backlight off and sends DISPOFF and SLPIN to the
+// ST7701, then a frame later gates the LCD_CAM clock. The timing generator and
+// the DMA that feeds it stop together, so the framebuffer is no longer read
+// from PSRAM and scan-out later resumes in step with it, the frame intact.
+// Turning on never blocks: panel_loop() ungates the clock, sends SLPOUT and
+// DISPON with the waits the controller needs and switches the backlight on
+// once a whole frame has been scanned in. The wake time is measured, it is
+// bounded by PANEL_CMD_WAIT + PANEL_FRAME_MS, plus what is left of
+// PANEL_SLEEP_MIN after a sleep that was cut short. Turning off during a wake
+// goes back to sleep without the backlight coming on.
+//
+// The backlight starts off and panel_first_frame() turns it on the same way,
+// a frame after the first LVGL frame was flushed, so the panel's power-on
+// content is never shown.
+//
+// On this board the SWSPI clock and data pins double as RGB data lines, they
+// are taken back for each command and returned to LCD_CAM afterwards.
+
+#define PANEL_SLEEP 1        // 0 only switches the backlight
+#define PANEL_CMD_WAIT 5     // ms the ST7701 needs after SLPIN or SLPOUT
+#define PANEL_SLEEP_MIN 120  // ms from SLPIN to the next SLPOUT
+#define PANEL_FRAME_MS 25    // One refresh at the panel timing, with margin
+
+typedef struct {
+  int8_t sck;            // SWSPI pins
+  int8_t mosi;
+  int8_t sck_data_bit;   // RGB data line the pin carries during scan-out, -1 if not shared
+  int8_t mosi_data_bit;
+} panel_spi_pins_t;
+
+typedef struct {
+  uint32_t sleeps;
+  uint32_t wakes;
+  uint32_t last_wake_ms;   // panel_set_on(true) or panel_first_frame() to backlight on
+  uint32_t max_wake_ms;
+  uint32_t off_ms;         // Total time with the scan-out stopped
+} panel_stats_t;
+
+// Backlight only until panel_attach() hands over the controller bus
+void panel_begin(int8_t backlight);
+void panel_attach(Arduino_DataBus* bus, const panel_spi_pins_t* pins);
+// Call once the first frame has been flushed, does nothing after that
+void panel_first_frame(void);
+
+void panel_set_on(bool on);
+void panel_loop(void);
+void panel_get_stats(panel_stats_t* stats);
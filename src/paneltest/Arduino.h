@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The Arduino calls src/panel.cpp makes, implemented by paneltest_main.cpp
+
+#define LOW 0
+#define HIGH 1
+#define OUTPUT 0x03
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint32_t millis(void);
+
+template <typename T>
+static inline T max(T a, T b) {
+  return a > b ? a : b;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// Only the command path of the SWSPI bus
+class Arduino_DataBus {
+public:
+  void sendCommand(uint8_t c);
+};
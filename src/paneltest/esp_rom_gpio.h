@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+void esp_rom_gpio_connect_out_signal(uint32_t gpio_num, uint32_t signal_idx, bool out_inv, bool oen_inv);
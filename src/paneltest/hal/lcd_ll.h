@@ -0,0 +1,5 @@
+#pragma once
+
+#include "soc/lcd_cam_struct.h"
+
+void lcd_ll_enable_clock(lcd_cam_dev_t* dev, bool en);
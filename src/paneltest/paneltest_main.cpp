@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include <Arduino_GFX_Library.h>
+#include "esp_rom_gpio.h"
+#include "hal/lcd_ll.h"
+#include "logger.hpp"
+#include "panel.hpp"
+
+// The panel power state machine (panel.hpp) on the host:
+//
+//   pio run -e paneltest && .pio/build/paneltest/program
+//
+// millis() is a fake clock stepped 1 ms per panel_loop(), the backlight pin,
+// the ST7701 commands and the LCD_CAM clock are recorded. panel.cpp keeps its
+// state in statics, so every case runs in its own child process. Checked:
+//   - the backlight stays off from panel_begin() until PANEL_FRAME_MS after
+//     panel_first_frame(), with and without the controller bus
+//   - a timer wake that leaves the screen off puts the panel to sleep
+//   - a full sleep gates the clock and a wake lights the backlight again
+//   - turning off at any ms of a wake, after a long or a cut short sleep,
+//     never lights the backlight, and the panel still sleeps and wakes after
+//   - SLPIN and SLPOUT keep PANEL_SLEEP_MIN apart, DISPON only with the clock
+//     running
+//   - turning on again while SLPIN waits out PANEL_SLEEP_MIN lights it again
+// Exits with 1 if any check fails.
+
+#define BACKLIGHT 2
+#define WAKE_MS (PANEL_CMD_WAIT + PANEL_FRAME_MS + 2)   // A wake from a long sleep, with margin
+#define SETTLE_MS 1000
+
+lcd_cam_dev_t LCD_CAM = { 1 };
+
+static uint32_t now_ms = 1000;
+static bool backlight = false;
+static bool lit = false;             // Backlight went high since the last clear_lit()
+static uint32_t slpin_at;
+static uint32_t slpout_at;
+static bool asleep = false;          // Last of SLPIN and SLPOUT was SLPIN
+static uint8_t last_cmd;
+static uint32_t sleeps;
+static unsigned failures = 0;
+
+#define PANELTEST_CHECK(cond, ...)                \
+  do {                                            \
+    if (!(cond)) {                                \
+      failures++;                                 \
+      printf("  FAIL %s: ", #cond);               \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin == BACKLIGHT) {
+    backlight = val == HIGH;
+    lit |= backlight;
+  }
+}
+
+uint32_t millis(void) {
+  return now_ms;
+}
+
+void esp_rom_gpio_connect_out_signal(uint32_t gpio_num, uint32_t signal_idx, bool out_inv, bool oen_inv) {
+  (void)gpio_num;
+  (void)signal_idx;
+  (void)out_inv;
+  (void)oen_inv;
+}
+
+void lcd_ll_enable_clock(lcd_cam_dev_t* dev, bool en) {
+  dev->clock_enabled = en;
+}
+
+void Arduino_DataBus::sendCommand(uint8_t c) {
+  switch (c) {
+    case 0x10:  // SLPIN
+      PANELTEST_CHECK(!asleep && now_ms - slpout_at >= PANEL_SLEEP_MIN, "SLPIN %u ms after SLPOUT",
+                      now_ms - slpout_at);
+      PANELTEST_CHECK(!backlight, "SLPIN with the backlight on");
+      slpin_at = now_ms;
+      asleep = true;
+      sleeps++;
+      break;
+    case 0x11:  // SLPOUT
+      PANELTEST_CHECK(asleep && now_ms - slpin_at >= PANEL_SLEEP_MIN, "SLPOUT %u ms after SLPIN", now_ms - slpin_at);
+      slpout_at = now_ms;
+      asleep = false;
+      break;
+    case 0x29:  // DISPON
+      PANELTEST_CHECK(!asleep && LCD_CAM.clock_enabled, "DISPON asleep %d, clock %d", asleep, LCD_CAM.clock_enabled);
+      break;
+  }
+  last_cmd = c;
+}
+
+bool logger_write(uint8_t level, uint16_t fmt, uint8_t nargs, const logger_word_t* args) {
+  (void)level;
+  (void)fmt;
+  (void)nargs;
+  (void)args;
+  return true;
+}
+
+static Arduino_DataBus bus;
+static const panel_spi_pins_t spi_pins = { 47, 41, -1, -1 };
+
+static void tick(uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    now_ms++;
+    panel_loop();
+  }
+}
+
+static void clear_lit(void) {
+  lit = false;
+}
+
+// Asleep with the clock gated and the backlight off
+static void check_off(const char* when) {
+  PANELTEST_CHECK(!backlight && asleep && !LCD_CAM.clock_enabled, "%s: backlight %d, asleep %d, clock %d", when,
+                  backlight, asleep, LCD_CAM.clock_enabled);
+}
+
+// Booted with the bus, first frame shown and lit for a while
+static void boot(void) {
+  panel_begin(BACKLIGHT);
+  panel_attach(&bus, &spi_pins);
+  tick(SETTLE_MS);
+  panel_first_frame();
+  tick(WAKE_MS);
+  tick(SETTLE_MS);
+}
+
+static void case_boot(int arg) {
+  (void)arg;
+  panel_begin(BACKLIGHT);
+  PANELTEST_CHECK(!lit, "backlight on in panel_begin()");
+  panel_attach(&bus, &spi_pins);
+  tick(SETTLE_MS);
+  PANELTEST_CHECK(!lit, "backlight on before the first frame");
+  uint32_t frame_at = now_ms;
+  panel_first_frame();
+  tick(PANEL_FRAME_MS - 1);
+  PANELTEST_CHECK(!lit, "backlight on %u ms after the first frame", now_ms - frame_at);
+  tick(2);
+  PANELTEST_CHECK(backlight, "backlight still off %u ms after the first frame", now_ms - frame_at);
+  panel_stats_t stats;
+  panel_get_stats(&stats);
+  PANELTEST_CHECK(stats.wakes == 1 && sleeps == 0, "%u wakes, %u sleeps", stats.wakes, sleeps);
+
+  // A full cycle
+  panel_set_on(false);
+  PANELTEST_CHECK(!backlight, "backlight on after panel_set_on(false)");
+  tick(SETTLE_MS);
+  check_off("slept");
+  clear_lit();
+  panel_set_on(true);
+  tick(WAKE_MS);
+  PANELTEST_CHECK(backlight && !asleep && LCD_CAM.clock_enabled && last_cmd == 0x29, "not awake %u ms after on",
+                  WAKE_MS);
+}
+
+static void case_backlight_only(int timer_wake) {
+  panel_begin(BACKLIGHT);
+  if (timer_wake) {
+    panel_set_on(false);
+  }
+  tick(SETTLE_MS);
+  PANELTEST_CHECK(!lit, "backlight on before the first frame, timer wake %d", timer_wake);
+  if (timer_wake) {
+    panel_set_on(true);
+    PANELTEST_CHECK(backlight, "backlight off after a timer wake");
+    return;
+  }
+  panel_first_frame();
+  PANELTEST_CHECK(!lit, "backlight on with the first frame");
+  tick(PANEL_FRAME_MS);
+  PANELTEST_CHECK(backlight, "backlight off after the first frame");
+  panel_set_on(false);
+  PANELTEST_CHECK(!backlight && sleeps == 0, "backlight %d, %u sleeps", backlight, sleeps);
+  panel_set_on(true);
+  PANELTEST_CHECK(backlight, "backlight off after panel_set_on(true)");
+}
+
+static void case_timer_wake(int arg) {
+  (void)arg;
+  panel_begin(BACKLIGHT);
+  panel_set_on(false);
+  panel_attach(&bus, &spi_pins);
+  tick(SETTLE_MS);
+  PANELTEST_CHECK(!lit, "backlight on in a timer wake");
+  check_off("timer wake");
+  panel_set_on(true);
+  tick(WAKE_MS);
+  PANELTEST_CHECK(backlight, "backlight off %u ms after on", WAKE_MS);
+}
+
+// Sleeps for arg / 1000 ms, then is turned off again arg % 1000 ms into the wake
+static void case_off_mid_wake(int arg) {
+  uint32_t slept = arg / 1000;
+  uint32_t into = arg % 1000;
+  boot();
+  panel_set_on(false);
+  tick(slept);
+  clear_lit();
+  uint32_t on_at = now_ms;
+  panel_set_on(true);
+  tick(into);
+  bool woke = lit;
+  // The shortest wake is the one from a long sleep
+  PANELTEST_CHECK(!woke || into >= PANEL_CMD_WAIT + PANEL_FRAME_MS, "slept %u ms, lit %u ms into the wake", slept,
+                  now_ms - on_at);
+  panel_set_on(false);
+  PANELTEST_CHECK(!backlight, "slept %u ms, backlight on after off %u ms into the wake", slept, into);
+  clear_lit();
+  tick(SETTLE_MS);
+  PANELTEST_CHECK(!lit, "slept %u ms, off %u ms into the wake, backlight came on", slept, into);
+  check_off("off mid-wake");
+
+  // Not stuck
+  panel_set_on(true);
+  tick(WAKE_MS);
+  PANELTEST_CHECK(backlight, "slept %u ms, off %u ms into the wake, no wake after", slept, into);
+}
+
+// Off arg ms after a wake, on again 10 ms later while SLPIN waits out PANEL_SLEEP_MIN
+static void case_on_before_slpin(int arg) {
+  boot();
+  panel_set_on(false);
+  tick(SETTLE_MS);
+  panel_set_on(true);
+  tick(WAKE_MS);
+  tick(arg);
+  uint32_t sleeps_before = sleeps;
+  panel_set_on(false);
+  PANELTEST_CHECK(!backlight && sleeps == sleeps_before, "off %u ms after the wake: backlight %d, SLPIN sent", arg,
+                  backlight);
+  tick(10);
+  panel_set_on(true);
+  tick(WAKE_MS);
+  PANELTEST_CHECK(backlight && !asleep, "on again %u ms after the wake: backlight %d, asleep %d", arg, backlight,
+                  asleep);
+  panel_set_on(false);
+  tick(SETTLE_MS);
+  check_off("off after on again");
+}
+
+// Runs fn(arg) in a child, panel.cpp starts from its initial state each time
+static void run(void (*fn)(int), int arg) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    failures = 0;
+    fn(arg);
+    fflush(stdout);
+    _exit(failures < 255 ? failures : 255);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    failures++;
+    return;
+  }
+  failures += WEXITSTATUS(status);
+}
+
+int main(int argc, char** argv) {
+  (void)argv;
+  if (argc > 1) {
+    printf("usage: program\n");
+    return 2;
+  }
+  printf("boot and a full cycle\n");
+  run(case_boot, 0);
+  printf("backlight only\n");
+  run(case_backlight_only, 0);
+  run(case_backlight_only, 1);
+  printf("timer wake with the screen off\n");
+  run(case_timer_wake, 0);
+  printf("off mid-wake\n");
+  static const uint32_t sleeps_ms[] = { 0, 10, PANEL_FRAME_MS + 1, PANEL_SLEEP_MIN + 10, SETTLE_MS };
+  for (uint32_t slept : sleeps_ms) {
+    for (uint32_t into = 0; into < PANEL_SLEEP_MIN + WAKE_MS; into++) {
+      run(case_off_mid_wake, (int)(slept * 1000 + into));
+    }
+  }
+  printf("on again before SLPIN\n");
+  // Until SLPIN goes out PANEL_SLEEP_MIN after SLPOUT
+  for (int after = 0; after + WAKE_MS + 10 < PANEL_SLEEP_MIN; after += 7) {
+    run(case_on_before_slpin, after);
+  }
+  printf("%u failed checks\n", failures);
+  return failures ? 1 : 0;
+}
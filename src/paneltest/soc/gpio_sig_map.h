@@ -0,0 +1,3 @@
+#pragma once
+
+#define LCD_DATA_OUT0_IDX 133
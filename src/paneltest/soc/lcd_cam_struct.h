@@ -0,0 +1,7 @@
+#pragma once
+
+typedef struct {
+  int clock_enabled;
+} lcd_cam_dev_t;
+
+extern lcd_cam_dev_t LCD_CAM;
@@ -0,0 +1,255 @@
+#include <string.h>
+#include "peer_sync.hpp"
+
+#define PEER_FRAME_HELLO 1
+#define PEER_FRAME_STATE 2
+#define PEER_FRAME_SETPOINT 3
+#define PEER_HEADER_SIZE 12
+#define PEER_HELLO_SIZE (PEER_HEADER_SIZE + 1)
+
+#define PEER_FLAG_BOILER 0x01
+#define PEER_FLAG_SERVER_OK 0x02
+#define PEER_FLAG_ACKED 0x04
+#define PEER_FLAG_AWAKE 0x08
+
+#define PEER_SEQ_RESTART 16  // A leader frame this far behind is a restarted leader, not a duplicate
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Setpoint versions: higher sequence wins, the origin ID breaks ties
+static bool peer_newer(uint32_t seq, uint32_t origin, uint32_t than_seq, uint32_t than_origin) {
+  return seq > than_seq || (seq == than_seq && origin > than_origin);
+}
+
+static void peer_send(peer_t* peer, uint8_t type, uint32_t now) {
+  uint8_t f[PEER_FRAME_SIZE];
+  const peer_state_t* s = &peer->state;
+  f[0] = 'T';
+  f[1] = 'S';
+  f[2] = PEER_PROTO_VERSION;
+  f[3] = type;
+  put32(f + 4, peer->id);
+  put32(f + 8, ++peer->frame_seq);
+  f[12] = (s->boiler ? PEER_FLAG_BOILER : 0) | (s->server_ok ? PEER_FLAG_SERVER_OK : 0) |
+          (s->setpoint_acked ? PEER_FLAG_ACKED : 0) | (peer->awake ? PEER_FLAG_AWAKE : 0);
+  size_t len = PEER_HELLO_SIZE;
+  if (type != PEER_FRAME_HELLO) {
+    f[13] = (uint8_t)s->setpoint;
+    put16(f + 14, (uint16_t)s->temp);
+    put32(f + 16, s->setpoint_seq);
+    put32(f + 20, s->setpoint_origin);
+    len = PEER_FRAME_SIZE;
+  }
+  if (peer->send && peer->send(peer->send_ctx, f, len)) {
+    peer->stats.frames_sent++;
+  }
+  peer->last_sent = now;
+}
+
+static void peer_lead(peer_t* peer, uint32_t now) {
+  peer->role = PEER_LEADER;
+  if (peer->leader_id != peer->id) {
+    peer->leader_id = peer->id;
+    peer->stats.leader_changes++;
+  }
+  peer_send(peer, PEER_FRAME_STATE, now);
+}
+
+void peer_init(peer_t* peer, uint32_t id, int8_t setpoint, peer_send_t send, void* send_ctx, uint32_t now) {
+  memset(peer, 0, sizeof(*peer));
+  peer->id = id;
+  peer->role = PEER_STARTING;
+  peer->send = send;
+  peer->send_ctx = send_ctx;
+  peer->started = now;
+  peer->last_sent = now - PEER_HELLO_INTERVAL;
+  peer->state.setpoint = setpoint;
+}
+
+void peer_tick(peer_t* peer, uint32_t now) {
+  bool lower_alive = peer->lower_seen && now - peer->lower_heard < PEER_TIMEOUT;
+  bool leader_alive = peer->leader_id && now - peer->leader_heard < PEER_TIMEOUT;
+
+  // Nobody leads: the lowest live ID takes over, the others wait for it
+  if (peer->role == PEER_STARTING && now - peer->started >= PEER_TIMEOUT && !lower_alive) {
+    peer_lead(peer, now);
+  } else if (peer->role == PEER_FOLLOWER && !leader_alive && !lower_alive) {
+    peer_lead(peer, now);
+  }
+
+  if (peer->role == PEER_LEADER) {
+    if (now - peer->last_sent >= PEER_STATE_INTERVAL) {
+      peer_send(peer, PEER_FRAME_STATE, now);
+    }
+    return;
+  }
+  if (peer->setpoint_unconfirmed && now - peer->setpoint_sent >= PEER_SETPOINT_RETRY) {
+    peer->setpoint_sent = now;
+    peer_send(peer, PEER_FRAME_SETPOINT, now);
+  } else if (now - peer->last_sent >= PEER_HELLO_INTERVAL) {
+    peer_send(peer, PEER_FRAME_HELLO, now);
+  }
+}
+
+// Takes the frame's setpoint if it is newer, returns PEER_GOT_SETPOINT if so
+static uint8_t peer_merge_setpoint(peer_t* peer, const uint8_t* f) {
+  peer_state_t* s = &peer->state;
+  uint32_t seq = get32(f + 16);
+  uint32_t origin = get32(f + 20);
+  bool acked = f[12] & PEER_FLAG_ACKED;
+  if (peer_newer(seq, origin, s->setpoint_seq, s->setpoint_origin)) {
+    s->setpoint = (int8_t)f[13];
+    s->setpoint_seq = seq;
+    s->setpoint_origin = origin;
+    s->setpoint_acked = acked;
+    peer->setpoint_unconfirmed = false;
+    return PEER_GOT_SETPOINT;
+  }
+  if (seq == s->setpoint_seq && origin == s->setpoint_origin) {
+    s->setpoint_acked |= acked;
+    if (f[3] == PEER_FRAME_STATE) {
+      peer->setpoint_unconfirmed = false;
+    }
+  }
+  return 0;
+}
+
+uint8_t peer_receive(peer_t* peer, const uint8_t* f, size_t len, uint32_t now) {
+  if (len < PEER_HELLO_SIZE || f[0] != 'T' || f[1] != 'S' || f[2] != PEER_PROTO_VERSION ||
+      (f[3] != PEER_FRAME_HELLO && len < PEER_FRAME_SIZE)) {
+    peer->stats.frames_dropped++;
+    return 0;
+  }
+  uint32_t sender = get32(f + 4);
+  if (sender == peer->id) {
+    // Our own frame looped back
+    return 0;
+  }
+  peer->stats.frames_received++;
+  if (sender < peer->id) {
+    peer->lower_heard = now;
+    peer->lower_seen = true;
+  }
+  if (f[12] & PEER_FLAG_AWAKE) {
+    peer->awake_heard = now;
+  }
+
+  uint8_t got = 0;
+  switch (f[3]) {
+    case PEER_FRAME_STATE: {
+      // A second leader: the lower ID keeps the role
+      bool leader_alive = peer->leader_id && now - peer->leader_heard < PEER_TIMEOUT;
+      if (peer->role == PEER_LEADER ? sender > peer->id
+                                    : leader_alive && sender != peer->leader_id && sender > peer->leader_id) {
+        break;
+      }
+      uint32_t seq = get32(f + 8);
+      if (sender != peer->leader_id) {
+        peer->leader_id = sender;
+        peer->stats.leader_changes++;
+      } else if (seq <= peer->leader_frame_seq && peer->leader_frame_seq - seq < PEER_SEQ_RESTART) {
+        peer->stats.frames_dropped++;
+        break;
+      }
+      peer->leader_frame_seq = seq;
+      peer->leader_heard = now;
+      peer->role = PEER_FOLLOWER;
+
+      peer_state_t* s = &peer->state;
+      s->temp = (int16_t)get16(f + 14);
+      s->boiler = f[12] & PEER_FLAG_BOILER;
+      s->server_ok = f[12] & PEER_FLAG_SERVER_OK;
+      got = PEER_GOT_STATE | peer_merge_setpoint(peer, f);
+      break;
+    }
+
+    case PEER_FRAME_SETPOINT:
+      got = peer_merge_setpoint(peer, f);
+      if (got && peer->role == PEER_LEADER) {
+        // Confirms it to the sender and spreads it right away
+        peer_send(peer, PEER_FRAME_STATE, now);
+      }
+      break;
+
+    default:
+      break;
+  }
+  return got;
+}
+
+bool peer_polls_server(const peer_t* peer, uint32_t now) {
+  // A follower whose leader vanished without a successor polls on its own after a while
+  return peer->role != PEER_FOLLOWER || now - peer->leader_heard >= 2 * PEER_TIMEOUT;
+}
+
+bool peer_any_awake(const peer_t* peer, uint32_t now) {
+  return peer->awake || (peer->awake_heard && now - peer->awake_heard < PEER_TIMEOUT);
+}
+
+void peer_set_awake(peer_t* peer, bool awake) {
+  peer->awake = awake;
+}
+
+void peer_set_setpoint(peer_t* peer, int8_t setpoint, uint32_t now) {
+  peer_state_t* s = &peer->state;
+  s->setpoint = setpoint;
+  s->setpoint_seq++;
+  s->setpoint_origin = peer->id;
+  s->setpoint_acked = false;
+  if (peer->role == PEER_LEADER) {
+    peer_send(peer, PEER_FRAME_STATE, now);
+  } else {
+    peer->setpoint_unconfirmed = true;
+    peer->setpoint_sent = now;
+    peer_send(peer, PEER_FRAME_SETPOINT, now);
+  }
+}
+
+void peer_publish(peer_t* peer, int16_t temp, bool boiler, bool server_ok, uint32_t now) {
+  peer_state_t* s = &peer->state;
+  bool changed = boiler != s->boiler || server_ok != s->server_ok;
+  s->temp = temp;
+  s->boiler = boiler;
+  s->server_ok = server_ok;
+  if (changed && peer->role == PEER_LEADER) {
+    peer_send(peer, PEER_FRAME_STATE, now);
+  }
+}
+
+void peer_setpoint_acked(peer_t* peer, uint32_t seq, uint32_t origin, uint32_t now) {
+  peer_state_t* s = &peer->state;
+  if (s->setpoint_acked || seq != s->setpoint_seq || origin != s->setpoint_origin) {
+    return;
+  }
+  s->setpoint_acked = true;
+  if (peer->role == PEER_LEADER) {
+    peer_send(peer, PEER_FRAME_STATE, now);
+  }
+}
+
+const char* peer_role_str(peer_role_t role) {
+  switch (role) {
+    case PEER_STARTING: return "starting";
+    case PEER_FOLLOWER: return "follower";
+    case PEER_LEADER: return "leader";
+    default: return "?";
+  }
+}
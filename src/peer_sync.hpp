@@ -0,0 +1,103 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// State sharing between thermostats over UDP multicast.
+//
+// One unit, the leader, polls the server and multicasts a state frame every
+// PEER_STATE_INTERVAL, the others follow it and do not poll. A leader keeps the
+// role while it is heard, so a rebooting unit does not take it back. When the
+// leader has been silent for PEER_TIMEOUT, the live node with the lowest ID
+// takes over; of two leaders the higher ID steps down. Every node sends a hello
+// frame so the next in line is known before the leader goes away.
+//
+// A setpoint is versioned by a sequence number and the ID of the node where it
+// was set, the higher pair wins everywhere. A follower multicasts its own
+// change and repeats it until the leader's state carries it, the leader posts
+// it to the server and flags it acknowledged once the server took it.
+//
+// Frames are little endian: "TS", protocol version, type, sender ID, frame
+// sequence, flags, then for state and setpoint frames setpoint, temperature
+// (centidegrees), setpoint sequence and origin. Frames of another version are
+// dropped. A node is a plain struct driven by peer_tick() and peer_receive(),
+// so several of them run side by side in the host simulation (pio run -e peersim).
+
+#define PEER_GROUP "239.255.42.1"
+#define PEER_PORT 4210
+#define PEER_PROTO_VERSION 1
+#define PEER_STATE_INTERVAL 1000    // Leader state frames
+#define PEER_HELLO_INTERVAL 2000    // Follower presence frames
+#define PEER_TIMEOUT 5000           // A node not heard from for this long is gone
+#define PEER_SETPOINT_RETRY 250     // Repeat a setpoint until the leader's state carries it
+#define PEER_FRAME_SIZE 24
+
+typedef enum {
+  PEER_STARTING,   // Listening for a leader, polls the server meanwhile
+  PEER_FOLLOWER,
+  PEER_LEADER
+} peer_role_t;
+
+// Returned by peer_receive()
+#define PEER_GOT_STATE 0x01     // Fresh readings from the leader
+#define PEER_GOT_SETPOINT 0x02  // A newer setpoint was adopted
+
+typedef struct {
+  int16_t temp;              // Centidegrees
+  int8_t setpoint;
+  bool boiler;
+  bool server_ok;            // The leader reaches the server
+  bool setpoint_acked;       // The server has the setpoint
+  uint32_t setpoint_seq;
+  uint32_t setpoint_origin;  // Node where it was set
+} peer_state_t;
+
+typedef struct {
+  uint32_t frames_sent;
+  uint32_t frames_received;
+  uint32_t frames_dropped;   // Bad magic, size or version, duplicates
+  uint32_t leader_changes;
+} peer_stats_t;
+
+typedef bool (*peer_send_t)(void* ctx, const uint8_t* frame, size_t len);
+
+typedef struct {
+  uint32_t id;
+  peer_role_t role;
+  peer_send_t send;
+  void* send_ctx;
+  uint32_t started;
+  uint32_t leader_id;         // 0 while unknown
+  uint32_t leader_heard;
+  uint32_t leader_frame_seq;
+  uint32_t lower_heard;       // Last frame from a node with a lower ID
+  bool lower_seen;
+  uint32_t awake_heard;       // Last frame from a node with its screen on
+  bool awake;                 // This node's screen is on
+  uint32_t frame_seq;
+  uint32_t last_sent;
+  bool setpoint_unconfirmed;  // Own change not yet in the leader's state
+  uint32_t setpoint_sent;
+  peer_state_t state;
+  peer_stats_t stats;
+} peer_t;
+
+void peer_init(peer_t* peer, uint32_t id, int8_t setpoint, peer_send_t send, void* send_ctx, uint32_t now);
+void peer_tick(peer_t* peer, uint32_t now);
+uint8_t peer_receive(peer_t* peer, const uint8_t* frame, size_t len, uint32_t now);
+
+// True while this node has to poll the server itself
+bool peer_polls_server(const peer_t* peer, uint32_t now);
+
+// True if this node or a peer has its screen on, the leader polls for all of them
+bool peer_any_awake(const peer_t* peer, uint32_t now);
+void peer_set_awake(peer_t* peer, bool awake);
+
+// Knob change on this node
+void peer_set_setpoint(peer_t* peer, int8_t setpoint, uint32_t now);
+
+// Leader side: readings from the server, and the server's acknowledgement of a setpoint
+void peer_publish(peer_t* peer, int16_t temp, bool boiler, bool server_ok, uint32_t now);
+void peer_setpoint_acked(peer_t* peer, uint32_t seq, uint32_t origin, uint32_t now);
+
+const char* peer_role_str(peer_role_t role);
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "peer_sync.hpp"
+
+// Several thermostats sharing one server poller through peer_sync, on the
+// host with a simulated clock, multicast bus and server:
+//
+//   pio run -e peersim && .pio/build/peersim/program --nodes 10 --minutes 60 --loss 2
+//
+// Each node polls like the fixed policy (Temp every 5 s, boilerStatus every
+// 2 s) while peer_polls_server() says so, and posts setpoints it holds that
+// the server has not acknowledged. Knobs turn on random nodes and the leader is
+// killed and restarted every --kill-every seconds. The report compares the
+// server load with every unit polling on its own, and gives the setpoint
+// propagation latency to all live nodes and to the server, and the failover
+// gap. Exits with 1 if the live nodes disagree on the setpoint or the leader
+// once the knobs have been left alone for a while.
+
+#define PEERSIM_MAX_NODES 64
+#define PEERSIM_TEMP_INTERVAL 5000
+#define PEERSIM_BOILER_INTERVAL 2000
+#define PEERSIM_BUS_MIN_MS 1
+#define PEERSIM_BUS_MAX_MS 10
+#define PEERSIM_SERVER_MIN_MS 20
+#define PEERSIM_SERVER_MAX_MS 80
+#define PEERSIM_QUIET 30000    // No knob turns or kills at the end, then the nodes must agree
+
+typedef struct {
+  uint32_t at;
+  int to;
+  uint8_t len;
+  uint8_t data[PEER_FRAME_SIZE];
+} peersim_frame_t;
+
+struct frame_later {
+  bool operator()(const peersim_frame_t& a, const peersim_frame_t& b) const { return a.at > b.at; }
+};
+
+typedef enum {
+  REQ_TEMP,
+  REQ_BOILER,
+  REQ_SET_TEMP,
+  REQ_COUNT
+} peersim_req_t;
+
+typedef struct {
+  peer_t peer;
+  bool alive;
+  uint32_t restart_at;
+  uint32_t next_poll[REQ_COUNT];
+  uint32_t done_at[REQ_COUNT];   // In-flight request completes, 0 if idle
+  uint32_t sent_seq;             // Setpoint version of the in-flight POST
+  uint32_t sent_origin;
+  int8_t sent_setpoint;
+} peersim_node_t;
+
+typedef struct {
+  uint32_t at;
+  uint32_t seq;
+  uint32_t origin;
+  uint32_t to_all;     // ms until every live node had it or a newer one, 0 while not
+  uint32_t to_server;
+} peersim_change_t;
+
+static peersim_node_t nodes[PEERSIM_MAX_NODES];
+static int node_count = 10;
+static std::priority_queue<peersim_frame_t, std::vector<peersim_frame_t>, frame_later> bus;
+static uint32_t now = 0;
+static uint32_t rng = 1;
+static double loss_pct = 0;
+
+// Server side
+static uint32_t server_requests[REQ_COUNT];
+static int16_t server_temp = 2000;
+static bool server_boiler = false;
+static int8_t server_setpoint = 25;
+static uint32_t server_seq = 0;
+static uint32_t server_origin = 0;
+
+static uint32_t frames_lost = 0;
+static std::vector<peersim_change_t> changes;
+static std::vector<uint32_t> failover_gaps;
+
+static uint32_t rand_next(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static uint32_t rand_range(uint32_t lo, uint32_t hi) {
+  return lo + rand_next() % (hi - lo + 1);
+}
+
+static bool newer_or_same(uint32_t seq, uint32_t origin, uint32_t than_seq, uint32_t than_origin) {
+  return seq > than_seq || (seq == than_seq && origin >= than_origin);
+}
+
+// Multicast: every other live node gets its own copy with its own delay and loss
+static bool bus_send(void* ctx, const uint8_t* frame, size_t len) {
+  int from = (int)(intptr_t)ctx;
+  for (int i = 0; i < node_count; i++) {
+    if (i == from || !nodes[i].alive) {
+      continue;
+    }
+    if (rand_next() % 10000 < loss_pct * 100) {
+      frames_lost++;
+      continue;
+    }
+    peersim_frame_t f;
+    f.at = now + rand_range(PEERSIM_BUS_MIN_MS, PEERSIM_BUS_MAX_MS);
+    f.to = i;
+    f.len = (uint8_t)len;
+    memcpy(f.data, frame, len);
+    bus.push(f);
+  }
+  return true;
+}
+
+static void node_start(int i) {
+  peersim_node_t* n = &nodes[i];
+  uint32_t id = n->peer.id ? n->peer.id : rand_next() | 1;
+  memset(n, 0, sizeof(*n));
+  peer_init(&n->peer, id, 25, bus_send, (void*)(intptr_t)i, now);
+  n->alive = true;
+  for (int r = 0; r < REQ_COUNT; r++) {
+    n->next_poll[r] = now + rand_range(0, PEERSIM_TEMP_INTERVAL);
+  }
+}
+
+static void node_request(peersim_node_t* n, peersim_req_t req) {
+  server_requests[req]++;
+  n->done_at[req] = now + rand_range(PEERSIM_SERVER_MIN_MS, PEERSIM_SERVER_MAX_MS);
+  if (req == REQ_SET_TEMP) {
+    n->sent_seq = n->peer.state.setpoint_seq;
+    n->sent_origin = n->peer.state.setpoint_origin;
+    n->sent_setpoint = n->peer.state.setpoint;
+  }
+}
+
+static void node_complete(peersim_node_t* n, peersim_req_t req) {
+  n->done_at[req] = 0;
+  switch (req) {
+    case REQ_TEMP:
+      peer_publish(&n->peer, server_temp, n->peer.state.boiler, true, now);
+      break;
+    case REQ_BOILER:
+      peer_publish(&n->peer, n->peer.state.temp, server_boiler, true, now);
+      break;
+    case REQ_SET_TEMP:
+      // The server keeps the last POST it got, like the real one
+      server_setpoint = n->sent_setpoint;
+      server_seq = n->sent_seq;
+      server_origin = n->sent_origin;
+      peer_setpoint_acked(&n->peer, n->sent_seq, n->sent_origin, now);
+      break;
+    default:
+      break;
+  }
+}
+
+static void node_step(peersim_node_t* n) {
+  for (int r = 0; r < REQ_COUNT; r++) {
+    if (n->done_at[r] && now >= n->done_at[r]) {
+      node_complete(n, (peersim_req_t)r);
+    }
+  }
+  peer_tick(&n->peer, now);
+  if (!peer_polls_server(&n->peer, now)) {
+    return;
+  }
+  static const uint32_t intervals[] = { PEERSIM_TEMP_INTERVAL, PEERSIM_BOILER_INTERVAL };
+  for (int r = REQ_TEMP; r <= REQ_BOILER; r++) {
+    if (!n->done_at[r] && now >= n->next_poll[r]) {
+      n->next_poll[r] = now + intervals[r];
+      node_request(n, (peersim_req_t)r);
+    }
+  }
+  if (!n->peer.state.setpoint_acked && n->peer.state.setpoint_seq && !n->done_at[REQ_SET_TEMP]) {
+    node_request(n, REQ_SET_TEMP);
+  }
+}
+
+static int find_leader(void) {
+  for (int i = 0; i < node_count; i++) {
+    if (nodes[i].alive && nodes[i].peer.role == PEER_LEADER) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void track_changes(void) {
+  for (auto& c : changes) {
+    if (!c.to_server && newer_or_same(server_seq, server_origin, c.seq, c.origin)) {
+      c.to_server = std::max<uint32_t>(now - c.at, 1);
+    }
+    if (c.to_all) {
+      continue;
+    }
+    bool all = true;
+    for (int i = 0; i < node_count && all; i++) {
+      const peer_state_t* s = &nodes[i].peer.state;
+      all = !nodes[i].alive || newer_or_same(s->setpoint_seq, s->setpoint_origin, c.seq, c.origin);
+    }
+    if (all) {
+      c.to_all = std::max<uint32_t>(now - c.at, 1);
+    }
+  }
+}
+
+static void print_percentiles(const char* name, std::vector<uint32_t> s) {
+  if (s.empty()) {
+    printf("  %-28s no samples\n", name);
+    return;
+  }
+  std::sort(s.begin(), s.end());
+  printf("  %-28s n=%-6zu p50 %7u  p90 %7u  p99 %7u  max %7u ms\n", name, s.size(), s[s.size() / 2],
+         s[s.size() * 9 / 10], s[s.size() * 99 / 100], s.back());
+}
+
+static void usage(const char* prog) {
+  printf("usage: %s [--nodes N] [--minutes N] [--loss PCT] [--knob S] [--kill-every S] [--down S] [--seed N]\n",
+         prog);
+}
+
+int main(int argc, char** argv) {
+  uint32_t minutes = 60;
+  uint32_t knob_s = 20;
+  uint32_t kill_every_s = 120;
+  uint32_t down_s = 30;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!val) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (!strcmp(arg, "--nodes")) node_count = std::max(1, std::min(PEERSIM_MAX_NODES, atoi(val)));
+    else if (!strcmp(arg, "--minutes")) minutes = std::max(1, atoi(val));
+    else if (!strcmp(arg, "--loss")) loss_pct = atof(val);
+    else if (!strcmp(arg, "--knob")) knob_s = std::max(1, atoi(val));
+    else if (!strcmp(arg, "--kill-every")) kill_every_s = (uint32_t)atol(val);
+    else if (!strcmp(arg, "--down")) down_s = (uint32_t)atol(val);
+    else if (!strcmp(arg, "--seed")) rng = std::max(1, atoi(val));
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+  }
+
+  uint32_t end = minutes * 60000;
+  uint32_t quiet_from = end > PEERSIM_QUIET ? end - PEERSIM_QUIET : 0;
+  uint32_t last_kill = quiet_from > down_s * 1000 ? quiet_from - down_s * 1000 : 0;  // Back up before the quiet end
+  uint32_t next_knob = rand_range(1000, knob_s * 2000);
+  uint32_t next_kill = kill_every_s ? kill_every_s * 1000 : UINT32_MAX;
+  uint32_t next_weather = 60000;
+  uint32_t killed_at = 0;
+  uint32_t frames_sent = 0;
+  uint32_t frames_dropped = 0;
+  uint32_t kills = 0;
+
+  printf("%d nodes, %u minutes, %.1f%% loss, knob every ~%u s, leader killed every %u s for %u s\n", node_count,
+         minutes, loss_pct, knob_s, kill_every_s, down_s);
+  for (int i = 0; i < node_count; i++) {
+    node_start(i);
+  }
+
+  for (now = 0; now < end; now++) {
+    while (!bus.empty() && bus.top().at <= now) {
+      peersim_frame_t f = bus.top();
+      bus.pop();
+      if (nodes[f.to].alive) {
+        peer_receive(&nodes[f.to].peer, f.data, f.len, now);
+      }
+    }
+
+    // The room: temperature drifts, the server switches the boiler on its setpoint
+    if (now >= next_weather) {
+      next_weather = now + 60000;
+      server_temp += server_boiler ? 20 : -15;
+      server_boiler = server_temp < server_setpoint * 100;
+    }
+
+    if (now >= next_knob && now < quiet_from) {
+      next_knob = now + rand_range(1000, knob_s * 2000);
+      int i = rand_range(0, node_count - 1);
+      if (nodes[i].alive) {
+        peer_t* p = &nodes[i].peer;
+        int8_t sp = (int8_t)std::max(10, std::min(70, p->state.setpoint + (int)rand_range(0, 6) - 3));
+        peer_set_setpoint(p, sp, now);
+        changes.push_back({ now, p->state.setpoint_seq, p->state.setpoint_origin, 0, 0 });
+      }
+    }
+
+    if (now >= next_kill && now < last_kill) {
+      next_kill = now + kill_every_s * 1000;
+      int leader = find_leader();
+      if (leader >= 0) {
+        nodes[leader].alive = false;
+        nodes[leader].restart_at = now + down_s * 1000;
+        frames_sent += nodes[leader].peer.stats.frames_sent;
+        frames_dropped += nodes[leader].peer.stats.frames_dropped;
+        kills++;
+        killed_at = now;
+      }
+    }
+
+    for (int i = 0; i < node_count; i++) {
+      peersim_node_t* n = &nodes[i];
+      if (!n->alive) {
+        if (now >= n->restart_at) {
+          node_start(i);
+        }
+        continue;
+      }
+      node_step(n);
+    }
+
+    if (killed_at && find_leader() >= 0) {
+      failover_gaps.push_back(now - killed_at);
+      killed_at = 0;
+    }
+    track_changes();
+  }
+
+  // Agreement once things settled
+  int failures = 0;
+  int leaders = 0;
+  int ref = -1;
+  for (int i = 0; i < node_count; i++) {
+    peersim_node_t* n = &nodes[i];
+    if (!n->alive) {
+      continue;
+    }
+    frames_sent += n->peer.stats.frames_sent;
+    frames_dropped += n->peer.stats.frames_dropped;
+    leaders += n->peer.role == PEER_LEADER;
+    if (ref < 0) {
+      ref = i;
+      continue;
+    }
+    const peer_t* a = &nodes[ref].peer;
+    const peer_t* b = &n->peer;
+    if (a->state.setpoint != b->state.setpoint || a->state.setpoint_seq != b->state.setpoint_seq ||
+        a->state.setpoint_origin != b->state.setpoint_origin || a->leader_id != b->leader_id) {
+      printf("FAIL: node %08x has setpoint %d (%u/%08x) leader %08x, node %08x has %d (%u/%08x) leader %08x\n",
+             a->id, a->state.setpoint, a->state.setpoint_seq, a->state.setpoint_origin, a->leader_id, b->id,
+             b->state.setpoint, b->state.setpoint_seq, b->state.setpoint_origin, b->leader_id);
+      failures++;
+    }
+  }
+  if (leaders != 1) {
+    printf("FAIL: %d leaders at the end\n", leaders);
+    failures++;
+  }
+  if (ref >= 0 && server_setpoint != nodes[ref].peer.state.setpoint) {
+    printf("FAIL: server setpoint %d, nodes %d\n", server_setpoint, nodes[ref].peer.state.setpoint);
+    failures++;
+  }
+
+  std::vector<uint32_t> to_all, to_server;
+  uint32_t lost_changes = 0;
+  for (const auto& c : changes) {
+    if (c.to_all) to_all.push_back(c.to_all);
+    if (c.to_server) to_server.push_back(c.to_server);
+    else lost_changes++;
+  }
+
+  uint32_t total = 0;
+  for (int r = 0; r < REQ_COUNT; r++) {
+    total += server_requests[r];
+  }
+  double per_min = total / (double)minutes;
+  double standalone = node_count * (60000.0 / PEERSIM_TEMP_INTERVAL + 60000.0 / PEERSIM_BOILER_INTERVAL);
+  printf("Server: %.1f requests/min (Temp %u, boilerStatus %u, setTemp %u), %.1f with every unit polling, %.1fx less\n",
+         per_min, server_requests[REQ_TEMP], server_requests[REQ_BOILER], server_requests[REQ_SET_TEMP], standalone,
+         standalone / per_min);
+  printf("Multicast: %.1f frames/min sent, %u lost on the bus, %u dropped by nodes\n", frames_sent / (double)minutes,
+         frames_lost, frames_dropped);
+  printf("Leaders killed %u times, %u setpoint changes, %u never reached the server\n", kills,
+         (uint32_t)changes.size(), lost_changes);
+  print_percentiles("Setpoint to all nodes", to_all);
+  print_percentiles("Setpoint to server", to_server);
+  print_percentiles("Failover gap", failover_gaps);
+  printf("%d failed checks\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+#include <string.h>
+#include "esp_timer.h"
+#include "pixel_kernels.hpp"
+
+#define PX_UDIV255(x) (((x) * 0x8081U) >> 0x17)
+
+#define PX_VEC_LANES 8
+#define PX_VEC_CHUNK 128       // Pixels per px_blend_vec() call, sizes the opacity table
+
+// Vector constants, eight equal lanes each, in the order px_blend_vec() loads them
+enum {
+  PX_K_ONE,
+  PX_K_ROUND,
+  PX_K_FG_R,
+  PX_K_SHL_R,                  // 2048, red back to bits 11-15
+  PX_K_MASK_G,
+  PX_K_FG_G,
+  PX_K_SHL_G,                  // 32
+  PX_K_MASK_B,
+  PX_K_FG_B,
+  PX_K_MASK_LO,                // Byte swap, PX_K_SWAP in pixel_kernels_pie.S
+  PX_K_SHL_LO,                 // 256
+  PX_K_COUNT
+};
+
+// Per block of PX_VEC_LANES pixels: their opacities, then 255 minus each
+typedef struct {
+  uint16_t opa[PX_VEC_LANES];
+  uint16_t inv[PX_VEC_LANES];
+} px_vec_opa_t;
+
+static_assert(PX_K_MASK_LO * PX_VEC_LANES * 2 == 144, "PX_K_SWAP in pixel_kernels_pie.S");
+static_assert(sizeof(px_vec_opa_t) == 32, "two vectors per block");
+
+// Pixel buffers are uint16_t, word access goes through an aliasing type
+typedef uint32_t __attribute__((may_alias)) px_word_t;
+
+static inline uint16_t px_bswap16(uint16_t v) {
+  return (uint16_t)((v << 8) | (v >> 8));
+}
+
+// Both 16-bit halves byte swapped at once
+static inline uint32_t px_bswap16x2(uint32_t v) {
+  return ((v & 0x00FF00FFu) << 8) | ((v >> 8) & 0x00FF00FFu);
+}
+
+static inline uint16_t px_mix(uint16_t fg, uint16_t bg, uint8_t opa) {
+  uint32_t inv = 255 - opa;
+  uint32_t r = PX_UDIV255((fg >> 11) * opa + (bg >> 11) * inv + PX_MIX_ROUND_OFS);
+  uint32_t g = PX_UDIV255(((fg >> 5) & 0x3F) * opa + ((bg >> 5) & 0x3F) * inv + PX_MIX_ROUND_OFS);
+  uint32_t b = PX_UDIV255((fg & 0x1F) * opa + (bg & 0x1F) * inv + PX_MIX_ROUND_OFS);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void px_swap_copy_ref(uint16_t* dst, const uint16_t* src, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = px_bswap16(src[i]);
+  }
+}
+
+void px_fill_ref(uint16_t* dst, uint16_t color, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = color;
+  }
+}
+
+void px_blend_ref(uint16_t* dst, uint16_t color, uint8_t opa, size_t n, bool swapped) {
+  for (size_t i = 0; i < n; i++) {
+    if (swapped) {
+      dst[i] = px_bswap16(px_mix(px_bswap16(color), px_bswap16(dst[i]), opa));
+    } else {
+      dst[i] = px_mix(color, dst[i], opa);
+    }
+  }
+}
+
+// Opacity of one masked pixel, as lv_draw_sw_blend_basic() combines mask and opa
+static inline uint8_t px_mask_opa(uint8_t mask, uint8_t opa) {
+  if (opa >= PX_OPA_MAX) {
+    return mask;
+  }
+  return mask == 255 ? opa : (uint8_t)((mask * opa) >> 8);
+}
+
+void px_blend_mask_ref(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n, bool swapped) {
+  uint16_t fg = swapped ? px_bswap16(color) : color;
+  for (size_t i = 0; i < n; i++) {
+    uint8_t a = px_mask_opa(mask[i], opa);
+    if (swapped) {
+      dst[i] = px_bswap16(px_mix(fg, px_bswap16(dst[i]), a));
+    } else {
+      dst[i] = px_mix(fg, dst[i], a);
+    }
+  }
+}
+
+void px_swap_copy_fast(uint16_t* dst, const uint16_t* src, size_t n) {
+  // Word access needs both pointers on the same 32-bit phase
+  if ((((uintptr_t)dst ^ (uintptr_t)src) & 3) != 0) {
+    px_swap_copy_ref(dst, src, n);
+    return;
+  }
+  if (((uintptr_t)dst & 3) && n) {
+    *dst++ = px_bswap16(*src++);
+    n--;
+  }
+  px_word_t* d = (px_word_t*)dst;
+  const px_word_t* s = (const px_word_t*)src;
+  size_t words = n / 2;
+  while (words >= 4) {
+    uint32_t a = s[0], b = s[1], c = s[2], e = s[3];
+    d[0] = px_bswap16x2(a);
+    d[1] = px_bswap16x2(b);
+    d[2] = px_bswap16x2(c);
+    d[3] = px_bswap16x2(e);
+    d += 4;
+    s += 4;
+    words -= 4;
+  }
+  while (words--) {
+    *d++ = px_bswap16x2(*s++);
+  }
+  if (n & 1) {
+    *(uint16_t*)d = px_bswap16(*(const uint16_t*)s);
+  }
+}
+
+void px_fill_fast(uint16_t* dst, uint16_t color, size_t n) {
+  if (((uintptr_t)dst & 3) && n) {
+    *dst++ = color;
+    n--;
+  }
+  px_word_t* d = (px_word_t*)dst;
+  uint32_t c2 = ((uint32_t)color << 16) | color;
+  size_t words = n / 2;
+  while (words >= 4) {
+    d[0] = c2;
+    d[1] = c2;
+    d[2] = c2;
+    d[3] = c2;
+    d += 4;
+    words -= 4;
+  }
+  while (words--) {
+    *d++ = c2;
+  }
+  if (n & 1) {
+    *(uint16_t*)d = color;
+  }
+}
+
+// blocks x 8 pixels at dst, 16-byte aligned: dst = fg * opa + dst * inv per channel, fg from k
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+extern "C" void px_blend_vec(uint16_t* dst, const px_vec_opa_t* opa, const uint16_t* k, size_t blocks, bool swapped);
+#else
+// The steps of pixel_kernels_pie.S lane by lane, x / 255 as (x + (x >> 8) + 1) >> 8 in 16 bits
+static uint32_t px_lane_div255(uint32_t x, const uint16_t* k) {
+  x = x + (x >> 8) + k[PX_K_ONE * PX_VEC_LANES];
+  return x >> 8;
+}
+
+static void px_blend_vec(uint16_t* dst, const px_vec_opa_t* opa, const uint16_t* k, size_t blocks, bool swapped) {
+  for (; blocks; blocks--, opa++, dst += PX_VEC_LANES) {
+    for (int l = 0; l < PX_VEC_LANES; l++) {
+      const uint16_t* kl = k + l;
+      uint32_t bg = dst[l];
+      if (swapped) {
+        bg = ((bg & kl[PX_K_MASK_LO * PX_VEC_LANES]) * kl[PX_K_SHL_LO * PX_VEC_LANES]) | (bg >> 8);
+      }
+      uint32_t a = opa->opa[l], inv = opa->inv[l], round = kl[PX_K_ROUND * PX_VEC_LANES];
+      uint32_t r = px_lane_div255((bg >> 11) * inv + kl[PX_K_FG_R * PX_VEC_LANES] * a + round, kl);
+      uint32_t g = px_lane_div255(((bg & kl[PX_K_MASK_G * PX_VEC_LANES]) >> 5) * inv +
+                                    kl[PX_K_FG_G * PX_VEC_LANES] * a + round, kl);
+      uint32_t b = px_lane_div255((bg & kl[PX_K_MASK_B * PX_VEC_LANES]) * inv + kl[PX_K_FG_B * PX_VEC_LANES] * a + round,
+                                  kl);
+      uint32_t out = r * kl[PX_K_SHL_R * PX_VEC_LANES] | g * kl[PX_K_SHL_G * PX_VEC_LANES] | b;
+      if (swapped) {
+        out = ((out & kl[PX_K_MASK_LO * PX_VEC_LANES]) * kl[PX_K_SHL_LO * PX_VEC_LANES]) | (out >> 8);
+      }
+      dst[l] = (uint16_t)out;
+    }
+  }
+}
+#endif
+
+static void px_vec_fill_k(uint16_t* k, uint16_t fg) {
+  const uint16_t values[PX_K_COUNT] = {
+    1, PX_MIX_ROUND_OFS, (uint16_t)(fg >> 11), 2048, 0x07E0, (uint16_t)((fg >> 5) & 0x3F), 32, 0x001F,
+    (uint16_t)(fg & 0x1F), 0x00FF, 256
+  };
+  for (int i = 0; i < PX_K_COUNT; i++) {
+    for (int l = 0; l < PX_VEC_LANES; l++) {
+      k[i * PX_VEC_LANES + l] = values[i];
+    }
+  }
+}
+
+// Scalar up to the first 16-byte boundary and after the last whole block, vectors in between.
+// mask NULL blends every pixel with opa.
+static void px_blend_run(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n, bool swapped) {
+  size_t head = (((uintptr_t)-(uintptr_t)dst) & 15) / 2;
+  if (n < PX_BLEND_VEC_MIN || (uintptr_t)dst & 1) {
+    head = n;
+  }
+  if (mask) {
+    px_blend_mask_ref(dst, color, opa, mask, head, swapped);
+    mask += head;
+  } else {
+    px_blend_ref(dst, color, opa, head, swapped);
+  }
+  dst += head;
+  n -= head;
+  if (n < PX_VEC_LANES) {
+    return;
+  }
+
+  uint16_t k[PX_K_COUNT * PX_VEC_LANES] __attribute__((aligned(16)));
+  px_vec_fill_k(k, swapped ? px_bswap16(color) : color);
+  px_vec_opa_t opas[PX_VEC_CHUNK / PX_VEC_LANES] __attribute__((aligned(16)));
+  if (!mask) {
+    for (px_vec_opa_t& o : opas) {
+      for (int l = 0; l < PX_VEC_LANES; l++) {
+        o.opa[l] = opa;
+        o.inv[l] = 255 - opa;
+      }
+    }
+  }
+  while (n >= PX_VEC_LANES) {
+    size_t blocks = n / PX_VEC_LANES;
+    if (blocks > PX_VEC_CHUNK / PX_VEC_LANES) {
+      blocks = PX_VEC_CHUNK / PX_VEC_LANES;
+    }
+    if (mask) {
+      for (size_t i = 0; i < blocks * PX_VEC_LANES; i++) {
+        uint8_t a = px_mask_opa(mask[i], opa);
+        opas[i / PX_VEC_LANES].opa[i % PX_VEC_LANES] = a;
+        opas[i / PX_VEC_LANES].inv[i % PX_VEC_LANES] = 255 - a;
+      }
+      mask += blocks * PX_VEC_LANES;
+    }
+    px_blend_vec(dst, opas, k, blocks, swapped);
+    dst += blocks * PX_VEC_LANES;
+    n -= blocks * PX_VEC_LANES;
+  }
+  if (mask) {
+    px_blend_mask_ref(dst, color, opa, mask, n, swapped);
+  } else {
+    px_blend_ref(dst, color, opa, n, swapped);
+  }
+}
+
+void px_blend_fast(uint16_t* dst, uint16_t color, uint8_t opa, size_t n, bool swapped) {
+  px_blend_run(dst, color, opa, NULL, n, swapped);
+}
+
+void px_blend_mask_fast(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n, bool swapped) {
+  px_blend_run(dst, color, opa, mask, n, swapped);
+}
+
+static uint32_t px_elapsed(int64_t start) {
+  return (uint32_t)(esp_timer_get_time() - start);
+}
+
+bool px_kernels_selftest(px_selftest_t* result, uint16_t* buf_a, uint16_t* buf_b, uint16_t* buf_src, size_t n) {
+  uint32_t seed = 0x12345678;
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    buf_src[i] = (uint16_t)(seed >> 16);
+  }
+  result->exact = true;
+  result->pixels = n;
+
+  // Odd offsets cover the unaligned head and tail handling
+  for (size_t ofs = 0; ofs < 2 && ofs <= n; ofs++) {
+    size_t len = n - ofs;
+    px_swap_copy_ref(buf_a + ofs, buf_src + ofs, len);
+    px_swap_copy_fast(buf_b + ofs, buf_src + ofs, len);
+    result->exact &= memcmp(buf_a + ofs, buf_b + ofs, len * 2) == 0;
+
+    px_fill_ref(buf_a + ofs, 0xA5C3, len);
+    px_fill_fast(buf_b + ofs, 0xA5C3, len);
+    result->exact &= memcmp(buf_a + ofs, buf_b + ofs, len * 2) == 0;
+
+    for (int swapped = 0; swapped < 2; swapped++) {
+      memcpy(buf_a + ofs, buf_src + ofs, len * 2);
+      memcpy(buf_b + ofs, buf_src + ofs, len * 2);
+      px_blend_ref(buf_a + ofs, 0x7BEF, 120, len, swapped);
+      px_blend_fast(buf_b + ofs, 0x7BEF, 120, len, swapped);
+      result->exact &= memcmp(buf_a + ofs, buf_b + ofs, len * 2) == 0;
+
+      // The mask on the other byte phase, opa below and at PX_OPA_MAX
+      const uint8_t* mask = (const uint8_t*)buf_src + 1;
+      for (int opa = 200; opa <= 255; opa += 55) {
+        px_blend_mask_ref(buf_a + ofs, 0xF81F, (uint8_t)opa, mask, len, swapped);
+        px_blend_mask_fast(buf_b + ofs, 0xF81F, (uint8_t)opa, mask, len, swapped);
+        result->exact &= memcmp(buf_a + ofs, buf_b + ofs, len * 2) == 0;
+      }
+    }
+  }
+  // dst and src on different 32-bit phases
+  if (n) {
+    px_swap_copy_ref(buf_a + 1, buf_src, n - 1);
+    px_swap_copy_fast(buf_b + 1, buf_src, n - 1);
+    result->exact &= memcmp(buf_a + 1, buf_b + 1, (n - 1) * 2) == 0;
+  }
+
+  int64_t start = esp_timer_get_time();
+  px_swap_copy_ref(buf_a, buf_src, n);
+  result->swap_copy_us[0] = px_elapsed(start);
+  start = esp_timer_get_time();
+  px_swap_copy_fast(buf_b, buf_src, n);
+  result->swap_copy_us[1] = px_elapsed(start);
+
+  start = esp_timer_get_time();
+  px_fill_ref(buf_a, 0x1234, n);
+  result->fill_us[0] = px_elapsed(start);
+  start = esp_timer_get_time();
+  px_fill_fast(buf_b, 0x1234, n);
+  result->fill_us[1] = px_elapsed(start);
+
+  memcpy(buf_a, buf_src, n * 2);
+  memcpy(buf_b, buf_src, n * 2);
+  start = esp_timer_get_time();
+  px_blend_ref(buf_a, 0x7BEF, 120, n, false);
+  result->blend_us[0] = px_elapsed(start);
+  start = esp_timer_get_time();
+  px_blend_fast(buf_b, 0x7BEF, 120, n, false);
+  result->blend_us[1] = px_elapsed(start);
+
+  const uint8_t* mask = (const uint8_t*)buf_src;
+  start = esp_timer_get_time();
+  px_blend_mask_ref(buf_a, 0x7BEF, 255, mask, n, false);
+  result->blend_mask_us[0] = px_elapsed(start);
+  start = esp_timer_get_time();
+  px_blend_mask_fast(buf_b, 0x7BEF, 255, mask, n, false);
+  result->blend_mask_us[1] = px_elapsed(start);
+
+  return result->exact;
+}
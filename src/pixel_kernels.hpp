@@ -0,0 +1,75 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// RGB565 pixel kernels for the flush and draw paths.
+//
+// Every kernel has a portable scalar reference (px_*_ref) and a variant tuned
+// for the ESP32-S3 (px_*_fast). Copy and fill work on two pixels per 32-bit
+// word. Blend runs eight pixels per 128-bit PIE vector in
+// pixel_kernels_pie.S, on 16-byte aligned blocks with the ends done by the
+// reference. Elsewhere a lane by lane C model of the vector code stands in,
+// so src/pxtest checks its arithmetic on the host. The unsuffixed names
+// resolve at compile time to the fast variant on the S3 and to the reference
+// elsewhere, or everywhere with -DPX_KERNELS_REFERENCE.
+//
+// "swapped" buffers hold byte-swapped RGB565, the LV_COLOR_16_SWAP layout.
+// Blending is bit exact with lv_color_mix() for the same rounding offset, and
+// masked blending with the per pixel opacity of lv_draw_sw_blend_basic().
+
+#ifndef PX_MIX_ROUND_OFS
+#ifdef LV_COLOR_MIX_ROUND_OFS
+#define PX_MIX_ROUND_OFS LV_COLOR_MIX_ROUND_OFS
+#else
+#define PX_MIX_ROUND_OFS 128
+#endif
+#endif
+
+#define PX_OPA_MAX 253       // LV_OPA_MAX, opacities from here on count as opaque
+#define PX_BLEND_VEC_MIN 24  // Shorter runs stay scalar, the vector setup would not pay off
+
+// dst[i] = bswap16(src[i])
+void px_swap_copy_ref(uint16_t* dst, const uint16_t* src, size_t n);
+void px_swap_copy_fast(uint16_t* dst, const uint16_t* src, size_t n);
+
+// dst[i] = color
+void px_fill_ref(uint16_t* dst, uint16_t color, size_t n);
+void px_fill_fast(uint16_t* dst, uint16_t color, size_t n);
+
+// dst[i] = color * opa + dst[i] * (255 - opa), per channel
+void px_blend_ref(uint16_t* dst, uint16_t color, uint8_t opa, size_t n, bool swapped);
+void px_blend_fast(uint16_t* dst, uint16_t color, uint8_t opa, size_t n, bool swapped);
+
+// As px_blend() with the opacity of pixel i taken from mask[i] and opa the way LVGL
+// combines them: mask[i] if opa >= PX_OPA_MAX, else opa if mask[i] is 255, else
+// mask[i] * opa >> 8. Anti-aliased edges are drawn through here.
+void px_blend_mask_ref(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n, bool swapped);
+void px_blend_mask_fast(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n, bool swapped);
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(PX_KERNELS_REFERENCE)
+#define PX_KERNELS_VARIANT "esp32s3"
+#define px_swap_copy px_swap_copy_fast
+#define px_fill px_fill_fast
+#define px_blend px_blend_fast
+#define px_blend_mask px_blend_mask_fast
+#else
+#define PX_KERNELS_VARIANT "reference"
+#define px_swap_copy px_swap_copy_ref
+#define px_fill px_fill_ref
+#define px_blend px_blend_ref
+#define px_blend_mask px_blend_mask_ref
+#endif
+
+typedef struct {
+  bool exact;                // Fast variants match the reference bit for bit
+  uint32_t swap_copy_us[2];  // Reference, fast
+  uint32_t fill_us[2];
+  uint32_t blend_us[2];
+  uint32_t blend_mask_us[2];
+  uint32_t pixels;
+} px_selftest_t;
+
+// Checks the fast kernels against the reference on pseudo random data and times both. buf_src
+// doubles as the blend mask. Any n, buffers need only be 16-bit aligned.
+bool px_kernels_selftest(px_selftest_t* result, uint16_t* buf_a, uint16_t* buf_b, uint16_t* buf_src, size_t n);
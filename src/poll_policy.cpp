@@ -0,0 +1,56 @@
+#include <string.h>
+#include "poll_policy.hpp"
+
+#define POLL_STATS_PERIOD 3600000  // 1 hour
+
+static uint32_t fixed_interval(poll_endpoint_t endpoint, const poll_ctx_t* ctx) {
+  (void)ctx;
+  return endpoint == POLL_TEMP ? TEMP_FETCH_INTERVAL : BOILER_STATUS_FETCH_INTERVAL;
+}
+
+static uint32_t adaptive_interval(poll_endpoint_t endpoint, const poll_ctx_t* ctx) {
+  bool temp = endpoint == POLL_TEMP;
+  uint32_t since_change = ctx->now - ctx->last_setpoint_change;
+  uint32_t since_boiler = ctx->now - ctx->last_boiler_change;
+
+  // A fresh change from the user or the boiler wants quick feedback
+  if (since_change < POLL_FAST_WINDOW || since_boiler < POLL_FAST_WINDOW) {
+    return temp ? POLL_FAST_TEMP_INTERVAL : POLL_FAST_BOILER_STATUS_INTERVAL;
+  }
+  // Nobody is looking, the boiler turning on wakes the screen on the next keep-alive
+  if (!ctx->screen_on && !ctx->boiler_on) {
+    return temp ? POLL_IDLE_TEMP_INTERVAL : POLL_IDLE_BOILER_STATUS_INTERVAL;
+  }
+  uint32_t since_temp = ctx->now - ctx->last_temp_change;
+  if (since_temp >= POLL_STABLE_AFTER && since_boiler >= POLL_STABLE_AFTER) {
+    return temp ? POLL_STABLE_TEMP_INTERVAL : POLL_STABLE_BOILER_STATUS_INTERVAL;
+  }
+  return temp ? TEMP_FETCH_INTERVAL : BOILER_STATUS_FETCH_INTERVAL;
+}
+
+const poll_policy_t poll_policy_fixed = {"fixed", fixed_interval};
+const poll_policy_t poll_policy_adaptive = {"adaptive", adaptive_interval};
+
+void poll_stats_count(poll_stats_t* stats, poll_endpoint_t endpoint) {
+  stats->requests[endpoint]++;
+}
+
+bool poll_stats_roll(poll_stats_t* stats, uint32_t now, poll_stats_t* last) {
+  if (now - stats->hour_start < POLL_STATS_PERIOD) {
+    return false;
+  }
+  *last = *stats;
+  memset(stats, 0, sizeof(*stats));
+  stats->hour_start = now;
+  return true;
+}
+
+const char* poll_endpoint_str(poll_endpoint_t endpoint) {
+  switch (endpoint) {
+    case POLL_TEMP: return "Temp";
+    case POLL_BOILER_STATUS: return "boilerStatus";
+    case POLL_SET_TEMP: return "setTemp";
+    case POLL_ENDPOINT_COUNT: break;
+  }
+  return "unknown";
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "stdint.h"
+
+// Pluggable polling policies for the server endpoints.
+//
+// A policy maps the current system state to the interval before the next poll
+// of an endpoint. The fixed policy reproduces the original 5 s / 2 s cadence,
+// the adaptive one polls fast after a setpoint change or boiler transition,
+// backs off while readings are stable and keeps a slow keep-alive while the
+// screen is off.
+
+#define TEMP_FETCH_INTERVAL 5000           // 5 seconds
+#define BOILER_STATUS_FETCH_INTERVAL 2000  // 2 seconds
+
+#define POLL_FAST_WINDOW 30000             // Fast polling after a change
+#define POLL_FAST_TEMP_INTERVAL 2000
+#define POLL_FAST_BOILER_STATUS_INTERVAL 1000
+#define POLL_STABLE_AFTER 120000           // Readings unchanged for this long are stable
+#define POLL_STABLE_TEMP_INTERVAL 20000
+#define POLL_STABLE_BOILER_STATUS_INTERVAL 10000
+#define POLL_IDLE_TEMP_INTERVAL 60000      // Keep-alive while the screen is off
+#define POLL_IDLE_BOILER_STATUS_INTERVAL 30000
+
+typedef enum {
+  POLL_TEMP,
+  POLL_BOILER_STATUS,
+  POLL_SET_TEMP,
+  POLL_ENDPOINT_COUNT
+} poll_endpoint_t;
+
+typedef struct {
+  uint32_t now;
+  uint32_t last_setpoint_change;
+  uint32_t last_boiler_change;
+  uint32_t last_temp_change;
+  bool screen_on;
+  bool boiler_on;
+} poll_ctx_t;
+
+typedef struct {
+  const char* name;
+  uint32_t (*interval)(poll_endpoint_t endpoint, const poll_ctx_t* ctx);
+} poll_policy_t;
+
+extern const poll_policy_t poll_policy_fixed;
+extern const poll_policy_t poll_policy_adaptive;
+
+typedef struct {
+  uint32_t hour_start;
+  uint32_t requests[POLL_ENDPOINT_COUNT];
+} poll_stats_t;
+
+void poll_stats_count(poll_stats_t* stats, poll_endpoint_t endpoint);
+
+// Returns true once per hour with the counts of the hour that just ended in *last
+bool poll_stats_roll(poll_stats_t* stats, uint32_t now, poll_stats_t* last);
+
+const char* poll_endpoint_str(poll_endpoint_t endpoint);
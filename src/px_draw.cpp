@@ -0,0 +1,53 @@
+#include "pixel_kernels.hpp"
+#include "px_draw.hpp"
+
+static void px_draw_blend(lv_draw_ctx_t* draw_ctx, const lv_draw_sw_blend_dsc_t* dsc) {
+  // Without anti-aliasing LVGL rounds the mask first, that stays with the software renderer
+  lv_disp_t* disp = _lv_refr_get_disp_refreshing();
+  bool masked = dsc->mask_buf != NULL && dsc->mask_res != LV_DRAW_MASK_RES_FULL_COVER;
+  if (dsc->src_buf != NULL || dsc->blend_mode != LV_BLEND_MODE_NORMAL || (masked && !disp->driver->antialiasing)) {
+    lv_draw_sw_blend_basic(draw_ctx, dsc);
+    return;
+  }
+  if (dsc->opa <= LV_OPA_MIN || (masked && dsc->mask_res == LV_DRAW_MASK_RES_TRANSP)) {
+    return;
+  }
+
+  lv_area_t area;
+  if (!_lv_area_intersect(&area, dsc->blend_area, draw_ctx->clip_area)) {
+    return;
+  }
+  const lv_area_t* buf_area = draw_ctx->buf_area;
+  int32_t stride = lv_area_get_width(buf_area);
+  int32_t w = lv_area_get_width(&area);
+  uint16_t* dest = (uint16_t*)draw_ctx->buf + stride * (area.y1 - buf_area->y1) + (area.x1 - buf_area->x1);
+  const lv_opa_t* mask = NULL;
+  int32_t mask_stride = 0;
+  if (masked) {
+    mask_stride = lv_area_get_width(dsc->mask_area);
+    mask = dsc->mask_buf + mask_stride * (area.y1 - dsc->mask_area->y1) + (area.x1 - dsc->mask_area->x1);
+  }
+
+  for (int32_t y = area.y1; y <= area.y2; y++) {
+    if (mask) {
+      px_blend_mask(dest, dsc->color.full, dsc->opa, mask, w, LV_COLOR_16_SWAP != 0);
+      mask += mask_stride;
+    } else if (dsc->opa >= LV_OPA_MAX) {
+      px_fill(dest, dsc->color.full, w);
+    } else {
+      px_blend(dest, dsc->color.full, dsc->opa, w, LV_COLOR_16_SWAP != 0);
+    }
+    dest += stride;
+  }
+}
+
+static void px_draw_ctx_init(lv_disp_drv_t* drv, lv_draw_ctx_t* draw_ctx) {
+  lv_draw_sw_init_ctx(drv, draw_ctx);
+  ((lv_draw_sw_ctx_t*)draw_ctx)->blend = px_draw_blend;
+}
+
+void px_draw_install(lv_disp_drv_t* drv) {
+  drv->draw_ctx_init = px_draw_ctx_init;
+  drv->draw_ctx_deinit = lv_draw_sw_deinit_ctx;
+  drv->draw_ctx_size = sizeof(lv_draw_sw_ctx_t);
+}
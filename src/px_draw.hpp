@@ -0,0 +1,10 @@
+#pragma once
+
+#include <lvgl.h>
+
+// Routes LVGL's solid, translucent and masked fills through the pixel kernels,
+// masked covers the anti-aliased edges of arcs, rounded corners and text.
+// Image blits, non-normal blending and masks without anti-aliasing stay with
+// the LVGL software renderer.
+// Call before lv_disp_drv_register().
+void px_draw_install(lv_disp_drv_t* drv);
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pixel_kernels.hpp"
+
+// The pixel kernels (pixel_kernels.hpp) on the host:
+//
+//   pio run -e pxtest && .pio/build/pxtest/program [--runs N]
+//
+// Runs px_kernels_selftest() for lengths around the word, unroll and vector
+// boundaries, with each buffer 32-bit aligned and one pixel off, and checks
+// that nothing outside the buffers was written. Blending, reference and fast,
+// is checked against the exact per channel formula of lv_color_mix(), for
+// every opacity, both byte orders and at the ends of the range, starting at
+// every pixel of a 16-byte block. Masked blending is checked against the way
+// lv_draw_sw_blend_basic() combines mask and opacity, for every mask value.
+// Off the S3 the fast blend is the C model of the PIE kernel, so this checks
+// its arithmetic and the split into head, vectors and tail, not the assembly;
+// the S3 compares the two at boot. Then times a 480 x 32 draw buffer stripe
+// and prints the best of --runs. Host timings only rank the variants, the S3
+// prints its own at boot (PX_KERNELS_SELFTEST in main.cpp). Exits with 1 on
+// any mismatch.
+
+#define PXTEST_STRIPE (480 * 32)
+#define PXTEST_GUARD 4              // Pixels either side of every buffer
+#define PXTEST_GUARD_VALUE 0xDEAD
+
+static const size_t lengths[] = { 0,   1,   2,   3,   4,   5,   7,   8,   9,   15,  16,
+                                  17,  23,  24,  25,  31,  32,  33,  127, 128, 129, 255,
+                                  PXTEST_STRIPE - 1, PXTEST_STRIPE };
+
+static unsigned failures = 0;
+
+#define PXTEST_CHECK(cond, ...)                   \
+  do {                                            \
+    if (!(cond)) {                                \
+      failures++;                                 \
+      printf("FAIL %s: ", #cond);                 \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+// A buffer of n pixels, one pixel past a 32-bit boundary if odd, with guards around it
+typedef struct {
+  uint32_t* mem;
+  uint16_t* px;
+  size_t n;
+} pxtest_buf_t;
+
+static void buf_alloc(pxtest_buf_t* buf, size_t n, bool odd) {
+  buf->mem = (uint32_t*)malloc((n + 2 * PXTEST_GUARD + 2) * 2);
+  uint16_t* base = (uint16_t*)buf->mem;
+  for (size_t i = 0; i < n + 2 * PXTEST_GUARD + 2; i++) {
+    base[i] = PXTEST_GUARD_VALUE;
+  }
+  buf->px = base + PXTEST_GUARD + (odd ? 1 : 0);
+  buf->n = n;
+}
+
+static bool buf_guards_intact(const pxtest_buf_t* buf) {
+  for (size_t i = 1; i <= PXTEST_GUARD; i++) {
+    if (buf->px[-(ptrdiff_t)i] != PXTEST_GUARD_VALUE || buf->px[buf->n + i - 1] != PXTEST_GUARD_VALUE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint16_t bswap16(uint16_t v) {
+  return (uint16_t)((v << 8) | (v >> 8));
+}
+
+// lv_color_mix() for RGB565, with a true division
+static uint16_t mix_exact(uint16_t fg, uint16_t bg, uint8_t opa) {
+  uint32_t inv = 255 - opa;
+  uint32_t r = ((fg >> 11) * opa + (bg >> 11) * inv + PX_MIX_ROUND_OFS) / 255;
+  uint32_t g = (((fg >> 5) & 0x3F) * opa + ((bg >> 5) & 0x3F) * inv + PX_MIX_ROUND_OFS) / 255;
+  uint32_t b = ((fg & 0x1F) * opa + (bg & 0x1F) * inv + PX_MIX_ROUND_OFS) / 255;
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void check_selftest(void) {
+  for (size_t n : lengths) {
+    for (int phase = 0; phase < 8; phase++) {
+      pxtest_buf_t a, b, src;
+      buf_alloc(&a, n, phase & 1);
+      buf_alloc(&b, n, phase & 2);
+      buf_alloc(&src, n, phase & 4);
+      px_selftest_t result;
+      bool exact = px_kernels_selftest(&result, a.px, b.px, src.px, n);
+      PXTEST_CHECK(exact && result.exact && result.pixels == n, "%zu px, phases %d: fast kernels differ", n, phase);
+      PXTEST_CHECK(buf_guards_intact(&a) && buf_guards_intact(&b) && buf_guards_intact(&src),
+                   "%zu px, phases %d: wrote outside the buffers", n, phase);
+      free(a.mem);
+      free(b.mem);
+      free(src.mem);
+    }
+  }
+}
+
+static const uint16_t colors[] = { 0x0000, 0xFFFF, 0x7BEF, 0xF800, 0x07E0, 0x001F, 0xA5C3 };
+
+// 256 backgrounds starting with black and white, the rest pseudo random
+static void fill_backgrounds(uint16_t* bg, size_t n) {
+  uint32_t seed = 0x9E3779B9;
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    bg[i] = i < 2 ? (i ? 0xFFFF : 0x0000) : (uint16_t)(seed >> 16);
+  }
+}
+
+// lv_draw_sw_blend_basic() fill_normal() for one masked pixel
+static uint16_t mask_exact(uint16_t fg, uint16_t bg, uint8_t mask, uint8_t opa) {
+  if (mask == 0) {
+    return bg;
+  }
+  uint8_t a = opa >= 253 ? mask : mask == 255 ? opa : (uint8_t)((mask * opa) >> 8);
+  return a == 255 ? fg : mix_exact(fg, bg, a);
+}
+
+typedef void (*blend_fn_t)(uint16_t* dst, uint16_t color, uint8_t opa, size_t n, bool swapped);
+typedef void (*blend_mask_fn_t)(uint16_t* dst, uint16_t color, uint8_t opa, const uint8_t* mask, size_t n,
+                                bool swapped);
+
+static void check_blend(const char* name, blend_fn_t blend) {
+  size_t n = 256;
+  uint16_t bg[256];
+  fill_backgrounds(bg, n);
+  unsigned wrong = 0;
+  bool guards = true;
+  // Every pixel of a 16-byte block as the first one
+  for (int phase = 0; phase < 8; phase++) {
+    pxtest_buf_t buf;
+    buf_alloc(&buf, n + phase, false);
+    uint16_t* dst = buf.px + phase;
+    for (uint16_t color : colors) {
+      for (int opa = 0; opa <= 255; opa++) {
+        for (int swapped = 0; swapped < 2; swapped++) {
+          for (size_t i = 0; i < n; i++) {
+            dst[i] = swapped ? bswap16(bg[i]) : bg[i];
+          }
+          blend(dst, swapped ? bswap16(color) : color, (uint8_t)opa, n - phase, swapped);
+          for (size_t i = 0; i < n; i++) {
+            uint16_t got = swapped ? bswap16(dst[i]) : dst[i];
+            uint16_t want = i >= n - phase ? bg[i]
+                            : opa == 0     ? bg[i]
+                            : opa == 255   ? color
+                                           : mix_exact(color, bg[i], (uint8_t)opa);
+            wrong += got != want;
+          }
+        }
+      }
+    }
+    guards &= buf_guards_intact(&buf);
+    free(buf.mem);
+  }
+  PXTEST_CHECK(wrong == 0, "%s: %u blended pixels differ from lv_color_mix()", name, wrong);
+  PXTEST_CHECK(guards, "%s wrote outside the buffer", name);
+}
+
+static void check_blend_mask(const char* name, blend_mask_fn_t blend) {
+  static const uint8_t opas[] = { 0, 1, 2, 64, 127, 128, 200, 252, 253, 254, 255 };
+  size_t n = 256;
+  uint16_t bg[256];
+  fill_backgrounds(bg, n);
+  // Every mask value, in an order that puts different values side by side
+  uint8_t mask_mem[256 + 3];
+  for (size_t i = 0; i < n; i++) {
+    mask_mem[i] = (uint8_t)(i * 167);
+  }
+  mask_mem[256] = mask_mem[257] = mask_mem[258] = 0xAA;
+  unsigned wrong = 0;
+  bool guards = true;
+  for (int phase = 0; phase < 8; phase++) {
+    pxtest_buf_t buf;
+    buf_alloc(&buf, n + phase, false);
+    uint16_t* dst = buf.px + phase;
+    const uint8_t* mask = mask_mem + phase % 4;
+    for (uint16_t color : colors) {
+      for (uint8_t opa : opas) {
+        for (int swapped = 0; swapped < 2; swapped++) {
+          for (size_t i = 0; i < n; i++) {
+            dst[i] = swapped ? bswap16(bg[i]) : bg[i];
+          }
+          blend(dst, swapped ? bswap16(color) : color, opa, mask, n - phase, swapped);
+          for (size_t i = 0; i < n; i++) {
+            uint16_t got = swapped ? bswap16(dst[i]) : dst[i];
+            uint16_t want = i >= n - phase ? bg[i] : mask_exact(color, bg[i], mask[i], opa);
+            wrong += got != want;
+          }
+        }
+      }
+    }
+    guards &= buf_guards_intact(&buf);
+    free(buf.mem);
+  }
+  PXTEST_CHECK(wrong == 0, "%s: %u masked pixels differ from lv_draw_sw_blend_basic()", name, wrong);
+  PXTEST_CHECK(guards, "%s wrote outside the buffer", name);
+}
+
+static void report_timings(int runs) {
+  size_t n = PXTEST_STRIPE;
+  pxtest_buf_t a, b, src;
+  buf_alloc(&a, n, false);
+  buf_alloc(&b, n, false);
+  buf_alloc(&src, n, false);
+  px_selftest_t best;
+  memset(&best, 0xFF, sizeof(best));
+  for (int r = 0; r < runs; r++) {
+    px_selftest_t t;
+    px_kernels_selftest(&t, a.px, b.px, src.px, n);
+    for (int v = 0; v < 2; v++) {
+      best.swap_copy_us[v] = t.swap_copy_us[v] < best.swap_copy_us[v] ? t.swap_copy_us[v] : best.swap_copy_us[v];
+      best.fill_us[v] = t.fill_us[v] < best.fill_us[v] ? t.fill_us[v] : best.fill_us[v];
+      best.blend_us[v] = t.blend_us[v] < best.blend_us[v] ? t.blend_us[v] : best.blend_us[v];
+      best.blend_mask_us[v] = t.blend_mask_us[v] < best.blend_mask_us[v] ? t.blend_mask_us[v] : best.blend_mask_us[v];
+    }
+  }
+  printf("%zu px, best of %d, ref/fast us: swap-copy %u/%u fill %u/%u blend %u/%u masked blend %u/%u\n", n, runs,
+         best.swap_copy_us[0], best.swap_copy_us[1], best.fill_us[0], best.fill_us[1], best.blend_us[0],
+         best.blend_us[1], best.blend_mask_us[0], best.blend_mask_us[1]);
+  free(a.mem);
+  free(b.mem);
+  free(src.mem);
+}
+
+int main(int argc, char** argv) {
+  int runs = 50;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else {
+      printf("usage: %s [--runs N]\n", argv[0]);
+      return 2;
+    }
+  }
+  check_selftest();
+  check_blend("px_blend_ref", px_blend_ref);
+  check_blend("px_blend_fast", px_blend_fast);
+  check_blend_mask("px_blend_mask_ref", px_blend_mask_ref);
+  check_blend_mask("px_blend_mask_fast", px_blend_mask_fast);
+  report_timings(runs > 0 ? runs : 1);
+  printf("%u failed checks\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,321 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "schedule.hpp"
+
+#define SCHEDULE_PACK_VERSION 1
+#define MINUTES_PER_WEEK (7 * 24 * 60)
+#define SECONDS_PER_WEEK (7 * 86400)
+
+static const char* const day_names[7] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun" };
+
+// Days since 1970-01-01 of a civil date
+static int64_t days_from_civil(int y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = (int)(y - era * 400);
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+int64_t schedule_local(int64_t utc) {
+  time_t t = (time_t)utc;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  return days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 86400 + tm.tm_hour * 3600 +
+         tm.tm_min * 60 + tm.tm_sec;
+}
+
+// Monday 00:00 of the week holding local, 1970-01-01 was a Thursday
+static int64_t week_start(int64_t local) {
+  int64_t days = local / 86400;
+  return (days - (days + 3) % 7) * 86400;
+}
+
+int schedule_active(const schedule_t* s, int64_t local) {
+  if (!s->count) {
+    return -1;
+  }
+  uint16_t minute = (uint16_t)((local - week_start(local)) / 60);
+  // Entries at or before minute, the one before the first is last week's last
+  int lo = 0;
+  int hi = s->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (s->entries[mid].minute <= minute) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo ? lo - 1 : s->count - 1;
+}
+
+// Latest start of entry i at or before local
+static int64_t occurrence(const schedule_t* s, int i, int64_t local) {
+  int64_t t = week_start(local) + s->entries[i].minute * 60;
+  return t > local ? t - SECONDS_PER_WEEK : t;
+}
+
+int schedule_due(schedule_t* s, int64_t utc) {
+  int64_t local = schedule_local(utc);
+  if (!s->count || !s->last || local < s->last - SCHEDULE_MAX_STEP_BACK) {
+    s->last = local;
+    return -1;
+  }
+  if (local <= s->last) {
+    // Repeated hour or a small step back, wait until past the point already evaluated
+    return -1;
+  }
+  int i = schedule_active(s, local);
+  bool fire = occurrence(s, i, local) > s->last;
+  s->last = local;
+  return fire ? s->entries[i].setpoint : -1;
+}
+
+// UTC of local wall time local read as standard (isdst 0) or daylight saving time (1)
+static int64_t utc_as(int64_t local, int isdst) {
+  time_t t = (time_t)local;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  tm.tm_isdst = isdst;
+  return (int64_t)mktime(&tm);
+}
+
+// First UTC second after utc at which local time reaches local. A time repeated in autumn is
+// reached at its first pass still ahead, one skipped in spring when the clock jumps over it.
+static int64_t utc_reaching(int64_t local, int64_t utc) {
+  int64_t std = utc_as(local, 0);
+  int64_t dst = utc_as(local, 1);
+  bool std_ok = std > utc && schedule_local(std) == local;
+  bool dst_ok = dst > utc && schedule_local(dst) == local;
+  if (std_ok || dst_ok) {
+    return std_ok && (!dst_ok || std < dst) ? std : dst;
+  }
+  if (schedule_local(std) == local || schedule_local(dst) == local) {
+    return utc;
+  }
+  // In the gap: the jump lies between the two readings, local time only moves forward in between
+  int64_t lo = std < dst ? std : dst;
+  int64_t hi = std < dst ? dst : std;
+  while (hi - lo > 1) {
+    int64_t mid = lo + (hi - lo) / 2;
+    if (schedule_local(mid) >= local) {
+      hi = mid;
+    } else {
+      lo = mid;
+    }
+  }
+  return hi > utc ? hi : utc;
+}
+
+uint32_t schedule_wait(const schedule_t* s, int64_t utc_ms) {
+  if (!s->count) {
+    return SCHEDULE_MAX_WAIT;
+  }
+  // Through the repeated autumn hour local time is behind the point already evaluated
+  int64_t utc = utc_ms / 1000;
+  int64_t local = schedule_local(utc);
+  int64_t from = local > s->last ? local : s->last;
+  int next = (schedule_active(s, from) + 1) % s->count;
+  int64_t t = occurrence(s, next, from);
+  if (t <= from) {
+    t += SECONDS_PER_WEEK;
+  }
+  int64_t wait = utc_reaching(t, utc) * 1000 - utc_ms;
+  return wait > SCHEDULE_MAX_WAIT ? SCHEDULE_MAX_WAIT : wait < 0 ? 0 : (uint32_t)wait;
+}
+
+void schedule_init(schedule_t* s) {
+  memset(s, 0, sizeof(*s));
+}
+
+// Sorted insert, an entry at the same minute is replaced
+static bool insert(schedule_t* s, uint16_t minute, int8_t setpoint) {
+  int i = 0;
+  while (i < s->count && s->entries[i].minute < minute) {
+    i++;
+  }
+  if (i < s->count && s->entries[i].minute == minute) {
+    s->entries[i].setpoint = setpoint;
+    return true;
+  }
+  if (s->count == SCHEDULE_MAX_ENTRIES) {
+    return false;
+  }
+  memmove(&s->entries[i + 1], &s->entries[i], (s->count - i) * sizeof(s->entries[0]));
+  s->entries[i].minute = minute;
+  s->entries[i].setpoint = setpoint;
+  s->count++;
+  return true;
+}
+
+static int parse_day(const char** p) {
+  for (int d = 0; d < 7; d++) {
+    if (!strncasecmp(*p, day_names[d], 3)) {
+      *p += 3;
+      return d;
+    }
+  }
+  return -1;
+}
+
+// "*", "Mon", "Mon-Fri", "Sat,Sun" and mixes of them, as a bit per day
+static uint8_t parse_days(const char** p) {
+  if (**p == '*') {
+    (*p)++;
+    return 0x7f;
+  }
+  uint8_t mask = 0;
+  do {
+    if (**p == ',') {
+      (*p)++;
+    }
+    int first = parse_day(p);
+    int last = first;
+    if (first >= 0 && **p == '-') {
+      (*p)++;
+      last = parse_day(p);
+    }
+    if (first < 0 || last < 0) {
+      return 0;
+    }
+    for (int d = first;; d = (d + 1) % 7) {
+      mask |= 1 << d;
+      if (d == last) {
+        break;
+      }
+    }
+  } while (**p == ',');
+  return mask;
+}
+
+bool schedule_parse(schedule_t* s, const char* text, int min_setpoint, int max_setpoint) {
+  schedule_t t;
+  schedule_init(&t);
+  const char* p = text;
+  for (;;) {
+    while (isspace((unsigned char)*p) || *p == ';') {
+      p++;
+    }
+    if (!*p) {
+      break;
+    }
+    uint8_t days = parse_days(&p);
+    int hour, minute, setpoint, n = 0;
+    if (!days || sscanf(p, " %d:%d %d%n", &hour, &minute, &setpoint, &n) != 3 || hour < 0 || hour > 23 ||
+        minute < 0 || minute > 59 || setpoint < min_setpoint || setpoint > max_setpoint) {
+      return false;
+    }
+    p += n;
+    if (*p && *p != ';' && !isspace((unsigned char)*p)) {
+      return false;
+    }
+    for (int d = 0; d < 7; d++) {
+      if ((days & (1 << d)) && !insert(&t, (uint16_t)(d * 1440 + hour * 60 + minute), (int8_t)setpoint)) {
+        return false;
+      }
+    }
+  }
+  memcpy(s->entries, t.entries, sizeof(t.entries));
+  s->count = t.count;
+  return true;
+}
+
+size_t schedule_format(const schedule_t* s, char* buf, size_t size) {
+  size_t len = 0;
+  if (size) {
+    buf[0] = '\0';
+  }
+  for (int i = 0; i < s->count && len < size; i++) {
+    const schedule_entry_t* e = &s->entries[i];
+    int n = snprintf(buf + len, size - len, "%s %02d:%02d %d\n", day_names[e->minute / 1440], e->minute % 1440 / 60,
+                     e->minute % 60, e->setpoint);
+    len += n > 0 ? (size_t)n : 0;
+  }
+  return len < size ? len : size - 1;
+}
+
+// Version, count, then minute (little endian) and setpoint per entry
+size_t schedule_pack(const schedule_t* s, uint8_t* buf, size_t size) {
+  if (size < SCHEDULE_PACK_SIZE(s->count)) {
+    return 0;
+  }
+  buf[0] = SCHEDULE_PACK_VERSION;
+  buf[1] = s->count;
+  for (int i = 0; i < s->count; i++) {
+    buf[2 + 3 * i] = (uint8_t)s->entries[i].minute;
+    buf[3 + 3 * i] = (uint8_t)(s->entries[i].minute >> 8);
+    buf[4 + 3 * i] = (uint8_t)s->entries[i].setpoint;
+  }
+  return SCHEDULE_PACK_SIZE(s->count);
+}
+
+bool schedule_unpack(schedule_t* s, const uint8_t* buf, size_t len) {
+  if (len < 2 || buf[0] != SCHEDULE_PACK_VERSION || buf[1] > SCHEDULE_MAX_ENTRIES ||
+      len != SCHEDULE_PACK_SIZE(buf[1])) {
+    return false;
+  }
+  schedule_entry_t entries[SCHEDULE_MAX_ENTRIES];
+  for (int i = 0; i < buf[1]; i++) {
+    entries[i].minute = (uint16_t)(buf[2 + 3 * i] | buf[3 + 3 * i] << 8);
+    entries[i].setpoint = (int8_t)buf[4 + 3 * i];
+    if (entries[i].minute >= MINUTES_PER_WEEK || (i && entries[i].minute <= entries[i - 1].minute)) {
+      return false;
+    }
+  }
+  memcpy(s->entries, entries, buf[1] * sizeof(entries[0]));
+  s->count = buf[1];
+  return true;
+}
+
+bool schedule_clock_now(schedule_clock_t* c, uint32_t at, int64_t* utc_ms) {
+  if (!c->valid) {
+    return false;
+  }
+  uint32_t elapsed = at - c->base_at;
+  int64_t corrected = elapsed - (int64_t)elapsed * c->drift / 1000000;
+  if (elapsed >= 0x40000000) {
+    // Rebase well before the tick wraps
+    c->base += corrected;
+    c->base_at = at;
+    corrected = 0;
+  }
+  *utc_ms = c->base + corrected;
+  return true;
+}
+
+void schedule_clock_set(schedule_clock_t* c, int64_t utc_ms, uint32_t at, bool sntp) {
+  int64_t now;
+  int64_t step = schedule_clock_now(c, at, &now) ? utc_ms - now : 0;
+  c->last_step = (int32_t)(step > INT32_MAX ? INT32_MAX : step < INT32_MIN ? INT32_MIN : step);
+  c->valid = true;
+  c->base = utc_ms;
+  c->base_at = at;
+  if (!sntp) {
+    return;
+  }
+
+  // Drift of the tick itself between two fixes far enough apart, a changed clock restarts the measurement
+  int64_t span = utc_ms - c->fix;
+  int64_t ticks = (uint32_t)(at - c->fix_at);
+  int64_t off = ticks - span;
+  if (c->fixed && span < SCHEDULE_DRIFT_MIN_SPAN && off > -SCHEDULE_CLOCK_STEP && off < SCHEDULE_CLOCK_STEP) {
+    return;
+  }
+  if (c->fixed && off > -SCHEDULE_CLOCK_STEP && off < SCHEDULE_CLOCK_STEP) {
+    int32_t ppm = (int32_t)(off * 1000000 / span);
+    int32_t drift = c->drift + (ppm - c->drift) / 2;
+    c->drift = drift > SCHEDULE_MAX_DRIFT ? SCHEDULE_MAX_DRIFT : drift < -SCHEDULE_MAX_DRIFT ? -SCHEDULE_MAX_DRIFT : drift;
+  }
+  c->fixed = true;
+  c->fix = utc_ms;
+  c->fix_at = at;
+}
+
+const char* schedule_day_str(int day) {
+  return day >= 0 && day < 7 ? day_names[day] : "?";
+}
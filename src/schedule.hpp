@@ -0,0 +1,87 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// Weekly setpoint schedule.
+//
+// The table holds up to SCHEDULE_MAX_ENTRIES transitions, each a minute of the
+// week in local time and the setpoint that starts there. It is sorted by
+// minute, so the entry in force is found by binary search, and packs into 3
+// bytes per entry for NVS. Local time comes from the POSIX TZ rules behind
+// localtime_r().
+//
+// An entry fires once, when local time moves past it:
+//   - Entries skipped by the spring forward gap fire when the clock jumps, the
+//     latest of them wins.
+//   - The hour repeated in autumn does not fire again, local time has to pass
+//     the last point evaluated first.
+//   - A clock jump forward fires only the latest entry crossed, after a week
+//     that is the entry in force.
+//   - A jump back of more than SCHEDULE_MAX_STEP_BACK is a corrected clock and
+//     restarts from the new time without firing.
+// A setpoint from the knob or the server holds until the next transition.
+//
+// schedule_clock_t keeps UTC between SNTP fixes on the ms tick, corrected by
+// the drift measured across fixes. The RTC time seeds it at boot.
+
+#define SCHEDULE_MAX_ENTRIES 64
+#define SCHEDULE_MAX_STEP_BACK 7200     // s, more than the DST change
+#define SCHEDULE_MAX_WAIT 3600000       // ms between evaluations, catches a clock that moved without a fix
+#define SCHEDULE_DRIFT_MIN_SPAN 1800000 // ms between fixes to measure drift over
+#define SCHEDULE_CLOCK_STEP 60000       // ms, a fix this far off is a clock change, not drift
+#define SCHEDULE_MAX_DRIFT 500          // ppm
+#define SCHEDULE_PACK_SIZE(n) (2 + 3 * (size_t)(n))
+
+typedef struct {
+  uint16_t minute;        // Of the week, Monday 00:00 is 0
+  int8_t setpoint;
+} schedule_entry_t;
+
+typedef struct {
+  schedule_entry_t entries[SCHEDULE_MAX_ENTRIES];
+  uint8_t count;
+  int64_t last;           // Local time in s evaluated up to, 0 if never
+} schedule_t;
+
+typedef struct {
+  bool valid;
+  bool fixed;             // At least one SNTP fix
+  int64_t base;           // UTC ms at base_at
+  uint32_t base_at;       // Tick in ms
+  int64_t fix;            // Last SNTP fix, UTC ms
+  uint32_t fix_at;
+  int32_t drift;          // ppm the tick runs fast
+  int32_t last_step;      // ms the last fix moved the clock
+} schedule_clock_t;
+
+void schedule_init(schedule_t* s);
+
+// "Mon-Fri 06:30 21; Sat,Sun 08:00 20; * 22:30 16": days (Mon..Sun, ranges, lists or *),
+// local time and setpoint, separated by ';' or newlines. False leaves the table untouched.
+bool schedule_parse(schedule_t* s, const char* text, int min_setpoint, int max_setpoint);
+// One "Mon 06:30 21" line per entry, returns the length
+size_t schedule_format(const schedule_t* s, char* buf, size_t size);
+
+// Compact form for NVS, SCHEDULE_PACK_SIZE(count) bytes
+size_t schedule_pack(const schedule_t* s, uint8_t* buf, size_t size);
+bool schedule_unpack(schedule_t* s, const uint8_t* buf, size_t len);
+
+// Local wall time in s, counted like UTC seconds
+int64_t schedule_local(int64_t utc);
+
+// Entry in force at local time, -1 with an empty table
+int schedule_active(const schedule_t* s, int64_t local);
+
+// Setpoint of the entry that fires at utc, -1 if none. Advances s->last.
+int schedule_due(schedule_t* s, int64_t utc);
+
+// UTC ms until the next entry fires, at most SCHEDULE_MAX_WAIT. Counted to the UTC time of the
+// entry, so across a DST change too, and to the jump for an entry in the spring gap.
+uint32_t schedule_wait(const schedule_t* s, int64_t utc_ms);
+
+void schedule_clock_set(schedule_clock_t* c, int64_t utc_ms, uint32_t at, bool sntp);
+// UTC ms at tick at, false until set
+bool schedule_clock_now(schedule_clock_t* c, uint32_t at, int64_t* utc_ms);
+
+const char* schedule_day_str(int day);
@@ -4,7 +4,6 @@
 // Project name: rot_lms
 
 #include "../ui.h"
-#include <stdio.h>
 
 #define COLOR_WHITE_GRAY        0xEAEAEB
 #define COLOR_WHITE             0xE5E4E4
@@ -19,6 +18,7 @@
 #define INDICATOR_BACKGROUND    COLOR_GRAY
 #define LABEL_TEMP_COLOR        COLOR_BLUE
 #define LABEL_SET_COLOR         COLOR_WHITE
+#define LABEL_STATUS_COLOR      COLOR_ORANGE
 
 void ui_ScreenPlay_screen_init(void)
 {
@@ -69,33 +69,60 @@ void ui_ScreenPlay_screen_init(void)
     
     lv_obj_set_style_opa(ui_ArcTemp, 0, LV_PART_KNOB | LV_STATE_DEFAULT);
 
+    //Temperature readouts: static caption label plus a numeric display drawn from a glyph atlas
+    static ui_glyph_atlas_t atlas_temp;
+    static ui_glyph_atlas_t atlas_set;
+    if(atlas_temp.cells[0].data == NULL) {
+        ui_glyph_atlas_init(&atlas_temp, ui_font_large, lv_color_hex(LABEL_TEMP_COLOR), lv_color_hex(COLOR_BLACK));
+        ui_glyph_atlas_init(&atlas_set, ui_font_large, lv_color_hex(LABEL_SET_COLOR), lv_color_hex(COLOR_BLACK));
+    }
+
     ui_LabelTemp = lv_label_create(ui_ScreenPlay);
-    lv_obj_set_width(ui_LabelTemp, 400);
+    lv_obj_set_width(ui_LabelTemp, 160);
     lv_obj_set_height(ui_LabelTemp, 50);
-    lv_obj_set_x(ui_LabelTemp, 0);
+    lv_obj_set_x(ui_LabelTemp, -70);
     lv_obj_set_y(ui_LabelTemp, 40);
     lv_obj_set_align(ui_LabelTemp, LV_ALIGN_CENTER);
-    lv_label_set_long_mode(ui_LabelTemp, LV_LABEL_LONG_DOT);
-    lv_label_set_text(ui_LabelTemp, "Temp: 25°C");
+    lv_label_set_long_mode(ui_LabelTemp, LV_LABEL_LONG_CLIP);
+    lv_label_set_text(ui_LabelTemp, "Temp:");
     lv_obj_set_style_text_color(ui_LabelTemp, lv_color_hex(LABEL_TEMP_COLOR), LV_PART_MAIN | LV_STATE_DEFAULT);
     lv_obj_set_style_text_opa(ui_LabelTemp, 255, LV_PART_MAIN | LV_STATE_DEFAULT);
-    lv_obj_set_style_text_align(ui_LabelTemp, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN | LV_STATE_DEFAULT);
-    lv_obj_set_style_text_font(ui_LabelTemp, &lv_font_montserrat_48, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(ui_LabelTemp, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_font(ui_LabelTemp, ui_font_large, LV_PART_MAIN | LV_STATE_DEFAULT);
+
+    ui_NumTemp = ui_numlabel_create(ui_ScreenPlay, &atlas_temp, 2);
+    if(ui_NumTemp) lv_obj_align_to(ui_NumTemp, ui_LabelTemp, LV_ALIGN_OUT_RIGHT_MID, 12, 0);
+    ui_numlabel_set_value(ui_NumTemp, DEFAULT_TEMP);
 
     ui_LabelSetTemp = lv_label_create(ui_ScreenPlay);
-    lv_obj_set_width(ui_LabelSetTemp, 400);
+    lv_obj_set_width(ui_LabelSetTemp, 160);
     lv_obj_set_height(ui_LabelSetTemp, 50);
-    lv_obj_set_x(ui_LabelSetTemp, 0);
+    lv_obj_set_x(ui_LabelSetTemp, -70);
     lv_obj_set_y(ui_LabelSetTemp, -40);
     lv_obj_set_align(ui_LabelSetTemp, LV_ALIGN_CENTER);
-    lv_label_set_long_mode(ui_LabelSetTemp, LV_LABEL_LONG_DOT);
-    char buff[12];
-    sprintf(buff, "Set: %d°C", DEFAULT_TEMP);
-    lv_label_set_text(ui_LabelSetTemp, buff);
+    lv_label_set_long_mode(ui_LabelSetTemp, LV_LABEL_LONG_CLIP);
+    lv_label_set_text(ui_LabelSetTemp, "Set:");
     lv_obj_set_style_text_color(ui_LabelSetTemp, lv_color_hex(LABEL_SET_COLOR), LV_PART_MAIN | LV_STATE_DEFAULT);
     lv_obj_set_style_text_opa(ui_LabelSetTemp, 255, LV_PART_MAIN | LV_STATE_DEFAULT);
-    lv_obj_set_style_text_align(ui_LabelSetTemp, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN | LV_STATE_DEFAULT);
-    lv_obj_set_style_text_font(ui_LabelSetTemp, &lv_font_montserrat_48, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(ui_LabelSetTemp, LV_TEXT_ALIGN_RIGHT, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_font(ui_LabelSetTemp, ui_font_large, LV_PART_MAIN | LV_STATE_DEFAULT);
+
+    ui_NumSetTemp = ui_numlabel_create(ui_ScreenPlay, &atlas_set, 2);
+    if(ui_NumSetTemp) lv_obj_align_to(ui_NumSetTemp, ui_LabelSetTemp, LV_ALIGN_OUT_RIGHT_MID, 12, 0);
+    ui_numlabel_set_value(ui_NumSetTemp, DEFAULT_TEMP);
+
+    //Degraded indicator, shown while the server is unreachable
+    ui_LabelStatus = lv_label_create(ui_ScreenPlay);
+    lv_obj_set_width(ui_LabelStatus, 300);
+    lv_obj_set_height(ui_LabelStatus, LV_SIZE_CONTENT);
+    lv_obj_set_x(ui_LabelStatus, 0);
+    lv_obj_set_y(ui_LabelStatus, 120);
+    lv_obj_set_align(ui_LabelStatus, LV_ALIGN_CENTER);
+    lv_label_set_text(ui_LabelStatus, LV_SYMBOL_WARNING " Server offline");
+    lv_obj_set_style_text_color(ui_LabelStatus, lv_color_hex(LABEL_STATUS_COLOR), LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_opa(ui_LabelStatus, 255, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_set_style_text_align(ui_LabelStatus, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_add_flag(ui_LabelStatus, LV_OBJ_FLAG_HIDDEN);
     /*
     //BUTTON
     ui_ButtonScrPlay1 = lv_btn_create(ui_ScreenPlay);
@@ -108,3 +135,17 @@ void ui_ScreenPlay_screen_init(void)
     lv_obj_clear_flag(ui_ButtonScrPlay1, LV_OBJ_FLAG_SCROLLABLE);      /// Flags
     */
 }
+
+void ui_ScreenPlay_screen_destroy(void)
+{
+    // The glyph atlases are static and outlive the screen
+    if(ui_ScreenPlay) lv_obj_del(ui_ScreenPlay);
+    ui_ScreenPlay = NULL;
+    ui_ArcSetTemp = NULL;
+    ui_ArcTemp = NULL;
+    ui_LabelTemp = NULL;
+    ui_LabelSetTemp = NULL;
+    ui_NumTemp = NULL;
+    ui_NumSetTemp = NULL;
+    ui_LabelStatus = NULL;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "stdint.h"
+
+// Simulator stand-in, deterministic for a given sim_reset() seed
+uint32_t esp_random(void);
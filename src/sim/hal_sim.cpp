@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.hpp"
+#include "http_client.hpp"
+#include "logger.hpp"
+#include "poll_policy.hpp"
+#include "sim.hpp"
+#include "stall_mon.hpp"
+#include "telemetry.hpp"
+#include "thermostat.hpp"
+
+#define SIM_MAX_PINS 64
+#define SIM_HEAT_RATE 10.0           // Degrees per hour with the boiler on, at outside temperature
+#define SIM_LOSS_RATE (1.0 / 3.0)    // Fraction of the inside/outside difference lost per hour
+#define SIM_SERVER_HYSTERESIS 0.3
+
+typedef struct {
+  http_req_t* req;
+  poll_endpoint_t endpoint;
+  uint32_t done_at;
+  bool dropped;
+  bool error;
+  float value;                       // POSTed setpoint
+  bool telemetry;
+  bool ack_lost;                     // Dropped after the server stored the batch
+  size_t len;
+  uint8_t data[TELEMETRY_BATCH_SIZE];
+} sim_pending_t;
+
+static uint64_t now_us;
+static uint32_t rng_state;
+
+static bool pins[SIM_MAX_PINS];
+static hal_pins_t hal_pins;
+static int16_t encoder_count;
+static bool button_pressed;
+
+static bool ap_up;
+static bool associating;
+static bool associated;
+static uint32_t associate_at;
+static uint32_t connect_min, connect_max;
+
+static sim_server_cfg_t server_cfg;
+static sim_server_t server;
+static double room_temp;
+static sim_request_hook_t request_hook;
+static sim_pending_t pending[4];
+
+static uint8_t log_level;
+
+static uint32_t telemetry_session;
+static uint32_t telemetry_next;      // Sequence expected in the session
+
+static int64_t wall_start;
+static int64_t wall_jumped;
+static int32_t wall_drift;
+static bool sntp_started;
+static uint32_t sntp_next;
+
+typedef struct {
+  char key[16];
+  uint8_t data[256];
+  size_t len;
+} sim_nvs_t;
+
+static sim_nvs_t nvs[4];
+
+void sim_reset(uint32_t seed) {
+  now_us = 0;
+  rng_state = seed ? seed : 1;
+  memset(pins, 0, sizeof(pins));
+  encoder_count = 0;
+  button_pressed = false;
+  ap_up = true;
+  associating = associated = false;
+  connect_min = 500;
+  connect_max = 3000;
+  server_cfg = (sim_server_cfg_t){ true, 40, 60, 0, 0, true };
+  memset(&server, 0, sizeof(server));
+  server.outside_temp = 5;
+  server.room_temp = 18;
+  server.setpoint = 25;
+  room_temp = server.room_temp;
+  request_hook = NULL;
+  memset(pending, 0, sizeof(pending));
+  telemetry_session = telemetry_next = 0;
+  log_level = LOG_LEVEL_NONE;
+  wall_start = 0;
+  wall_jumped = 0;
+  wall_drift = 0;
+  sntp_started = false;
+  memset(nvs, 0, sizeof(nvs));
+}
+
+uint64_t sim_now_us(void) {
+  return now_us;
+}
+
+// xorshift32
+uint32_t sim_rand(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+uint32_t sim_rand_range(uint32_t lo, uint32_t hi) {
+  return lo + sim_rand() % (hi - lo + 1);
+}
+
+uint32_t esp_random(void) {
+  return sim_rand();
+}
+
+// The server runs its own hysteresis on the last setpoint it got
+static void server_update(double hours) {
+  double heat = server.boiler ? SIM_HEAT_RATE : 0;
+  room_temp += (heat - SIM_LOSS_RATE * (room_temp - server.outside_temp)) * hours;
+  if (room_temp < server.setpoint - SIM_SERVER_HYSTERESIS) {
+    server.boiler = true;
+  } else if (room_temp > server.setpoint + SIM_SERVER_HYSTERESIS) {
+    server.boiler = false;
+  }
+  server.room_temp = (float)room_temp;
+}
+
+void sim_advance(uint32_t us) {
+  now_us += us;
+  server_update(us / 3.6e9);
+  if (associating && ap_up && hal_millis() - associate_at < 0x80000000u) {
+    associating = false;
+    associated = true;
+  }
+  if (!ap_up) {
+    associated = false;
+  }
+}
+
+void sim_wifi_set_ap(bool up) {
+  ap_up = up;
+  if (!up) {
+    associated = false;
+  }
+}
+
+void sim_wifi_set_connect_time(uint32_t min_ms, uint32_t max_ms) {
+  connect_min = min_ms;
+  connect_max = max_ms;
+}
+
+sim_server_cfg_t* sim_server_cfg(void) {
+  return &server_cfg;
+}
+
+const sim_server_t* sim_server(void) {
+  return &server;
+}
+
+void sim_server_set_hook(sim_request_hook_t hook) {
+  request_hook = hook;
+}
+
+void sim_wall_set(int64_t utc_ms, int32_t drift_ppm) {
+  wall_start = utc_ms;
+  wall_drift = drift_ppm;
+}
+
+// The tick is fast, so true time runs slow against it
+int64_t sim_wall_ms(void) {
+  int64_t tick = (int64_t)(now_us / 1000);
+  return wall_start + wall_jumped + tick - tick * wall_drift / 1000000;
+}
+
+void sim_wall_jump(int64_t ms) {
+  wall_jumped += ms;
+}
+
+void sim_encoder_move(int16_t steps) {
+  encoder_count += steps;
+}
+
+void sim_button_press(void) {
+  button_pressed = true;
+}
+
+bool sim_backlight(void) {
+  return pins[hal_pins.backlight];
+}
+
+bool sim_gpio(int pin) {
+  return pins[pin];
+}
+
+void sim_log_level(uint8_t level) {
+  log_level = level;
+}
+
+// HAL
+
+void hal_begin(const hal_pins_t* p) {
+  hal_pins = *p;
+  pins[hal_pins.backlight] = true;
+}
+
+uint32_t hal_millis(void) {
+  return (uint32_t)(now_us / 1000);
+}
+
+uint32_t hal_micros(void) {
+  return (uint32_t)now_us;
+}
+
+void hal_gpio_output(int pin, bool level) {
+  pins[pin] = level;
+}
+
+void hal_gpio_write(int pin, bool level) {
+  pins[pin] = level;
+}
+
+int16_t hal_encoder_count(void) {
+  return encoder_count;
+}
+
+void hal_encoder_restore(int16_t count) {
+  encoder_count = count;
+}
+
+bool hal_button_was_pressed(void) {
+  bool pressed = button_pressed;
+  button_pressed = false;
+  return pressed;
+}
+
+uint32_t hal_button_held(void) {
+  return 0;
+}
+
+void hal_wifi_begin(const char* ssid, const char* password) {
+  (void)ssid;
+  (void)password;
+  associated = false;
+  associating = true;
+  associate_at = hal_millis() + sim_rand_range(connect_min, connect_max);
+}
+
+bool hal_wifi_connected(void) {
+  return associated;
+}
+
+void hal_wifi_disconnect(void) {
+  associated = associating = false;
+}
+
+void hal_wifi_ip(uint8_t ip[4]) {
+  static const uint8_t addr[4] = { 192, 168, 4, 2 };
+  memcpy(ip, addr, 4);
+}
+
+// A single simulated unit has no peers, src/peersim/ runs several
+bool hal_udp_begin(const char* group, uint16_t port) {
+  (void)group;
+  (void)port;
+  return true;
+}
+
+bool hal_udp_send(const uint8_t* data, size_t len) {
+  (void)data;
+  (void)len;
+  return true;
+}
+
+int hal_udp_recv(uint8_t* buf, size_t size) {
+  (void)buf;
+  (void)size;
+  return -1;
+}
+
+uint32_t hal_node_id(void) {
+  return 1;
+}
+
+void hal_display_power(bool on) {
+  pins[hal_pins.backlight] = on;
+}
+
+// NVS: a few keys in memory, a run starts erased
+
+static sim_nvs_t* find_nvs(const char* key) {
+  for (auto& n : nvs) {
+    if (!strcmp(n.key, key)) {
+      return &n;
+    }
+  }
+  return NULL;
+}
+
+int hal_nvs_read(const char* key, void* buf, size_t size) {
+  sim_nvs_t* n = find_nvs(key);
+  if (!n || n->len > size) {
+    return -1;
+  }
+  memcpy(buf, n->data, n->len);
+  return (int)n->len;
+}
+
+bool hal_nvs_write(const char* key, const void* buf, size_t len) {
+  sim_nvs_t* n = find_nvs(key);
+  if (!n) {
+    n = find_nvs("");
+  }
+  if (!n || len > sizeof(n->data) || strlen(key) >= sizeof(n->key)) {
+    return false;
+  }
+  snprintf(n->key, sizeof(n->key), "%s", key);
+  memcpy(n->data, buf, len);
+  n->len = len;
+  return true;
+}
+
+// Wall clock: SNTP fixes while associated, the first one a second after hal_sntp_begin()
+
+void hal_time_zone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+void hal_sntp_begin(const char* server) {
+  (void)server;
+  if (!sntp_started) {
+    sntp_started = true;
+    sntp_next = hal_millis() + 1000;
+  }
+}
+
+bool hal_time_fix(int64_t* utc_ms, uint32_t* at) {
+  uint32_t now = hal_millis();
+  if (!sntp_started || !associated || now - sntp_next >= 0x80000000u) {
+    return false;
+  }
+  sntp_next = now + SIM_SNTP_INTERVAL;
+  *utc_ms = sim_wall_ms();
+  *at = now;
+  return true;
+}
+
+bool hal_rtc_time(int64_t* utc_ms) {
+  *utc_ms = sim_wall_ms();
+  return wall_start != 0;
+}
+
+// Stall monitor: the simulated clock only moves between iterations, breadcrumbs are dropped
+
+stall_step_t stall_mon_step(stall_step_t step) {
+  return step;
+}
+
+// Network: the http_client.hpp API, answered by the simulated server
+
+static sim_pending_t* find_pending(const http_req_t* req) {
+  for (auto& p : pending) {
+    if (p.req == req) {
+      return &p;
+    }
+  }
+  return NULL;
+}
+
+static http_state_t sim_http_fail(http_req_t* req, http_err_t err) {
+  sim_pending_t* p = find_pending(req);
+  if (p) {
+    p->req = NULL;
+  }
+  req->error = err;
+  req->elapsed = hal_millis() - req->start_time;
+  req->state = HTTP_FAILED;
+  return req->state;
+}
+
+static sim_pending_t* sim_begin(http_req_t* req, const char* path, uint32_t timeout_ms) {
+  if (http_busy(req)) {
+    http_cancel(req);
+  }
+  memset(req, 0, offsetof(http_req_t, tx));
+  req->sock = -1;
+  req->start_time = hal_millis();
+  req->timeout = timeout_ms;
+  req->content_length = -1;
+  req->rx[0] = '\0';
+
+  bool telemetry = strcmp(path, "/telemetry") == 0;
+  poll_endpoint_t endpoint = strncmp(path, "/setTemp", 8) == 0 ? POLL_SET_TEMP
+                             : strncmp(path, "/Temp", 5) == 0  ? POLL_TEMP
+                                                               : POLL_BOILER_STATUS;
+  if (request_hook) {
+    request_hook(telemetry ? POLL_ENDPOINT_COUNT : endpoint, hal_millis());
+  }
+  if (!hal_wifi_connected()) {
+    sim_http_fail(req, HTTP_ERR_CONNECT);
+    return NULL;
+  }
+
+  sim_pending_t* p = find_pending(NULL);
+  if (!p) {
+    sim_http_fail(req, HTTP_ERR_SOCKET);
+    return NULL;
+  }
+  p->req = req;
+  p->endpoint = endpoint;
+  p->telemetry = telemetry;
+  p->dropped = !server_cfg.up || sim_rand_range(0, 999) < server_cfg.drop_permille;
+  p->ack_lost = false;
+  p->error = sim_rand_range(0, 999) < server_cfg.error_permille;
+  p->done_at = hal_millis() + server_cfg.latency + sim_rand_range(0, server_cfg.jitter);
+  p->value = 0;
+  p->len = 0;
+  req->state = HTTP_CONNECTING;
+  return p;
+}
+
+// Request bytes as http_client.cpp sends them
+static uint32_t request_size(const char* host, const char* path, const char* content_type, size_t body) {
+  return snprintf(NULL, 0, "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                  "Content-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                  path, host, content_type, (unsigned)body) + (uint32_t)body;
+}
+
+static bool get_varint(const uint8_t** p, const uint8_t* end, uint32_t* v) {
+  *v = 0;
+  for (int shift = 0; *p < end && shift < 35; shift += 7) {
+    uint8_t b = *(*p)++;
+    *v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Decodes and stores a batch like tools/standin_server.py, returns the sequence expected next
+static uint32_t telemetry_store(const uint8_t* data, size_t len) {
+  server.telemetry_batches++;
+  server.telemetry_bytes += request_size("192.168.4.1", "/telemetry", "application/octet-stream", len);
+  if (len < TELEMETRY_HEADER_SIZE || data[0] != TELEMETRY_VERSION) {
+    server.telemetry_bad++;
+    return telemetry_next;
+  }
+  uint32_t session = get_u32(data + 5);
+  uint32_t seq = get_u32(data + 9);
+  uint16_t count = data[25] | data[26] << 8;
+  if (session != telemetry_session) {
+    telemetry_session = session;
+    telemetry_next = seq;
+  }
+  const uint8_t* p = data + TELEMETRY_HEADER_SIZE;
+  const uint8_t* end = data + len;
+  int32_t prev[2] = { 0, 0 };
+  for (uint16_t i = 0; i < count; i++, seq++) {
+    uint32_t tag, z = 0;
+    uint8_t kind;
+    if (!get_varint(&p, end, &tag) || ((kind = tag & 3) <= TELEMETRY_SETPOINT && !get_varint(&p, end, &z))) {
+      server.telemetry_bad++;
+      return telemetry_next;
+    }
+    if (kind <= TELEMETRY_SETPOINT) {
+      prev[kind] += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    }
+    if (seq < telemetry_next) {
+      server.telemetry_resent++;
+      continue;
+    }
+    server.telemetry_gaps += seq - telemetry_next;
+    telemetry_next = seq + 1;
+    server.telemetry_records++;
+    char body[40];
+    if (kind == TELEMETRY_TEMP) {
+      server.telemetry_bad += prev[0] < -4000 || prev[0] > 6000;
+      snprintf(body, sizeof(body), "kind=temp&value=%.2f", prev[0] / 100.0);
+    } else if (kind == TELEMETRY_SETPOINT) {
+      server.telemetry_bad += prev[1] < THERMOSTAT_MIN_TEMP || prev[1] > THERMOSTAT_MAX_TEMP;
+      server.telemetry_setpoint = (uint16_t)prev[1];
+      snprintf(body, sizeof(body), "kind=setpoint&value=%d.00", (int)prev[1]);
+    } else {
+      snprintf(body, sizeof(body), "kind=boiler&value=%d", kind == TELEMETRY_BOILER_ON);
+    }
+    server.telemetry_sample_bytes +=
+      request_size("192.168.4.1", "/telemetry", "application/x-www-form-urlencoded", strlen(body));
+  }
+  server.telemetry_bad += p != end;
+  return telemetry_next;
+}
+
+bool http_begin(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                const char* content_type, const char* body, uint32_t timeout_ms) {
+  (void)host;
+  (void)port;
+  (void)method;
+  (void)content_type;
+  sim_pending_t* p = sim_begin(req, path, timeout_ms);
+  if (p) {
+    p->value = body && strncmp(body, "value=", 6) == 0 ? (float)atof(body + 6) : 0;
+  }
+  return p != NULL;
+}
+
+bool http_begin_data(http_req_t* req, const char* host, uint16_t port, const char* method, const char* path,
+                     const char* content_type, const uint8_t* body, size_t len, uint32_t timeout_ms) {
+  (void)host;
+  (void)port;
+  (void)method;
+  (void)content_type;
+  sim_pending_t* p = sim_begin(req, path, timeout_ms);
+  if (p) {
+    p->len = len < sizeof(p->data) ? len : sizeof(p->data);
+    memcpy(p->data, body, p->len);
+    p->ack_lost = p->dropped && server_cfg.up && server_cfg.telemetry && sim_rand() % 2;
+  }
+  return p != NULL;
+}
+
+http_state_t http_step(http_req_t* req) {
+  if (!http_busy(req)) {
+    return req->state;
+  }
+  uint32_t now = hal_millis();
+  if (now - req->start_time >= req->timeout) {
+    return sim_http_fail(req, HTTP_ERR_TIMEOUT);
+  }
+  if (!hal_wifi_connected()) {
+    return sim_http_fail(req, HTTP_ERR_RECV);
+  }
+  sim_pending_t* p = find_pending(req);
+  if (now - p->done_at >= 0x80000000u) {
+    return req->state;
+  }
+  if (p->dropped) {
+    if (p->ack_lost) {
+      telemetry_store(p->data, p->len);
+      p->ack_lost = false;
+    }
+    return req->state;
+  }
+
+  // The server handles the request when the answer is due
+  p->req = NULL;
+  if (!p->telemetry) {
+    server.requests[p->endpoint]++;
+  }
+  if (p->error) {
+    req->status = 500;
+  } else if (p->telemetry && !server_cfg.telemetry) {
+    server.telemetry_batches++;
+    req->status = 404;
+  } else if (p->telemetry) {
+    req->status = 200;
+    snprintf(req->rx, sizeof(req->rx), "%u", telemetry_store(p->data, p->len));
+  } else {
+    req->status = 200;
+    switch (p->endpoint) {
+      case POLL_SET_TEMP:
+        server.setpoint = p->value;
+        snprintf(req->rx, sizeof(req->rx), "OK");
+        break;
+      case POLL_TEMP:
+        snprintf(req->rx, sizeof(req->rx), "%.2f", server.room_temp);
+        break;
+      default:
+        snprintf(req->rx, sizeof(req->rx), "%s", server.boiler ? "true" : "false");
+        break;
+    }
+  }
+  req->rx_len = (uint16_t)strlen(req->rx);
+  req->elapsed = now - req->start_time;
+  req->state = HTTP_DONE;
+  return req->state;
+}
+
+void http_cancel(http_req_t* req) {
+  if (http_busy(req)) {
+    sim_http_fail(req, HTTP_ERR_CANCELLED);
+  }
+}
+
+bool http_busy(const http_req_t* req) {
+  return req->state != HTTP_IDLE && req->state != HTTP_DONE && req->state != HTTP_FAILED;
+}
+
+const char* http_body(const http_req_t* req) {
+  return req->state == HTTP_DONE ? req->rx + req->body_off : "";
+}
+
+const char* http_err_str(http_err_t err) {
+  static const char* const names[] = { "none", "bad address", "socket", "connect", "send",
+                                       "recv", "protocol", "overflow", "timeout", "cancelled" };
+  return (unsigned)err < sizeof(names) / sizeof(names[0]) ? names[err] : "unknown";
+}
+
+// Logger: records are formatted straight away with the simulated time
+
+#define LOG_FMT(id, fmt) fmt,
+static const char* const log_formats[] = {
+#include "log_formats.def"
+};
+#undef LOG_FMT
+
+void logger_begin(int core) {
+  (void)core;
+}
+
+uint32_t logger_dropped(void) {
+  return 0;
+}
+
+bool logger_write(uint8_t level, uint16_t fmt, uint8_t nargs, const logger_word_t* args) {
+  if (level > log_level || fmt >= LOGF_COUNT) {
+    return true;
+  }
+  char line[256];
+  int len = 0;
+  uint8_t arg = 0;
+  for (const char* f = log_formats[fmt]; *f && len < (int)sizeof(line) - 1;) {
+    if (f[0] != '%' || f[1] == '%') {
+      line[len++] = *f;
+      f += f[0] == '%' ? 2 : 1;
+      continue;
+    }
+    char spec[16];
+    size_t n = 0;
+    do {
+      spec[n++] = *f;
+    } while (*f && !strchr("diuxXcsfeEgGp", *f++) && n < sizeof(spec) - 1);
+    spec[n] = '\0';
+    logger_word_t word = arg < nargs ? args[arg++] : 0;
+    char conv = spec[n - 1];
+    int room = (int)sizeof(line) - len;
+    if (conv == 's') {
+      len += snprintf(line + len, room, spec, (const char*)word);
+    } else if (strchr("feEgG", conv)) {
+      uint32_t bits = (uint32_t)word;
+      float value;
+      memcpy(&value, &bits, sizeof(value));
+      len += snprintf(line + len, room, spec, (double)value);
+    } else {
+      len += snprintf(line + len, room, spec, (unsigned)word);
+    }
+  }
+  line[len < (int)sizeof(line) ? len : (int)sizeof(line) - 1] = '\0';
+  printf("[%10.3f][%c] %s\n", now_us / 1e6, "-EWID"[level], line);
+  return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "stdint.h"
+
+#define SIM_SNTP_INTERVAL 3600000
+
+// Simulated board, network and server for the thermostat logic.
+//
+// Time only moves in sim_advance(), so a run is fully determined by its seed
+// and days of operation take seconds. The server keeps a simple room model:
+// the room heats while its boiler is on and loses heat to the outside. It
+// decodes telemetry batches, half of the dropped ones are stored with the
+// answer lost.
+
+typedef struct {
+  bool up;                  // false blackholes every request (times out)
+  uint32_t latency;         // ms
+  uint32_t jitter;          // ms, added uniformly
+  uint16_t drop_permille;   // Requests that never get an answer
+  uint16_t error_permille;  // Requests answered with 500
+  bool telemetry;           // false answers /telemetry with 404, like the real server
+} sim_server_cfg_t;
+
+typedef struct {
+  float room_temp;
+  float outside_temp;
+  float setpoint;           // Last setpoint POSTed to the server
+  bool boiler;
+  uint32_t requests[3];     // POLL_TEMP, POLL_BOILER_STATUS, POLL_SET_TEMP
+  uint32_t telemetry_batches;
+  uint32_t telemetry_bytes;         // Request bytes, headers included
+  uint32_t telemetry_records;       // Stored, resent ones skipped
+  uint32_t telemetry_resent;
+  uint32_t telemetry_gaps;          // Records missing between stored ones
+  uint32_t telemetry_bad;           // Batches that do not decode, values out of range
+  uint32_t telemetry_sample_bytes;  // The same records posted one per request
+  uint16_t telemetry_setpoint;      // Last setpoint stored
+} sim_server_t;
+
+// Called on every request the server sees, endpoint as poll_endpoint_t, POLL_ENDPOINT_COUNT for /telemetry
+typedef void (*sim_request_hook_t)(int endpoint, uint32_t now);
+
+void sim_reset(uint32_t seed);
+uint64_t sim_now_us(void);
+void sim_advance(uint32_t us);
+
+uint32_t sim_rand(void);
+uint32_t sim_rand_range(uint32_t lo, uint32_t hi);  // Inclusive
+
+// WiFi access point, a station joins it connect_time ms after hal_wifi_begin()
+void sim_wifi_set_ap(bool up);
+void sim_wifi_set_connect_time(uint32_t min_ms, uint32_t max_ms);
+
+sim_server_cfg_t* sim_server_cfg(void);
+const sim_server_t* sim_server(void);
+void sim_server_set_hook(sim_request_hook_t hook);
+
+// Wall clock: UTC ms when the run starts, the simulated tick runs drift_ppm fast against it.
+// SNTP hands out a fix SIM_SNTP_INTERVAL ms apart while WiFi is up, the RTC starts set.
+void sim_wall_set(int64_t utc_ms, int32_t drift_ppm);
+int64_t sim_wall_ms(void);
+void sim_wall_jump(int64_t ms);  // The network's time changes, passed on at the next fix
+
+// Inputs
+void sim_encoder_move(int16_t steps);
+void sim_button_press(void);
+
+// Outputs
+bool sim_backlight(void);
+bool sim_gpio(int pin);
+
+// Log records at or below this level go to stdout
+void sim_log_level(uint8_t level);
@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "boot_prof.hpp"
+#include "hal.hpp"
+#include "logger.hpp"
+#include "thermostat.hpp"
+#include "schedule.hpp"
+#include "telemetry.hpp"
+#include "sim.hpp"
+
+// Runs the thermostat logic against the simulated board for days of
+// simulated time with WiFi drops, server outages, slow and failing server
+// periods and bursts of knob turns, checks its invariants on every step and
+// reports latency statistics. The weekly schedule runs on a drifting wall
+// clock that starts before the spring DST change, --start picks another UTC
+// start time (1792713600 crosses the autumn change). The schedule engine is
+// also checked on its own across both changes and clock jumps. Telemetry
+// records have to reach the server once each, in order, through lost answers.
+//
+//   pio run -e sim && .pio/build/sim/program --days 7 --seed 42
+//
+// Exits with 1 if any check failed.
+
+#define SIM_STEP_US 5000          // One loop() iteration
+#define SIM_INDEV_PERIOD 30000    // LVGL reads the encoder every 30 ms
+#define SIM_LED_PIN 4
+#define SIM_MAX_REPORTED_FAILURES 20
+#define SIM_START 1774569600      // Friday 2026-03-27 00:00 UTC, the spring DST change is on Sunday
+#define SIM_DRIFT 150             // ppm the tick runs fast against the wall clock
+#define SIM_SCHEDULE "Mon-Fri 06:30 21; Mon-Fri 08:00 17; Mon-Fri 17:30 21; Sat,Sun 08:00 21; * 22:30 16; Sun 02:30 19"
+#define SIM_SCHEDULE_GRACE 5000   // ms after a transition to see its setpoint, DST gap included
+#define SIM_BOOT_LIVE_DATA_MAX 5000 // ms from WiFi up to the first reading at boot
+
+typedef struct {
+  const char* name;
+  std::vector<uint32_t> samples;
+} sim_stat_t;
+
+static void stat_add(sim_stat_t* stat, uint32_t value) {
+  stat->samples.push_back(value);
+}
+
+static void stat_print(sim_stat_t* stat, const char* unit) {
+  std::vector<uint32_t>& s = stat->samples;
+  if (s.empty()) {
+    printf("  %-28s no samples\n", stat->name);
+    return;
+  }
+  std::sort(s.begin(), s.end());
+  printf("  %-28s n=%-7zu p50 %7u  p90 %7u  p99 %7u  max %7u %s\n", stat->name, s.size(), s[s.size() / 2],
+         s[s.size() * 9 / 10], s[s.size() * 99 / 100], s.back(), unit);
+}
+
+static sim_stat_t wifi_reconnect = { "WiFi reconnect", {} };
+static sim_stat_t screen_off_delay = { "Screen timeout overshoot", {} };
+static sim_stat_t screen_wake = { "Screen wake after input", {} };
+static sim_stat_t temp_gap = { "Temp poll interval", {} };
+static sim_stat_t boiler_gap = { "boilerStatus poll interval", {} };
+static sim_stat_t setpoint_sync = { "Setpoint sync", {} };
+static sim_stat_t schedule_late = { "Schedule transition late", {} };
+
+static uint32_t failures = 0;
+
+#define SIM_CHECK(cond, ...)                              \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      if (++failures <= SIM_MAX_REPORTED_FAILURES) {      \
+        printf("[%10.3f] FAIL %s: ", sim_now_us() / 1e6, #cond); \
+        printf(__VA_ARGS__);                              \
+        printf("\n");                                     \
+      }                                                   \
+    }                                                     \
+  } while (0)
+
+// What the checks need to know about the past
+static struct {
+  uint32_t last_input;          // Knob or button
+  uint32_t pending_wake;        // Input time while the screen was off, 0 if none
+  uint32_t ap_up_since;         // 0 while the AP is down
+  bool wifi_was_connected;
+  uint32_t reconnect_from;      // AP back while the station was disconnected
+  uint32_t last_request[2];
+  uint32_t healthy_since;       // WiFi up, server up and all breakers closed
+  uint32_t setpoint_changed;    // Last knob change not yet acknowledged, 0 if synced
+  uint32_t outage_end;
+  uint32_t slow_end;
+  uint32_t errors_end;
+  uint32_t storm_end;
+  int16_t storm_dir;
+  uint32_t next_wifi_drop;
+  uint32_t next_outage;
+  uint32_t next_slow;
+  uint32_t next_errors;
+  uint32_t next_storm;
+  uint32_t next_press;
+  int64_t sched_local;          // Latest local wall time seen
+  uint32_t sched_at;            // Transition due since, 0 if none outstanding
+  int sched_setpoint;
+  uint32_t takeovers;
+  uint32_t handbacks;
+} h;
+
+static schedule_t sim_schedule;   // What the device was given, read only
+
+static void on_request(int endpoint, uint32_t now) {
+  if (endpoint > 1) {
+    return;
+  }
+  uint32_t gap = now - h.last_request[endpoint];
+  uint32_t min_gap = endpoint == 0 ? POLL_FAST_TEMP_INTERVAL : POLL_FAST_BOILER_STATUS_INTERVAL;
+  uint32_t max_gap = (endpoint == 0 ? POLL_IDLE_TEMP_INTERVAL : POLL_IDLE_BOILER_STATUS_INTERVAL) + HTTP_TIMEOUT;
+  if (h.last_request[endpoint] != 0) {
+    SIM_CHECK(gap >= min_gap, "endpoint %d polled again after %u ms", endpoint, gap);
+    // Only a gap spent entirely healthy has to respect the slowest interval
+    if (h.healthy_since != 0 && h.last_request[endpoint] >= h.healthy_since) {
+      SIM_CHECK(gap <= max_gap, "endpoint %d not polled for %u ms", endpoint, gap);
+      stat_add(endpoint == 0 ? &temp_gap : &boiler_gap, gap);
+    }
+  }
+  h.last_request[endpoint] = now;
+}
+
+static void user_input(uint32_t now, bool screen_on) {
+  h.last_input = now;
+  if (!screen_on && !h.pending_wake) {
+    h.pending_wake = now;
+  }
+}
+
+// Random faults and user activity, each with its own mean period
+static void schedule(uint32_t now) {
+  sim_server_cfg_t* cfg = sim_server_cfg();
+  thermostat_status_t st;
+  thermostat_get_status(&st);
+
+  if (now >= h.next_wifi_drop && h.ap_up_since) {
+    sim_wifi_set_ap(false);
+    h.ap_up_since = 0;
+    h.next_wifi_drop = now + sim_rand_range(5000, 600000);   // Outage length, then back up below
+  } else if (now >= h.next_wifi_drop && !h.ap_up_since) {
+    sim_wifi_set_ap(true);
+    h.ap_up_since = now;
+    if (st.wifi != WIFI_CONNECTED) {
+      h.reconnect_from = now;
+    }
+    h.next_wifi_drop = now + sim_rand_range(600000, 14400000);
+  }
+
+  if (now >= h.next_outage) {
+    cfg->up = false;
+    h.outage_end = now + sim_rand_range(10000, 1800000);
+    h.next_outage = h.outage_end + sim_rand_range(3600000, 43200000);
+  }
+  if (!cfg->up && now >= h.outage_end) {
+    cfg->up = true;
+  }
+
+  if (now >= h.next_slow) {
+    cfg->latency = sim_rand_range(500, 1200);
+    cfg->jitter = 800;                                      // Some requests beyond HTTP_TIMEOUT
+    h.slow_end = now + sim_rand_range(60000, 900000);
+    h.next_slow = h.slow_end + sim_rand_range(3600000, 21600000);
+  }
+  if (h.slow_end && now >= h.slow_end) {
+    cfg->latency = 40;
+    cfg->jitter = 60;
+    h.slow_end = 0;
+  }
+
+  if (now >= h.next_errors) {
+    cfg->error_permille = 300;
+    cfg->drop_permille = 50;
+    h.errors_end = now + sim_rand_range(30000, 600000);
+    h.next_errors = h.errors_end + sim_rand_range(3600000, 21600000);
+  }
+  if (h.errors_end && now >= h.errors_end) {
+    cfg->error_permille = 0;
+    cfg->drop_permille = 0;
+    h.errors_end = 0;
+  }
+
+  // Knob storm: the encoder moves every few ms for a couple of seconds
+  if (now >= h.next_storm) {
+    h.storm_end = now + sim_rand_range(500, 3000);
+    h.storm_dir = sim_rand() & 1 ? 1 : -1;
+    h.next_storm = h.storm_end + sim_rand_range(600000, 7200000);
+  }
+  if (h.storm_end && now < h.storm_end) {
+    if (sim_rand_range(0, 3) == 0) {
+      sim_encoder_move((int16_t)(h.storm_dir * (int)sim_rand_range(1, 3)));
+      user_input(now, st.screen_on);
+      if (!h.setpoint_changed) {
+        h.setpoint_changed = now;
+      }
+    }
+  } else {
+    h.storm_end = 0;
+  }
+
+  if (now >= h.next_press) {
+    sim_button_press();
+    user_input(now, st.screen_on);
+    h.next_press = now + sim_rand_range(60000, 10800000);
+  }
+}
+
+// Invariants checked after every loop() iteration
+static void check(uint32_t now) {
+  thermostat_status_t st;
+  thermostat_get_status(&st);
+  const sim_server_t* server = sim_server();
+  bool boiler = sim_gpio(SIM_LED_PIN);
+
+  SIM_CHECK(boiler == st.boiler_on, "LED %d, boiler %d", boiler, st.boiler_on);
+  SIM_CHECK(sim_backlight() == st.screen_on, "backlight %d, screen %d", sim_backlight(), st.screen_on);
+
+  // Screen: wakes on input or a starting boiler and stays on while the boiler runs. It times out
+  // SCREEN_TIMEOUT after the last of them, the knob is only seen at the next encoder read.
+  static bool was_on = true;
+  static bool was_boiler = false;
+  static uint32_t last_wake_cause = 0;
+  static uint32_t boiler_off_time = 0;
+  if (boiler && !was_boiler) {
+    last_wake_cause = now;
+  }
+  if (!boiler && was_boiler) {
+    boiler_off_time = now;
+  }
+  if (h.last_input > last_wake_cause) {
+    last_wake_cause = h.last_input;
+  }
+  if (st.screen_on && h.pending_wake) {
+    stat_add(&screen_wake, now - h.pending_wake);
+    h.pending_wake = 0;
+  }
+  SIM_CHECK(!h.pending_wake || now - h.pending_wake <= SIM_INDEV_PERIOD / 1000 + SIM_STEP_US / 1000,
+            "screen still off %u ms after input", now - h.pending_wake);
+  SIM_CHECK(!boiler || st.screen_on, "screen off while the boiler runs");
+  uint32_t deadline = std::max(last_wake_cause + SCREEN_TIMEOUT, boiler_off_time);
+  if (was_on && !st.screen_on) {
+    uint32_t idle = now - last_wake_cause;
+    SIM_CHECK(idle > SCREEN_TIMEOUT, "screen off after %u ms idle", idle);
+    stat_add(&screen_off_delay, now - deadline);
+  }
+  SIM_CHECK(!st.screen_on || boiler || now <= deadline + SIM_INDEV_PERIOD / 1000 + 2 * SIM_STEP_US / 1000,
+            "screen on %u ms after the last input", now - last_wake_cause);
+  was_on = st.screen_on;
+  was_boiler = boiler;
+
+  // WiFi: back within a retry interval and a connect timeout once the AP is up
+  bool connected = st.wifi == WIFI_CONNECTED;
+  if (connected && !h.wifi_was_connected && h.reconnect_from) {
+    stat_add(&wifi_reconnect, now - h.reconnect_from);
+    h.reconnect_from = 0;
+  }
+  if (!connected && h.wifi_was_connected && h.ap_up_since) {
+    h.reconnect_from = now;
+  }
+  SIM_CHECK(!h.reconnect_from || now - h.reconnect_from <= WIFI_RETRY_INTERVAL + WIFI_CONNECT_TIMEOUT,
+            "WiFi not back %u ms after the AP", now - h.reconnect_from);
+  h.wifi_was_connected = connected;
+
+  bool healthy = connected && !st.server_degraded && sim_server_cfg()->up;
+  if (!healthy) {
+    h.healthy_since = 0;
+  } else if (!h.healthy_since) {
+    h.healthy_since = now;
+  }
+
+  // Setpoint: an acknowledged setpoint is the one the server has
+  if (!st.setpoint_pending) {
+    SIM_CHECK((int)server->setpoint == st.setpoint, "server setpoint %d, device %d acknowledged",
+              (int)server->setpoint, st.setpoint);
+    if (h.setpoint_changed && (!h.storm_end || now >= h.storm_end)) {
+      stat_add(&setpoint_sync, now - h.setpoint_changed);
+      h.setpoint_changed = 0;
+    }
+  }
+  SIM_CHECK(st.setpoint >= THERMOSTAT_MIN_TEMP && st.setpoint <= THERMOSTAT_MAX_TEMP, "setpoint %d", st.setpoint);
+
+  // Schedule: a transition shows up as the setpoint unless the knob moved after it. Entries
+  // count once the wall clock passes them for the first time, the autumn repeat does not.
+  int64_t local = schedule_local(sim_wall_ms() / 1000);
+  if (local > h.sched_local) {
+    int64_t week = (local / 86400 - (local / 86400 + 3) % 7) * 86400;
+    int64_t latest = 0;
+    for (int i = 0; i < sim_schedule.count; i++) {
+      int64_t t = week + sim_schedule.entries[i].minute * 60;
+      t = t > local ? t - 7 * 86400 : t;
+      if (t > h.sched_local && t > latest) {
+        latest = t;
+        h.sched_setpoint = sim_schedule.entries[i].setpoint;
+      }
+    }
+    if (latest && h.sched_local) {
+      h.sched_at = now;
+    }
+    h.sched_local = local;
+  }
+  if (h.sched_at && (st.setpoint == h.sched_setpoint || h.last_input >= h.sched_at)) {
+    if (st.setpoint == h.sched_setpoint) {
+      stat_add(&schedule_late, now - h.sched_at);
+    }
+    h.sched_at = 0;
+  }
+  SIM_CHECK(!h.sched_at || now - h.sched_at <= SIM_SCHEDULE_GRACE, "schedule setpoint %d not applied after %u ms",
+            h.sched_setpoint, now - h.sched_at);
+
+#if LOCAL_CONTROL
+  // Local control: takes over within a tick once the boiler status is LOCAL_CTRL_TAKEOVER past its next
+  // poll and hands back within a tick of the next status
+  uint32_t status_age = now - st.boiler_time;
+  uint32_t tick = LOCAL_CTRL_TICK + SIM_STEP_US / 1000;
+  uint32_t takeover = LOCAL_CTRL_TAKEOVER + POLL_IDLE_BOILER_STATUS_INTERVAL + tick;
+  SIM_CHECK(st.local_control || status_age <= takeover, "no local control %u ms after the last boiler status",
+            status_age);
+  SIM_CHECK(!st.local_control || status_age >= LOCAL_CTRL_TAKEOVER || status_age <= tick,
+            "local control with a boiler status %u ms old", status_age);
+  static bool was_local = false;
+  if (st.local_control != was_local) {
+    (st.local_control ? h.takeovers : h.handbacks)++;
+    was_local = st.local_control;
+  }
+#endif
+}
+
+// Steps the engine a minute at a time from utc to end, moving the clock by jump once at jump_at
+static std::vector<std::pair<int64_t, int>> step_schedule(schedule_t* s, int64_t utc, int64_t end, int64_t jump_at,
+                                                          int64_t jump) {
+  std::vector<std::pair<int64_t, int>> fired;
+  while (utc < end) {
+    int setpoint = schedule_due(s, utc);
+    if (setpoint >= 0) {
+      fired.push_back({ utc, setpoint });
+    }
+    utc += 60;
+    if (jump_at && utc >= jump_at) {
+      utc += jump;
+      jump_at = 0;
+    }
+  }
+  return fired;
+}
+
+static bool fired_at(const std::vector<std::pair<int64_t, int>>& fired, size_t i, int64_t utc, int setpoint) {
+  return i < fired.size() && fired[i].first >= utc && fired[i].first < utc + 60 && fired[i].second == setpoint;
+}
+
+// The schedule engine and its clock on their own, in SCHEDULE_TZ
+static void check_schedule_engine(void) {
+  static const char* table = "Sun 02:30 19; Sun 03:15 20; * 22:30 16";
+  schedule_t s;
+  schedule_init(&s);
+  SIM_CHECK(schedule_parse(&s, table, THERMOSTAT_MIN_TEMP, THERMOSTAT_MAX_TEMP) && s.count == 9, "parse %u",
+            s.count);
+
+  // Spring: 02:30 does not exist on 2026-03-29 and fires when the clock jumps to 03:00 CEST
+  schedule_t t = s;
+  auto fired = step_schedule(&t, 1774699200, 1774785600, 0, 0);
+  SIM_CHECK(fired.size() == 3 && fired_at(fired, 0, 1774733400, 16) && fired_at(fired, 1, 1774746000, 19) &&
+              fired_at(fired, 2, 1774746900, 20),
+            "spring DST change fired %zu", fired.size());
+
+  // Autumn: 02:30 comes twice on 2026-10-25 and fires once
+  t = s;
+  t.last = 0;
+  fired = step_schedule(&t, 1792843200, 1792929600, 0, 0);
+  SIM_CHECK(fired.size() == 3 && fired_at(fired, 0, 1792873800, 16) && fired_at(fired, 1, 1792888200, 19) &&
+              fired_at(fired, 2, 1792894500, 20),
+            "autumn DST change fired %zu", fired.size());
+
+  // Waits run to the UTC time of the next entry: to the jump for 02:30 in the spring gap, past the
+  // repeated 02:30 in autumn once it fired on the first pass
+  t = s;
+  t.last = schedule_local(1774744200);
+  uint32_t wait_gap = schedule_wait(&t, 1774744200000LL);
+  t.last = schedule_local(1774746000);
+  uint32_t wait_after = schedule_wait(&t, 1774746000000LL + 250);
+  t.last = schedule_local(1792886400);
+  uint32_t wait_autumn = schedule_wait(&t, 1792886400000LL);
+  t.last = schedule_local(1792889999);
+  uint32_t wait_repeat = schedule_wait(&t, 1792891800000LL);
+  SIM_CHECK(wait_gap == 1800000 && wait_after == 899750 && wait_autumn == 1800000 && wait_repeat == 2700000,
+            "waits %u %u %u %u ms", wait_gap, wait_after, wait_autumn, wait_repeat);
+
+  // Three days forward: only the entry in force fires
+  t = s;
+  t.last = 0;
+  fired = step_schedule(&t, 1774569600, 1774569600 + 3 * 86400 + 7200, 1774573200, 3 * 86400);
+  SIM_CHECK(fired.size() == 1 && fired[0].second == 16, "jump forward fired %zu", fired.size());
+
+  // 45 minutes back: 22:30 is passed again without firing
+  t = s;
+  t.last = 0;
+  fired = step_schedule(&t, 1774731600, 1774737000, 1774734000, -2700);
+  SIM_CHECK(fired.size() == 1 && fired_at(fired, 0, 1774733400, 16), "step back fired %zu", fired.size());
+
+  // A day back is a corrected clock: no firing at the jump, 22:30 fires again when it comes round
+  t = s;
+  t.last = 0;
+  fired = step_schedule(&t, 1774731600, 1774734000, 1774734000, -86400);
+  SIM_CHECK(fired.size() == 2 && fired_at(fired, 0, 1774733400, 16) && fired_at(fired, 1, 1774733400, 16),
+            "day back fired %zu", fired.size());
+
+  // Table text and the packed NVS form
+  uint8_t buf[SCHEDULE_PACK_SIZE(SCHEDULE_MAX_ENTRIES)];
+  schedule_t u;
+  schedule_init(&u);
+  size_t len = schedule_pack(&s, buf, sizeof(buf));
+  bool same = len == SCHEDULE_PACK_SIZE(9) && schedule_unpack(&u, buf, len) && u.count == s.count;
+  for (int i = 0; same && i < s.count; i++) {
+    same = u.entries[i].minute == s.entries[i].minute && u.entries[i].setpoint == s.entries[i].setpoint;
+  }
+  SIM_CHECK(same, "pack round trip");
+  SIM_CHECK(!schedule_parse(&u, "Mon 25:00 20", 10, 70) && !schedule_parse(&u, "Fun 06:00 20", 10, 70) &&
+              !schedule_parse(&u, "Mon 06:00 90", 10, 70) && u.count == s.count,
+            "bad tables accepted");
+  SIM_CHECK(schedule_parse(&u, "Sat-Mon 07:00 18", 10, 70) && u.count == 3 && u.entries[0].minute == 420,
+            "wrapping day range %u", u.count);
+
+  // Clock: a tick 300 ppm fast is measured across hourly fixes, a step is not taken for drift
+  schedule_clock_t c = {};
+  int64_t wall = 1774569600000;
+  for (int i = 0; i <= 6; i++) {
+    schedule_clock_set(&c, wall + i * 3600000LL, (uint32_t)(i * 3600000LL * 1000300 / 1000000), true);
+  }
+  int64_t est;
+  schedule_clock_now(&c, (uint32_t)(7 * 3600000LL * 1000300 / 1000000), &est);
+  SIM_CHECK(c.drift >= 290 && c.drift <= 310 && llabs(est - (wall + 7 * 3600000LL)) < 50,
+            "drift %d ppm, off %lld ms after an hour", c.drift, (long long)(est - (wall + 7 * 3600000LL)));
+  int32_t drift = c.drift;
+  schedule_clock_set(&c, wall + 8 * 3600000LL + 300000, (uint32_t)(8 * 3600000LL * 1000300 / 1000000), true);
+  SIM_CHECK(c.drift == drift && c.last_step > 299000 && c.last_step < 301000, "step %d ms, drift %d ppm",
+            c.last_step, c.drift);
+}
+
+int main(int argc, char** argv) {
+  uint32_t days = 3;
+  uint32_t seed = 1;
+  int64_t start = SIM_START;
+  uint8_t verbose = LOG_LEVEL_NONE;
+  bool telemetry_endpoint = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+      days = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+      start = atoll(argv[++i]);
+    } else if (strcmp(argv[i], "--no-telemetry-endpoint") == 0) {
+      telemetry_endpoint = false;
+    } else if (strcmp(argv[i], "-v") == 0) {
+      verbose = verbose < LOG_LEVEL_DEBUG ? verbose + 1 : verbose;
+    } else {
+      printf("usage: %s [--days N] [--seed N] [--start UTC] [--no-telemetry-endpoint] [-v [-v ...]]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  sim_reset(seed);
+  sim_log_level(verbose);
+  sim_server_set_hook(on_request);
+  sim_server_cfg()->telemetry = telemetry_endpoint;
+  memset(&h, 0, sizeof(h));
+  h.ap_up_since = 1;
+  h.next_wifi_drop = sim_rand_range(600000, 14400000);
+  h.next_outage = sim_rand_range(3600000, 43200000);
+  h.next_slow = sim_rand_range(3600000, 21600000);
+  h.next_errors = sim_rand_range(3600000, 21600000);
+  h.next_storm = sim_rand_range(60000, 7200000);
+  h.next_press = sim_rand_range(60000, 10800000);
+
+  static const hal_pins_t pins = { 38, 3, 5, 6 };
+  hal_begin(&pins);
+  static const thermostat_cfg_t cfg = { "sim", "sim", "192.168.4.1", 80, SIM_LED_PIN };
+  static const thermostat_ui_t ui = { NULL, NULL };
+  sim_wall_set(start * 1000, SIM_DRIFT);
+  thermostat_begin(&cfg, &ui);
+  check_schedule_engine();
+  schedule_init(&sim_schedule);
+  schedule_parse(&sim_schedule, SIM_SCHEDULE, THERMOSTAT_MIN_TEMP, THERMOSTAT_MAX_TEMP);
+  SIM_CHECK(thermostat_set_schedule(SIM_SCHEDULE), "schedule rejected");
+
+  uint64_t end = (uint64_t)days * 86400000000ULL;
+  uint64_t next_indev = 0;
+  uint32_t iterations = 0;
+  while (sim_now_us() < end) {
+    uint32_t now = hal_millis();
+    schedule(now);
+    if (sim_now_us() >= next_indev) {
+      thermostat_encoder(hal_encoder_count());
+      next_indev += SIM_INDEV_PERIOD;
+    }
+    thermostat_loop();
+    boot_prof_report("sim");
+    check(now);
+    sim_advance(SIM_STEP_US);
+    iterations++;
+  }
+
+  const sim_server_t* server = sim_server();
+  printf("Simulated %u days (seed %u), %u loop iterations\n", days, seed, iterations);
+  printf("Server saw Temp %u, boilerStatus %u, setTemp %u requests (fixed policy: %lu polls)\n",
+         server->requests[0], server->requests[1], server->requests[2],
+         (unsigned long)days * (86400000UL / TEMP_FETCH_INTERVAL + 86400000UL / BOILER_STATUS_FETCH_INTERVAL));
+  stat_print(&wifi_reconnect, "ms");
+  stat_print(&screen_wake, "ms");
+  stat_print(&screen_off_delay, "ms");
+  stat_print(&temp_gap, "ms");
+  stat_print(&boiler_gap, "ms");
+  stat_print(&setpoint_sync, "ms");
+  stat_print(&schedule_late, "ms");
+#if TELEMETRY
+  thermostat_status_t status;
+  thermostat_get_status(&status);
+  if (sim_server_cfg()->telemetry) {
+    // Every record the device did not drop reaches the server once, in order
+    SIM_CHECK(server->telemetry_bad == 0, "%u bad telemetry batches or values", server->telemetry_bad);
+    SIM_CHECK(server->telemetry_gaps == status.telemetry_dropped, "%u telemetry records missing, %u dropped",
+              server->telemetry_gaps, status.telemetry_dropped);
+    SIM_CHECK(server->telemetry_records > 0 && status.telemetry_backlog <= TELEMETRY_FLUSH_AT,
+              "%u telemetry records stored, %u waiting", server->telemetry_records, status.telemetry_backlog);
+  } else {
+    // Rejected uploads wait out the interval however many records pile up
+    uint32_t max_uploads = (uint32_t)(days * 86400000ULL / TELEMETRY_INTERVAL) + 1;
+    SIM_CHECK(server->telemetry_batches <= max_uploads && status.telemetry_dropped > 0,
+              "%u uploads to a server without /telemetry (at most %u), %u dropped", server->telemetry_batches,
+              max_uploads, status.telemetry_dropped);
+  }
+  printf("Telemetry: %u records (%u waiting), %u uploads, %u B, %u resent; one POST per record: %u requests, %u B\n",
+         server->telemetry_records, status.telemetry_backlog, server->telemetry_batches, server->telemetry_bytes,
+         server->telemetry_resent, server->telemetry_records, server->telemetry_sample_bytes);
+#endif
+#if LOCAL_CONTROL
+  // Outages longer than LOCAL_CTRL_TAKEOVER come often enough that both directions get exercised
+  SIM_CHECK(h.takeovers > 0 && h.handbacks > 0, "%u takeovers, %u handbacks", h.takeovers, h.handbacks);
+  printf("Local control: %u takeovers, %u handbacks\n", h.takeovers, h.handbacks);
+#endif
+  // A cold boot polls as soon as WiFi is up instead of waiting out a poll interval
+  uint32_t wifi_up = boot_prof_at(BOOT_STAGE_WIFI_UP);
+  uint32_t live = boot_prof_at(BOOT_STAGE_LIVE_DATA);
+  SIM_CHECK(wifi_up && live && live - wifi_up <= SIM_BOOT_LIVE_DATA_MAX * 1000, "WiFi up at %u ms, live data at %u ms",
+            wifi_up / 1000, live / 1000);
+  printf("Boot: WiFi up at %u ms, live data at %u ms\n", wifi_up / 1000, live / 1000);
+  printf("%u failed checks\n", failures);
+  return failures ? 1 : 0;
+}
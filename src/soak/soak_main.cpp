@@ -0,0 +1,422 @@
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include "esp_timer.h"
+#include "http_client.hpp"
+#include "telemetry.hpp"
+
+// Soak and throughput benchmark for the firmware's HTTP client, built for the
+// host against tools/standin_server.py:
+//
+//   tools/standin_server.py --port 8080 --latency 20 --jitter 30 --drop 0.01 --reset 0.01 &
+//   pio run -e soak && .pio/build/soak/program --port 8080 --duration 3600 --gap 100
+//
+// Each slot cycles through the four endpoints the firmware uses, waiting
+// --gap ms between its requests (0 runs them back to back for throughput).
+// Every --report seconds and at the end it prints the success rate, latency
+// percentiles and the process memory and descriptor counts. The benchmark
+// itself allocates nothing after startup, so any heap or descriptor growth is
+// the client's. Exits with 1 if sockets leaked or the success rate is below
+// --min-success.
+
+#define SOAK_MAX_SLOTS 64
+#define SOAK_ENDPOINTS 4
+#define SOAK_TELEMETRY_RECORDS 200  // Per batch, about a day of history
+
+// Latency histogram: exact below 64 us, then 32 buckets per power of two (3 %)
+#define SOAK_SUB_BITS 5
+#define SOAK_LINEAR 64
+#define SOAK_BUCKETS (SOAK_LINEAR + 26 * (1 << SOAK_SUB_BITS))
+
+typedef enum {
+  SOAK_OK,
+  SOAK_FAIL_HTTP,       // http_err_t failure
+  SOAK_FAIL_STATUS,     // Answer other than 200
+  SOAK_FAIL_BODY,       // 200 with a body the firmware would reject
+} soak_result_t;
+
+typedef struct {
+  uint32_t ok;
+  uint32_t max_us;
+  uint32_t buckets[SOAK_BUCKETS];  // Latency of the successful requests
+  uint32_t http_errors[HTTP_ERR_CANCELLED + 1];
+  uint32_t bad_status;
+  uint32_t bad_body;
+} soak_stat_t;
+
+typedef struct {
+  http_req_t req;
+  int endpoint;
+  int64_t start;
+  int64_t next;
+  uint8_t batch[TELEMETRY_BATCH_SIZE];  // Sent from here while the request runs
+  uint32_t batch_next;                   // Sequence the server has to answer with
+} soak_slot_t;
+
+typedef struct {
+  long rss_kb;
+  long heap_kb;
+  int fds;
+} soak_mem_t;
+
+static const char* host = "127.0.0.1";
+static uint16_t port = 8080;
+static uint32_t duration_s = 60;
+static int slot_count = SOAK_ENDPOINTS;
+static uint32_t gap_ms = 0;
+static uint32_t timeout_ms = 1500;
+static uint32_t report_s = 10;
+static double min_success = 0;
+
+static soak_slot_t slots[SOAK_MAX_SLOTS];
+static soak_stat_t window[SOAK_ENDPOINTS];
+static soak_stat_t total[SOAK_ENDPOINTS];
+static const char* const endpoint_names[SOAK_ENDPOINTS] = { "setTemp", "Temp", "boilerStatus", "telemetry" };
+static telemetry_t telemetry;
+
+static void mem_sample(soak_mem_t* mem) {
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  mem->rss_kb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  mem->heap_kb = (long)(mallinfo2().uordblks / 1024);
+#else
+  mem->heap_kb = -1;
+#endif
+  mem->fds = 0;
+  DIR* dir = opendir("/proc/self/fd");
+  if (dir) {
+    while (struct dirent* e = readdir(dir)) {
+      if (e->d_name[0] != '.') {
+        mem->fds++;
+      }
+    }
+    closedir(dir);
+    mem->fds--;  // The directory stream itself
+  }
+}
+
+// A fresh session each time, so the server stores every batch
+static size_t telemetry_batch(uint8_t* buf) {
+  telemetry_init(&telemetry, 1, (uint32_t)rand(), 0);
+  uint32_t now = 0;
+  int16_t temp = 2000;
+  for (int i = 0; i < SOAK_TELEMETRY_RECORDS; i++) {
+    now += 20000 + rand() % 400000;
+    temp += rand() % 21 - 10;
+    telemetry_record(&telemetry, i % 10 ? TELEMETRY_TEMP : i % 20 ? TELEMETRY_BOILER_ON : TELEMETRY_BOILER_OFF,
+                     temp, now);
+  }
+  return telemetry_encode(&telemetry, buf, TELEMETRY_BATCH_SIZE, now, 0);
+}
+
+static void slot_begin(soak_slot_t* slot) {
+  static const char* const paths[SOAK_ENDPOINTS] = { "/setTemp", "/Temp?plain", "/boilerStatus?plain", "/telemetry" };
+  if (slot->endpoint == 3) {
+    size_t len = telemetry_batch(slot->batch);
+    slot->batch_next = telemetry.head;
+    slot->start = esp_timer_get_time();
+    http_begin_data(&slot->req, host, port, "POST", paths[3], "application/octet-stream", slot->batch, len,
+                    timeout_ms);
+    return;
+  }
+  char body[32];
+  const char* post = NULL;
+  if (slot->endpoint == 0) {
+    snprintf(body, sizeof(body), "value=%d.00", 10 + rand() % 61);
+    post = body;
+  }
+  slot->start = esp_timer_get_time();
+  http_begin(&slot->req, host, port, post ? "POST" : "GET", paths[slot->endpoint],
+             "application/x-www-form-urlencoded", post, timeout_ms);
+}
+
+// Same acceptance as the firmware's response handlers
+static soak_result_t slot_result(const soak_slot_t* slot) {
+  const http_req_t* req = &slot->req;
+  if (req->state != HTTP_DONE) {
+    return SOAK_FAIL_HTTP;
+  }
+  if (req->status != 200) {
+    return SOAK_FAIL_STATUS;
+  }
+  const char* body = http_body(req);
+  switch (slot->endpoint) {
+    case 1: {
+      char* end;
+      strtof(body, &end);
+      return end != body ? SOAK_OK : SOAK_FAIL_BODY;
+    }
+    case 2:
+      return strcmp(body, "true") == 0 || strcmp(body, "false") == 0 ? SOAK_OK : SOAK_FAIL_BODY;
+    case 3: {
+      // Everything stored: the next sequence the server expects follows the batch
+      char* end;
+      return strtoul(body, &end, 10) == slot->batch_next && end != body ? SOAK_OK : SOAK_FAIL_BODY;
+    }
+    default:
+      return SOAK_OK;
+  }
+}
+
+static int soak_bucket(uint32_t us) {
+  if (us < SOAK_LINEAR) {
+    return us;
+  }
+  int msb = 31 - __builtin_clz(us);
+  int sub = (us >> (msb - SOAK_SUB_BITS)) & ((1 << SOAK_SUB_BITS) - 1);
+  return SOAK_LINEAR + ((msb - 6) << SOAK_SUB_BITS) + sub;
+}
+
+static uint32_t soak_bucket_upper(int idx) {
+  if (idx < SOAK_LINEAR) {
+    return idx;
+  }
+  int msb = ((idx - SOAK_LINEAR) >> SOAK_SUB_BITS) + 6;
+  int sub = (idx - SOAK_LINEAR) & ((1 << SOAK_SUB_BITS) - 1);
+  uint32_t lower = (uint32_t)((1 << SOAK_SUB_BITS) + sub) << (msb - SOAK_SUB_BITS);
+  return lower + (1u << (msb - SOAK_SUB_BITS)) - 1;
+}
+
+static uint32_t stat_percentile(const soak_stat_t* stat, uint32_t percent) {
+  uint32_t rank = (uint32_t)(((uint64_t)stat->ok * percent + 99) / 100);
+  uint32_t seen = 0;
+  for (int i = 0; i < SOAK_BUCKETS; i++) {
+    seen += stat->buckets[i];
+    if (seen >= rank) {
+      return std::min(soak_bucket_upper(i), stat->max_us);
+    }
+  }
+  return stat->max_us;
+}
+
+static void stat_record(soak_stat_t* stat, const soak_slot_t* slot, soak_result_t result, uint32_t us) {
+  switch (result) {
+    case SOAK_OK:
+      stat->ok++;
+      stat->buckets[soak_bucket(us)]++;
+      stat->max_us = std::max(stat->max_us, us);
+      break;
+    case SOAK_FAIL_HTTP:
+      stat->http_errors[slot->req.error]++;
+      break;
+    case SOAK_FAIL_STATUS:
+      stat->bad_status++;
+      break;
+    case SOAK_FAIL_BODY:
+      stat->bad_body++;
+      break;
+  }
+}
+
+static uint32_t stat_failed(const soak_stat_t* stat) {
+  uint32_t failed = stat->bad_status + stat->bad_body;
+  for (uint32_t n : stat->http_errors) {
+    failed += n;
+  }
+  return failed;
+}
+
+static void stat_print(const char* name, soak_stat_t* stat, double seconds) {
+  uint32_t failed = stat_failed(stat);
+  uint32_t count = stat->ok + failed;
+  printf("  %-13s %8u req %8.1f/s %7.3f%% ok", name, count, count / seconds,
+         count ? 100.0 * stat->ok / count : 0.0);
+  if (stat->ok) {
+    printf("  p50 %6.2f  p90 %6.2f  p99 %7.2f  max %7.2f ms", stat_percentile(stat, 50) / 1e3,
+           stat_percentile(stat, 90) / 1e3, stat_percentile(stat, 99) / 1e3, stat->max_us / 1e3);
+  }
+  printf("\n");
+  if (failed) {
+    printf("  %13s", "");
+    for (int e = 0; e <= HTTP_ERR_CANCELLED; e++) {
+      if (stat->http_errors[e]) {
+        printf(" %s %u,", http_err_str((http_err_t)e), stat->http_errors[e]);
+      }
+    }
+    if (stat->bad_status) {
+      printf(" status %u,", stat->bad_status);
+    }
+    if (stat->bad_body) {
+      printf(" body %u,", stat->bad_body);
+    }
+    printf("\n");
+  }
+}
+
+// Adds a report window into the totals and clears it
+static void stat_merge(soak_stat_t* into, soak_stat_t* from) {
+  into->ok += from->ok;
+  into->max_us = std::max(into->max_us, from->max_us);
+  for (int i = 0; i < SOAK_BUCKETS; i++) {
+    into->buckets[i] += from->buckets[i];
+  }
+  for (int e = 0; e <= HTTP_ERR_CANCELLED; e++) {
+    into->http_errors[e] += from->http_errors[e];
+  }
+  into->bad_status += from->bad_status;
+  into->bad_body += from->bad_body;
+  memset(from, 0, sizeof(*from));
+}
+
+static void mem_print(const char* label, const soak_mem_t* mem) {
+  printf("  %-13s RSS %ld KB, heap %ld KB, %d fds\n", label, mem->rss_kb, mem->heap_kb, mem->fds);
+}
+
+// Waits until a busy slot's socket is ready or the next slot is due, at most 1 ms
+static void wait_sockets(int64_t now) {
+  fd_set rfds, wfds;
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  int max_fd = -1;
+  int64_t wait_us = 1000;
+  for (int i = 0; i < slot_count; i++) {
+    soak_slot_t* slot = &slots[i];
+    if (!http_busy(&slot->req)) {
+      wait_us = std::min(wait_us, std::max<int64_t>(0, slot->next - now));
+      continue;
+    }
+    if (slot->req.sock < 0) {
+      continue;
+    }
+    FD_SET(slot->req.sock, slot->req.state <= HTTP_SENDING ? &wfds : &rfds);
+    max_fd = std::max(max_fd, slot->req.sock);
+  }
+  struct timeval tv = { 0, (suseconds_t)wait_us };
+  select(max_fd + 1, &rfds, &wfds, NULL, &tv);
+}
+
+static void usage(const char* prog) {
+  printf("usage: %s [--host IP] [--port N] [--duration S] [--slots N] [--gap MS] [--timeout MS]\n"
+         "          [--report S] [--min-success PCT]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!val) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (!strcmp(arg, "--host")) host = val;
+    else if (!strcmp(arg, "--port")) port = (uint16_t)atoi(val);
+    else if (!strcmp(arg, "--duration")) duration_s = (uint32_t)atol(val);
+    else if (!strcmp(arg, "--slots")) slot_count = std::max(1, std::min(SOAK_MAX_SLOTS, atoi(val)));
+    else if (!strcmp(arg, "--gap")) gap_ms = (uint32_t)atol(val);
+    else if (!strcmp(arg, "--timeout")) timeout_ms = (uint32_t)atol(val);
+    else if (!strcmp(arg, "--report")) report_s = std::max(1, atoi(val));
+    else if (!strcmp(arg, "--min-success")) min_success = atof(val);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+  }
+  // lwIP has no SIGPIPE, a reset connection must fail the send like on the board
+  signal(SIGPIPE, SIG_IGN);
+  srand(1);
+
+  printf("Soak against %s:%u for %u s, %d slots, %u ms gap, %u ms timeout\n", host, port, duration_s, slot_count,
+         gap_ms, timeout_ms);
+
+  soak_mem_t mem_start, mem_now;
+  mem_sample(&mem_start);
+  mem_print("start", &mem_start);
+
+  int64_t start = esp_timer_get_time();
+  int64_t end = start + (int64_t)duration_s * 1000000;
+  int64_t window_start = start;
+  for (int i = 0; i < slot_count; i++) {
+    slots[i].endpoint = i % SOAK_ENDPOINTS;
+    slots[i].next = start;
+  }
+
+  bool draining = false;
+  for (;;) {
+    int64_t now = esp_timer_get_time();
+    draining = now >= end;
+    int busy = 0;
+    for (int i = 0; i < slot_count; i++) {
+      soak_slot_t* slot = &slots[i];
+      if (http_busy(&slot->req)) {
+        http_step(&slot->req);
+        if (http_busy(&slot->req)) {
+          busy++;
+          continue;
+        }
+        int64_t done = esp_timer_get_time();
+        stat_record(&window[slot->endpoint], slot, slot_result(slot), (uint32_t)(done - slot->start));
+        slot->endpoint = (slot->endpoint + 1) % SOAK_ENDPOINTS;
+        slot->next = done + (int64_t)gap_ms * 1000;
+      }
+      if (!draining && now >= slot->next) {
+        slot_begin(slot);
+        // A request that fails at begin is recorded right away
+        if (!http_busy(&slot->req)) {
+          stat_record(&window[slot->endpoint], slot, SOAK_FAIL_HTTP, 0);
+          slot->endpoint = (slot->endpoint + 1) % SOAK_ENDPOINTS;
+          slot->next = now + (int64_t)gap_ms * 1000;
+        } else {
+          busy++;
+        }
+      }
+    }
+
+    if (now - window_start >= (int64_t)report_s * 1000000 || (draining && !busy)) {
+      double seconds = (now - window_start) / 1e6;
+      mem_sample(&mem_now);
+      printf("[%8.1f s]\n", (now - start) / 1e6);
+      for (int e = 0; e < SOAK_ENDPOINTS; e++) {
+        stat_print(endpoint_names[e], &window[e], seconds);
+        stat_merge(&total[e], &window[e]);
+      }
+      mem_print("memory", &mem_now);
+      window_start = now;
+    }
+    if (draining && !busy) {
+      break;
+    }
+    wait_sockets(now);
+  }
+
+  // Every request has finished, so every socket must be closed again
+  double seconds = (esp_timer_get_time() - start) / 1e6;
+  mem_sample(&mem_now);
+  uint32_t ok = 0, count = 0;
+  printf("\nTotal over %.1f s\n", seconds);
+  for (int e = 0; e < SOAK_ENDPOINTS; e++) {
+    ok += total[e].ok;
+    count += total[e].ok + stat_failed(&total[e]);
+    stat_print(endpoint_names[e], &total[e], seconds);
+  }
+  double success = count ? 100.0 * ok / count : 0;
+  printf("  %-13s %8u req %8.1f/s %7.3f%% ok\n", "all", count, count / seconds, success);
+  mem_print("start", &mem_start);
+  mem_print("end", &mem_now);
+  printf("  %-13s RSS %+ld KB, heap %+ld KB (%.1f KB/h), fds %+d\n", "growth", mem_now.rss_kb - mem_start.rss_kb,
+         mem_now.heap_kb - mem_start.heap_kb, (mem_now.heap_kb - mem_start.heap_kb) * 3600.0 / seconds,
+         mem_now.fds - mem_start.fds);
+
+  bool failed = false;
+  if (mem_now.fds != mem_start.fds) {
+    printf("FAIL: %d sockets leaked\n", mem_now.fds - mem_start.fds);
+    failed = true;
+  }
+  if (success < min_success) {
+    printf("FAIL: success rate %.3f%% below %.3f%%\n", success, min_success);
+    failed = true;
+  }
+  return failed ? 1 : 0;
+}
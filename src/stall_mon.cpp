@@ -0,0 +1,327 @@
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_debug_helpers.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#if __has_include("esp_private/freertos_debug.h")
+#include "esp_private/freertos_debug.h"
+#else
+#include "freertos/task_snapshot.h"
+#endif
+#if __has_include("freertos/xtensa_context.h")
+#include "freertos/xtensa_context.h"
+#else
+#include "xtensa_context.h"
+#endif
+#include "logger.hpp"
+#include "stall_mon.hpp"
+
+#define STALL_MON_MAGIC 0x5354414c    // "STAL"
+#define STALL_MON_OPEN_MAGIC 0x4f50454e // "OPEN"
+#define STALL_MON_SWITCH_US 50        // Lets the other core switch the suspended task out
+
+typedef struct {
+  uint8_t step;
+  uint8_t depth;
+  uint32_t pc[STALL_MON_DEPTH];
+} stall_capture_t;
+
+typedef struct {
+  volatile bool active;
+  volatile uint32_t start;
+  volatile uint32_t next_capture;   // us into the pass
+  volatile bool captured;
+  stall_capture_t capture;          // Written only while the loop task is suspended
+  uint32_t budget;
+  stall_hist_t hist;
+} stall_pass_state_t;
+
+// Survives everything but a power cycle, checked by magic and checksum
+typedef struct {
+  uint32_t magic;
+  uint32_t boots;
+  uint32_t count;
+  stall_record_t worst[STALL_MON_RING];
+  uint32_t check;
+} stall_rtc_t;
+
+// Last capture of the pass stuck longest, written by the watch task, cleared when the pass ends
+typedef struct {
+  uint32_t magic;
+  stall_record_t rec;
+  uint32_t check;
+} stall_open_t;
+
+static RTC_NOINIT_ATTR stall_rtc_t rtc;
+static RTC_NOINIT_ATTR stall_open_t open_rec;
+
+static volatile uint8_t crumb = STALL_STEP_IDLE;
+static TaskHandle_t loop_task = NULL;
+static stall_pass_state_t passes[STALL_PASS_COUNT] = {
+  { false, 0, 0, false, {}, STALL_MON_LOOP_BUDGET, {} },
+  { false, 0, 0, false, {}, STALL_MON_LVGL_BUDGET, {} },
+};
+
+static uint32_t stall_now(void) {
+  return (uint32_t)esp_timer_get_time();
+}
+
+static uint32_t checksum(const void* data, size_t len) {
+  const uint32_t* w = (const uint32_t*)data;
+  uint32_t sum = 0x811c9dc5;
+  for (size_t i = 0; i < len / 4; i++) {
+    sum = (sum ^ w[i]) * 16777619;
+  }
+  return sum;
+}
+
+static uint32_t rtc_checksum(void) {
+  return checksum(&rtc, offsetof(stall_rtc_t, check));
+}
+
+static uint32_t open_checksum(void) {
+  return checksum(&open_rec, offsetof(stall_open_t, check));
+}
+
+// Return addresses carry the call window size in the top bits and point past the call
+static uint32_t stall_pc(uint32_t pc, bool ret) {
+  if (pc & 0x80000000) {
+    pc = (pc & 0x3fffffff) | 0x40000000;
+  }
+  return ret ? pc - 3 : pc;
+}
+
+// Walks the saved stack of the suspended loop task
+static void stall_backtrace(stall_capture_t* cap) {
+  TaskSnapshot_t snap;
+  cap->depth = 0;
+  vTaskGetSnapshot(loop_task, &snap);
+  const XtExcFrame* exc = (const XtExcFrame*)snap.pxTopOfStack;
+  esp_backtrace_frame_t frame = {};
+  if (exc->exit) {
+    // Preempted by an interrupt: full exception frame
+    frame.pc = exc->pc;
+    frame.sp = exc->a1;
+    frame.next_pc = exc->a0;
+  } else {
+    // Blocked in a yield: solicited frame
+    const XtSolFrame* sol = (const XtSolFrame*)snap.pxTopOfStack;
+    frame.pc = sol->pc;
+    frame.sp = sol->a1;
+    frame.next_pc = sol->a0;
+  }
+  cap->pc[cap->depth++] = stall_pc(frame.pc, false);
+  while (cap->depth < STALL_MON_DEPTH && frame.next_pc && esp_backtrace_get_next_frame(&frame)) {
+    cap->pc[cap->depth++] = stall_pc(frame.pc, true);
+  }
+}
+
+static void stall_watch(void* arg) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(STALL_MON_PERIOD));
+    bool due = false;
+    uint32_t now = stall_now();
+    for (auto& p : passes) {
+      due |= p.active && now - p.start >= p.next_capture;
+    }
+    if (!due) {
+      continue;
+    }
+
+    vTaskSuspend(loop_task);
+    esp_rom_delay_us(STALL_MON_SWITCH_US);
+    stall_capture_t cap;
+    cap.step = crumb;
+    stall_backtrace(&cap);
+    // Passes that ended meanwhile are not touched, the loop task can not start a new one while suspended
+    now = stall_now();
+    int longest = -1;
+    for (int i = 0; i < STALL_PASS_COUNT; i++) {
+      stall_pass_state_t& p = passes[i];
+      if (p.active && now - p.start >= p.next_capture) {
+        p.capture = cap;
+        p.captured = true;
+        p.next_capture *= 2;
+        if (longest < 0 || now - p.start > now - passes[longest].start) {
+          longest = i;
+        }
+      }
+    }
+    if (longest >= 0) {
+      // Kept across a reset in case the pass never ends
+      uint32_t us = now - passes[longest].start;
+      memset(&open_rec, 0, sizeof(open_rec));
+      open_rec.rec.boot = rtc.boots;
+      open_rec.rec.uptime_ms = (uint32_t)(esp_timer_get_time() / 1000) - us / 1000;
+      open_rec.rec.duration_us = us;
+      open_rec.rec.pass = (uint8_t)longest;
+      open_rec.rec.step = cap.step;
+      open_rec.rec.depth = cap.depth;
+      open_rec.rec.unfinished = true;
+      memcpy(open_rec.rec.pc, cap.pc, sizeof(cap.pc));
+      open_rec.magic = STALL_MON_OPEN_MAGIC;
+      open_rec.check = open_checksum();
+    }
+    vTaskResume(loop_task);
+  }
+}
+
+// Keeps the worst STALL_MON_RING, sorted longest first
+static void stall_keep(const stall_record_t* rec) {
+  uint32_t n = rtc.count;
+  if (n == STALL_MON_RING && rec->duration_us <= rtc.worst[n - 1].duration_us) {
+    return;
+  }
+  uint32_t i = n < STALL_MON_RING ? n : n - 1;
+  while (i > 0 && rtc.worst[i - 1].duration_us < rec->duration_us) {
+    rtc.worst[i] = rtc.worst[i - 1];
+    i--;
+  }
+  rtc.worst[i] = *rec;
+  if (n < STALL_MON_RING) {
+    rtc.count = n + 1;
+  }
+  rtc.check = rtc_checksum();
+}
+
+static void stall_log(const stall_record_t* rec) {
+  if (rec->unfinished) {
+    LOG_W(STALL_UNFINISHED, stall_mon_pass_str(rec->pass), rec->duration_us, stall_mon_step_str(rec->step),
+          rec->boot, rec->uptime_ms);
+  } else {
+    LOG_W(STALL, stall_mon_pass_str(rec->pass), rec->duration_us, stall_mon_step_str(rec->step), rec->boot,
+          rec->uptime_ms);
+  }
+  uint32_t pc[STALL_MON_DEPTH] = {};
+  memcpy(pc, rec->pc, rec->depth * sizeof(pc[0]));
+  for (int i = 0; i < rec->depth; i += 6) {
+    LOG_W(STALL_TRACE, pc[i], pc[i + 1], pc[i + 2], pc[i + 3], pc[i + 4], pc[i + 5]);
+  }
+}
+
+void stall_mon_begin(void) {
+  if (rtc.magic != STALL_MON_MAGIC || rtc.check != rtc_checksum() || rtc.count > STALL_MON_RING) {
+    memset(&rtc, 0, sizeof(rtc));
+    rtc.magic = STALL_MON_MAGIC;
+  }
+  // A pass still stuck when the chip reset, the watchdog or a panic ended it
+  if (open_rec.magic == STALL_MON_OPEN_MAGIC && open_rec.check == open_checksum() &&
+      open_rec.rec.pass < STALL_PASS_COUNT && open_rec.rec.depth <= STALL_MON_DEPTH) {
+    stall_keep(&open_rec.rec);
+  }
+  memset(&open_rec, 0, sizeof(open_rec));
+  rtc.boots++;
+  rtc.check = rtc_checksum();
+
+  if (rtc.count) {
+    LOG_W(STALL_BOOT, rtc.count, rtc.boots, (int)esp_reset_reason());
+    for (uint32_t i = 0; i < rtc.count; i++) {
+      stall_log(&rtc.worst[i]);
+    }
+  }
+
+  loop_task = xTaskGetCurrentTaskHandle();
+  xTaskCreatePinnedToCore(stall_watch, "stall_mon", 3 * 1024, NULL, configMAX_PRIORITIES - 2, NULL,
+                          STALL_MON_CORE);
+}
+
+stall_step_t stall_mon_step(stall_step_t step) {
+  stall_step_t prev = (stall_step_t)crumb;
+  crumb = step;
+  return prev;
+}
+
+void stall_mon_enter(stall_pass_t pass) {
+  stall_pass_state_t* p = &passes[pass];
+  p->captured = false;
+  p->next_capture = p->budget;
+  p->start = stall_now();
+  p->active = true;
+}
+
+bool stall_mon_exit(stall_pass_t pass) {
+  stall_pass_state_t* p = &passes[pass];
+  p->active = false;
+  uint32_t us = stall_now() - p->start;
+  if (open_rec.magic && open_rec.rec.pass == pass) {
+    // Ended after all, kept below like any other stall
+    open_rec.magic = 0;
+  }
+
+  stall_hist_t* h = &p->hist;
+  uint32_t ms = us / 1000;
+  int bucket = ms ? 32 - __builtin_clz(ms) : 0;
+  h->buckets[bucket < STALL_MON_BUCKETS ? bucket : STALL_MON_BUCKETS - 1]++;
+  h->passes++;
+  if (us > h->max_us) {
+    h->max_us = us;
+  }
+  if (us <= p->budget) {
+    return false;
+  }
+  h->stalls++;
+
+  stall_record_t rec = {};
+  rec.boot = rtc.boots;
+  rec.uptime_ms = (uint32_t)(esp_timer_get_time() / 1000) - us / 1000;
+  rec.duration_us = us;
+  rec.pass = pass;
+  rec.step = p->captured ? p->capture.step : crumb;
+  if (p->captured) {
+    rec.depth = p->capture.depth;
+    memcpy(rec.pc, p->capture.pc, sizeof(rec.pc));
+  }
+  stall_log(&rec);
+  stall_keep(&rec);
+  return true;
+}
+
+uint32_t stall_mon_boot(void) {
+  return rtc.boots;
+}
+
+int stall_mon_count(void) {
+  return rtc.count;
+}
+
+bool stall_mon_get(int idx, stall_record_t* rec) {
+  if (idx < 0 || idx >= (int)rtc.count) {
+    return false;
+  }
+  *rec = rtc.worst[idx];
+  return true;
+}
+
+void stall_mon_get_hist(stall_pass_t pass, stall_hist_t* hist, bool reset) {
+  *hist = passes[pass].hist;
+  if (reset) {
+    memset(&passes[pass].hist, 0, sizeof(passes[pass].hist));
+  }
+}
+
+uint32_t stall_mon_hist_pct(const stall_hist_t* hist, uint8_t pct) {
+  uint64_t target = (uint64_t)hist->passes * pct / 100;
+  uint32_t seen = 0;
+  for (int i = 0; i < STALL_MON_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen > target) {
+      return 1u << i;
+    }
+  }
+  return 1u << STALL_MON_BUCKETS;
+}
+
+const char* stall_mon_step_str(uint8_t step) {
+  static const char* const names[STALL_STEP_COUNT] = {
+    "idle", "render", "flush", "WiFi", "fetch", "POST", "HTTP", "control", "panel", "OTA", "report"
+  };
+  return step < STALL_STEP_COUNT ? names[step] : "?";
+}
+
+const char* stall_mon_pass_str(uint8_t pass) {
+  return pass == STALL_PASS_LOOP ? "loop" : pass == STALL_PASS_LVGL ? "LVGL" : "?";
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "stdint.h"
+
+// Main loop stall monitor.
+//
+// Every loop() iteration and every lv_timer_handler() pass is timed against a
+// budget. Code on the loop task leaves a breadcrumb of the step it is in with
+// stall_mon_step(). A watch task on the other core notices a pass that runs
+// over budget while it is still stuck, suspends the loop task for a moment and
+// takes the breadcrumb and a backtrace, again each time the overrun doubles,
+// so the last capture shows where most of the time went. A stall with
+// interrupts masked cannot be sampled, the interrupt watchdog covers those.
+//
+// The STALL_MON_RING worst stalls live in RTC memory that survives a software
+// reset, a panic and a watchdog reset (not a power cycle). A pass enters the
+// ring when it ends; a freeze that never ends is kept by the watch task, which
+// writes each capture to an RTC record of its own, and stall_mon_begin() moves
+// that record into the ring after the reset, marked unfinished with the time
+// stuck up to the last capture. Backtraces are raw PCs:
+//   xtensa-esp32s3-elf-addr2line -pfiaC -e .pio/build/<env>/firmware.elf <pc> ...
+// Pass times also feed a log2 histogram per pass type.
+
+#define STALL_MON_LOOP_BUDGET 50000   // us
+#define STALL_MON_LVGL_BUDGET 33000   // us, two frames at 60 Hz
+#define STALL_MON_PERIOD 5            // ms between watch task checks
+#define STALL_MON_CORE 0              // Watch task, the loop task runs on core 1
+#define STALL_MON_DEPTH 12            // Backtrace frames kept
+#define STALL_MON_RING 8              // Worst stalls kept across reboots
+#define STALL_MON_BUCKETS 12          // < 1 ms, < 2 ms, < 4 ms ... >= 1024 ms
+
+typedef enum {
+  STALL_STEP_IDLE,
+  STALL_STEP_RENDER,    // lv_timer_handler() outside the flush
+  STALL_STEP_FLUSH,     // Copying a stripe or waiting for the flush task
+  STALL_STEP_WIFI,
+  STALL_STEP_FETCH,     // Starting a GET
+  STALL_STEP_POST,      // Starting the setpoint POST
+  STALL_STEP_HTTP,      // Stepping requests in flight
+  STALL_STEP_CONTROL,   // Local control, peer sync
+  STALL_STEP_PANEL,
+  STALL_STEP_OTA,
+  STALL_STEP_REPORT,
+  STALL_STEP_COUNT
+} stall_step_t;
+
+typedef enum {
+  STALL_PASS_LOOP,
+  STALL_PASS_LVGL,
+  STALL_PASS_COUNT
+} stall_pass_t;
+
+typedef struct {
+  uint32_t boot;          // Boot number, see stall_mon_boot()
+  uint32_t uptime_ms;     // Start of the pass
+  uint32_t duration_us;
+  uint8_t pass;
+  uint8_t step;           // Breadcrumb at the last capture, or at the end if none was taken
+  uint8_t depth;          // 0 if the pass ended before the watch task looked
+  bool unfinished;        // Still running at a reset, duration_us is up to the last capture
+  uint32_t pc[STALL_MON_DEPTH];
+} stall_record_t;
+
+typedef struct {
+  uint32_t passes;
+  uint32_t stalls;        // Over budget
+  uint32_t max_us;
+  uint32_t buckets[STALL_MON_BUCKETS];
+} stall_hist_t;
+
+// Call from setup(), on the loop task. Reports stalls kept from earlier boots, a pass
+// still running at the reset included.
+void stall_mon_begin(void);
+
+// Sets the breadcrumb, returns the previous one to restore
+stall_step_t stall_mon_step(stall_step_t step);
+
+void stall_mon_enter(stall_pass_t pass);
+// True if the pass ran over budget, it is then logged and offered to the ring
+bool stall_mon_exit(stall_pass_t pass);
+
+uint32_t stall_mon_boot(void);
+
+// Worst first
+int stall_mon_count(void);
+bool stall_mon_get(int idx, stall_record_t* rec);
+
+void stall_mon_get_hist(stall_pass_t pass, stall_hist_t* hist, bool reset);
+// Upper bound in ms of the bucket holding the pct percentile
+uint32_t stall_mon_hist_pct(const stall_hist_t* hist, uint8_t pct);
+
+const char* stall_mon_step_str(uint8_t step);
+const char* stall_mon_pass_str(uint8_t pass);
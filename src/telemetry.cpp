@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry.hpp"
+
+static size_t put_varint(uint8_t* p, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+// Whole seconds on the ms tick, carried across its wrap
+static void advance(telemetry_t* t, uint32_t now) {
+  uint32_t s = (now - t->clock_ms) / 1000;
+  t->clock += s;
+  t->clock_ms += s * 1000;
+}
+
+void telemetry_init(telemetry_t* t, uint32_t node, uint32_t session, uint32_t now) {
+  memset(t, 0, sizeof(*t));
+  t->node = node;
+  t->session = session;
+  t->clock_ms = now;
+}
+
+void telemetry_record(telemetry_t* t, telemetry_kind_t kind, int16_t value, uint32_t now) {
+  advance(t, now);
+  if (kind <= TELEMETRY_SETPOINT) {
+    if (t->have[kind] && t->last[kind] == value &&
+        (kind == TELEMETRY_SETPOINT || t->clock - t->last_time[kind] < TELEMETRY_TEMP_KEEPALIVE)) {
+      return;
+    }
+    t->have[kind] = true;
+    t->last[kind] = value;
+    t->last_time[kind] = t->clock;
+  }
+  if (t->head - t->tail == TELEMETRY_RING) {
+    t->tail++;
+    t->stats.dropped++;
+  }
+  telemetry_record_t* r = &t->ring[t->head % TELEMETRY_RING];
+  r->time = t->clock;
+  r->kind = (uint8_t)kind;
+  r->value = kind <= TELEMETRY_SETPOINT ? value : 0;
+  t->head++;
+  t->stats.recorded++;
+}
+
+uint32_t telemetry_backlog(const telemetry_t* t) {
+  return t->head - t->tail;
+}
+
+size_t telemetry_encode(telemetry_t* t, uint8_t* buf, size_t size, uint32_t now, uint32_t utc) {
+  advance(t, now);
+  if (t->head == t->tail || size < TELEMETRY_HEADER_SIZE) {
+    return 0;
+  }
+  const telemetry_record_t* first = &t->ring[t->tail % TELEMETRY_RING];
+  buf[0] = TELEMETRY_VERSION;
+  put_u32(buf + 1, t->node);
+  put_u32(buf + 5, t->session);
+  put_u32(buf + 9, t->tail);
+  put_u32(buf + 13, t->clock);
+  put_u32(buf + 17, first->time);
+  put_u32(buf + 21, utc);
+
+  size_t len = TELEMETRY_HEADER_SIZE;
+  uint16_t count = 0;
+  uint32_t time = first->time;
+  int32_t prev[2] = { 0, 0 };
+  uint8_t rec[10];
+  for (uint32_t seq = t->tail; seq != t->head && count < 0xffff; seq++) {
+    const telemetry_record_t* r = &t->ring[seq % TELEMETRY_RING];
+    size_t n = put_varint(rec, (r->time - time) << 2 | r->kind);
+    if (r->kind <= TELEMETRY_SETPOINT) {
+      n += put_varint(rec + n, zigzag(r->value - prev[r->kind]));
+    }
+    if (len + n > size) {
+      break;
+    }
+    memcpy(buf + len, rec, n);
+    len += n;
+    time = r->time;
+    if (r->kind <= TELEMETRY_SETPOINT) {
+      prev[r->kind] = r->value;
+    }
+    count++;
+  }
+  buf[25] = (uint8_t)count;
+  buf[26] = (uint8_t)(count >> 8);
+  t->stats.uploads++;
+  t->stats.bytes += len;
+  return len;
+}
+
+bool telemetry_ack(telemetry_t* t, const char* answer) {
+  char* end;
+  unsigned long next = strtoul(answer, &end, 10);
+  // Anything outside the waiting records is a server that lost its state, the records are gone from here
+  if (end == answer || (uint32_t)next - t->tail > t->head - t->tail) {
+    t->stats.failures++;
+    return false;
+  }
+  t->stats.acked += (uint32_t)next - t->tail;
+  t->tail = (uint32_t)next;
+  return true;
+}
+
+void telemetry_failed(telemetry_t* t) {
+  t->stats.failures++;
+}
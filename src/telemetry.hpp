@@ -0,0 +1,82 @@
+#pragma once
+
+#include "stdint.h"
+#include "stddef.h"
+
+// History of readings, setpoints and boiler changes, uploaded in batches.
+//
+// Records wait in a ring of TELEMETRY_RING until the server acknowledges
+// them. Every record has a sequence number, a batch carries the first one and
+// the server answers with the sequence it expects next, so a batch whose
+// answer was lost is sent again and the server drops what it already has.
+// When the ring is full the oldest record is overwritten and counted as
+// dropped. An unchanged reading is recorded once every TELEMETRY_TEMP_KEEPALIVE,
+// an unchanged setpoint not at all.
+//
+// A batch is little endian: version, node ID, session (random per boot, the
+// sequence restarts with it), first sequence, the device's seconds clock now
+// and at the first record, UTC seconds now (0 while unknown) and the record
+// count. Each record is a varint of its time since the previous record in
+// seconds, shifted left by 2 and or'ed with its kind, then for readings and
+// setpoints a zigzag varint of the change from the previous one of the same
+// kind in the batch (from 0 for the first). An unchanged reading 20 s after
+// the last one takes 2 bytes.
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING 512              // Records kept until acknowledged, 8 B each
+#define TELEMETRY_BATCH_SIZE 1024       // Encoded bytes per upload at most
+#define TELEMETRY_HEADER_SIZE 27
+#define TELEMETRY_INTERVAL 900000       // ms between uploads
+#define TELEMETRY_FLUSH_AT 256          // Records waiting that start an upload before the interval
+#define TELEMETRY_TEMP_KEEPALIVE 600    // s
+
+typedef enum {
+  TELEMETRY_TEMP,                       // Centidegrees
+  TELEMETRY_SETPOINT,                   // Degrees
+  TELEMETRY_BOILER_OFF,
+  TELEMETRY_BOILER_ON
+} telemetry_kind_t;
+
+typedef struct {
+  uint32_t time;                        // s on the telemetry clock
+  int16_t value;
+  uint8_t kind;
+} telemetry_record_t;
+
+typedef struct {
+  uint32_t recorded;
+  uint32_t dropped;                     // Overwritten before they were acknowledged
+  uint32_t acked;
+  uint32_t uploads;
+  uint32_t failures;                    // Uploads without a valid answer
+  uint32_t bytes;                       // Batch bytes sent
+} telemetry_stats_t;
+
+typedef struct {
+  uint32_t node;
+  uint32_t session;
+  telemetry_record_t ring[TELEMETRY_RING];
+  uint32_t head;                        // Sequence of the next record
+  uint32_t tail;                        // Oldest not acknowledged
+  uint32_t clock;                       // s since telemetry_init()
+  uint32_t clock_ms;                    // hal_millis() the clock last counted up to
+  int16_t last[2];                      // Last reading and setpoint recorded
+  uint32_t last_time[2];
+  bool have[2];
+  telemetry_stats_t stats;
+} telemetry_t;
+
+void telemetry_init(telemetry_t* t, uint32_t node, uint32_t session, uint32_t now);
+
+// Readings and setpoints equal to the last one are skipped, see above
+void telemetry_record(telemetry_t* t, telemetry_kind_t kind, int16_t value, uint32_t now);
+
+// Records waiting for an acknowledgement
+uint32_t telemetry_backlog(const telemetry_t* t);
+
+// Encodes the oldest waiting records into buf, returns the length, 0 if none wait
+size_t telemetry_encode(telemetry_t* t, uint8_t* buf, size_t size, uint32_t now, uint32_t utc);
+
+// The server's answer to a batch: the sequence it expects next. False if it makes no sense.
+bool telemetry_ack(telemetry_t* t, const char* answer);
+void telemetry_failed(telemetry_t* t);
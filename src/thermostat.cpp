@@ -0,0 +1,814 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#if defined __has_include
+#if __has_include("esp_random.h")
+#include "esp_random.h"
+#else
+#include "esp_system.h"
+#endif
+#else
+#include "esp_system.h"
+#endif
+#include "hal.hpp"
+#include "http_client.hpp"
+#include "boot_prof.hpp"
+#include "breaker.hpp"
+#include "local_ctrl.hpp"
+#include "input_trace.hpp"
+#include "logger.hpp"
+#include "peer_sync.hpp"
+#include "schedule.hpp"
+#include "stall_mon.hpp"
+#include "telemetry.hpp"
+#include "thermostat.hpp"
+
+static thermostat_cfg_t cfg;
+static thermostat_ui_t ui;
+
+static wifi_state_t wifi_state = WIFI_DISCONNECTED;
+static uint32_t last_wifi_attempt = 0;
+
+static uint32_t last_activity_time = 0;
+static bool screen_on = true;
+static bool boiler_on = false;
+
+// One request slot per endpoint, stepped from thermostat_loop()
+static http_req_t set_temp_req;
+static http_req_t temp_req;
+static http_req_t boiler_status_req;
+
+// Circuit breaker per endpoint, stops hammering a server that is down
+static breaker_t set_temp_breaker;
+static breaker_t temp_breaker;
+static breaker_t boiler_status_breaker;
+
+// Latest setpoint, pending until the server acknowledges it
+static bool set_temp_pending = false;
+static int set_temp = THERMOSTAT_DEFAULT_TEMP;
+static int sent_set_temp = THERMOSTAT_DEFAULT_TEMP;
+
+// State the polling policy adapts to, and requests made per hour
+static const poll_policy_t* poll_policy = &POLL_POLICY;
+static poll_ctx_t poll_ctx;
+static poll_stats_t poll_stats;
+static uint32_t last_temp_fetch = 0;
+static uint32_t last_boiler_status_fetch = 0;
+static bool net_begun = false;        // thermostat_begin_net() ran
+static bool poll_on_connect = true;   // Nothing fresh on screen yet, poll as soon as WiFi is up
+
+// Last readings from the server, the local controller works from these
+static float last_temp = THERMOSTAT_DEFAULT_TEMP;
+static uint32_t last_temp_time = 0;
+static uint32_t last_boiler_status_time = 0;
+
+static local_ctrl_t local_ctrl;
+static bool local_control_active = false;
+
+static bool server_degraded = false;
+
+#if PEER_SYNC
+static peer_t peer;
+static peer_role_t peer_role = PEER_STARTING;
+static uint32_t sent_set_temp_seq = 0;
+static uint32_t sent_set_temp_origin = 0;
+
+static bool peer_send_udp(void* ctx, const uint8_t* frame, size_t len) {
+  (void)ctx;
+  return wifi_state == WIFI_CONNECTED && hal_udp_send(frame, len);
+}
+#endif
+
+#if TELEMETRY
+// Not part of server_degraded, a server without /telemetry still runs the thermostat
+static telemetry_t telemetry;
+static http_req_t telemetry_req;
+static breaker_t telemetry_breaker;
+static uint8_t telemetry_batch[TELEMETRY_BATCH_SIZE];  // Sent from here, untouched while telemetry_req runs
+static uint32_t last_telemetry_upload = 0;
+static bool telemetry_failing = false;  // Last upload not acknowledged, wait out the interval
+#endif
+
+#if SCHEDULE
+static schedule_t schedule;
+static schedule_clock_t sched_clock;
+static uint32_t sched_checked = 0;
+static uint32_t sched_wait = 0;      // 0 evaluates at the next loop
+#endif
+
+// With peer sync only the leader talks to the server
+static bool polls_server(uint32_t now) {
+#if PEER_SYNC
+  return peer_polls_server(&peer, now);
+#else
+  (void)now;
+  return true;
+#endif
+}
+
+static void record(telemetry_kind_t kind, int value) {
+#if TELEMETRY
+  telemetry_record(&telemetry, kind, (int16_t)value, hal_millis());
+#else
+  (void)kind;
+  (void)value;
+#endif
+}
+
+static void set_screen_state(bool state) {
+  screen_on = state;
+  hal_display_power(state);
+  LOG_I(SCREEN_STATE, state ? "ON" : "OFF");
+}
+
+static void connect_wifi(void) {
+  if (wifi_state == WIFI_CONNECTING) {
+    // Already trying to connect
+    return;
+  }
+  LOG_I(WIFI_CONNECTING);
+  hal_wifi_begin(cfg.ssid, cfg.password);
+  wifi_state = WIFI_CONNECTING;
+  last_wifi_attempt = hal_millis();
+}
+
+static void check_wifi(void) {
+  uint32_t now = hal_millis();
+  switch (wifi_state) {
+    case WIFI_DISCONNECTED:
+      // Try to connect if enough time has passed since last attempt
+      if (now - last_wifi_attempt >= WIFI_RETRY_INTERVAL) {
+        connect_wifi();
+      }
+      break;
+
+    case WIFI_CONNECTING:
+      if (hal_wifi_connected()) {
+        uint8_t ip[4];
+        hal_wifi_ip(ip);
+        LOG_I(WIFI_CONNECTED, ip[0], ip[1], ip[2], ip[3]);
+        wifi_state = WIFI_CONNECTED;
+        boot_prof_mark(BOOT_STAGE_WIFI_UP);
+        if (poll_on_connect) {
+          // Due right away under any policy
+          last_temp_fetch = last_boiler_status_fetch = now - POLL_IDLE_TEMP_INTERVAL;
+          poll_on_connect = false;
+        }
+#if SCHEDULE
+        hal_sntp_begin(SCHEDULE_NTP_SERVER);
+#endif
+#if PEER_SYNC
+        if (!hal_udp_begin(PEER_GROUP, PEER_PORT)) {
+          LOG_W(PEER_UDP_FAILED);
+        }
+#endif
+      } else if (now - last_wifi_attempt >= WIFI_CONNECT_TIMEOUT) {
+        LOG_W(WIFI_TIMEOUT);
+        wifi_state = WIFI_DISCONNECTED;
+        hal_wifi_disconnect();
+      }
+      break;
+
+    case WIFI_CONNECTED:
+      if (!hal_wifi_connected()) {
+        LOG_W(WIFI_LOST);
+        wifi_state = WIFI_DISCONNECTED;
+        hal_wifi_disconnect();
+      }
+      break;
+  }
+}
+
+static void check_screen_timeout(void) {
+  // Only time out while the boiler is not active
+  if (screen_on && !boiler_on && hal_millis() - last_activity_time > SCREEN_TIMEOUT) {
+    set_screen_state(false);
+  }
+}
+
+void thermostat_activity(void) {
+  last_activity_time = hal_millis();
+  if (!screen_on) {
+    set_screen_state(true);
+  }
+}
+
+static void set_boiler_status(bool status) {
+  // Only process changes in status
+  if (boiler_on == status) {
+    return;
+  }
+  boiler_on = status;
+  poll_ctx.last_boiler_change = hal_millis();
+  record(boiler_on ? TELEMETRY_BOILER_ON : TELEMETRY_BOILER_OFF, 0);
+  hal_gpio_write(cfg.led_pin, boiler_on);
+
+  // Turn on screen if boiler is active, this also resets the timeout when it is already on
+  if (boiler_on) {
+    thermostat_activity();
+  }
+}
+
+// Feed a completed request into its breaker. Server errors (5xx) count as failures.
+static bool record_result(breaker_t* breaker, http_req_t* req) {
+  bool ok = req->state == HTTP_DONE && req->status < 500;
+  if (ok) {
+    breaker_success(breaker, hal_millis());
+  } else {
+    breaker_failure(breaker, hal_millis());
+  }
+  return ok;
+}
+
+// Log breaker transitions, the status shows the degraded state while any breaker is not closed
+static void on_breaker_transition(const breaker_t* breaker, breaker_state_t from, breaker_state_t to) {
+  LOG_I(BREAKER, breaker->name, breaker_state_str(from), breaker_state_str(to), breaker->backoff,
+        breaker->transitions, breaker->rejected);
+  server_degraded = set_temp_breaker.state != BREAKER_CLOSED || temp_breaker.state != BREAKER_CLOSED ||
+                    boiler_status_breaker.state != BREAKER_CLOSED;
+}
+
+static void on_set_temp_response(http_req_t* req) {
+  if (req->error == HTTP_ERR_CANCELLED) {
+    return;
+  }
+  if (record_result(&set_temp_breaker, req)) {
+    LOG_I(POST_OK, (double)sent_set_temp, req->status);
+    if (sent_set_temp == set_temp) {
+      set_temp_pending = false;
+#if PEER_SYNC
+      peer_setpoint_acked(&peer, sent_set_temp_seq, sent_set_temp_origin, hal_millis());
+#endif
+    }
+  } else if (req->state == HTTP_DONE) {
+    LOG_W(POST_HTTP_ERROR, req->status);
+  } else {
+    LOG_W(POST_ERROR, http_err_str(req->error));
+  }
+}
+
+static void send_set_temp(void) {
+  if (wifi_state != WIFI_CONNECTED) {
+    LOG_D(POST_NO_WIFI);
+    return;
+  }
+  if (!breaker_allow(&set_temp_breaker, hal_millis())) {
+    return;
+  }
+
+  // Also reached from the encoder read inside the LVGL pass
+  stall_step_t prev_step = stall_mon_step(STALL_STEP_POST);
+  char post_data[24];
+  sent_set_temp = set_temp;
+#if PEER_SYNC
+  sent_set_temp_seq = peer.state.setpoint_seq;
+  sent_set_temp_origin = peer.state.setpoint_origin;
+#endif
+  snprintf(post_data, sizeof(post_data), "value=%d.00", sent_set_temp);
+  if (!http_begin(&set_temp_req, cfg.server_ip, cfg.server_port, "POST", "/setTemp",
+                  "application/x-www-form-urlencoded", post_data, HTTP_TIMEOUT)) {
+    on_set_temp_response(&set_temp_req);
+  }
+  poll_stats_count(&poll_stats, POLL_SET_TEMP);
+  stall_mon_step(prev_step);
+}
+
+// A newer setpoint replaces one still in flight
+static void post_set_temp(int temp) {
+  uint32_t now = hal_millis();
+  poll_ctx.last_setpoint_change = now;
+  set_temp = temp;
+  set_temp_pending = true;
+  record(TELEMETRY_SETPOINT, temp);
+#if PEER_SYNC
+  if (temp != peer.state.setpoint) {
+    peer_set_setpoint(&peer, temp, now);
+  }
+#endif
+  if (polls_server(now)) {
+    send_set_temp();
+  }
+}
+
+static void on_temp_response(http_req_t* req) {
+  if (!record_result(&temp_breaker, req) || req->status != 200) {
+    if (req->state == HTTP_DONE) {
+      LOG_W(TEMP_HTTP_ERROR, req->status);
+    } else {
+      LOG_W(TEMP_ERROR, http_err_str(req->error));
+    }
+    return;
+  }
+  float temp = atof(http_body(req));
+  LOG_D(TEMP_OK, temp);
+  if ((int)temp != (int)last_temp) {
+    poll_ctx.last_temp_change = hal_millis();
+  }
+  last_temp = temp;
+  last_temp_time = hal_millis();
+  record(TELEMETRY_TEMP, (int)(temp * 100 + (temp < 0 ? -0.5f : 0.5f)));
+  boot_prof_mark(BOOT_STAGE_LIVE_DATA);
+  if (ui.show_temp) {
+    ui.show_temp((int)temp);
+  }
+}
+
+static void fetch_current_temp(void) {
+  if (wifi_state != WIFI_CONNECTED) {
+    LOG_D(TEMP_NO_WIFI);
+    return;
+  }
+  if (http_busy(&temp_req) || !breaker_allow(&temp_breaker, hal_millis())) {
+    return;
+  }
+  // "?plain" gets a plain text response
+  if (!http_begin(&temp_req, cfg.server_ip, cfg.server_port, "GET", "/Temp?plain", NULL, NULL, HTTP_TIMEOUT)) {
+    on_temp_response(&temp_req);
+  }
+  poll_stats_count(&poll_stats, POLL_TEMP);
+}
+
+static void on_boiler_status_response(http_req_t* req) {
+  if (!record_result(&boiler_status_breaker, req) || req->status != 200) {
+    if (req->state == HTTP_DONE) {
+      LOG_W(BOILER_HTTP_ERROR, req->status);
+    } else {
+      LOG_W(BOILER_ERROR, http_err_str(req->error));
+    }
+    return;
+  }
+  // Plain true/false
+  const char* body = http_body(req);
+  bool status = strcasecmp(body, "true") == 0 || strcmp(body, "1") == 0;
+  LOG_D(BOILER_OK, status);
+  last_boiler_status_time = hal_millis();
+  set_boiler_status(status);
+}
+
+static void fetch_boiler_status(void) {
+  if (wifi_state != WIFI_CONNECTED) {
+    LOG_D(BOILER_NO_WIFI);
+    return;
+  }
+  if (http_busy(&boiler_status_req) || !breaker_allow(&boiler_status_breaker, hal_millis())) {
+    return;
+  }
+  if (!http_begin(&boiler_status_req, cfg.server_ip, cfg.server_port, "GET", "/boilerStatus?plain", NULL, NULL,
+                  HTTP_TIMEOUT)) {
+    on_boiler_status_response(&boiler_status_req);
+  }
+  poll_stats_count(&poll_stats, POLL_BOILER_STATUS);
+}
+
+#if TELEMETRY
+// Anything but a valid acknowledgement is a failure, a server without /telemetry answers 404
+static void on_telemetry_response(http_req_t* req) {
+  if (req->state == HTTP_DONE && req->status == 200 && telemetry_ack(&telemetry, http_body(req))) {
+    breaker_success(&telemetry_breaker, hal_millis());
+    telemetry_failing = false;
+    LOG_D(TELEMETRY_SENT, telemetry.stats.acked, telemetry_backlog(&telemetry), req->elapsed);
+    return;
+  }
+  breaker_failure(&telemetry_breaker, hal_millis());
+  telemetry_failing = true;
+  if (req->state == HTTP_DONE && req->status == 200) {
+    // telemetry_ack() counted the failure
+    LOG_W(TELEMETRY_ERROR, "bad acknowledgement", telemetry_backlog(&telemetry));
+    return;
+  }
+  telemetry_failed(&telemetry);
+  if (req->state == HTTP_DONE) {
+    LOG_W(TELEMETRY_HTTP_ERROR, req->status, telemetry_backlog(&telemetry));
+  } else {
+    LOG_W(TELEMETRY_ERROR, http_err_str(req->error), telemetry_backlog(&telemetry));
+  }
+}
+
+// UTC in s for the batch header, 0 while the time is unknown
+static uint32_t wall_time(uint32_t now) {
+#if SCHEDULE
+  int64_t utc_ms;
+  if (schedule_clock_now(&sched_clock, now, &utc_ms)) {
+    return (uint32_t)(utc_ms / 1000);
+  }
+#endif
+  (void)now;
+  return 0;
+}
+
+// Every TELEMETRY_INTERVAL, sooner once TELEMETRY_FLUSH_AT records wait unless the last upload failed.
+// Unacknowledged records go again.
+static void upload_telemetry(void) {
+  uint32_t now = hal_millis();
+  uint32_t backlog = telemetry_backlog(&telemetry);
+  bool flush = backlog >= TELEMETRY_FLUSH_AT && !telemetry_failing;
+  if (wifi_state != WIFI_CONNECTED || http_busy(&telemetry_req) || !backlog ||
+      (now - last_telemetry_upload < TELEMETRY_INTERVAL && !flush) ||
+      !breaker_allow(&telemetry_breaker, now)) {
+    return;
+  }
+  last_telemetry_upload = now;
+  size_t len = telemetry_encode(&telemetry, telemetry_batch, sizeof(telemetry_batch), now, wall_time(now));
+  if (!http_begin_data(&telemetry_req, cfg.server_ip, cfg.server_port, "POST", "/telemetry",
+                       "application/octet-stream", telemetry_batch, len, HTTP_TIMEOUT)) {
+    on_telemetry_response(&telemetry_req);
+  }
+}
+#endif
+
+// Step every in-flight request and dispatch the ones that just completed
+static void service_http(void) {
+  static const struct {
+    http_req_t* req;
+    void (*on_complete)(http_req_t* req);
+  } slots[] = {
+    { &set_temp_req, on_set_temp_response },
+    { &temp_req, on_temp_response },
+    { &boiler_status_req, on_boiler_status_response },
+#if TELEMETRY
+    { &telemetry_req, on_telemetry_response },
+#endif
+  };
+
+  for (const auto& slot : slots) {
+    if (http_busy(slot.req) && http_step(slot.req) >= HTTP_DONE) {
+      slot.on_complete(slot.req);
+    }
+  }
+}
+
+#if PEER_SYNC
+// Take readings and setpoints from the other units, publish ours when leading
+static void run_peer_sync(void) {
+  uint32_t now = hal_millis();
+  const peer_state_t* s = &peer.state;
+  uint8_t frame[PEER_FRAME_SIZE];
+  int len;
+  peer_set_awake(&peer, screen_on);
+  while (wifi_state == WIFI_CONNECTED && (len = hal_udp_recv(frame, sizeof(frame))) >= 0) {
+    uint8_t got = peer_receive(&peer, frame, len, now);
+    if (got & PEER_GOT_STATE) {
+      // The leader's poll stands in for ours, and its boiler decision for local control
+      float temp = s->temp / 100.0f;
+      if ((int)temp != (int)last_temp) {
+        poll_ctx.last_temp_change = now;
+      }
+      last_temp = temp;
+      last_temp_time = now;
+      last_boiler_status_time = now;
+      record(TELEMETRY_TEMP, s->temp);
+      boot_prof_mark(BOOT_STAGE_LIVE_DATA);
+      if (ui.show_temp) {
+        ui.show_temp((int)temp);
+      }
+      set_boiler_status(s->boiler);
+    }
+    if (got & PEER_GOT_SETPOINT) {
+      poll_ctx.last_setpoint_change = now;
+      set_temp = s->setpoint;
+      set_temp_pending = !s->setpoint_acked;
+      record(TELEMETRY_SETPOINT, set_temp);
+      if (ui.show_setpoint) {
+        ui.show_setpoint(set_temp);
+      }
+      if (set_temp_pending && polls_server(now)) {
+        send_set_temp();
+      }
+    }
+  }
+
+  if (polls_server(now)) {
+    peer_publish(&peer, (int16_t)(last_temp * 100), boiler_on, !server_degraded, now);
+  } else {
+    set_temp_pending = !s->setpoint_acked;
+  }
+  peer_tick(&peer, now);
+
+  if (peer.role != peer_role) {
+    peer_role = peer.role;
+    LOG_I(PEER_ROLE, peer_role_str(peer_role), peer.leader_id, peer.stats.frames_sent, peer.stats.frames_received,
+          peer.stats.frames_dropped);
+  }
+}
+#endif
+
+#if SCHEDULE
+// Follow the clock's fixes and fire schedule transitions through the knob's setpoint path.
+// Evaluated when the next transition is due, after a clock fix and at least every SCHEDULE_MAX_WAIT.
+static void run_schedule(void) {
+  uint32_t now = hal_millis();
+  int64_t fix;
+  uint32_t fix_at;
+  if (hal_time_fix(&fix, &fix_at)) {
+    schedule_clock_set(&sched_clock, fix, fix_at, true);
+    if (sched_clock.last_step >= SCHEDULE_CLOCK_STEP || sched_clock.last_step <= -SCHEDULE_CLOCK_STEP) {
+      LOG_I(CLOCK_FIX, sched_clock.last_step, sched_clock.drift);
+    }
+    sched_wait = 0;
+  }
+  int64_t utc_ms;
+  if (now - sched_checked < sched_wait || !schedule_clock_now(&sched_clock, now, &utc_ms)) {
+    return;
+  }
+  sched_checked = now;
+  int64_t before = schedule.last;
+  int setpoint = schedule_due(&schedule, utc_ms / 1000);
+  // UTC ms to ticks, the tick runs fast by the measured drift
+  uint32_t wait = schedule_wait(&schedule, utc_ms);
+  sched_wait = wait + (uint32_t)((int64_t)wait * sched_clock.drift / 1000000);
+  if (before && schedule.last < before) {
+    LOG_W(SCHEDULE_RESTART, (int)(before - schedule.last));
+  }
+  if (setpoint < 0) {
+    return;
+  }
+
+  // Missed transitions are caught up after a reboot, but each fires once
+  hal_nvs_write("sched_last", &schedule.last, sizeof(schedule.last));
+  const schedule_entry_t* e = &schedule.entries[schedule_active(&schedule, schedule.last)];
+  LOG_I(SCHEDULE_FIRED, setpoint, schedule_day_str(e->minute / 1440), e->minute % 1440 / 60, e->minute % 60);
+  if (ui.show_setpoint) {
+    ui.show_setpoint(setpoint);
+  }
+  if (setpoint != set_temp) {
+    post_set_temp(setpoint);
+  }
+}
+
+static void load_schedule(void) {
+  uint8_t buf[SCHEDULE_PACK_SIZE(SCHEDULE_MAX_ENTRIES)];
+  int len = hal_nvs_read("schedule", buf, sizeof(buf));
+  schedule_init(&schedule);
+  if (len > 0 && schedule_unpack(&schedule, buf, len)) {
+    LOG_I(SCHEDULE_LOADED, schedule.count);
+  }
+  if (hal_nvs_read("sched_last", &schedule.last, sizeof(schedule.last)) != sizeof(schedule.last)) {
+    schedule.last = 0;
+  }
+  // The RTC until the first SNTP fix
+  int64_t rtc;
+  if (hal_rtc_time(&rtc)) {
+    schedule_clock_set(&sched_clock, rtc, hal_millis(), false);
+  }
+}
+#endif
+
+// Decide the boiler state on the device while the server is unreachable.
+// As soon as the server reports a boiler status again it is back in charge.
+static void run_local_control(void) {
+  static uint32_t last_tick = 0;
+  static uint32_t status_at_takeover = 0;
+  uint32_t now = hal_millis();
+  if (now - last_tick < LOCAL_CTRL_TICK) {
+    return;
+  }
+  last_tick = now;
+
+  if (local_control_active && last_boiler_status_time != status_at_takeover) {
+    LOG_I(LOCAL_CTRL_OFF);
+    local_control_active = false;
+  }
+  if (!local_control_active) {
+    // Counted from when the next boiler status was due, the idle keep-alive polls slower than the takeover
+    uint32_t due = poll_policy->interval(POLL_BOILER_STATUS, &poll_ctx);
+    if (now - last_boiler_status_time < due + LOCAL_CTRL_TAKEOVER) {
+      return;
+    }
+    LOG_W(LOCAL_CTRL_ON);
+    local_control_active = true;
+    status_at_takeover = last_boiler_status_time;
+    local_ctrl_reset(&local_ctrl, boiler_on);
+  }
+
+  bool temp_fresh = last_temp_time != 0 && now - last_temp_time < LOCAL_CTRL_MAX_TEMP_AGE;
+  bool heat = temp_fresh && local_ctrl_tick(&local_ctrl, (int32_t)(last_temp * 100), (int32_t)set_temp * 100);
+  set_boiler_status(heat);
+}
+
+// Hourly request counts, compared with what the fixed 5 s / 2 s cadence would cost
+static void report_poll_stats(void) {
+  poll_stats_t last_hour;
+  if (!poll_stats_roll(&poll_stats, hal_millis(), &last_hour)) {
+    return;
+  }
+  uint32_t total = 0;
+  for (int i = 0; i < POLL_ENDPOINT_COUNT; i++) {
+    total += last_hour.requests[i];
+  }
+  LOG_I(POLL_STATS, poll_policy->name, total, last_hour.requests[POLL_TEMP], last_hour.requests[POLL_BOILER_STATUS],
+        last_hour.requests[POLL_SET_TEMP], 3600000UL / TEMP_FETCH_INTERVAL + 3600000UL / BOILER_STATUS_FETCH_INTERVAL);
+#if TELEMETRY
+  const telemetry_stats_t* t = &telemetry.stats;
+  LOG_I(TELEMETRY_STATS, t->recorded, t->uploads, t->bytes, t->failures, telemetry_backlog(&telemetry), t->dropped);
+#endif
+}
+
+void thermostat_begin(const thermostat_cfg_t* config, const thermostat_ui_t* callbacks) {
+  cfg = *config;
+  ui = *callbacks;
+  hal_gpio_output(cfg.led_pin, boiler_on);
+  local_ctrl_cfg_t local_ctrl_cfg;
+  local_ctrl_defaults(&local_ctrl_cfg, LOCAL_CTRL_MODE);
+  local_ctrl_init(&local_ctrl, &local_ctrl_cfg);
+  breaker_init(&set_temp_breaker, "setTemp", BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF, BREAKER_MAX_BACKOFF,
+               on_breaker_transition);
+  breaker_init(&temp_breaker, "Temp", BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF, BREAKER_MAX_BACKOFF,
+               on_breaker_transition);
+  breaker_init(&boiler_status_breaker, "boilerStatus", BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF,
+               BREAKER_MAX_BACKOFF, on_breaker_transition);
+#if PEER_SYNC
+  peer_init(&peer, hal_node_id(), set_temp, peer_send_udp, NULL, hal_millis());
+#endif
+#if TELEMETRY
+  breaker_init(&telemetry_breaker, "telemetry", BREAKER_THRESHOLD, BREAKER_BASE_BACKOFF, BREAKER_MAX_BACKOFF,
+               on_breaker_transition);
+  telemetry_init(&telemetry, hal_node_id(), esp_random(), hal_millis());
+  last_telemetry_upload = hal_millis();
+#endif
+  if (!net_begun) {
+    thermostat_begin_net(config);
+  }
+  last_activity_time = hal_millis();
+}
+
+void thermostat_begin_net(const thermostat_cfg_t* config) {
+  cfg = *config;
+#if SCHEDULE
+  hal_time_zone(SCHEDULE_TZ);
+  load_schedule();
+#endif
+  boot_prof_mark(BOOT_STAGE_NVS);
+  connect_wifi();
+  boot_prof_mark(BOOT_STAGE_WIFI_START);
+  net_begun = true;
+}
+
+void thermostat_loop(void) {
+  stall_mon_step(STALL_STEP_WIFI);
+  check_wifi();
+  check_screen_timeout();
+  if (hal_button_was_pressed()) {
+    // Only wakes the screen, the trace ends with the backlight
+    input_trace_capture(INPUT_TRACE_BUTTON, 0);
+    thermostat_activity();
+    input_trace_widget(false);
+  }
+
+#if PEER_SYNC
+  stall_mon_step(STALL_STEP_CONTROL);
+  run_peer_sync();
+#endif
+
+  // Poll at the rate the policy picks for the current state
+  uint32_t now = hal_millis();
+  bool poll = polls_server(now);
+  poll_ctx.now = now;
+#if PEER_SYNC
+  // The leader polls for every unit, at the awake rate while any screen is on
+  poll_ctx.screen_on = peer_any_awake(&peer, now);
+#else
+  poll_ctx.screen_on = screen_on;
+#endif
+  poll_ctx.boiler_on = boiler_on;
+  stall_mon_step(STALL_STEP_FETCH);
+  if (poll && now - last_temp_fetch >= poll_policy->interval(POLL_TEMP, &poll_ctx)) {
+    last_temp_fetch = now;
+    fetch_current_temp();
+  }
+  if (poll && now - last_boiler_status_fetch >= poll_policy->interval(POLL_BOILER_STATUS, &poll_ctx)) {
+    last_boiler_status_fetch = now;
+    fetch_boiler_status();
+  }
+
+  // Retry a setpoint the server has not acknowledged yet
+  if (poll && set_temp_pending && wifi_state == WIFI_CONNECTED && !http_busy(&set_temp_req)) {
+    send_set_temp();
+  }
+
+  // Advance in-flight requests
+  stall_mon_step(STALL_STEP_HTTP);
+#if TELEMETRY
+  upload_telemetry();
+#endif
+  service_http();
+
+#if SCHEDULE
+  stall_mon_step(STALL_STEP_CONTROL);
+  run_schedule();
+#endif
+
+#if LOCAL_CONTROL
+  stall_mon_step(STALL_STEP_CONTROL);
+  run_local_control();
+#endif
+
+  report_poll_stats();
+}
+
+static int16_t count_last = 0;
+
+void thermostat_encoder(int16_t count) {
+  static uint32_t last_read = 0;
+  uint32_t now = hal_micros();
+  uint32_t poll_gap = now - last_read;
+  last_read = now;
+  if (count == count_last) {
+    return;
+  }
+  input_trace_capture(INPUT_TRACE_ENCODER, poll_gap);
+  thermostat_activity();
+
+  int temp = set_temp + (int16_t)(count_last - count);
+  count_last = count;
+  temp = temp < THERMOSTAT_MIN_TEMP ? THERMOSTAT_MIN_TEMP : temp > THERMOSTAT_MAX_TEMP ? THERMOSTAT_MAX_TEMP : temp;
+  if (ui.show_setpoint) {
+    ui.show_setpoint(temp);
+  }
+  // Send the new setpoint to the server
+  bool changed = temp != set_temp;
+  post_set_temp(temp);
+  input_trace_widget(changed);
+}
+
+void thermostat_get_status(thermostat_status_t* status) {
+  status->wifi = wifi_state;
+  status->screen_on = screen_on;
+  status->boiler_on = boiler_on;
+  status->server_degraded = server_degraded;
+  status->local_control = local_control_active;
+  status->setpoint_pending = set_temp_pending;
+  status->setpoint = set_temp;
+  status->temp = last_temp;
+  status->temp_time = last_temp_time;
+  status->boiler_time = last_boiler_status_time;
+#if TELEMETRY
+  status->telemetry_backlog = telemetry_backlog(&telemetry);
+  status->telemetry_dropped = telemetry.stats.dropped;
+#else
+  status->telemetry_backlog = status->telemetry_dropped = 0;
+#endif
+}
+
+bool thermostat_set_schedule(const char* text) {
+#if SCHEDULE
+  uint8_t buf[SCHEDULE_PACK_SIZE(SCHEDULE_MAX_ENTRIES)];
+  if (!schedule_parse(&schedule, text, THERMOSTAT_MIN_TEMP, THERMOSTAT_MAX_TEMP)) {
+    LOG_W(SCHEDULE_INVALID, schedule.count);
+    return false;
+  }
+  hal_nvs_write("schedule", buf, schedule_pack(&schedule, buf, sizeof(buf)));
+  LOG_I(SCHEDULE_LOADED, schedule.count);
+  int64_t utc_ms;
+  if (schedule_clock_now(&sched_clock, hal_millis(), &utc_ms)) {
+    schedule.last = schedule_local(utc_ms / 1000);
+  }
+  sched_wait = 0;
+  return true;
+#else
+  (void)text;
+  return false;
+#endif
+}
+
+bool thermostat_check_schedule(const char* text) {
+#if SCHEDULE
+  schedule_t s;
+  return schedule_parse(&s, text, THERMOSTAT_MIN_TEMP, THERMOSTAT_MAX_TEMP);
+#else
+  (void)text;
+  return false;
+#endif
+}
+
+size_t thermostat_get_schedule(char* buf, size_t size) {
+#if SCHEDULE
+  return schedule_format(&schedule, buf, size);
+#else
+  if (size) {
+    buf[0] = '\0';
+  }
+  return 0;
+#endif
+}
+
+void thermostat_save(thermostat_snapshot_t* snapshot) {
+  snapshot->setpoint = (int8_t)set_temp;
+  snapshot->setpoint_pending = set_temp_pending;
+  snapshot->boiler_on = boiler_on;
+  snapshot->temp = (int16_t)(last_temp * 100);
+  snapshot->encoder = count_last;
+}
+
+void thermostat_restore(const thermostat_snapshot_t* snapshot, bool screen_on_wake) {
+  set_temp = sent_set_temp = snapshot->setpoint;
+  set_temp_pending = snapshot->setpoint_pending;
+  last_temp = snapshot->temp / 100.0f;
+  boiler_on = snapshot->boiler_on;
+  count_last = snapshot->encoder;
+  hal_encoder_restore(snapshot->encoder);
+  poll_on_connect = true;
+  if (!screen_on_wake) {
+    set_screen_state(false);
+  }
+}
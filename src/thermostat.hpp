@@ -0,0 +1,108 @@
+#pragma once
+
+#include "stdint.h"
+#include "poll_policy.hpp"
+
+// Thermostat logic: WiFi state machine, screen timeout, setpoint input,
+// adaptive polling of the server behind circuit breakers and local control
+// while the server is unreachable.
+//
+// Board access goes through hal.hpp and the http_client.hpp API, the screen is
+// updated through the thermostat_ui_t callbacks, so the same code runs on the
+// device and in the simulator.
+
+#define SCREEN_TIMEOUT 60000
+#define WIFI_RETRY_INTERVAL 10000
+#define WIFI_CONNECT_TIMEOUT 5000
+#define POLL_POLICY poll_policy_adaptive // or poll_policy_fixed for the constant 5 s / 2 s cadence
+#define HTTP_TIMEOUT 1500              // Deadline for a whole request
+#define BREAKER_THRESHOLD 3            // Consecutive failures that open a breaker
+#define BREAKER_BASE_BACKOFF 4000      // First open period, doubles on each failed probe
+#define BREAKER_MAX_BACKOFF 120000     // 2 minutes
+#define LOCAL_CONTROL 1                // Run the boiler locally while the server is unreachable
+#define LOCAL_CTRL_MODE LOCAL_CTRL_HYSTERESIS // Or LOCAL_CTRL_PID, tuning in local_ctrl.cpp
+#define LOCAL_CTRL_TICK 1000           // Control period
+#define LOCAL_CTRL_TAKEOVER 20000      // No boiler status for this long past the next poll hands control over
+#define LOCAL_CTRL_MAX_TEMP_AGE 1800000 // Don't heat on a reading older than 30 minutes
+#define PEER_SYNC 0                    // Units on the LAN share one server poller (peer_sync.hpp)
+#define SCHEDULE 1                     // Weekly setpoint schedule kept in NVS (schedule.hpp)
+#define SCHEDULE_TZ "CET-1CEST,M3.5.0,M10.5.0/3" // POSIX TZ rules of the schedule's local time
+#define SCHEDULE_NTP_SERVER "pool.ntp.org"
+#ifndef TELEMETRY
+#define TELEMETRY 0                    // Upload readings, setpoints and boiler changes in batches (telemetry.hpp),
+                                       // the server needs /telemetry (tools/standin_server.py has it)
+#endif
+
+// Setpoint range, the same as the arcs in ui.h
+#define THERMOSTAT_MIN_TEMP 10
+#define THERMOSTAT_MAX_TEMP 70
+#define THERMOSTAT_DEFAULT_TEMP 25
+
+typedef enum {
+  WIFI_DISCONNECTED,
+  WIFI_CONNECTING,
+  WIFI_CONNECTED
+} wifi_state_t;
+
+typedef struct {
+  const char* ssid;
+  const char* password;
+  const char* server_ip;
+  uint16_t server_port;
+  int led_pin;                  // Boiler indicator
+} thermostat_cfg_t;
+
+typedef struct {
+  void (*show_temp)(int temp);
+  void (*show_setpoint)(int temp);
+} thermostat_ui_t;
+
+typedef struct {
+  wifi_state_t wifi;
+  bool screen_on;
+  bool boiler_on;
+  bool server_degraded;         // Any server breaker not closed
+  bool local_control;
+  bool setpoint_pending;        // Not acknowledged by the server yet
+  int setpoint;
+  float temp;
+  uint32_t temp_time;           // hal_millis() of the last reading, 0 if none
+  uint32_t boiler_time;         // hal_millis() of the last boiler status, 0 if none
+  uint32_t telemetry_backlog;   // Records not acknowledged by the server yet
+  uint32_t telemetry_dropped;   // Records lost to a full ring
+} thermostat_status_t;
+
+// State kept across deep sleep, enough to draw the screen before the network is back
+typedef struct {
+  int8_t setpoint;
+  bool setpoint_pending;
+  bool boiler_on;
+  int16_t temp;                 // Centidegrees of the last reading
+  int16_t encoder;              // Encoder count
+} thermostat_snapshot_t;
+
+void thermostat_begin(const thermostat_cfg_t* cfg, const thermostat_ui_t* ui);
+// The NVS loads and the start of WiFi association, from any task and before thermostat_begin(),
+// so they run while the loop task brings up the display. thermostat_begin() does them otherwise.
+void thermostat_begin_net(const thermostat_cfg_t* cfg);
+void thermostat_loop(void);
+
+// Feed the absolute encoder count, turning the knob changes the setpoint
+void thermostat_encoder(int16_t count);
+
+// Any user interaction, keeps the screen on and wakes it
+void thermostat_activity(void);
+
+void thermostat_get_status(thermostat_status_t* status);
+
+// Replaces the weekly schedule and stores it in NVS, false if the text does not parse (schedule.hpp).
+// Transitions already past do not fire.
+bool thermostat_set_schedule(const char* text);
+// Parses without applying, from any task
+bool thermostat_check_schedule(const char* text);
+size_t thermostat_get_schedule(char* buf, size_t size);
+
+void thermostat_save(thermostat_snapshot_t* snapshot);
+// Call before thermostat_begin(). The restored reading is shown but counts as stale,
+// both endpoints are polled as soon as WiFi is up.
+void thermostat_restore(const thermostat_snapshot_t* snapshot, bool screen_on);
@@ -5,6 +5,7 @@
 
 #include "ui.h"
 #include "ui_helpers.h"
+#include "ui_screens.h"
 
 // SCREEN: ui_ScreenPlay
 lv_obj_t * ui_ScreenPlay;
@@ -12,9 +13,18 @@ lv_obj_t * ui_ArcSetTemp;
 lv_obj_t * ui_ArcTemp;
 lv_obj_t * ui_LabelTemp;
 lv_obj_t * ui_LabelSetTemp;
+lv_obj_t * ui_NumTemp;
+lv_obj_t * ui_NumSetTemp;
+lv_obj_t * ui_LabelStatus;
 lv_obj_t * ui_ButtonScrPlay1;
 lv_obj_t * ui____initial_actions0;
 
+#if LV_FONT_MONTSERRAT_48
+const lv_font_t * ui_font_large = &lv_font_montserrat_48;
+#else
+const lv_font_t * ui_font_large = LV_FONT_DEFAULT;
+#endif
+
 ///////////////////// TEST LVGL SETTINGS ////////////////////
 #if LV_COLOR_DEPTH != 16
     #error "LV_COLOR_DEPTH should be 16bit to match SquareLine Studio's settings"
@@ -37,14 +47,18 @@ void ui_event_ButtonScrPlay1(lv_event_t * e)
 
 ///////////////////// SCREENS ////////////////////
 
+static const ui_screen_desc_t ui_screen_table[UI_SCREEN_COUNT] = {
+    [UI_SCREEN_PLAY] = { "Play", ui_ScreenPlay_screen_init, ui_ScreenPlay_screen_destroy, &ui_ScreenPlay, true, -1 },
+};
+
 void ui_init(void)
 {
     lv_disp_t * dispp = lv_disp_get_default();
     lv_theme_t * theme = lv_theme_default_init(dispp, lv_palette_main(LV_PALETTE_BLUE), lv_palette_main(LV_PALETTE_RED),
                                                false, LV_FONT_DEFAULT);
     lv_disp_set_theme(dispp, theme);
-    ui_ScreenPlay_screen_init();
     ui____initial_actions0 = lv_obj_create(NULL);
-    lv_disp_load_scr(ui_ScreenPlay);
-    lv_timer_handler();
+    ui_screens_begin(ui_screen_table, UI_SCREEN_COUNT);
+    // Not rendered here, setup() fills in the widgets before the first frame
+    ui_screens_load(UI_SCREEN_PLAY);
 }
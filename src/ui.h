@@ -24,6 +24,7 @@ extern "C" {
 
 #include "ui_helpers.h"
 #include "ui_events.h"
+#include "ui_numlabel.h"
 
 #define MAX_TEMP 70
 #define MIN_TEMP 10
@@ -34,23 +35,17 @@ extern lv_obj_t * ui_ArcSetTemp;
 extern lv_obj_t * ui_ArcTemp;
 extern lv_obj_t * ui_LabelTemp;
 extern lv_obj_t * ui_LabelSetTemp;
+extern lv_obj_t * ui_NumTemp;
+extern lv_obj_t * ui_NumSetTemp;
+extern lv_obj_t * ui_LabelStatus;
 extern lv_obj_t * ui_ButtonScrPlay1;
 extern lv_obj_t * ui____initial_actions0;
 
-LV_IMG_DECLARE(ui_img_clear_png);    // assets\Clear.png
-LV_IMG_DECLARE(ui_img_clockwise_sec_png);    // assets\clockwise_sec.png
-LV_IMG_DECLARE(ui_img_clockwise_min_png);    // assets\clockwise_min.png
-LV_IMG_DECLARE(ui_img_clockwise_hour_png);    // assets\clockwise_hour.png
-
-LV_FONT_DECLARE(ui_font_Font1);
-LV_FONT_DECLARE(ui_font_monos100);
-LV_FONT_DECLARE(ui_font_montse100);
-LV_FONT_DECLARE(ui_font_montse120);
-LV_FONT_DECLARE(ui_font_oneslot100);
-LV_FONT_DECLARE(ui_font_oneslot120);
-LV_FONT_DECLARE(ui_font_opensansreg22);
+// Captions and numbers. Points at the asset pack font when main.cpp found one, set before ui_init()
+extern const lv_font_t * ui_font_large;
 
 void ui_ScreenPlay_screen_init(void);
+void ui_ScreenPlay_screen_destroy(void);
 void ui_event_ButtonScrPlay1(lv_event_t * e);
 void ui_init(void);
 
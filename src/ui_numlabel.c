@@ -0,0 +1,157 @@
+#include "ui_numlabel.h"
+#include "esp_heap_caps.h"
+
+#define UI_NUMLABEL_MAX_DIGITS 4
+
+typedef struct {
+    const ui_glyph_atlas_t * atlas;
+    uint8_t digits;
+    int32_t value;
+    lv_obj_t * cells[UI_NUMLABEL_MAX_DIGITS];
+} ui_numlabel_t;
+
+static uint8_t glyph_opa(const uint8_t * bitmap, uint32_t idx, uint8_t bpp)
+{
+    /* Font bitmaps are packed without row padding */
+    uint32_t bit = idx * bpp;
+    uint8_t max = (1 << bpp) - 1;
+    uint8_t val = (bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & max;
+    return (uint16_t)val * 255 / max;
+}
+
+static bool rasterize(lv_img_dsc_t * cell, const lv_font_t * font, uint32_t letter, lv_coord_t w,
+                      lv_color_t color, lv_color_t bg)
+{
+    lv_font_glyph_dsc_t g;
+    if(!lv_font_get_glyph_dsc(font, &g, letter, 0)) return false;
+
+    lv_coord_t h = lv_font_get_line_height(font);
+    lv_color_t * px = heap_caps_malloc(w * h * sizeof(lv_color_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if(px == NULL) px = heap_caps_malloc(w * h * sizeof(lv_color_t), MALLOC_CAP_8BIT);
+    if(px == NULL) return false;
+    for(int32_t i = 0; i < w * h; i++) px[i] = bg;
+
+    const uint8_t * bitmap = lv_font_get_glyph_bitmap(g.resolved_font, letter);
+    uint8_t bpp = g.bpp == 3 ? 4 : g.bpp;   /*Compressed 3 bpp glyphs are decompressed to 4 bpp*/
+    if(bitmap && bpp) {
+        /*Same placement as lv_draw_letter, centered horizontally in the cell*/
+        lv_coord_t x0 = (w - g.adv_w) / 2 + g.ofs_x;
+        lv_coord_t y0 = (font->line_height - font->base_line) - g.box_h - g.ofs_y;
+        for(lv_coord_t y = 0; y < g.box_h; y++) {
+            lv_coord_t py = y0 + y;
+            if(py < 0 || py >= h) continue;
+            for(lv_coord_t x = 0; x < g.box_w; x++) {
+                lv_coord_t pxx = x0 + x;
+                if(pxx < 0 || pxx >= w) continue;
+                lv_opa_t opa = glyph_opa(bitmap, y * g.box_w + x, bpp);
+                if(opa) px[py * w + pxx] = lv_color_mix(color, bg, opa);
+            }
+        }
+    }
+
+    cell->header.always_zero = 0;
+    cell->header.cf = LV_IMG_CF_TRUE_COLOR;
+    cell->header.w = w;
+    cell->header.h = h;
+    cell->data_size = w * h * sizeof(lv_color_t);
+    cell->data = (const uint8_t *)px;
+    return true;
+}
+
+bool ui_glyph_atlas_init(ui_glyph_atlas_t * atlas, const lv_font_t * font, lv_color_t color, lv_color_t bg)
+{
+    const char * chars = UI_GLYPH_ATLAS_CHARS;
+    uint32_t ofs = 0;
+    for(int i = 0; i < UI_GLYPH_ATLAS_SIZE; i++) {
+        atlas->letters[i] = _lv_txt_encoded_next(chars, &ofs);
+    }
+
+    /*Every digit gets the width of the widest one so values never shift*/
+    atlas->digit_w = 0;
+    for(int i = 0; i < 10; i++) {
+        lv_coord_t w = lv_font_get_glyph_width(font, atlas->letters[i], 0);
+        if(w > atlas->digit_w) atlas->digit_w = w;
+    }
+    atlas->h = lv_font_get_line_height(font);
+
+    for(int i = 0; i < UI_GLYPH_ATLAS_SIZE; i++) {
+        lv_coord_t w = i < 10 ? atlas->digit_w : lv_font_get_glyph_width(font, atlas->letters[i], 0);
+        if(!rasterize(&atlas->cells[i], font, atlas->letters[i], w, color, bg)) return false;
+    }
+    return true;
+}
+
+const lv_img_dsc_t * ui_glyph_atlas_get(const ui_glyph_atlas_t * atlas, uint32_t letter)
+{
+    for(int i = 0; i < UI_GLYPH_ATLAS_SIZE; i++) {
+        if(atlas->letters[i] == letter) return &atlas->cells[i];
+    }
+    return NULL;
+}
+
+static void numlabel_delete_cb(lv_event_t * e)
+{
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_mem_free(lv_obj_get_user_data(obj));
+    lv_obj_set_user_data(obj, NULL);
+}
+
+static lv_obj_t * add_cell(lv_obj_t * parent, const lv_img_dsc_t * src, lv_coord_t x)
+{
+    lv_obj_t * img = lv_img_create(parent);
+    lv_img_set_src(img, src);
+    lv_obj_set_pos(img, x, 0);
+    lv_obj_clear_flag(img, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    return img;
+}
+
+lv_obj_t * ui_numlabel_create(lv_obj_t * parent, const ui_glyph_atlas_t * atlas, uint8_t digits)
+{
+    if(digits == 0 || digits > UI_NUMLABEL_MAX_DIGITS) return NULL;
+    if(atlas->cells[UI_GLYPH_ATLAS_SIZE - 1].data == NULL) return NULL;   /*Atlas failed to initialize*/
+
+    ui_numlabel_t * nl = lv_mem_alloc(sizeof(ui_numlabel_t));
+    if(nl == NULL) return NULL;
+    nl->atlas = atlas;
+    nl->digits = digits;
+    nl->value = 0;
+
+    lv_obj_t * obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(obj);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_user_data(obj, nl);
+    lv_obj_add_event_cb(obj, numlabel_delete_cb, LV_EVENT_DELETE, NULL);
+
+    lv_coord_t x = 0;
+    for(uint8_t i = 0; i < digits; i++) {
+        nl->cells[i] = add_cell(obj, &atlas->cells[0], x);
+        x += atlas->digit_w;
+    }
+    const lv_img_dsc_t * degree = ui_glyph_atlas_get(atlas, 0xB0);
+    const lv_img_dsc_t * celsius = ui_glyph_atlas_get(atlas, 'C');
+    add_cell(obj, degree, x);
+    x += degree->header.w;
+    add_cell(obj, celsius, x);
+    x += celsius->header.w;
+    lv_obj_set_size(obj, x, atlas->h);
+    return obj;
+}
+
+void ui_numlabel_set_value(lv_obj_t * obj, int32_t value)
+{
+    if(obj == NULL) return;
+    ui_numlabel_t * nl = lv_obj_get_user_data(obj);
+    if(nl == NULL) return;
+
+    int32_t max = 1;
+    for(uint8_t i = 0; i < nl->digits; i++) max *= 10;
+    value = LV_CLAMP(0, value, max - 1);
+    nl->value = value;
+
+    /*Only the cells whose digit changed are invalidated*/
+    for(int i = nl->digits - 1; i >= 0; i--) {
+        const lv_img_dsc_t * src = &nl->atlas->cells[value % 10];
+        if(lv_img_get_src(nl->cells[i]) != src) lv_img_set_src(nl->cells[i], src);
+        value /= 10;
+    }
+}
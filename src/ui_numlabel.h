@@ -0,0 +1,37 @@
+#ifndef _UI_NUMLABEL_H
+#define _UI_NUMLABEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lvgl.h"
+
+/* Fast numeric display.
+ * The glyphs are rasterized once into an atlas of opaque true color cells in the
+ * label color over the background color. A value update only swaps the image
+ * source of the cells that changed, there is no text formatting, shaping or
+ * relayout and drawing a cell is a plain copy. */
+
+#define UI_GLYPH_ATLAS_CHARS "0123456789:\xC2\xB0" "C"
+#define UI_GLYPH_ATLAS_SIZE 13
+
+typedef struct {
+    lv_coord_t digit_w;
+    lv_coord_t h;
+    uint32_t letters[UI_GLYPH_ATLAS_SIZE];
+    lv_img_dsc_t cells[UI_GLYPH_ATLAS_SIZE];
+} ui_glyph_atlas_t;
+
+bool ui_glyph_atlas_init(ui_glyph_atlas_t * atlas, const lv_font_t * font, lv_color_t color, lv_color_t bg);
+const lv_img_dsc_t * ui_glyph_atlas_get(const ui_glyph_atlas_t * atlas, uint32_t letter);
+
+/* Shows `digits` digits followed by "°C". Values outside the digit range are clamped. */
+lv_obj_t * ui_numlabel_create(lv_obj_t * parent, const ui_glyph_atlas_t * atlas, uint8_t digits);
+void ui_numlabel_set_value(lv_obj_t * obj, int32_t value);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
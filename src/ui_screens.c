@@ -0,0 +1,116 @@
+#include "ui_screens.h"
+#include "mem_pool.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const ui_screen_desc_t * screens;
+static uint8_t screen_count;
+static ui_screen_stats_t stats[UI_SCREENS_MAX];
+static uint32_t last_shown[UI_SCREENS_MAX];
+static uint32_t show_count;
+static int8_t active = -1;
+
+static bool build(ui_screen_id_t id)
+{
+    const ui_screen_desc_t * desc = &screens[id];
+    uint32_t heap = mem_pool_used();
+    int64_t start = esp_timer_get_time();
+    desc->init();
+    if(*desc->obj == NULL) {
+        desc->destroy();
+        return false;
+    }
+    stats[id].build_us = (uint32_t)(esp_timer_get_time() - start);
+    stats[id].footprint = mem_pool_used() - heap;
+    stats[id].builds++;
+    stats[id].resident = true;
+    return true;
+}
+
+static void teardown(ui_screen_id_t id)
+{
+    screens[id].destroy();
+    stats[id].resident = false;
+}
+
+static uint32_t resident_bytes(void)
+{
+    uint32_t total = 0;
+    for(int i = 0; i < screen_count; i++) {
+        if(stats[i].resident) total += stats[i].footprint;
+    }
+    return total;
+}
+
+/* Deletes the least recently shown screens until the rest fits the budget */
+static void enforce_budget(uint32_t extra)
+{
+    while(resident_bytes() + extra > UI_SCREENS_BUDGET) {
+        int victim = -1;
+        for(int i = 0; i < screen_count; i++) {
+            if(!stats[i].resident || screens[i].pinned || i == active) continue;
+            if(victim < 0 || last_shown[i] < last_shown[victim]) victim = i;
+        }
+        if(victim < 0) return;
+        teardown((ui_screen_id_t)victim);
+    }
+}
+
+void ui_screens_begin(const ui_screen_desc_t * table, uint8_t count)
+{
+    screens = table;
+    screen_count = count < UI_SCREENS_MAX ? count : UI_SCREENS_MAX;
+    memset(stats, 0, sizeof(stats));
+    memset(last_shown, 0, sizeof(last_shown));
+    show_count = 0;
+    active = -1;
+}
+
+static void switch_to(ui_screen_id_t id, bool render)
+{
+    if(id >= screen_count) return;
+    int64_t start = esp_timer_get_time();
+    if(!stats[id].resident) {
+        enforce_budget(stats[id].footprint);
+        if(!build(id)) return;
+    }
+    active = id;
+    last_shown[id] = ++show_count;
+    lv_disp_load_scr(*screens[id].obj);
+    if(render) lv_refr_now(NULL);
+
+    ui_screen_stats_t * s = &stats[id];
+    s->shows++;
+    s->last_switch_us = (uint32_t)(esp_timer_get_time() - start);
+    if(s->last_switch_us > s->max_switch_us) s->max_switch_us = s->last_switch_us;
+    enforce_budget(0);
+}
+
+void ui_screens_show(ui_screen_id_t id)
+{
+    switch_to(id, true);
+}
+
+void ui_screens_load(ui_screen_id_t id)
+{
+    switch_to(id, false);
+}
+
+void ui_screens_idle(void)
+{
+    if(active < 0 || lv_disp_get_inactive_time(NULL) < UI_SCREENS_PRELOAD_IDLE) return;
+    int8_t next = screens[active].next;
+    if(next < 0 || stats[next].resident) return;
+    if(stats[next].builds && resident_bytes() + stats[next].footprint > UI_SCREENS_BUDGET) return;
+    build((ui_screen_id_t)next);
+}
+
+const char * ui_screens_name(ui_screen_id_t id)
+{
+    return id < screen_count ? screens[id].name : "?";
+}
+
+void ui_screens_get_stats(ui_screen_id_t id, ui_screen_stats_t * out)
+{
+    *out = stats[id];
+}
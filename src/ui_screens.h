@@ -0,0 +1,66 @@
+#ifndef _UI_SCREENS_H
+#define _UI_SCREENS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lvgl.h"
+
+/* Screen manager.
+ * A screen is created the first time it is shown. Inactive screens stay
+ * resident while the footprints of all resident screens fit UI_SCREENS_BUDGET,
+ * beyond that the least recently shown ones are deleted and rebuilt on the
+ * next visit. Once the UI has been idle for UI_SCREENS_PRELOAD_IDLE, the
+ * screen most likely to come next is built ahead of time. A footprint is what
+ * the LVGL heap grew by while the screen was built, a switch time runs from
+ * the request to the new screen rendered and flushed. */
+
+#define UI_SCREENS_BUDGET (96 * 1024)    /* Bytes of LVGL heap for all resident screens */
+#define UI_SCREENS_PRELOAD_IDLE 2000     /* ms without input before preloading */
+#define UI_SCREENS_MAX 8
+
+typedef enum {
+    UI_SCREEN_PLAY,
+    UI_SCREEN_COUNT
+} ui_screen_id_t;
+
+typedef struct {
+    const char * name;
+    void (*init)(void);
+    void (*destroy)(void);      /* Deletes the screen and clears its object pointers */
+    lv_obj_t ** obj;
+    bool pinned;                /* Never torn down, widgets updated from outside the UI */
+    int8_t next;                /* Screen to preload while this one is shown, -1 for none */
+} ui_screen_desc_t;
+
+typedef struct {
+    bool resident;
+    uint32_t footprint;         /* Bytes, from the last build */
+    uint32_t builds;
+    uint32_t build_us;
+    uint32_t shows;
+    uint32_t last_switch_us;
+    uint32_t max_switch_us;
+} ui_screen_stats_t;
+
+/* The app's screens, indexed by ui_screen_id_t. The table is kept, not copied. src/uitest runs
+ * the manager on the host against fake screens. */
+void ui_screens_begin(const ui_screen_desc_t * table, uint8_t count);
+
+void ui_screens_show(ui_screen_id_t id);
+/* Makes a screen active without rendering it, for the first screen at boot: the caller fills
+ * in its widgets and renders the first frame itself. The switch time excludes the frame. */
+void ui_screens_load(ui_screen_id_t id);
+
+/* Call from the main loop, preloads when the UI is idle */
+void ui_screens_idle(void);
+
+const char * ui_screens_name(ui_screen_id_t id);
+void ui_screens_get_stats(ui_screen_id_t id, ui_screen_stats_t * stats);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
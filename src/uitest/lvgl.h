@@ -0,0 +1,27 @@
+#ifndef UITEST_LVGL_H
+#define UITEST_LVGL_H
+
+// The few LVGL calls the screen manager makes, for the host test in uitest_main.cpp
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int id;
+} lv_obj_t;
+
+typedef struct lv_disp_t lv_disp_t;
+
+void lv_disp_load_scr(lv_obj_t * scr);
+void lv_refr_now(lv_disp_t * disp);
+uint32_t lv_disp_get_inactive_time(const lv_disp_t * disp);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif
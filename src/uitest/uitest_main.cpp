@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+#include "ui_screens.h"
+#include "mem_pool.h"
+
+// The screen manager (ui_screens.h) on the host, against fake screens:
+//
+//   pio run -e uitest && .pio/build/uitest/program
+//
+// A fake screen grows a fake LVGL heap by its footprint when built and gives
+// it back when destroyed. src/uitest/lvgl.h stands in for the LVGL calls the
+// manager makes, counting renders and recording the loaded screen. Checked:
+//   - resident screens stay within UI_SCREENS_BUDGET, the least recently shown
+//     go first, the pinned and the active screen never
+//   - a screen that does not fit even alone leaves only itself and the pinned
+//   - a torn down screen is rebuilt on the next visit, a resident one is not
+//   - the next screen is preloaded only after UI_SCREENS_PRELOAD_IDLE, without
+//     rendering, and not if its known footprint would break the budget
+//   - a screen whose build fails is cleaned up and not shown
+//   - ui_screens_load() switches without rendering
+// Exits with 1 if any check fails.
+
+#define KB 1024
+
+enum {
+  HOME,     // Pinned
+  ROOM_A,
+  ROOM_B,
+  ROOM_C,
+  BROKEN,   // init creates nothing
+  HUGE,     // Over the budget alone
+  FAKE_SCREENS
+};
+
+static const uint32_t footprints[FAKE_SCREENS] = { 8 * KB, 40 * KB, 40 * KB, 40 * KB, 0, 100 * KB };
+
+static lv_obj_t objs[FAKE_SCREENS];
+static lv_obj_t* fake_obj[FAKE_SCREENS];
+static uint32_t builds[FAKE_SCREENS];
+static uint32_t heap_used;
+static uint32_t renders;
+static lv_obj_t* loaded;
+static uint32_t inactive_ms;
+static unsigned failures = 0;
+
+#define UITEST_CHECK(cond, ...)                   \
+  do {                                            \
+    if (!(cond)) {                                \
+      failures++;                                 \
+      printf("  FAIL %s: ", #cond);               \
+      printf(__VA_ARGS__);                        \
+      printf("\n");                               \
+    }                                             \
+  } while (0)
+
+extern "C" {
+uint32_t mem_pool_used(void) {
+  return heap_used;
+}
+
+void lv_disp_load_scr(lv_obj_t* scr) {
+  loaded = scr;
+}
+
+void lv_refr_now(lv_disp_t* disp) {
+  (void)disp;
+  renders++;
+}
+
+uint32_t lv_disp_get_inactive_time(const lv_disp_t* disp) {
+  (void)disp;
+  return inactive_ms;
+}
+}
+
+template <int I>
+static void fake_init(void) {
+  builds[I]++;
+  if (I == BROKEN) {
+    return;
+  }
+  heap_used += footprints[I];
+  objs[I].id = I;
+  fake_obj[I] = &objs[I];
+}
+
+template <int I>
+static void fake_destroy(void) {
+  if (fake_obj[I]) {
+    heap_used -= footprints[I];
+  }
+  fake_obj[I] = NULL;
+}
+
+static const ui_screen_desc_t table[FAKE_SCREENS] = {
+  { "home", fake_init<HOME>, fake_destroy<HOME>, &fake_obj[HOME], true, ROOM_A },
+  { "room A", fake_init<ROOM_A>, fake_destroy<ROOM_A>, &fake_obj[ROOM_A], false, ROOM_B },
+  { "room B", fake_init<ROOM_B>, fake_destroy<ROOM_B>, &fake_obj[ROOM_B], false, ROOM_C },
+  { "room C", fake_init<ROOM_C>, fake_destroy<ROOM_C>, &fake_obj[ROOM_C], false, -1 },
+  { "broken", fake_init<BROKEN>, fake_destroy<BROKEN>, &fake_obj[BROKEN], false, -1 },
+  { "huge", fake_init<HUGE>, fake_destroy<HUGE>, &fake_obj[HUGE], false, -1 },
+};
+
+static void reset(void) {
+  for (int i = 0; i < FAKE_SCREENS; i++) {
+    fake_obj[i] = NULL;
+  }
+  memset(builds, 0, sizeof(builds));
+  heap_used = 0;
+  renders = 0;
+  loaded = NULL;
+  inactive_ms = 0;
+  ui_screens_begin(table, FAKE_SCREENS);
+}
+
+static bool resident(int id) {
+  ui_screen_stats_t stats;
+  ui_screens_get_stats((ui_screen_id_t)id, &stats);
+  UITEST_CHECK(stats.resident == (fake_obj[id] != NULL), "%s resident %d, object %p", table[id].name,
+               stats.resident, (void*)fake_obj[id]);
+  return stats.resident;
+}
+
+// Shows id and checks what every switch has to hold
+static void show(int id) {
+  uint32_t before = renders;
+  ui_screens_show((ui_screen_id_t)id);
+  UITEST_CHECK(loaded == fake_obj[id] && loaded, "%s not loaded", table[id].name);
+  UITEST_CHECK(renders == before + 1, "%s rendered %u times", table[id].name, renders - before);
+  UITEST_CHECK(!builds[HOME] || resident(HOME), "pinned screen torn down");
+}
+
+static void check_budget(void) {
+  printf("budget and LRU eviction\n");
+  reset();
+  show(HOME);
+  show(ROOM_A);
+  show(ROOM_B);
+  UITEST_CHECK(resident(HOME) && resident(ROOM_A) && resident(ROOM_B) && heap_used == 88 * KB,
+               "%u B resident after home, A, B", heap_used);
+
+  // C does not fit beside A and B: A was shown longest ago
+  show(ROOM_C);
+  UITEST_CHECK(!resident(ROOM_A) && resident(ROOM_B) && resident(ROOM_C) && heap_used <= UI_SCREENS_BUDGET,
+               "after C: A %d, B %d, %u B", resident(ROOM_A), resident(ROOM_B), heap_used);
+
+  // Back to B is a switch without a build, then A comes back at the cost of C, not of B
+  show(ROOM_B);
+  UITEST_CHECK(builds[ROOM_B] == 1, "B built %u times", builds[ROOM_B]);
+  show(ROOM_A);
+  UITEST_CHECK(builds[ROOM_A] == 2 && !resident(ROOM_C) && resident(ROOM_B) && heap_used <= UI_SCREENS_BUDGET,
+               "after A again: A built %u times, C %d, B %d, %u B", builds[ROOM_A], resident(ROOM_C),
+               resident(ROOM_B), heap_used);
+
+  // Nothing else fits beside the huge screen, it still shows with the pinned one
+  show(HUGE);
+  UITEST_CHECK(resident(HUGE) && resident(HOME) && !resident(ROOM_A) && !resident(ROOM_B) &&
+                 heap_used == 108 * KB,
+               "huge screen: %u B resident", heap_used);
+  show(ROOM_C);
+  UITEST_CHECK(!resident(HUGE) && heap_used == 48 * KB, "huge screen kept, %u B resident", heap_used);
+}
+
+static void check_preload(void) {
+  printf("idle preload\n");
+  reset();
+  show(HOME);
+  uint32_t before = renders;
+  inactive_ms = UI_SCREENS_PRELOAD_IDLE - 1;
+  ui_screens_idle();
+  UITEST_CHECK(!resident(ROOM_A), "preloaded before %u ms idle", UI_SCREENS_PRELOAD_IDLE);
+  inactive_ms = UI_SCREENS_PRELOAD_IDLE;
+  ui_screens_idle();
+  UITEST_CHECK(resident(ROOM_A) && builds[ROOM_A] == 1 && renders == before && loaded == fake_obj[HOME],
+               "preload: A %d, %u renders, home still loaded %d", resident(ROOM_A), renders - before,
+               loaded == fake_obj[HOME]);
+  ui_screens_idle();
+  UITEST_CHECK(builds[ROOM_A] == 1, "A preloaded again");
+  inactive_ms = 0;
+  show(ROOM_A);
+  UITEST_CHECK(builds[ROOM_A] == 1, "preloaded A built again on show");
+
+  // B preloads, C's known footprint would go over the budget beside A and B
+  show(ROOM_B);
+  show(ROOM_C);
+  show(ROOM_B);
+  UITEST_CHECK(!resident(ROOM_A) && resident(ROOM_C), "A %d, C %d", resident(ROOM_A), resident(ROOM_C));
+  show(ROOM_A);
+  UITEST_CHECK(!resident(ROOM_C), "C still resident");
+  show(ROOM_B);
+  inactive_ms = UI_SCREENS_PRELOAD_IDLE;
+  ui_screens_idle();
+  UITEST_CHECK(!resident(ROOM_C) && heap_used <= UI_SCREENS_BUDGET, "C preloaded over the budget, %u B", heap_used);
+}
+
+static void check_failures(void) {
+  printf("failed builds and loads without rendering\n");
+  reset();
+  show(HOME);
+  ui_screens_show((ui_screen_id_t)BROKEN);
+  UITEST_CHECK(loaded == fake_obj[HOME] && !resident(BROKEN) && builds[BROKEN] == 1 && renders == 1,
+               "broken screen: loaded %p, built %u times, %u renders", (void*)loaded, builds[BROKEN], renders);
+  ui_screens_show((ui_screen_id_t)FAKE_SCREENS);
+  UITEST_CHECK(loaded == fake_obj[HOME], "out of range id loaded");
+
+  ui_screens_load((ui_screen_id_t)ROOM_A);
+  ui_screen_stats_t stats;
+  ui_screens_get_stats((ui_screen_id_t)ROOM_A, &stats);
+  UITEST_CHECK(loaded == fake_obj[ROOM_A] && renders == 1 && stats.shows == 1, "load: %u renders, %u shows",
+               renders, stats.shows);
+}
+
+int main(int argc, char** argv) {
+  (void)argv;
+  if (argc > 1) {
+    printf("usage: program\n");
+    return 2;
+  }
+  check_budget();
+  check_preload();
+  check_failures();
+  printf("%u failed checks\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Build the asset pack that src/asset_pack.cpp maps from flash.
+
+Each font in FONTS is cut down to the glyphs the UI draws with it. Those are
+found in the sources: the text given with lv_label_set_text() to every object
+that gets the font through lv_obj_set_style_text_font(), plus the value of the
+listed macros (the glyph atlas characters). Glyph bitmaps are taken from the
+LVGL font C file, deflated one by one and written to a pack:
+
+    header   "TAPK", u16 version, u16 entry count, u32 pack size, u32 crc32 of the rest
+    entries  char name[20], u8 type, 3 pad, u32 offset, u32 size
+    font     u16 line height, i16 base line, i8 underline position, i8 underline thickness,
+             u8 bpp, u8 pad, u16 glyph count, u16 largest bitmap
+             glyphs sorted by code point: u32 unicode, u16 advance (1/16 px),
+             u8 box w, u8 box h, i8 x ofs, i8 y ofs, u16 deflated size, u32 offset
+             raw deflate streams, stored as is when deflate does not help
+
+As a PlatformIO extra script it runs before every build of the firmware,
+writes assets.bin to the build directory and adds it to the upload at the
+offset of the "assets" partition. Standalone:
+    build_assets.py --lvgl .pio/libdeps/<env>/lvgl --out assets.bin
+"""
+
+import argparse
+import binascii
+import os
+import re
+import struct
+import sys
+import zlib
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+FONTS = [
+    {
+        "name": "montserrat_48",
+        "source": "src/font/lv_font_montserrat_48.c",  # In the LVGL library
+        "var": "ui_font_large",
+        "macros": ["UI_GLYPH_ATLAS_CHARS"],
+    },
+]
+SCAN = ["src/ui.c", "src/ui_numlabel.h", "src/screens", "src/main.cpp"]
+PARTITIONS = "partitions_ota_32MB.csv"
+
+PACK_MAGIC = b"TAPK"
+PACK_VERSION = 1
+TYPE_FONT = 1
+ENTRY = struct.Struct("<20sB3xII")
+GLYPH = struct.Struct("<IHBBbbHI")
+
+STR_RE = r'"((?:[^"\\]|\\.)*)"'
+
+
+def c_string(body):
+    """Bytes of a C string literal body, escapes resolved."""
+    out = bytearray()
+    i = 0
+    while i < len(body):
+        c = body[i]
+        if c != "\\":
+            out += c.encode()
+            i += 1
+            continue
+        n = body[i + 1]
+        if n == "x":
+            m = re.match(r"[0-9a-fA-F]+", body[i + 2:])
+            out.append(int(m.group(0), 16) & 0xFF)
+            i += 2 + len(m.group(0))
+        elif n in "01234567":
+            m = re.match(r"[0-7]{1,3}", body[i + 1:])
+            out.append(int(m.group(0), 8))
+            i += 1 + len(m.group(0))
+        else:
+            out.append(ord({"n": "\n", "t": "\t", "r": "\r", "0": "\0"}.get(n, n)))
+            i += 2
+    return bytes(out)
+
+
+def literal(expr):
+    """Concatenated string literals at the start of expr, None if it is not one."""
+    parts = re.match(r"\s*((?:%s\s*)+)" % STR_RE, expr)
+    if not parts:
+        return None
+    return b"".join(c_string(s) for s in re.findall(STR_RE, parts.group(1))).decode("utf-8")
+
+
+def sources():
+    for rel in SCAN:
+        path = os.path.join(ROOT, rel)
+        names = [os.path.join(path, n) for n in sorted(os.listdir(path))] if os.path.isdir(path) else [path]
+        for name in names:
+            with open(name, encoding="utf-8") as f:
+                yield name, re.sub(r"/\*.*?\*/", "", f.read(), flags=re.S)
+
+
+def used_text(font):
+    """Every string drawn with the font, with where it was found."""
+    texts = []
+    for name, text in sources():
+        objs = set(re.findall(r"lv_obj_set_style_text_font\(\s*(\w+)\s*,\s*&?%s\b" % re.escape(font["var"]), text))
+        for m in re.finditer(r"lv_label_set_text(_fmt)?\(\s*(\w+)\s*,(.*)", text):
+            s = literal(m.group(3))
+            if m.group(2) in objs and s is not None:
+                if m.group(1):
+                    # Numbers from the format: digits and sign
+                    s = re.sub(r"%%", "%", re.sub(r"%[-+ 0#]*\d*[diu]", "-0123456789", s))
+                texts.append((name, s))
+        for macro in font["macros"]:
+            m = re.search(r"#define\s+%s\s+(.*)" % macro, text)
+            if m:
+                texts.append((name, literal(m.group(1))))
+    return texts
+
+
+def parse_font(path):
+    with open(path, encoding="utf-8") as f:
+        text = re.sub(r"/\*.*?\*/", "", f.read(), flags=re.S)
+
+    def array(name):
+        m = re.search(r"\b%s\[\]\s*=\s*\{(.*?)\};" % name, text, re.S)
+        return m.group(1) if m else None
+
+    def field(name, src=text):
+        return int(re.search(r"\.%s\s*=\s*(-?\w+)" % name, src).group(1), 0)
+
+    if field("bitmap_format") != 0:
+        sys.exit("%s: compressed LVGL bitmaps are not supported" % path)
+    bitmap = bytes(int(v, 16) for v in re.findall(r"0x[0-9a-fA-F]+", array("glyph_bitmap")))
+    glyphs = [dict((k, int(v)) for k, v in re.findall(r"\.(\w+)\s*=\s*(-?\d+)", g))
+              for g in re.findall(r"\{([^{}]*)\}", array("glyph_dsc"))]
+
+    cmap = {}
+    for c in re.findall(r"\{([^{}]*)\}", array("cmaps")):
+        start, length, gid = field("range_start", c), field("range_length", c), field("glyph_id_start", c)
+        kind = re.search(r"\.type\s*=\s*LV_FONT_FMT_TXT_CMAP_(\w+)", c).group(1)
+        ul = re.search(r"\.unicode_list\s*=\s*(\w+)", c).group(1)
+        ol = re.search(r"\.glyph_id_ofs_list\s*=\s*(\w+)", c).group(1)
+        ul = [int(v, 0) for v in re.findall(r"0x[0-9a-fA-F]+|\d+", array(ul))] if ul != "NULL" else []
+        ol = [int(v, 0) for v in re.findall(r"0x[0-9a-fA-F]+|\d+", array(ol))] if ol != "NULL" else []
+        if kind == "FORMAT0_TINY":
+            pairs = [(start + i, gid + i) for i in range(length)]
+        elif kind == "FORMAT0_FULL":
+            pairs = [(start + i, gid + o) for i, o in enumerate(ol) if o]
+        elif kind == "SPARSE_TINY":
+            pairs = [(start + u, gid + i) for i, u in enumerate(ul)]
+        else:
+            pairs = [(start + u, gid + o) for u, o in zip(ul, ol)]
+        cmap.update(pairs)
+
+    bpp = field("bpp")
+    font = {"line_height": field("line_height"), "base_line": field("base_line"),
+            "underline_position": field("underline_position"),
+            "underline_thickness": field("underline_thickness"), "bpp": bpp, "glyphs": {}}
+    for u, gid in cmap.items():
+        g = glyphs[gid]
+        size = (g["box_w"] * g["box_h"] * bpp + 7) // 8
+        font["glyphs"][u] = dict(g, bitmap=bitmap[g["bitmap_index"]:g["bitmap_index"] + size])
+    font["full_size"] = len(bitmap) + 8 * len(glyphs)  # Bitmaps and lv_font_fmt_txt_glyph_dsc_t
+    return font
+
+
+def deflate(data):
+    z = zlib.compressobj(9, zlib.DEFLATED, -15, 9)
+    packed = z.compress(data) + z.flush()
+    return packed if len(packed) < len(data) else data
+
+
+def font_blob(font, chars):
+    missing = sorted(c for c in chars if ord(c) not in font["glyphs"])
+    if missing:
+        sys.exit("glyphs not in the font: %s" % " ".join("U+%04X" % ord(c) for c in missing))
+    codes = sorted(ord(c) for c in chars)
+    table = 12 + GLYPH.size * len(codes)
+    head = struct.pack("<HhbbBxHH", font["line_height"], font["base_line"], font["underline_position"],
+                       font["underline_thickness"], font["bpp"], len(codes),
+                       max(len(font["glyphs"][u]["bitmap"]) for u in codes))
+    dsc, data = b"", b""
+    for u in codes:
+        g = font["glyphs"][u]
+        z = deflate(g["bitmap"])
+        dsc += GLYPH.pack(u, g["adv_w"], g["box_w"], g["box_h"], g["ofs_x"], g["ofs_y"], len(z), table + len(data))
+        data += z
+    return head + dsc + data
+
+
+def build(lvgl, out, quiet=False):
+    entries = []
+    for f in FONTS:
+        font = parse_font(os.path.join(lvgl, f["source"]))
+        texts = used_text(f)
+        chars = set("".join(s for _, s in texts)) - set("\n")
+        blob = font_blob(font, chars)
+        entries.append((f["name"], TYPE_FONT, blob))
+        if not quiet:
+            print("assets: %s %d of %d glyphs, %d B compiled in -> %d B packed: %s" % (
+                f["name"], len(chars), len(font["glyphs"]), font["full_size"], len(blob),
+                "".join(sorted(chars))))
+
+    table = ENTRY.size * len(entries)
+    body, ofs = b"", 16 + table
+    for name, kind, blob in entries:
+        body += blob + b"\0" * (-len(blob) % 4)
+    rest = b""
+    for name, kind, blob in entries:
+        rest += ENTRY.pack(name.encode(), kind, ofs, len(blob))
+        ofs += len(blob) + (-len(blob) % 4)
+    rest += body
+    pack = PACK_MAGIC + struct.pack("<HHII", PACK_VERSION, len(entries), 16 + len(rest),
+                                    binascii.crc32(rest) & 0xFFFFFFFF) + rest
+    if not os.path.exists(out) or open(out, "rb").read() != pack:
+        with open(out, "wb") as f:
+            f.write(pack)
+    if not quiet:
+        print("assets: %s, %d B" % (out, len(pack)))
+    return pack
+
+
+def partition(name):
+    with open(os.path.join(ROOT, PARTITIONS), encoding="utf-8") as f:
+        for line in f:
+            cols = [c.strip() for c in line.split("#")[0].split(",")]
+            if cols[0] == name:
+                return int(cols[3], 0), int(cols[4], 0)
+    sys.exit("%s: no %s partition" % (PARTITIONS, name))
+
+
+def platformio(env):
+    lvgl = os.path.join(env.subst("$PROJECT_LIBDEPS_DIR"), env.subst("$PIOENV"), "lvgl")
+    out = os.path.join(env.subst("$BUILD_DIR"), "assets.bin")
+    os.makedirs(os.path.dirname(out), exist_ok=True)
+    if not os.path.isdir(lvgl):
+        print("assets: LVGL not installed yet, pack not built")
+        return
+    pack = build(lvgl, out)
+    offset, size = partition("assets")
+    if len(pack) > size:
+        sys.exit("assets: pack of %d B does not fit the %d B partition" % (len(pack), size))
+    env.Append(FLASH_EXTRA_IMAGES=[("0x%x" % offset, out)])
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--lvgl", required=True, help="LVGL library directory")
+    ap.add_argument("--out", default="assets.bin")
+    args = ap.parse_args()
+    build(args.lvgl, args.out)
+
+
+if __name__ == "__main__":
+    main()
+else:
+    Import("env")  # noqa: F821, PlatformIO extra script
+    platformio(env)  # noqa: F821
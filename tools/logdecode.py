@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Decode the binary log frames written by src/logger.cpp.
+
+Usage:
+    logdecode.py [dump.bin]              decode a capture, or stdin
+    logdecode.py --port /dev/ttyACM0     decode live from the serial port (needs pyserial)
+
+Frame: 0xA5 0x5A, payload length, payload, checksum (sum of the payload bytes).
+Payload: u32 ms timestamp, u16 format ID, u8 level, then one 4-byte little
+endian word per argument, or a length prefixed string for %s. Bytes outside
+a valid frame (boot ROM messages, panics) are passed through as text.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = b"\xa5\x5a"
+LEVELS = "-EWID"
+CONV_RE = re.compile(r"%%|%[-+ #0]*\d*(?:\.\d+)?[hlLqjzt]*([diuxXcsfeEgGp])")
+DEF_FILE = os.path.join(os.path.dirname(__file__), "..", "src", "log_formats.def")
+
+
+def load_formats(path):
+    formats = []
+    with open(path, encoding="utf-8") as f:
+        for m in re.finditer(r'^\s*LOG_FMT\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', f.read(), re.M):
+            formats.append((m.group(1), m.group(2).encode().decode("unicode_escape")))
+    return formats
+
+
+def decode_payload(payload, formats):
+    ts, fid, level = struct.unpack_from("<IHB", payload, 0)
+    off = 7
+    if fid >= len(formats):
+        return "[%d][%s] <unknown format %d>" % (ts, LEVELS[level] if level < len(LEVELS) else "?", fid)
+    _, fmt = formats[fid]
+    args = []
+    for m in CONV_RE.finditer(fmt):
+        conv = m.group(1)
+        if not conv or off >= len(payload):
+            continue
+        if conv == "s":
+            n = payload[off]
+            args.append(payload[off + 1:off + 1 + n].decode("utf-8", "replace"))
+            off += 1 + n
+        else:
+            (word,) = struct.unpack_from("<I", payload, off)
+            off += 4
+            if conv in "feEgG":
+                (word,) = struct.unpack("<f", struct.pack("<I", word))
+            elif conv in "di":
+                word = word - (1 << 32) if word & 0x80000000 else word
+            args.append(word)
+    # Python's % has no length modifiers
+    fmt = re.sub(r"(%[-+ #0]*\d*(?:\.\d+)?)[hlLqjzt]+", r"\1", fmt)
+    try:
+        text = fmt % tuple(args)
+    except (TypeError, ValueError):
+        text = "%s %r" % (fmt, args)
+    return "[%d][%s] %s" % (ts, LEVELS[level] if level < len(LEVELS) else "?", text)
+
+
+class Decoder:
+    def __init__(self, formats, out):
+        self.formats = formats
+        self.out = out
+        self.buf = bytearray()
+        self.frames = 0
+        self.bad = 0
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            i = self.buf.find(SYNC)
+            if i < 0:
+                # Keep a trailing 0xA5, it may start the next frame
+                keep = 1 if self.buf.endswith(SYNC[:1]) else 0
+                self.text(self.buf[:len(self.buf) - keep])
+                del self.buf[:len(self.buf) - keep]
+                return
+            self.text(self.buf[:i])
+            del self.buf[:i]
+            if len(self.buf) < 3:
+                return
+            n = self.buf[2]
+            if len(self.buf) < 3 + n + 1:
+                return
+            payload = bytes(self.buf[3:3 + n])
+            if n >= 7 and sum(payload) & 0xFF == self.buf[3 + n]:
+                self.out.write(decode_payload(payload, self.formats) + "\n")
+                self.frames += 1
+                del self.buf[:4 + n]
+            else:
+                # Not a frame after all, resync on the next byte
+                self.bad += 1
+                self.text(self.buf[:1])
+                del self.buf[:1]
+
+    def text(self, data):
+        if data:
+            self.out.write(data.decode("utf-8", "replace"))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("file", nargs="?", help="binary capture, stdin if omitted")
+    ap.add_argument("--port", help="serial port to read live")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--formats", default=DEF_FILE, help="log_formats.def of the running firmware")
+    args = ap.parse_args()
+
+    dec = Decoder(load_formats(args.formats), sys.stdout)
+    try:
+        if args.port:
+            import serial
+            with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+                while True:
+                    dec.feed(port.read(256))
+                    sys.stdout.flush()
+        else:
+            src = open(args.file, "rb") if args.file else sys.stdin.buffer
+            with src:
+                for chunk in iter(lambda: src.read(4096), b""):
+                    dec.feed(chunk)
+    except KeyboardInterrupt:
+        pass
+    sys.stderr.write("%d frames, %d bad\n" % (dec.frames, dec.bad))
+
+
+if __name__ == "__main__":
+    main()
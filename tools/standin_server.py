@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+"""Stand-in for the thermostat server at 192.168.4.1, with fault injection.
+
+Serves the endpoints the firmware uses:
+    POST /setTemp              value=<degrees>, answers OK
+    GET  /Temp?plain           room temperature, "%.2f"
+    GET  /boilerStatus?plain   "true" or "false"
+    POST /telemetry            a batch of history records (src/telemetry.hpp), answers
+                               the sequence number it expects next
+
+The room follows the same model as the simulator (src/sim/hal_sim.cpp): the
+boiler heats it, it loses heat to the outside, and the server switches the
+boiler with a hysteresis around the last setpoint it got.
+
+Every request can be hit by one fault, drawn in this order:
+    --drop P          read the request and never answer, hold the connection
+    --reset P         read the request and close with a TCP RST
+    --error P         answer 503
+    --slow-body P     send the headers, then trickle the body (--slow-byte-ms per byte)
+and every answer is delayed by --latency ms plus up to --jitter ms.
+
+Usage:
+    standin_server.py --port 8080 --latency 20 --jitter 30 --drop 0.01 --reset 0.01
+    standin_server.py --host 0.0.0.0 --port 80     stand in for the real server (AP mode)
+
+GET /stats returns the request and fault counters as JSON, GET /telemetry the
+last TELEMETRY_KEEP records of each device session with their UTC time.
+"""
+
+import argparse
+import asyncio
+import json
+import random
+import socket
+import struct
+import sys
+import time
+
+HEAT_RATE = 10.0          # Degrees per hour with the boiler on
+LOSS_RATE = 1.0 / 3.0     # Fraction of the inside/outside difference lost per hour
+HYSTERESIS = 0.3
+MAX_REQUEST = 4096
+TELEMETRY_VERSION = 1
+TELEMETRY_HEADER = struct.Struct("<BIIIIIIH")
+TELEMETRY_KINDS = ("temp", "setpoint", "boiler_off", "boiler_on")
+TELEMETRY_KEEP = 10000
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def decode_telemetry(data):
+    """Header fields and (sequence, device seconds, kind, value) records of a batch."""
+    version, node, session, first, clock, time, utc, count = TELEMETRY_HEADER.unpack_from(data)
+    if version != TELEMETRY_VERSION:
+        raise ValueError("version %d" % version)
+    pos, prev, records = TELEMETRY_HEADER.size, [0, 0], []
+    for i in range(count):
+        tag, pos = varint(data, pos)
+        time += tag >> 2
+        kind, value = tag & 3, None
+        if kind < 2:
+            z, pos = varint(data, pos)
+            prev[kind] += (z >> 1) ^ -(z & 1)
+            value = prev[kind] / 100.0 if kind == 0 else prev[kind]
+        records.append((first + i, time, kind, value))
+    if pos != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - pos))
+    return node, session, clock, utc, records
+
+
+class Room:
+    def __init__(self, time_scale, outside):
+        self.time_scale = time_scale
+        self.outside = outside
+        self.temp = 18.0
+        self.setpoint = 25.0
+        self.boiler = False
+        self.last = time.monotonic()
+
+    def advance(self):
+        now = time.monotonic()
+        hours = (now - self.last) * self.time_scale / 3600.0
+        self.last = now
+        heat = HEAT_RATE if self.boiler else 0.0
+        self.temp += (heat - LOSS_RATE * (self.temp - self.outside)) * hours
+        if self.temp < self.setpoint - HYSTERESIS:
+            self.boiler = True
+        elif self.temp > self.setpoint + HYSTERESIS:
+            self.boiler = False
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.room = Room(args.time_scale, args.outside)
+        self.rng = random.Random(args.seed)
+        self.stats = {"requests": 0, "answered": 0, "not_found": 0, "bad_request": 0,
+                      "drop": 0, "reset": 0, "error": 0, "slow_body": 0, "open": 0,
+                      "telemetry_batches": 0, "telemetry_records": 0, "telemetry_duplicates": 0,
+                      "telemetry_bytes": 0}
+        self.held = set()
+        self.streams = {}  # (node, session) -> next sequence and records
+
+    def pick_fault(self):
+        for name in ("drop", "reset", "error", "slow_body"):
+            if self.rng.random() < getattr(self.args, name):
+                return name
+        return None
+
+    def route(self, method, path, body):
+        self.room.advance()
+        if method == "POST" and path == "/setTemp":
+            for field in body.split("&"):
+                key, _, value = field.partition("=")
+                if key == "value":
+                    try:
+                        self.room.setpoint = float(value)
+                    except ValueError:
+                        return 400, "bad value"
+                    self.room.advance()
+                    return 200, "OK"
+            return 400, "missing value"
+        if method == "GET" and path in ("/Temp?plain", "/Temp"):
+            return 200, "%.2f" % self.room.temp
+        if method == "GET" and path in ("/boilerStatus?plain", "/boilerStatus"):
+            return 200, "true" if self.room.boiler else "false"
+        if method == "POST" and path == "/telemetry":
+            return self.telemetry(body.encode("latin-1"))
+        if method == "GET" and path == "/telemetry":
+            streams = [{"node": "%08x" % node, "session": "%08x" % session, "next": s["next"],
+                        "records": s["records"]} for (node, session), s in self.streams.items()]
+            return 200, json.dumps(streams)
+        if method == "GET" and path == "/stats":
+            stats = dict(self.stats, temp=round(self.room.temp, 2), setpoint=self.room.setpoint,
+                         boiler=self.room.boiler)
+            return 200, json.dumps(stats)
+        self.stats["not_found"] += 1
+        return 404, "not found"
+
+    # Records already stored are skipped, a lost answer makes the device send them again
+    def telemetry(self, data):
+        try:
+            node, session, clock, utc, records = decode_telemetry(data)
+        except (ValueError, IndexError, struct.error) as e:
+            return 400, "bad batch: %s" % e
+        stream = self.streams.setdefault((node, session), {"next": 0, "records": []})
+        for seq, time, kind, value in records:
+            if seq < stream["next"]:
+                self.stats["telemetry_duplicates"] += 1
+                continue
+            stream["records"].append({"seq": seq, "utc": utc - (clock - time) if utc else None,
+                                      "kind": TELEMETRY_KINDS[kind], "value": value})
+            stream["next"] = seq + 1
+            self.stats["telemetry_records"] += 1
+        del stream["records"][:-TELEMETRY_KEEP]
+        self.stats["telemetry_batches"] += 1
+        self.stats["telemetry_bytes"] += len(data)
+        return 200, str(stream["next"])
+
+    async def read_request(self, reader):
+        head = await reader.readuntil(b"\r\n\r\n")
+        if len(head) > MAX_REQUEST:
+            raise ValueError("request too large")
+        lines = head.decode("latin-1").split("\r\n")
+        method, path, _ = lines[0].split(" ", 2)
+        length = 0
+        for line in lines[1:]:
+            name, _, value = line.partition(":")
+            if name.strip().lower() == "content-length":
+                length = int(value)
+        if length > MAX_REQUEST:
+            raise ValueError("body too large")
+        body = await reader.readexactly(length) if length else b""
+        return method, path, body.decode("latin-1")
+
+    async def handle(self, reader, writer):
+        self.stats["open"] += 1
+        try:
+            try:
+                method, path, body = await self.read_request(reader)
+            except (ValueError, asyncio.IncompleteReadError, asyncio.LimitOverrunError):
+                self.stats["bad_request"] += 1
+                return
+            self.stats["requests"] += 1
+            fault = self.pick_fault() if path != "/stats" else None
+            if fault:
+                self.stats[fault] += 1
+
+            if fault == "drop":
+                # Hold the connection until the client gives up
+                await reader.read()
+                return
+            if fault == "reset":
+                sock = writer.get_extra_info("socket")
+                sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+                writer.transport.abort()
+                return
+
+            delay = self.args.latency + self.rng.uniform(0, self.args.jitter)
+            if delay > 0:
+                await asyncio.sleep(delay / 1000.0)
+            if fault == "error":
+                status, text = 503, "unavailable"
+            else:
+                status, text = self.route(method, path, body)
+            payload = text.encode()
+            reason = {200: "OK", 400: "Bad Request", 404: "Not Found", 503: "Service Unavailable"}[status]
+            writer.write(("HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n"
+                          "Connection: close\r\n\r\n" % (status, reason, len(payload))).encode())
+            if fault == "slow_body":
+                for i in range(len(payload)):
+                    await writer.drain()
+                    await asyncio.sleep(self.args.slow_byte_ms / 1000.0)
+                    writer.write(payload[i:i + 1])
+            else:
+                writer.write(payload)
+            await writer.drain()
+            self.stats["answered"] += 1
+        except (ConnectionError, OSError):
+            pass
+        finally:
+            self.stats["open"] -= 1
+            if not writer.transport.is_closing():
+                writer.close()
+
+    async def report(self):
+        while True:
+            await asyncio.sleep(self.args.report)
+            self.room.advance()
+            s = self.stats
+            print("%d requests, %d answered, faults: %d drop %d reset %d error %d slow, %d open | "
+                  "room %.2f C, setpoint %.1f, boiler %s" %
+                  (s["requests"], s["answered"], s["drop"], s["reset"], s["error"], s["slow_body"], s["open"],
+                   self.room.temp, self.room.setpoint, "on" if self.room.boiler else "off"), flush=True)
+
+
+async def serve(args):
+    server = Server(args)
+    srv = await asyncio.start_server(server.handle, args.host, args.port, backlog=256)
+    print("Stand-in server on %s:%d" % (args.host, args.port), flush=True)
+    if args.report > 0:
+        asyncio.ensure_future(server.report())
+    async with srv:
+        await srv.serve_forever()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--host", default="127.0.0.1")
+    ap.add_argument("--port", type=int, default=8080)
+    ap.add_argument("--latency", type=float, default=0, help="ms added to every answer")
+    ap.add_argument("--jitter", type=float, default=0, help="up to this many ms more, uniform")
+    ap.add_argument("--drop", type=float, default=0, help="probability of never answering")
+    ap.add_argument("--reset", type=float, default=0, help="probability of a connection reset")
+    ap.add_argument("--error", type=float, default=0, help="probability of a 503")
+    ap.add_argument("--slow-body", type=float, default=0, help="probability of a trickled body")
+    ap.add_argument("--slow-byte-ms", type=float, default=200, help="delay per body byte when slow")
+    ap.add_argument("--time-scale", type=float, default=1, help="room model speed, 60 = a minute per second")
+    ap.add_argument("--outside", type=float, default=5, help="outside temperature")
+    ap.add_argument("--seed", type=int, default=None)
+    ap.add_argument("--report", type=float, default=10, help="seconds between counter lines, 0 = off")
+    args = ap.parse_args()
+    try:
+        asyncio.run(serve(args))
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())